@@ -0,0 +1,413 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+// Benchmarks of the hot paths: pattern scans over synthetic sections, symbol and vtable lookups, vtable hooks.
+// The scans run with each SIMD kernel the CPU supports ("find_pattern/avx2", ...), "scan_kernel" of the context is the default one.
+// The results are printed as JSON (to track them over time):
+//   { "context": { ... }, "benchmarks": [ { "name", "iterations", "ns_per_op", "bytes_per_second" }, ... ] }
+//
+// Usage: dynutils_bench [--size=<bytes>] [--wildcards=<0..1>] [--pattern-size=<bytes>] [--min-time=<seconds>] [--filter=<substring>]
+
+#include <dynlibutils/module.hpp>
+#include <dynlibutils/virtual.hpp>
+#include <dynlibutils/vthook.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace DynLibUtils;
+
+using Clock_t = std::chrono::steady_clock;
+
+struct Options_t
+{
+	std::size_t m_nSectionSize = 16 << 20;
+	double m_flWildcards = 0.25;
+	std::size_t m_nPatternSize = 32;
+	double m_flMinTime = 0.2;
+	std::string m_sFilter;
+};
+
+struct Result_t
+{
+	std::string m_sName;
+	std::uint64_t m_nIterations;
+	double m_flNsPerOp;
+	std::size_t m_nBytesPerOp; // 0 if isn't a throughput one.
+};
+
+static Options_t s_options;
+static std::vector<Result_t> s_vecResults;
+
+static volatile std::uintptr_t s_nSink; // Keeps the results alive.
+
+template<typename F>
+static double Time(const F& func)
+{
+	const auto start = Clock_t::now();
+
+	func();
+
+	return std::chrono::duration<double, std::nano>(Clock_t::now() - start).count();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Runs a benchmark with doubling iteration counts until it takes the minimal time
+// Input  : svName
+//          nBytesPerOp
+//          func - (std::uint64_t nIterations) -> elapsed nanoseconds, so that the setup can be excluded
+//-----------------------------------------------------------------------------
+template<typename F>
+static void Run(const std::string_view svName, std::size_t nBytesPerOp, const F& func)
+{
+	if (!s_options.m_sFilter.empty() && svName.find(s_options.m_sFilter) == std::string_view::npos)
+		return;
+
+	for (std::uint64_t n = 1;; n *= 2)
+	{
+		const double flElapsed = func(n);
+
+		if (flElapsed >= s_options.m_flMinTime * 1e9 || n >= (std::uint64_t(1) << 32))
+		{
+			s_vecResults.push_back({ std::string(svName), n, flElapsed / static_cast<double>(n), nBytesPerOp });
+
+			std::fprintf(stderr, "%-48s %12.1f ns\n", s_vecResults.back().m_sName.c_str(), s_vecResults.back().m_flNsPerOp);
+
+			return;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Generates bytes distributed roughly as machine code is (many zeros,
+//          REX prefixes, MOVs, CALLs, padding)
+//-----------------------------------------------------------------------------
+static std::vector<std::uint8_t> GenerateCode(std::size_t nSize, std::mt19937_64& rng)
+{
+	static constexpr std::uint8_t s_aCommon[] = { 0x00, 0x00, 0x00, 0xFF, 0x48, 0x48, 0x8B, 0x89, 0xE8, 0x0F, 0xCC, 0x24 };
+
+	std::vector<std::uint8_t> vecCode(nSize);
+
+	for (auto& nByte : vecCode)
+	{
+		const auto nRandom = rng();
+
+		nByte = (nRandom & 1) ? s_aCommon[(nRandom >> 8) % sizeof(s_aCommon)] : static_cast<std::uint8_t>(nRandom >> 16);
+	}
+
+	return vecCode;
+}
+
+static Pattern_t<s_nDefaultPatternSize> MakePattern(const std::uint8_t* pBytes, std::size_t nSize, std::mt19937_64& rng)
+{
+	std::array<std::uint8_t, s_nDefaultPatternSize> aBytes {};
+	std::array<char, s_nDefaultPatternSize> aMask {};
+
+	std::uniform_real_distribution<double> distribution(0.0, 1.0);
+
+	for (std::size_t i = 0; i < nSize; ++i)
+	{
+		const bool bWildcard = i && i + 1 < nSize && distribution(rng) < s_options.m_flWildcards; // The ends are compared.
+
+		aBytes[i] = bWildcard ? 0 : pBytes[i];
+		aMask[i] = bWildcard ? '?' : 'x';
+	}
+
+	return Pattern_t<s_nDefaultPatternSize>(nSize, aBytes, aMask);
+}
+
+static void BenchScan()
+{
+	std::mt19937_64 rng(0xD1B54A32D192ED03ull);
+
+	const std::size_t nSize = s_options.m_nSectionSize, nPatternSize = std::min(s_options.m_nPatternSize, s_nDefaultPatternSize);
+
+	auto vecCode = GenerateCode(nSize, rng);
+
+	// The pattern is at the end: a whole scan.
+	const std::vector<std::uint8_t> vecPattern = GenerateCode(nPatternSize, rng);
+
+	std::copy(vecPattern.begin(), vecPattern.end(), vecCode.end() - nPatternSize);
+
+	const Section_t section(CMemory(vecCode.data()), vecCode.size(), ".text");
+	const auto pattern = MakePattern(vecPattern.data(), nPatternSize, rng);
+
+	// Each kernel the CPU supports, side by side.
+	std::vector<ScanKernel> vecKernels;
+
+	for (const ScanKernel eKernel : { ScanKernel::SSE2, ScanKernel::AVX2, ScanKernel::AVX512, ScanKernel::NEON })
+	{
+		if (SetScanKernel(eKernel))
+			vecKernels.push_back(eKernel);
+	}
+
+	auto funcScan = [&](std::uint64_t n, bool bParallel)
+	{
+		return Time([&]
+		{
+			for (std::uint64_t i = 0; i < n; ++i)
+			{
+				CModule module; // Not cached.
+
+				if (bParallel)
+					module.SetParallelScan(s_nParallelScanChunkSize); // Of any size, the default is past it.
+
+				s_nSink = module.FindPattern(pattern.GetView(), nullptr, &section).GetAddr();
+			}
+		});
+	};
+
+	for (const ScanKernel eKernel : vecKernels)
+	{
+		const std::string sKernel = GetScanKernelName(eKernel);
+
+		SetScanKernel(eKernel);
+
+		Run("find_pattern/" + sKernel, nSize, [&](std::uint64_t n) { return funcScan(n, false); });
+		Run("find_pattern/" + sKernel + "/parallel", nSize, [&](std::uint64_t n) { return funcScan(n, true); });
+	}
+
+	// Planted every 64 KB.
+	for (std::size_t nOffset = 0; nOffset + nPatternSize < nSize; nOffset += 0x10000)
+		std::copy(vecPattern.begin(), vecPattern.end(), vecCode.begin() + nOffset);
+
+	for (const ScanKernel eKernel : vecKernels)
+	{
+		SetScanKernel(eKernel);
+
+		Run("find_all_patterns/" + std::string(GetScanKernelName(eKernel)), nSize, [&](std::uint64_t n)
+		{
+			CModule module;
+
+			auto signature = module.CreateSignature(pattern);
+
+			return Time([&]
+			{
+				for (std::uint64_t i = 0; i < n; ++i)
+					s_nSink = module.FindAllPatterns(signature, [](std::size_t, CMemory) { return true; }, nullptr, &section);
+			});
+		});
+	}
+
+	SetScanKernel(ScanKernel::Auto);
+}
+
+static void BenchLookups()
+{
+	CModule module("libstdc++");
+
+	if (!module.IsValid())
+	{
+		std::fprintf(stderr, "libstdc++ isn't loaded, the lookups are skipped\n");
+
+		return;
+	}
+
+	std::vector<std::string> vecFunctions, vecTypes;
+
+	for (const auto& symbol : module.GetSymbols())
+	{
+		const std::string_view svName = module.GetSymbols().GetName(symbol);
+
+		if (svName.substr(0, 4) == "_ZTV")
+			vecTypes.emplace_back(svName.substr(4)); // The decorated name of the type.
+		else if (symbol.m_nSize)
+			vecFunctions.emplace_back(svName);
+	}
+
+	// A miss is the first lookup of a name by a module, the module is renewed (untimed) when all are looked up.
+	auto funcMisses = [&](std::uint64_t n, const std::vector<std::string>& vecNames, bool bVirtualTable, bool bTypeIndex)
+	{
+		double flElapsed = 0;
+
+		for (std::uint64_t i = 0; i < n;)
+		{
+			CModule moduleCold("libstdc++");
+
+			if (bTypeIndex)
+				moduleCold.BuildTypeIndex();
+
+			const std::uint64_t nCount = std::min<std::uint64_t>(n - i, vecNames.size());
+
+			flElapsed += Time([&]
+			{
+				for (std::uint64_t j = 0; j < nCount; ++j)
+					s_nSink = bVirtualTable ? moduleCold.GetVirtualTableByName(vecNames[j], true).GetAddr() : moduleCold.GetFunctionByName(vecNames[j]).GetAddr();
+			});
+
+			i += nCount;
+		}
+
+		return flElapsed;
+	};
+
+	if (!vecTypes.empty())
+	{
+		Run("get_virtual_table/scan", 0, [&](std::uint64_t n) { return funcMisses(n, vecTypes, true, false); });
+		Run("get_virtual_table/type_index", 0, [&](std::uint64_t n) { return funcMisses(n, vecTypes, true, true); });
+		Run("get_virtual_table/cached", 0, [&](std::uint64_t n)
+		{
+			return Time([&]
+			{
+				for (std::uint64_t i = 0; i < n; ++i)
+					s_nSink = module.GetVirtualTableByName(vecTypes[i % vecTypes.size()], true).GetAddr();
+			});
+		});
+	}
+
+	if (!vecFunctions.empty())
+	{
+		Run("get_function_by_name/miss", 0, [&](std::uint64_t n) { return funcMisses(n, vecFunctions, false, false); });
+		Run("get_function_by_name/hit", 0, [&](std::uint64_t n)
+		{
+			return Time([&]
+			{
+				for (std::uint64_t i = 0; i < n; ++i)
+					s_nSink = module.GetFunctionByName(vecFunctions[i % 64 % vecFunctions.size()]).GetAddr();
+			});
+		});
+	}
+}
+
+class CBenchTarget
+{
+public:
+	virtual ~CBenchTarget() = default;
+	virtual int Compute(int n);
+};
+
+int CBenchTarget::Compute(int n)
+{
+	return n + 1;
+}
+
+static CBenchTarget s_target;
+static CBenchTarget* volatile s_pTarget = &s_target; // Not devirtualized.
+
+static int Call(std::uint64_t n)
+{
+	int nResult = 0;
+
+	for (std::uint64_t i = 0; i < n; ++i)
+		nResult += s_pTarget->Compute(static_cast<int>(i));
+
+	return nResult;
+}
+
+static void BenchHooks()
+{
+	const CVirtualTable pVTable(static_cast<void*>(&s_target));
+	const std::ptrdiff_t nIndex = GetVirtualIndex<&CBenchTarget::Compute>();
+
+	Run("vthook/hook_unhook", 0, [&](std::uint64_t n)
+	{
+		return Time([&]
+		{
+			CVTHook<int, CBenchTarget*, int> hook;
+
+			for (std::uint64_t i = 0; i < n; ++i)
+			{
+				hook.Hook(pVTable, nIndex, +[](CBenchTarget*, int a) -> int { return a; });
+				hook.Unhook();
+			}
+		});
+	});
+
+	Run("call/direct", 0, [&](std::uint64_t n) { return Time([&] { s_nSink = Call(n); }); });
+
+	Run("call/vtfhook", 0, [&](std::uint64_t n)
+	{
+		CVTFHook<int, CBenchTarget*, int> hook;
+
+		int nCalls = 0;
+
+		hook.Hook(pVTable, nIndex, [&nCalls, &hook](CBenchTarget* pThis, int a) -> int { ++nCalls; return hook.Call(pThis, a); });
+
+		return Time([&] { s_nSink = Call(n); });
+	});
+
+	Run("call/vtfmhook", 0, [&](std::uint64_t n)
+	{
+		using Hook_t = CVTFMHook<int, CBenchTarget*, int>;
+
+		Hook_t hook;
+
+		int nCalls = 0;
+
+		hook.AddHook(pVTable, nIndex, [&nCalls](CBenchTarget*, int a) -> int { ++nCalls; return a + 1; });
+
+		const double flElapsed = Time([&] { s_nSink = Call(n); });
+
+		hook.Clear();
+
+		return flElapsed;
+	});
+}
+
+static void PrintResults()
+{
+#if defined(__aarch64__) || defined(_M_ARM64)
+	const char* pszArch = "arm64";
+#elif defined(__arm__) || defined(_M_ARM)
+	const char* pszArch = "arm";
+#elif defined(__x86_64__) || defined(_M_X64)
+	const char* pszArch = "x86_64";
+#else
+	const char* pszArch = "x86";
+#endif
+
+	std::printf("{\n\t\"context\": {\n\t\t\"arch\": \"%s\",\n\t\t\"scan_kernel\": \"%s\",\n\t\t\"section_size\": %zu,\n\t\t\"pattern_size\": %zu,\n\t\t\"wildcards\": %.3f\n\t},\n\t\"benchmarks\": [", pszArch, GetScanKernelName(GetScanKernel()), s_options.m_nSectionSize, s_options.m_nPatternSize, s_options.m_flWildcards);
+
+	for (std::size_t i = 0; i < s_vecResults.size(); ++i)
+	{
+		const auto& result = s_vecResults[i];
+
+		std::printf("%s\n\t\t{ \"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, \"bytes_per_second\": %.0f }", i ? "," : "", result.m_sName.c_str(), static_cast<unsigned long long>(result.m_nIterations), result.m_flNsPerOp, result.m_nBytesPerOp ? static_cast<double>(result.m_nBytesPerOp) * 1e9 / result.m_flNsPerOp : 0.0);
+	}
+
+	std::printf("\n\t]\n}\n");
+}
+
+int main(int argc, char* argv[])
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::string_view svArg(argv[i]);
+		const std::size_t nEqual = svArg.find('=');
+		const std::string_view svKey = svArg.substr(0, nEqual);
+		const char* pszValue = nEqual != std::string_view::npos ? argv[i] + nEqual + 1 : "";
+
+		if (svKey == "--size")
+			s_options.m_nSectionSize = std::max<std::size_t>(std::strtoull(pszValue, nullptr, 0), s_nDefaultPatternSize);
+		else if (svKey == "--wildcards")
+			s_options.m_flWildcards = std::strtod(pszValue, nullptr);
+		else if (svKey == "--pattern-size")
+			s_options.m_nPatternSize = std::clamp<std::size_t>(std::strtoull(pszValue, nullptr, 0), 1, s_nDefaultPatternSize);
+		else if (svKey == "--min-time")
+			s_options.m_flMinTime = std::strtod(pszValue, nullptr);
+		else if (svKey == "--filter")
+			s_options.m_sFilter = pszValue;
+		else
+		{
+			std::fprintf(stderr, "Usage: %s [--size=<bytes>] [--wildcards=<0..1>] [--pattern-size=<bytes>] [--min-time=<seconds>] [--filter=<substring>]\n", argv[0]);
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	BenchScan();
+	BenchLookups();
+	BenchHooks();
+
+	PrintResults();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,136 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#ifndef DYNLIBUTILS_DETOUR_HPP
+#define DYNLIBUTILS_DETOUR_HPP
+#pragma once
+
+#include "execarena.hpp"
+#include "memaddr.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace DynLibUtils {
+
+// A decoded machine instruction of the build architecture (x86, x86-64 or ARM64).
+struct Instruction_t
+{
+	std::uint8_t m_nLength = 0; // In bytes.
+	std::uint8_t m_nOpcodeOffset = 0; // Of the (first) opcode byte, past the prefixes (x86).
+	std::uint8_t m_nDispOffset = 0; // Of a RIP-relative disp32 (x86-64), 0 if none.
+	std::uint8_t m_nRelOffset = 0; // Of a relative branch operand (x86), 0 if none.
+	std::uint8_t m_nRelSize = 0; // Of the relative branch operand (x86): 1, 2 or 4.
+	bool m_bPCRelative = false; // Depends on its own address (a relative branch or operand).
+}; // struct Instruction_t
+
+// Decodes the length and the position-dependent parts of an instruction.
+//   - Returns false for an unknown or invalid encoding.
+bool DecodeInstruction(const CMemory pCode, Instruction_t &insn) noexcept;
+
+// Hooks a function by patching its prologue with a jump (an inline hook).
+// The replaced instructions are relocated to a trampoline, which is allocated near the target
+// (within the reach of a rel32 jump on x86-64 or a B on ARM64) and continues the original function.
+// The patch is published by aligned stores: at once if it fits an aligned qword (x86) or is a single instruction (ARM64),
+// otherwise a "jmp $" is stored over the first two bytes while the rest is written. So a thread which enters the function
+// meanwhile runs either the original first instruction or the new one (after spinning). On x86 the other threads are
+// suspended for the write (see CThreadSuspender), and one which is inside the bytes of the jump (past the first) resumes
+// at the same instruction in the trampoline. The jump is a single instruction, so no thread can be inside it on unhook.
+// A target at 8n + 7 (x86) isn't hooked, as its first two bytes can't be stored at once.
+//
+// Example usage:
+//
+//   CDetour detour;
+//
+//   detour.Hook(pFunction, &MyFunction);
+//
+//   int MyFunction(int a)
+//   {
+//       return detour.Call<int>(a) + 1;
+//   }
+class CDetour : public CMemory // Address of the target.
+{
+public:
+	static constexpr std::size_t s_nMaxPatchSize = 24;
+
+	CDetour() = default;
+	CDetour(const CDetour &other) = delete;
+	CDetour(CDetour &&other) noexcept { MoveFrom(std::move(other)); }
+	~CDetour()
+	{
+		if (IsHooked())
+		{
+			Unhook();
+		}
+	}
+
+	CDetour &CopyFrom(const CDetour &other) = delete;
+	CDetour &MoveFrom(CDetour &&other) noexcept
+	{
+		*static_cast<CMemory *>(this) = std::exchange(static_cast<CMemory &>(other), DYNLIB_INVALID_MEMORY);
+		m_pDetour = std::exchange(other.m_pDetour, DYNLIB_INVALID_MEMORY);
+		m_pTrampoline = std::exchange(other.m_pTrampoline, DYNLIB_INVALID_MEMORY);
+		m_nPatchSize = std::exchange(other.m_nPatchSize, 0);
+		m_aOriginal = other.m_aOriginal;
+		m_aPatch = other.m_aPatch;
+
+		return *this;
+	}
+
+	bool IsHooked() const noexcept { return IsValid(); } // Returns true if the target is patched.
+
+	// Redirects pTarget to pDetour.
+	//   Preconditions:
+	//     * No hooked before (asserted)
+	//   Returns false (and doesn't patch) if the prologue can't be relocated,
+	//   no memory is free near the target or the target is at 8n + 7 (x86).
+	//   On x86 also if a call in it would return into the jump, the threads can't be suspended
+	//   or one is inside the jump where the trampoline has no instruction (jumped into the prologue).
+	bool Hook(const CMemory pTarget, const CMemory pDetour) noexcept;
+	template<typename F, typename = std::enable_if_t<std::is_pointer_v<F>>>
+	bool Hook(const CMemory pTarget, F pfnDetour) noexcept { return Hook(pTarget, CMemory(reinterpret_cast<void *>(pfnDetour))); }
+
+	// Restores the original prologue. Fails when the patch was overwritten since (by someone else).
+	// The trampoline is only queued for freeing, as other threads may still run through it;
+	// call GetArena().Collect() once none can.
+	bool Unhook() noexcept;
+
+	// Returns the arena the trampolines are allocated from (never destroyed).
+	static CExecArena &GetArena() noexcept;
+
+	template<typename T = void *> T GetTargetPtr() const noexcept { return RCast<T>(); }
+	template<typename T = void *> T GetDetour() const noexcept { return m_pDetour.RCast<T>(); }
+	template<typename T = void *> T GetOrigin() const noexcept { return m_pTrampoline.RCast<T>(); } // Returns the trampoline, which calls the original function.
+
+	// Calls the original function.
+	template<typename R, typename ...Args>
+	R Call(Args... args) const
+	{
+		if constexpr (std::is_void_v<R>)
+		{
+			GetOrigin<R (*)(Args...)>()(args...);
+			return;
+		}
+		else
+		{
+			return GetOrigin<R (*)(Args...)>()(args...);
+		}
+	}
+
+private:
+	CMemory m_pDetour;
+	CMemory m_pTrampoline;
+	std::size_t m_nPatchSize = 0;
+	std::array<std::uint8_t, s_nMaxPatchSize> m_aOriginal {};
+	std::array<std::uint8_t, s_nMaxPatchSize> m_aPatch {};
+}; // class CDetour
+
+} // namespace DynLibUtils
+
+#endif // DYNLIBUTILS_DETOUR_HPP
@@ -0,0 +1,130 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#ifndef DYNLIBUTILS_EXECARENA_HPP
+#define DYNLIBUTILS_EXECARENA_HPP
+#pragma once
+
+#include "memaddr.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace DynLibUtils
+{
+	/**
+	 * @class CExecArena
+	 * @brief An allocator of small executable code blocks (trampolines, thunks) near given addresses.
+	 *
+	 * The blocks are carved from regions reserved within a distance of the address they're
+	 * requested near (e.g. the base of a CAssemblyModule), so that rel32 jumps reach them.
+	 * The code pages are never writable and executable at once where the platform allows
+	 * a second, writable view of them (dual-mapping); otherwise they're flipped briefly on writes.
+	 * Freed blocks are only reused after Collect(), as other threads may still run them.
+	 */
+	class CExecArena
+	{
+	public:
+		static constexpr std::size_t s_nRegionSize = 0x10000; /**< Size of a reserved region. */
+		static constexpr std::size_t s_nAlignment = 16; /**< Alignment of the blocks. */
+#if defined(__aarch64__) || defined(_M_ARM64)
+		static constexpr std::size_t s_nMaxDistance = 0x7FF0000; /**< Default reach from the near address, of B (±128 MB). */
+#elif defined(__x86_64__) || defined(_M_X64)
+		static constexpr std::size_t s_nMaxDistance = 0x7FFF0000; /**< Default reach from the near address, of rel32 (±2 GB). */
+#else
+		static constexpr std::size_t s_nMaxDistance = static_cast<std::size_t>(-1); /**< Default reach from the near address, any. */
+#endif
+
+		CExecArena() = default;
+		CExecArena(const CExecArena &other) = delete;
+		CExecArena &operator=(const CExecArena &other) = delete;
+
+		/**
+		 * @brief Unmaps all the regions, the blocks must not run anymore.
+		 */
+		~CExecArena();
+
+		/**
+		 * @brief Allocates a block of code.
+		 * @param size The size of the block.
+		 * @param pNear The address the block must be in reach of (any if null).
+		 * @param maxDistance The maximal distance of the whole block from pNear.
+		 * @return The block (readable and executable), or nullptr on failure.
+		 */
+		void *Alloc(std::size_t size, CMemory pNear = nullptr, std::size_t maxDistance = s_nMaxDistance) noexcept;
+
+		/**
+		 * @brief Writes to a block, which may be running meanwhile, and flushes the instruction cache.
+		 * @param pDest The address in a block of the arena.
+		 * @param pSource The code to write.
+		 * @param size The number of bytes to write.
+		 * @return True if written, false if pDest isn't of the arena or can't be unprotected.
+		 */
+		bool Write(void *pDest, const void *pSource, std::size_t size) noexcept;
+
+		/**
+		 * @brief Queues a block to be freed by the next Collect().
+		 * @param pBlock The block returned by Alloc.
+		 * @param size The size it was allocated with.
+		 */
+		void Free(void *pBlock, std::size_t size) noexcept;
+
+		/**
+		 * @brief Frees the queued blocks at once, and unmaps the regions that become empty.
+		 * Call it when no thread may run the freed blocks anymore.
+		 * @return The number of bytes freed.
+		 */
+		std::size_t Collect() noexcept;
+
+		/**
+		 * @brief Checks whether the whole [addr, addr + size) is in reach of pNear.
+		 */
+		static bool IsNear(std::uintptr_t addr, std::size_t size, std::uintptr_t pNear, std::size_t maxDistance = s_nMaxDistance) noexcept
+		{
+			return !pNear || (addr >= pNear ? addr + size - pNear : pNear - addr) <= maxDistance;
+		}
+
+		/**
+		 * @brief Flushes the instruction cache of modified code.
+		 */
+		static void FlushCode(void *pCode, std::size_t size) noexcept;
+
+	private:
+		struct Region_t
+		{
+			std::uintptr_t m_nAddr = 0; /**< Of the executable view. */
+			std::ptrdiff_t m_nWriteDelta = 0; /**< To the writable view, 0 if there is none. */
+			void *m_pHandle = nullptr; /**< Of the platform mapping. */
+			std::size_t m_nUsed = 0; /**< Bump offset. */
+			std::size_t m_nLive = 0; /**< Bytes allocated and not freed. */
+		};
+
+		struct Block_t
+		{
+			std::uintptr_t m_nAddr;
+			std::size_t m_nSize;
+		};
+
+		Region_t *FindRegion(std::uintptr_t addr) noexcept;
+
+	private: // Platform.
+		/**
+		 * @brief Maps a region of s_nRegionSize within maxDistance of pNear.
+		 */
+		static bool MapRegion(std::uintptr_t pNear, std::size_t maxDistance, Region_t &region) noexcept;
+		static void UnmapRegion(const Region_t &region) noexcept;
+
+	private:
+		std::mutex m_mutex;
+		std::vector<Region_t> m_vecRegions;
+		std::vector<Block_t> m_vecFree; /**< Reusable. */
+		std::vector<Block_t> m_vecRetired; /**< Waiting for Collect(). */
+	};
+} // namespace DynLibUtils
+
+#endif // DYNLIBUTILS_EXECARENA_HPP
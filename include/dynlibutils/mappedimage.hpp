@@ -0,0 +1,150 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#ifndef DYNLIBUTILS_MAPPEDIMAGE_HPP
+#define DYNLIBUTILS_MAPPEDIMAGE_HPP
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace DynLibUtils {
+
+// Contiguous read-only elements, of a mapped image generally.
+template<typename T>
+struct Span_t
+{
+	const T* m_pData = nullptr;
+	std::size_t m_nSize = 0;
+
+	[[nodiscard]] const T& operator[](std::size_t nIndex) const noexcept { return m_pData[nIndex]; }
+
+	[[nodiscard]] std::size_t Size() const noexcept { return m_nSize; }
+	[[nodiscard]] bool IsEmpty() const noexcept { return !m_nSize; }
+
+	const T* begin() const noexcept { return m_pData; }
+	const T* end() const noexcept { return m_pData + m_nSize; }
+}; // struct Span_t<T>
+
+// Read-only mapping of the file of a module (ELF, PE or Mach-O), shared by all the users of the same path
+// and unmapped with the last one. The pages are read in on demand and nothing is copied out of them:
+// the names and tables are views of the mapping, valid while it's referenced.
+//
+// Example usage:
+//
+//   auto pImage = CMappedImage::Open("/usr/lib/libfoo.so");
+//
+//   for (const auto& sym : pImage->GetTable<Elf64_Sym>(".dynsym"))
+//       ...
+class CMappedImage
+{
+public:
+	struct FileSection_t
+	{
+		std::string_view m_svName; // Into the mapping.
+		std::uintptr_t m_nAddress; // Relative to the image base (sh_addr, VirtualAddress, addr).
+		std::size_t m_nSize; // In memory.
+		std::size_t m_nOffset; // In the file.
+		std::size_t m_nFileSize; // Of the data in the file, 0 if it has none there (.bss).
+	}; // struct FileSection_t
+
+	// Of the file on the disk: a file rebuilt or replaced at the same path has another one.
+	struct FileIdentity_t
+	{
+		std::uint64_t m_nDevice = 0; // st_dev, the volume serial number.
+		std::uint64_t m_nIndex = 0; // st_ino, the file index.
+		std::uint64_t m_nModified = 0; // Of the last write, in the units of the platform.
+		std::uint64_t m_nSize = 0;
+
+		bool operator==(const FileIdentity_t& other) const noexcept { return m_nDevice == other.m_nDevice && m_nIndex == other.m_nIndex && m_nModified == other.m_nModified && m_nSize == other.m_nSize; }
+		bool operator!=(const FileIdentity_t& other) const noexcept { return !(*this == other); }
+	}; // struct FileIdentity_t
+
+	CMappedImage(const CMappedImage&) = delete;
+	CMappedImage& operator=(const CMappedImage&) = delete;
+	~CMappedImage();
+
+	// Maps the file, or returns the mapping already shared for the path if the file is the same (of the identity).
+	// The mapping of a file replaced since is kept by its users, the new one is shared from now on.
+	//   Returns nullptr if the file can't be opened or mapped.
+	[[nodiscard]] static std::shared_ptr<const CMappedImage> Open(const std::string_view svPath);
+
+	// Returns false if the file can't be found.
+	static bool GetFileIdentity(const std::string& sPath, FileIdentity_t& identity) noexcept;
+
+	[[nodiscard]] const std::uint8_t* GetData() const noexcept { return m_pData; }
+	[[nodiscard]] std::size_t GetSize() const noexcept { return m_nSize; }
+	[[nodiscard]] const FileIdentity_t& GetIdentity() const noexcept { return m_identity; } // Of the file mapped.
+
+	// Returns the elements at the file offset, or an empty span if they overrun the file.
+	template<typename T>
+	[[nodiscard]] Span_t<T> GetSpan(std::size_t nOffset, std::size_t nCount) const noexcept
+	{
+		if (nOffset > m_nSize || nCount > (m_nSize - nOffset) / sizeof(T))
+			return {};
+
+		return { reinterpret_cast<const T*>(m_pData + nOffset), nCount };
+	}
+
+	// The contents of a section as a table (of symbols, relocations, ...).
+	template<typename T>
+	[[nodiscard]] Span_t<T> GetTable(const FileSection_t* pSection) const noexcept { return pSection && pSection->m_nFileSize ? GetSpan<T>(pSection->m_nOffset, pSection->m_nFileSize / sizeof(T)) : Span_t<T>{}; }
+	template<typename T>
+	[[nodiscard]] Span_t<T> GetTable(const std::string_view svSectionName) const noexcept { return GetTable<T>(GetSectionByName(svSectionName)); }
+
+	[[nodiscard]] Span_t<FileSection_t> GetSections() const noexcept { return { m_vecSections.data(), m_vecSections.size() }; } // In the file order.
+	[[nodiscard]] const FileSection_t* GetSectionByName(const std::string_view svSectionName) const noexcept; // The first one of the name.
+	[[nodiscard]] const FileSection_t* GetSectionByAddress(std::uintptr_t nAddress) const noexcept; // Of the file data at the address (relative to the image base).
+
+	// Converts between the file offsets and the addresses relative to the image base by the section table.
+	//   Returns -1 if no section has the data in the file.
+	[[nodiscard]] std::uintptr_t OffsetToAddress(std::size_t nOffset) const noexcept;
+	[[nodiscard]] std::size_t AddressToOffset(std::uintptr_t nAddress) const noexcept;
+
+	// Reads [nOffset, nOffset + nSize) of the file by chunks (of s_nStreamChunkSize, short last one aside) into one buffer
+	// instead of the mapping, so that nothing is read in to the process: the file is hinted to be read sequentially and not reused.
+	// Each chunk starts with the last nOverlap bytes of the previous one (less than s_nStreamChunkSize),
+	// so a sequence of nOverlap + 1 bytes is always whole in one.
+	//   pfnCallback(pContext, pChunk, nChunkSize, nChunkOffset) returns false to stop.
+	//   Returns false if the file can't be read.
+	using StreamCallback_t = bool (*)(const void* pContext, const std::uint8_t* pChunk, std::size_t nChunkSize, std::size_t nChunkOffset);
+	bool Stream(std::size_t nOffset, std::size_t nSize, std::size_t nOverlap, StreamCallback_t pfnCallback, const void* pContext) const;
+
+	static constexpr std::size_t s_nStreamChunkSize = 1 << 20;
+
+private:
+	CMappedImage() = default;
+
+	void IndexSections(); // After the sections are parsed.
+
+private: // Platform.
+	bool Map(const std::string& sPath);
+	void Unmap() noexcept;
+	void ParseSections(); // Of the known formats, none otherwise.
+
+	static void* OpenStream(const std::string& sPath) noexcept; // nullptr on failure.
+	static bool ReadStream(void* pStream, std::size_t nOffset, void* pBuffer, std::size_t nSize) noexcept; // All the bytes or fails.
+	static void CloseStream(void* pStream) noexcept;
+
+private:
+	const std::uint8_t* m_pData = nullptr;
+	std::size_t m_nSize = 0;
+	void* m_pHandle = nullptr; // Of the platform mapping.
+	std::string m_sPath;
+	FileIdentity_t m_identity;
+
+	std::vector<FileSection_t> m_vecSections;
+	std::vector<std::uint32_t> m_vecSectionsByName; // Indices sorted by the name.
+}; // class CMappedImage
+
+} // namespace DynLibUtils
+
+#endif // DYNLIBUTILS_MAPPEDIMAGE_HPP
@@ -45,7 +45,7 @@ namespace DynLibUtils
 		/**
 		 * @brief Defines a memory read routine that will not throw exceptions, and can handle potential
 		 * reads from NO_ACCESS or otherwise inaccessible memory pages. Defaults to ReadProcessMemory.
-		 * Must fail gracefully.
+		 * Must fail gracefully: on Linux and Apple the copy goes through the kernel, see SafeMemReadV.
 		 * @param src The source memory address.
 		 * @param dest The destination memory address.
 		 * @param size The number of bytes to read.
@@ -54,6 +54,32 @@ namespace DynLibUtils
 		 */
 		static bool SafeMemRead(CMemory src, CMemory dest, size_t size, size_t& read) noexcept;
 
+		/**
+		 * @brief A range of a vectored read and its result.
+		 */
+		struct SafeRead_t
+		{
+			CMemory m_pSrc;
+			CMemory m_pDest;
+			size_t m_nSize;
+			size_t m_nRead = 0; // Set by SafeMemReadV: the bytes read, 0 if the source isn't readable.
+		};
+
+		/**
+		 * @brief Reads several ranges as SafeMemRead does, each one limited by the end of its memory region,
+		 * but validates all of them at once: against one snapshot of the regions (Linux) or by one
+		 * VirtualQuery per region of the sources in the address order (Windows). For the walks of many small reads.
+		 * On Linux the snapshot only bounds the ranges, they're copied by process_vm_readv: a range unmapped or
+		 * protected elsewhere since the snapshot fails (it's bounded by a fresh one and read again once) rather
+		 * than faulting. Where the syscall is denied (seccomp) they're copied by memcpy, which may fault on a stale
+		 * snapshot: call InvalidateRegions after mapping or protecting memory elsewhere then. On Windows the copy
+		 * of a range is racy against a concurrent VirtualFree or VirtualProtect of its region.
+		 * @param reads The ranges, their read counts are set.
+		 * @param count The number of the ranges.
+		 * @return The number of the ranges read (wholly or partly).
+		 */
+		static size_t SafeMemReadV(SafeRead_t* reads, size_t count) noexcept;
+
 		/**
 		 * @brief Defines a memory protection set/unset routine that may fail ungracefully.
 		 * @param dest The memory address to change protection for.
@@ -63,6 +89,14 @@ namespace DynLibUtils
 		 * @return The previous protection flags if the operation succeeds, otherwise an appropriate error code.
 		 */
 		static ProtFlag MemProtect(CMemory dest, size_t size, ProtFlag newProtection, bool& status);
+
+		/**
+		 * @brief Drops the cached memory regions the safe routines look addresses up in (Linux only).
+		 * Our own MemProtect calls keep them in sync, call it after mapping or unmapping memory elsewhere:
+		 * the safe reads find a new mapping and recover from a faulting one by themselves, but they still
+		 * refuse a region made readable since, and SafeMemCopy and MemProtect use the snapshot as it is.
+		 */
+		static void InvalidateRegions() noexcept;
 	};
 
 	static constexpr size_t MemoryRound(size_t numToRound, size_t multiple)
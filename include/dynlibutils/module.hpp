@@ -9,13 +9,21 @@
 
 #pragma once
 
+#include "mappedimage.hpp"
 #include "memaddr.hpp"
 
-#include <emmintrin.h>
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#	include <emmintrin.h>
+#endif
 
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <type_traits>
@@ -53,44 +61,245 @@ struct Section_t : public CMemory // Start address of the section.
 	std::string m_svSectionName;    // Name of the section.
 }; // struct Section_t
 
+// Sections of the common roles, cached by CAssemblyModule on load (see GetSection).
+enum class SectionKind : std::uint8_t
+{
+	Text,                     // .text, __text.
+	ReadOnlyData,             // .rodata, .rdata, __const.
+	ReadOnlyRelocations,      // .data.rel.ro (ELF), __const (Mach-O __DATA_CONST).
+	ReadOnlyRelocationsLocal, // .data.rel.ro.local (ELF).
+	Data,                     // .data, __data.
+	Count
+}; // enum class SectionKind
+
+static constexpr std::size_t s_nSectionKinds = static_cast<std::size_t>(SectionKind::Count);
+
+// Where CAssemblyModule reads the sections to scan the patterns from (see SetScanSource).
+enum class ScanSource : std::uint8_t
+{
+	Memory,       // The loaded image.
+	MappedFile,   // The shared mapping of the module file (CMappedImage), the loaded image isn't touched.
+	StreamedFile, // The module file read by chunks (sequentially, not to be cached), nor the mapping is touched but the headers.
+}; // enum class ScanSource
+
+// The SIMD kernels of the pattern scans (see SetScanKernel).
+enum class ScanKernel : std::uint8_t
+{
+	Auto,   // The widest one the CPU and the OS support.
+	SSE2,
+	AVX2,
+	AVX512, // With BW.
+	NEON,
+}; // enum class ScanKernel
+
+// The kernel the pattern scans of all the modules use (never Auto).
+[[nodiscard]] ScanKernel GetScanKernel() noexcept;
+
+// "sse2", "avx2", "avx512", "neon", or "auto".
+[[nodiscard]] const char* GetScanKernelName(ScanKernel eKernel) noexcept;
+
+// Forces the kernel of the pattern scans of all the modules (Auto detects it again), so that
+// the narrower ones can be measured or tested. Returns false (the kernel is kept) if the CPU
+// or the OS doesn't support it.
+bool SetScanKernel(ScanKernel eKernel) noexcept;
+
 static constexpr std::size_t s_nDefaultPatternSize = 256;
 static constexpr std::size_t s_nMaxSimdBlocks = 1 << 6; // 64 blocks = 1024 bytes per chunk.
+static constexpr std::size_t s_nInvalidAnchor = static_cast<std::size_t>(-1);
+static constexpr std::size_t s_nDefaultParallelScanSize = 1 << 25; // From 32 MB (~1.5 ms of a serial AVX-512 scan), a smaller range gains little over the wake-ups of the workers.
+static constexpr std::size_t s_nParallelScanChunkSize = 1 << 21; // Of a job, ~0.1 ms of a serial scan.
+
+// Log-scaled frequency of the bytes in x86-64 code (.text of common system libraries), 255 = most common.
+static constexpr std::array<std::uint8_t, 256> s_aCodeByteFrequency =
+{
+	255, 220, 197, 193, 198, 194, 180, 185, 211, 178, 173, 172, 182, 181, 177, 231, // 00
+	210, 188, 169, 170, 179, 179, 172, 171, 199, 165, 162, 164, 170, 166, 175, 207, // 10
+	202, 168, 164, 163, 230, 179, 159, 160, 196, 189, 159, 175, 167, 166, 181, 167, // 20
+	193, 210, 158, 166, 169, 180, 159, 161, 187, 205, 163, 175, 174, 184, 161, 169, // 30
+	200, 214, 171, 189, 214, 199, 175, 181, 249, 213, 166, 167, 222, 196, 164, 166, // 40
+	194, 163, 161, 187, 193, 190, 176, 175, 181, 161, 162, 186, 187, 191, 175, 174, // 50
+	188, 158, 166, 175, 183, 164, 206, 161, 178, 161, 162, 166, 179, 168, 170, 183, // 60
+	197, 161, 170, 174, 210, 195, 167, 169, 181, 163, 161, 177, 193, 178, 172, 180, // 70
+	195, 179, 166, 215, 217, 220, 165, 172, 185, 236, 158, 232, 171, 219, 166, 165, // 80
+	192, 158, 159, 163, 177, 176, 159, 160, 174, 159, 156, 159, 169, 166, 157, 159, // 90
+	180, 159, 157, 161, 166, 164, 160, 158, 174, 159, 164, 165, 171, 162, 157, 164, // A0
+	178, 159, 158, 163, 172, 171, 183, 166, 186, 171, 185, 169, 183, 183, 190, 181, // B0
+	213, 193, 184, 201, 191, 191, 192, 205, 182, 184, 170, 165, 166, 168, 169, 168, // C0
+	187, 172, 192, 169, 167, 169, 169, 171, 181, 168, 173, 181, 168, 171, 179, 195, // D0
+	190, 176, 174, 167, 175, 170, 179, 185, 225, 211, 180, 194, 185, 184, 184, 197, // E0
+	188, 173, 180, 187, 172, 177, 195, 189, 194, 181, 190, 189, 188, 195, 202, 244, // F0
+};
+
+struct PatternAnchors_t
+{
+	std::size_t m_nAnchor; // Rarest non-wildcard byte offset (s_nInvalidAnchor if whole pattern is wildcards).
+	std::size_t m_nNextAnchor; // Second rarest one (the anchor again if it's the only one).
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Picks the two rarest non-wildcard bytes of a pattern for the scanner
+//          to search first, the full pattern is verified around them
+// Input  : *pBytes
+//          *pMask
+//          nSize
+// Output : PatternAnchors_t
+//-----------------------------------------------------------------------------
+constexpr PatternAnchors_t SelectPatternAnchors(const std::uint8_t* pBytes, const char* pMask, std::size_t nSize) noexcept
+{
+	PatternAnchors_t result { s_nInvalidAnchor, s_nInvalidAnchor };
+
+	for (std::size_t i = 0; i < nSize; ++i)
+	{
+		if (pMask[i] != 'x')
+			continue;
+
+		const std::uint8_t nFrequency = s_aCodeByteFrequency[pBytes[i]];
+
+		if (result.m_nAnchor == s_nInvalidAnchor || nFrequency < s_aCodeByteFrequency[pBytes[result.m_nAnchor]])
+		{
+			result.m_nNextAnchor = result.m_nAnchor;
+			result.m_nAnchor = i;
+		}
+		else if (result.m_nNextAnchor == s_nInvalidAnchor || nFrequency < s_aCodeByteFrequency[pBytes[result.m_nNextAnchor]])
+		{
+			result.m_nNextAnchor = i;
+		}
+	}
+
+	if (result.m_nNextAnchor == s_nInvalidAnchor)
+		result.m_nNextAnchor = result.m_nAnchor;
+
+	return result;
+}
+
+static constexpr std::uint64_t s_nPatternHashSeed = 0xCBF29CE484222325ull;
+
+//-----------------------------------------------------------------------------
+// Purpose: Hashes the bytes a word at a time (usable at compile time, so the words
+//          are assembled byte-wise; the compilers fold it into loads)
+// Input  : h - previous hash
+//          *pData
+//          nSize
+// Output : std::uint64_t
+//-----------------------------------------------------------------------------
+template<typename T>
+constexpr std::uint64_t HashPatternBytes(std::uint64_t h, const T* pData, std::size_t nSize) noexcept
+{
+	auto funcLoadWord = [pData](std::size_t nOffset, std::size_t nCount) -> std::uint64_t
+	{
+		std::uint64_t nWord = 0;
+
+		for (std::size_t i = 0; i < nCount; ++i)
+			nWord |= static_cast<std::uint64_t>(static_cast<std::uint8_t>(pData[nOffset + i])) << (i * 8);
+
+		return nWord;
+	};
+
+	std::uint64_t nWord = 0;
+
+	if (nSize >= sizeof(std::uint64_t))
+	{
+		for (std::size_t i = 0; i + sizeof(std::uint64_t) < nSize; i += sizeof(std::uint64_t))
+		{
+			h = (h ^ funcLoadWord(i, sizeof(std::uint64_t))) * 0xFF51AFD7ED558CCDull;
+			h ^= h >> 32;
+		}
+
+		nWord = funcLoadWord(nSize - sizeof(std::uint64_t), sizeof(std::uint64_t)); // The last word overlaps.
+	}
+	else
+	{
+		nWord = funcLoadWord(0, nSize);
+	}
+
+	h = (h ^ nWord ^ (static_cast<std::uint64_t>(nSize) << 56)) * 0xC4CEB9FE1A85EC53ull;
+
+	return h ^ (h >> 32);
+}
+
+// Hash of the pattern part of a cache key.
+constexpr std::uint64_t HashPattern(const std::uint8_t* pBytes, const char* pMask, std::size_t nSize) noexcept
+{
+	return HashPatternBytes(HashPatternBytes(s_nPatternHashSeed, pBytes, nSize), pMask, nSize);
+}
+
+// Pattern prepared for the scan, a view of Pattern_t fields which are computed at compile time.
+struct PatternView_t
+{
+	const std::uint8_t* m_pBytes;
+	std::string_view m_svMask;
+	PatternAnchors_t m_anchors;
+	const std::uint16_t* m_pBlockMasks; // A bit per byte of 16-byte blocks, set = compared (nullptr to compute).
+	std::uint64_t m_nHash; // HashPattern().
+};
 
 template<std::size_t SIZE = 0l>
 struct Pattern_t
 {
 	static constexpr std::size_t sm_nMaxSize = SIZE;
 
+	static constexpr std::size_t sm_nBlocks = (SIZE + 15) / 16;
+
 	// Constructors.
-	constexpr Pattern_t(const Pattern_t<SIZE>& copyFrom) noexcept { CopyFrom(copyFrom); }
-	constexpr Pattern_t(Pattern_t<SIZE>&& moveFrom) noexcept { MoveFrom(std::move(moveFrom)); }
-	constexpr Pattern_t(std::size_t size = 0, const std::array<uint8_t, SIZE>& bytes = {}, const std::array<char, SIZE>& mask = {}) noexcept : m_nSize(size), m_aBytes(bytes), m_aMask(mask) {} // Default one.
-	constexpr Pattern_t(std::size_t &&size, std::array<uint8_t, SIZE>&& bytes, const std::array<char, SIZE>&& mask) noexcept : m_nSize(std::move(size)), m_aBytes(std::move(bytes)), m_aMask(std::move(mask)) {}
-	Pattern_t& operator=(const Pattern_t<SIZE>& copyFrom) { return CopyFrom(); }
+	constexpr Pattern_t(const Pattern_t<SIZE>& copyFrom) noexcept : m_nSize(copyFrom.m_nSize), m_aBytes(copyFrom.m_aBytes), m_aMask(copyFrom.m_aMask), m_anchors(copyFrom.m_anchors), m_aBlockMasks(copyFrom.m_aBlockMasks), m_nHash(copyFrom.m_nHash) {}
+	constexpr Pattern_t(Pattern_t<SIZE>&& moveFrom) noexcept : m_nSize(moveFrom.m_nSize), m_aBytes(std::move(moveFrom.m_aBytes)), m_aMask(std::move(moveFrom.m_aMask)), m_anchors(moveFrom.m_anchors), m_aBlockMasks(moveFrom.m_aBlockMasks), m_nHash(moveFrom.m_nHash) {}
+	constexpr Pattern_t(std::size_t size = 0, const std::array<uint8_t, SIZE>& bytes = {}, const std::array<char, SIZE>& mask = {}) noexcept : m_nSize(size), m_aBytes(bytes), m_aMask(mask), m_anchors(SelectPatternAnchors(m_aBytes.data(), m_aMask.data(), m_nSize)), m_aBlockMasks(MakeBlockMasks(m_aMask, m_nSize)), m_nHash(HashPattern(m_aBytes.data(), m_aMask.data(), m_nSize)) {} // Default one.
+	constexpr Pattern_t(std::size_t &&size, std::array<uint8_t, SIZE>&& bytes, const std::array<char, SIZE>&& mask) noexcept : m_nSize(std::move(size)), m_aBytes(std::move(bytes)), m_aMask(std::move(mask)), m_anchors(SelectPatternAnchors(m_aBytes.data(), m_aMask.data(), m_nSize)), m_aBlockMasks(MakeBlockMasks(m_aMask, m_nSize)), m_nHash(HashPattern(m_aBytes.data(), m_aMask.data(), m_nSize)) {}
+	Pattern_t& operator=(const Pattern_t<SIZE>& copyFrom) { return CopyFrom(copyFrom); }
 	Pattern_t& operator=(Pattern_t<SIZE>&& moveFrom) { return MoveFrom(std::move(moveFrom)); }
 
-	Pattern_t& CopyFrom(const Pattern_t<SIZE>& other)
+	constexpr Pattern_t& CopyFrom(const Pattern_t<SIZE>& other)
 	{
 		m_nSize = other.m_nSize;
 		m_aBytes = other.m_aBytes;
 		m_aMask = other.m_aMask;
+		m_anchors = other.m_anchors;
+		m_aBlockMasks = other.m_aBlockMasks;
+		m_nHash = other.m_nHash;
 
 		return *this;
 	}
 
-	Pattern_t& MoveFrom(Pattern_t<SIZE>&& other)
+	constexpr Pattern_t& MoveFrom(Pattern_t<SIZE>&& other)
 	{
 		m_nSize = other.m_nSize;
 		m_aBytes = std::move(other.m_aBytes);
 		m_aMask = std::move(other.m_aMask);
+		m_anchors = other.m_anchors;
+		m_aBlockMasks = other.m_aBlockMasks;
+		m_nHash = other.m_nHash;
 
 		return *this;
 	}
 
+	static constexpr std::array<std::uint16_t, sm_nBlocks> MakeBlockMasks(const std::array<char, SIZE>& mask, std::size_t nSize) noexcept
+	{
+		std::array<std::uint16_t, sm_nBlocks> result {};
+
+		for (std::size_t i = 0; i < nSize; ++i)
+			if (mask[i] == 'x')
+				result[i / 16] |= static_cast<std::uint16_t>(1u << (i % 16));
+
+		return result;
+	}
+
+	// Recomputes the anchors, masks and hash after the fields are filled.
+	constexpr void Update() noexcept
+	{
+		m_anchors = SelectPatternAnchors(m_aBytes.data(), m_aMask.data(), m_nSize);
+		m_aBlockMasks = MakeBlockMasks(m_aMask, m_nSize);
+		m_nHash = HashPattern(m_aBytes.data(), m_aMask.data(), m_nSize);
+	}
+
+	constexpr PatternView_t GetView() const noexcept { return { m_aBytes.data(), std::string_view(m_aMask.data(), m_nSize), m_anchors, m_aBlockMasks.data(), m_nHash }; }
+
 	// Fields. Available to anyone (so structure).
 	std::size_t m_nSize;
 	std::array<std::uint8_t, SIZE> m_aBytes;
 	std::array<char, SIZE> m_aMask;
+	PatternAnchors_t m_anchors;
+	std::array<std::uint16_t, sm_nBlocks> m_aBlockMasks;
+	std::uint64_t m_nHash;
 }; // struct Pattern_t
 
 // Concept for pattern callback.
@@ -107,6 +316,45 @@ concept PatternCallback_t = requires(T func, std::size_t index, CMemory match)
 #	define PatternCallback_t typename
 #endif
 
+// Runs a job of the parallel scan (e.g. posts it to the thread pool of the application).
+// The calling thread takes chunks too, so the scan completes even if no job has started.
+using ScanExecutor_t = std::function<void(std::function<void()> job)>;
+
+// Counters of the scans and lookups of a module (see CAssemblyModule::GetStats).
+// Collected if the library is built with DYNLIBUTILS_STATS, zeros otherwise.
+template<typename T>
+struct BasicModuleStats_t
+{
+	T m_nScans {};        // Of the patterns not cached (each one of FindPatterns too).
+	T m_nScanTime {};     // Nanoseconds.
+	T m_nScannedBytes {}; // Up to the match.
+	T m_nCandidates {};   // Offsets which passed the anchor bytes test, so were compared fully.
+	T m_nMatches {};
+	T m_nCacheHits {};    // Of the address cache (patterns, functions and virtual tables).
+	T m_nCacheMisses {};
+	T m_nLockWaits {};    // Contended locks of the address cache and the image (std::shared_mutex instantiation).
+	T m_nLockWaitTime {}; // Nanoseconds.
+}; // struct BasicModuleStats_t<T>
+
+using ModuleStats_t = BasicModuleStats_t<std::uint64_t>;
+
+// A scan of a pattern, reported to the stats sink of a module (see CAssemblyModule::SetStatsSink).
+struct ScanEvent_t
+{
+	std::string_view m_svPattern; // Bytes.
+	std::string_view m_svMask;
+	const Section_t* m_pSection;
+	ScanSource m_eSource;
+	std::uint64_t m_nTime;       // Nanoseconds, of the whole pass for FindPatterns.
+	std::size_t m_nScannedBytes;
+	std::uint64_t m_nCandidates; // Of the pass for FindPatterns.
+	std::size_t m_nMatches;      // FindAllPatterns finds many.
+	std::size_t m_nBatchSize;    // Of the patterns scanned in the same pass (FindPatterns), 1 otherwise.
+	CMemory m_pFound;            // First match, or invalid.
+}; // struct ScanEvent_t
+
+using StatsSink_t = std::function<void(const ScanEvent_t& event)>;
+
 #if defined(__clang__)
 #	define DYNLIB_FORCE_INLINE [[gnu::always_inline]] inline
 #	define DYNLIB_NOINLINE [[gnu::noinline]]
@@ -230,6 +478,8 @@ template<std::size_t N, std::size_t SIZE = (N - 1) / 2>
 
 	ProcessStringPattern<0, N, SIZE>(szInput, n, result.m_nSize, result.m_aBytes, result.m_aMask);
 
+	result.Update();
+
 	return result;
 }
 
@@ -289,17 +539,85 @@ inline auto ParsePattern(const std::string_view svInput)
 
 	result.m_aMask[nOut] = '\0'; // Stores null-terminated character to FindPattern (raw). Don't do (N - 1).
 	result.m_nSize = nOut;
+	result.Update();
 
 	return result;
 }
 
-struct CCache
+struct CNullMutex
+{
+	void lock() const noexcept {}
+	void unlock() const noexcept {}
+	bool try_lock() const noexcept { return true; }
+
+	void lock_shared() const noexcept {}
+	void unlock_shared() const noexcept {}
+	bool try_lock_shared() const noexcept { return true; }
+};
+
+// Non-owning key of the address cache: a name with a meta value or a pattern with its search range.
+struct CCacheKey
+{
+	std::string_view m_svPattern;
+	std::string_view m_svMask;
+	uintptr_t m_nStart;
+	uintptr_t m_pSectionAddr;
+	size_t m_nSectionSize;
+
+	constexpr CCacheKey(std::string_view svName = {}, uintptr_t nMeta = 0) noexcept
+		: m_svPattern(svName)
+		, m_nStart(nMeta)
+		, m_pSectionAddr(0)
+		, m_nSectionSize(0) {
+	}
+
+	CCacheKey(
+		const volatile std::uint8_t* pPatternMem,
+		const std::string_view svMask,
+		const CMemory& pStartAddress = nullptr,
+		const Section_t* pModuleSection = nullptr
+	) noexcept
+		: m_svPattern(reinterpret_cast<const char*>(const_cast<const std::uint8_t*>(pPatternMem)), svMask.size())
+		, m_svMask(svMask)
+		, m_nStart(pStartAddress.GetAddr())
+		, m_pSectionAddr(pModuleSection ? pModuleSection->GetAddr() : 0)
+		, m_nSectionSize(pModuleSection ? pModuleSection->m_nSectionSize : 0) {
+	}
+
+	bool operator==(const CCacheKey& rhs) const noexcept
+	{
+		return m_nStart == rhs.m_nStart &&
+		       m_pSectionAddr == rhs.m_pSectionAddr &&
+		       m_nSectionSize == rhs.m_nSectionSize &&
+		       m_svPattern == rhs.m_svPattern &&
+		       m_svMask == rhs.m_svMask;
+	}
+
+	std::size_t Hash() const noexcept { return Hash(HashPatternBytes(HashPatternBytes(s_nPatternHashSeed, m_svPattern.data(), m_svPattern.size()), m_svMask.data(), m_svMask.size())); }
+
+	// With the precomputed HashPattern() of the pattern part.
+	std::size_t Hash(std::uint64_t nPatternHash) const noexcept
+	{
+		std::uint64_t h = nPatternHash ^ (m_nStart * 0x9E3779B97F4A7C15ull);
+
+		h = (h ^ m_pSectionAddr ^ (static_cast<std::uint64_t>(m_nSectionSize) << 24)) * 0xFF51AFD7ED558CCDull;
+
+		return static_cast<std::size_t>(h ^ (h >> 29));
+	}
+}; // struct CCacheKey
+
+// The owning key of the former address cache, kept for the code which names it: a key of
+// CAddressCache is a CCacheKey now, which views the bytes of a CCache while it's alive.
+struct [[deprecated("Use CCacheKey, the key of CAddressCache")]] CCache
 {
 	std::string m_svPattern;
+	std::string m_svMask;
 	uintptr_t m_nStart;
 	uintptr_t m_pSectionAddr;
 	size_t m_nSectionSize;
 
+	CCache() : m_nStart(0), m_pSectionAddr(0), m_nSectionSize(0) {}
+
 	CCache(std::string_view svName, uintptr_t nMeta = 0)
 		: m_svPattern(svName)
 		, m_nStart(nMeta)
@@ -311,64 +629,382 @@ struct CCache
 		const volatile std::uint8_t* pPatternMem,
 		const size_t nSize,
 		const CMemory& pStartAddress = nullptr,
-		const Section_t* pModuleSection = nullptr
+		const Section_t* pModuleSection = nullptr,
+		const std::string_view svMask = {}
 	)
 		: m_svPattern(pPatternMem, pPatternMem + nSize)
+		, m_svMask(svMask)
 		, m_nStart(pStartAddress.GetAddr())
 		, m_pSectionAddr(pModuleSection ? pModuleSection->GetAddr() : 0)
 		, m_nSectionSize(pModuleSection ? pModuleSection->m_nSectionSize : 0) {
 	}
 
-	bool operator==(const CCache& rhs) const noexcept
+	operator CCacheKey() const noexcept
 	{
-		return m_svPattern == rhs.m_svPattern &&
-		       m_nStart == rhs.m_nStart &&
-		       m_pSectionAddr == rhs.m_pSectionAddr &&
-		       m_nSectionSize == rhs.m_nSectionSize;
+		CCacheKey key(m_svPattern, m_nStart);
+
+		key.m_svMask = m_svMask;
+		key.m_pSectionAddr = m_pSectionAddr;
+		key.m_nSectionSize = m_nSectionSize;
+
+		return key;
 	}
 
+	bool operator==(const CCache& rhs) const noexcept { return CCacheKey(*this) == CCacheKey(rhs); }
+
 	bool operator<(const CCache& rhs) const noexcept
 	{
 		if (m_svPattern != rhs.m_svPattern)
 			return m_svPattern < rhs.m_svPattern;
+		if (m_svMask != rhs.m_svMask)
+			return m_svMask < rhs.m_svMask;
 		if (m_nStart != rhs.m_nStart)
 			return m_nStart < rhs.m_nStart;
 		if (m_pSectionAddr != rhs.m_pSectionAddr)
 			return m_pSectionAddr < rhs.m_pSectionAddr;
 		return m_nSectionSize < rhs.m_nSectionSize;
 	}
-};
+}; // struct CCache
 
-struct CHash
+// The hash of the former address cache, of a CCache (by its CCacheKey) or a CCacheKey.
+struct [[deprecated("Use CCacheKey::Hash")]] CHash
 {
-	static constexpr std::size_t m_nGoldenRatio = 0x9e3779b9u;
+	std::size_t operator()(const CCacheKey& k) const noexcept { return k.Hash(); }
+}; // struct CHash
+
+// Insert-only open-addressing table of the resolved addresses.
+// Lookups are lock-free and don't allocate, they count themselves in flight in the shard of the thread
+// (none for CNullMutex). Inserts are serialized by Mutex, a grown table is published at once, and
+// the replaced tables and the dropped nodes (of Clear and Rebase) are retired: they're freed by the next
+// change which sees no lookup in flight, so they take up to the memory of one more table and the
+// dropped nodes in between, or until destruction if the lookups never let up.
+template<typename Mutex = CNullMutex>
+class CAddressCache
+{
+	using UniqueLock_t = std::unique_lock<Mutex>;
+
+	struct Node_t
+	{
+		std::size_t m_nHash;
+		std::string m_sPattern;
+		std::string m_sMask;
+		uintptr_t m_nStart;
+		uintptr_t m_pSectionAddr;
+		size_t m_nSectionSize;
+		std::atomic<uintptr_t> m_pAddr;
+
+		CCacheKey GetKey() const noexcept
+		{
+			CCacheKey key(m_sPattern, m_nStart);
+
+			key.m_svMask = m_sMask;
+			key.m_pSectionAddr = m_pSectionAddr;
+			key.m_nSectionSize = m_nSectionSize;
+
+			return key;
+		}
+	};
+
+	struct Table_t
+	{
+		explicit Table_t(std::size_t nCapacity) : m_nMask(nCapacity - 1), m_aSlots(new std::atomic<Node_t*>[nCapacity]) {}
+
+		std::size_t m_nMask;
+		std::unique_ptr<std::atomic<Node_t*>[]> m_aSlots;
+	};
+
+public:
+	CAddressCache() noexcept : m_pTable(nullptr), m_nSize(0) {}
+	CAddressCache(const CAddressCache&) = delete;
+	CAddressCache(CAddressCache&& moveFrom) noexcept : CAddressCache() { MoveFrom(std::move(moveFrom)); }
+	CAddressCache& operator=(const CAddressCache&) = delete;
+	CAddressCache& operator=(CAddressCache&& moveFrom) noexcept { return MoveFrom(std::move(moveFrom)); }
+
+	CAddressCache& MoveFrom(CAddressCache&& other) noexcept
+	{
+		m_pTable.store(other.m_pTable.exchange(nullptr, std::memory_order_relaxed), std::memory_order_relaxed);
+		m_nSize.store(other.m_nSize.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+		m_vecTables = std::move(other.m_vecTables);
+		m_vecNodes = std::move(other.m_vecNodes);
+		m_vecRetiredNodes = std::move(other.m_vecRetiredNodes);
+
+		return *this;
+	}
+
+	[[nodiscard]] CMemory Find(const CCacheKey& key) const noexcept { return Find(key, key.Hash()); }
+	[[nodiscard]] CMemory Find(const CCacheKey& key, std::size_t nHash) const noexcept;
+	void Insert(const CCacheKey& key, const CMemory& pAddr) { Insert(key, pAddr, key.Hash()); }
+	void Insert(const CCacheKey& key, const CMemory& pAddr, std::size_t nHash);
+	void Clear();
+
+	// Moves the entries of [nOldBase, nOldBase + nSize) to nNewBase (of the module reloaded), the results out of it are dropped.
+	void Rebase(std::uintptr_t nOldBase, std::size_t nSize, std::uintptr_t nNewBase);
+
+	// Visits the entries (func(const CCacheKey&, CMemory)) while the inserts wait.
+	template<typename FUNC>
+	void ForEach(const FUNC& func) const
+	{
+		UniqueLock_t lock(m_mutex);
+
+		for (const auto& pNode : m_vecNodes)
+			func(pNode->GetKey(), CMemory(pNode->m_pAddr.load(std::memory_order_relaxed)));
+	}
+
+	[[nodiscard]] std::size_t Size() const noexcept { return m_nSize.load(std::memory_order_relaxed); }
+	[[nodiscard]] bool IsEmpty() const noexcept { return !Size(); }
+
+	// Contended locks of the inserts (DYNLIBUTILS_STATS).
+	[[nodiscard]] std::uint64_t GetLockWaits() const noexcept { return m_nLockWaits.load(std::memory_order_relaxed); }
+	[[nodiscard]] std::uint64_t GetLockWaitTime() const noexcept { return m_nLockWaitTime.load(std::memory_order_relaxed); } // Nanoseconds.
+
+private:
+	static constexpr std::size_t s_nMinCapacity = 64;
+	static constexpr std::size_t s_nReaderShards = 8;
+
+	struct alignas(64) Readers_t
+	{
+		std::atomic<std::size_t> m_nCount {};
+	};
+
+	UniqueLock_t Lock() const;
+
+	static std::atomic<Node_t*>* Probe(const Table_t& table, const CCacheKey& key, std::size_t nHash) noexcept;
+	static std::size_t GetShard() noexcept; // Of the calling thread.
+
+	void Publish(std::unique_ptr<Table_t> pTable); // Under the lock.
+	void Trim() noexcept; // Frees the retired ones if no lookup is in flight (under the lock).
+
+	std::atomic<Table_t*> m_pTable;
+	std::atomic<std::size_t> m_nSize;
+	std::vector<std::unique_ptr<Table_t>> m_vecTables; // The last one is current, the others are retired.
+	std::vector<std::unique_ptr<Node_t>> m_vecNodes;
+	std::vector<std::unique_ptr<Node_t>> m_vecRetiredNodes; // Cleared ones.
+	mutable std::array<Readers_t, s_nReaderShards> m_aReaders {}; // The lookups in flight.
+	DYNLIB_NUA mutable Mutex m_mutex;
+	mutable std::atomic<std::uint64_t> m_nLockWaits {};
+	mutable std::atomic<std::uint64_t> m_nLockWaitTime {};
+}; // class CAddressCache<Mutex>
+
+// Read-only hash index of the symbols of a module: name -> offset from the module base.
+// Built once on load (GNU-hash style: a bloom filter in front of the contiguous bucket chains),
+// so a miss usually costs a hash and a word, a hit one string comparison.
+class CSymbolIndex
+{
+public:
+	struct Symbol_t
+	{
+		std::uint32_t m_nHash;
+		std::uint32_t m_nName; // Offset in the names (null-terminated).
+		std::uint32_t m_nNameSize;
+		bool m_bIndirect; // Resolved by the loader (GNU IFUNC, PE forwarder).
+		std::uintptr_t m_nOffset;
+		std::size_t m_nSize;
+	};
+
+	void Reserve(std::size_t nSymbols, std::size_t nNamesSize);
+	void Add(const std::string_view svName, std::uintptr_t nOffset, std::size_t nSize, bool bIndirect = false);
+	void Build(); // After the symbols are added.
+	void Clear() noexcept;
+
+	[[nodiscard]] const Symbol_t* Find(const std::string_view svName) const noexcept;
+	[[nodiscard]] const char* GetName(const Symbol_t& symbol) const noexcept { return m_sNames.data() + symbol.m_nName; }
+
+	[[nodiscard]] std::size_t Size() const noexcept { return m_vecSymbols.size(); }
+	[[nodiscard]] bool IsEmpty() const noexcept { return m_vecSymbols.empty(); }
+
+	const Symbol_t* begin() const noexcept { return m_vecSymbols.data(); }
+	const Symbol_t* end() const noexcept { return m_vecSymbols.data() + m_vecSymbols.size(); }
 
-	std::size_t operator()(const CCache& k) const noexcept
+	// GNU hash (dl_new_hash).
+	static constexpr std::uint32_t Hash(const std::string_view svName) noexcept
 	{
-		std::size_t h = std::hash<std::string>()(k.m_svPattern);
-		h ^= std::hash<uintptr_t>()(k.m_nStart) + m_nGoldenRatio + (h << 6) + (h >> 2);
-		h ^= std::hash<uintptr_t>()(k.m_pSectionAddr) + m_nGoldenRatio + (h << 6) + (h >> 2);
-		h ^= std::hash<size_t>()(k.m_nSectionSize) + m_nGoldenRatio + (h << 6) + (h >> 2);
+		std::uint32_t h = 5381;
+
+		for (const char c : svName)
+			h = h * 33 + static_cast<std::uint8_t>(c);
+
 		return h;
 	}
-};
 
-struct CNullMutex
+private:
+	static constexpr std::uint32_t s_nBloomShift = 26; // The second bit of a symbol (as ld does).
+
+	std::string m_sNames;
+	std::vector<Symbol_t> m_vecSymbols; // Grouped by the buckets after Build().
+	std::vector<std::uint32_t> m_vecBuckets; // Start of each bucket in the symbols, and the end one.
+	std::vector<std::uint64_t> m_vecBloom;
+}; // class CSymbolIndex
+
+// Virtual tables of a module by the decorated type name (as RTTI stores it), see CAssemblyModule::BuildTypeIndex.
+class CTypeIndex
 {
-	void lock() const noexcept {}
-	void unlock() const noexcept {}
-	bool try_lock() const noexcept { return true; }
+public:
+	struct VirtualTable_t
+	{
+		std::uintptr_t m_nOffset; // From the module base to the first virtual function.
+		std::ptrdiff_t m_nOffsetToTop; // 0 for the primary one, negative for the secondary ones.
+	};
 
-	void lock_shared() const noexcept {}
-	void unlock_shared() const noexcept {}
-	bool try_lock_shared() const noexcept { return true; }
-};
+	struct Type_t
+	{
+		const VirtualTable_t* m_pTables;
+		std::size_t m_nCount;
+
+		[[nodiscard]] const VirtualTable_t* GetPrimary() const noexcept
+		{
+			for (const auto& table : *this)
+				if (!table.m_nOffsetToTop)
+					return &table;
+
+			return nullptr;
+		}
+
+		const VirtualTable_t* begin() const noexcept { return m_pTables; }
+		const VirtualTable_t* end() const noexcept { return m_pTables + m_nCount; }
+	};
+
+	void Add(const std::string_view svName, std::uintptr_t nOffset, std::ptrdiff_t nOffsetToTop);
+	void Build(); // After the tables are added.
+	void Clear() noexcept;
+
+	[[nodiscard]] Type_t Find(const std::string_view svName) const noexcept; // In the order of addition.
+
+	[[nodiscard]] std::size_t Size() const noexcept { return m_names.Size(); } // Count of the types.
+	[[nodiscard]] bool IsEmpty() const noexcept { return m_names.IsEmpty(); }
+
+private:
+	struct Pending_t
+	{
+		std::string m_sName;
+		VirtualTable_t m_table;
+	};
+
+	std::vector<Pending_t> m_vecPending;
+	std::vector<VirtualTable_t> m_vecTables; // Grouped by the types.
+	CSymbolIndex m_names; // Name -> first table (as offset) and count (as size).
+}; // class CTypeIndex
+
+// Kinds of the code references (decoded by CAssemblyModule::BuildReferenceIndex).
+enum class ReferenceKind : std::uint8_t
+{
+	Call,    // call rel32, bl.
+	Jump,    // jmp/jcc rel32, b.
+	Address, // lea [rip + disp32], adrp + add.
+	Data,    // mov/call/jmp [rip + disp32] (GOT and IAT slots too), adrp + ldr.
+}; // enum class ReferenceKind
+
+// Code references of a module by the target: the instructions which call, jump to, address or access it.
+class CReferenceIndex
+{
+public:
+	struct Reference_t
+	{
+		std::uint32_t m_nTarget; // Offsets from the module base.
+		std::uint32_t m_nSource; // Of the instruction.
+		ReferenceKind m_eKind;
+	};
+
+	void Reserve(std::size_t nReferences) { m_vecReferences.reserve(nReferences); }
+	void Add(std::uint32_t nTarget, std::uint32_t nSource, ReferenceKind eKind) { m_vecReferences.push_back({ nTarget, nSource, eKind }); }
+	void Build(); // After the references are added.
+	void Clear() noexcept;
+
+	[[nodiscard]] Span_t<Reference_t> Find(std::uint32_t nTarget) const noexcept; // In the source order.
+
+	[[nodiscard]] std::size_t Size() const noexcept { return m_vecReferences.size(); } // Count of the references.
+	[[nodiscard]] bool IsEmpty() const noexcept { return m_vecReferences.empty(); }
+
+private:
+	static std::size_t Hash(std::uint32_t nTarget, std::uint32_t nShift) noexcept { return static_cast<std::size_t>((nTarget * 0x9E3779B97F4A7C15ull) >> nShift); }
+
+	std::vector<Reference_t> m_vecReferences; // Grouped by the targets after Build().
+	std::vector<std::uint32_t> m_vecSlots; // Open addressing: index of the first reference of a target + 1, 0 if free.
+	std::uint32_t m_nShift = 64;
+}; // class CReferenceIndex
+
+// A set of patterns resolved together by CAssemblyModule::FindPatterns in a single pass over a section.
+// Patterns are referenced, not copied: they must outlive the set.
+class CSignatureSet
+{
+public:
+	struct Entry_t
+	{
+		const std::uint8_t* m_pBytes;
+		std::string_view m_svMask;
+		PatternAnchors_t m_anchors;
+		CMemory m_pResult;
+	};
+
+	CSignatureSet() = default;
+	explicit CSignatureSet(std::size_t nReserve) { m_vecEntries.reserve(nReserve); }
+
+	// Returns the index of the added pattern to get the result by.
+	std::size_t Add(const std::uint8_t* pBytes, const std::string_view svMask, const PatternAnchors_t& anchors)
+	{
+		m_vecEntries.push_back({ pBytes, svMask, anchors, DYNLIB_INVALID_MEMORY });
+
+		return m_vecEntries.size() - 1;
+	}
+
+	std::size_t Add(const std::uint8_t* pBytes, const std::string_view svMask) { return Add(pBytes, svMask, SelectPatternAnchors(pBytes, svMask.data(), svMask.size())); }
+
+	template<std::size_t SIZE>
+	std::size_t Add(const Pattern_t<SIZE>& pattern) { return Add(pattern.m_aBytes.data(), std::string_view(pattern.m_aMask.data(), pattern.m_nSize), pattern.m_anchors); }
+
+	template<std::size_t SIZE>
+	std::size_t Add(Pattern_t<SIZE>&& pattern) = delete; // Would dangle.
+
+	[[nodiscard]] CMemory Get(std::size_t nIndex) const { return m_vecEntries[nIndex].m_pResult; }
+	[[nodiscard]] CMemory operator[](std::size_t nIndex) const { return Get(nIndex); }
+
+	[[nodiscard]] std::size_t Size() const noexcept { return m_vecEntries.size(); }
+	[[nodiscard]] bool IsEmpty() const noexcept { return m_vecEntries.empty(); }
+	void Clear() noexcept { m_vecEntries.clear(); }
+
+	Entry_t* begin() noexcept { return m_vecEntries.data(); }
+	Entry_t* end() noexcept { return m_vecEntries.data() + m_vecEntries.size(); }
+	const Entry_t* begin() const noexcept { return m_vecEntries.data(); }
+	const Entry_t* end() const noexcept { return m_vecEntries.data() + m_vecEntries.size(); }
+
+private:
+	std::vector<Entry_t> m_vecEntries;
+}; // class CSignatureSet
+
+// Result of an asynchronous resolution (see CAssemblyModule::ResolveAsync), set once by the module.
+// Copies share the state, which outlives the module.
+class CResolveHandle
+{
+public:
+	struct State_t
+	{
+		std::atomic<bool> m_bReady {false};
+		CMemory m_pResult;
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+		std::shared_ptr<void> m_pQueue; // Of the module, until the result is set.
+		void (*m_pfnResolve)(void* pQueue); // Resolves the queued requests on the calling thread.
+
+		void Set(const CMemory& pResult);
+	}; // struct State_t
+
+	CResolveHandle() = default;
+	explicit CResolveHandle(std::shared_ptr<State_t> pState) noexcept : m_pState(std::move(pState)) {}
+
+	[[nodiscard]] bool IsValid() const noexcept { return m_pState != nullptr; }
+	[[nodiscard]] bool IsReady() const noexcept { return m_pState && m_pState->m_bReady.load(std::memory_order_acquire); }
+
+	// Blocks until the result is set, the queue of the module is resolved by the calling thread meanwhile.
+	//   Returns invalid memory if isn't found.
+	[[nodiscard]] CMemory Get() const;
+	[[nodiscard]] CMemory operator*() const { return Get(); }
+
+private:
+	std::shared_ptr<State_t> m_pState;
+}; // class CResolveHandle
 
 template<typename Mutex = CNullMutex>
 class CAssemblyModule : public CMemory
 {
-	using UniqueLock_t = std::unique_lock<Mutex>;
-	using SharedLock_t = std::shared_lock<Mutex>;
 public:
 	template<std::size_t SIZE>
 	class CSignatureView : public Pattern_t<SIZE>
@@ -412,33 +1048,99 @@ public:
 
 		[[nodiscard]] CMemory Find(const CMemory& pStart, const Section_t* pSection = nullptr) const
 		{
-			return m_pModule->FindPattern<SIZE>(CMemory(Base_t::m_aBytes.data()), std::string_view(Base_t::m_aMask.data(), Base_t::m_nSize), pStart, pSection);
+			return m_pModule->FindPattern(Base_t::GetView(), pStart, pSection);
 		}
 		[[nodiscard]] CMemory OffsetAndFind(const std::ptrdiff_t offset, CMemory pStart, const Section_t* pSection = nullptr) const { return Find(pStart + offset, pSection); }
 		[[nodiscard]] CMemory OffsetFromSelfAndFind(const CMemory& pStart, const Section_t* pSection = nullptr) const { return OffsetAndFind(Base_t::m_nSize, pStart, pSection); }
 		[[nodiscard]] CMemory DerefAndFind(const std::uintptr_t deref, CMemory pStart, const Section_t* pSection = nullptr) const { return Find(pStart.Deref(deref), pSection); }
+
+		// See CAssemblyModule::ResolveAsync.
+		[[nodiscard]] CResolveHandle FindAsync(const Section_t* pSection = nullptr) const { return m_pModule->ResolveAsync(Base_t::GetView(), pSection); }
 	}; // class CSignatureView<SIZE>
 
 private:
 	[[nodiscard]] CMemory GetVirtualTable(const std::string_view svTableName, bool bDecorated = false) const;
 	[[nodiscard]] CMemory GetFunction(const std::string_view svFunctionName) const noexcept;
-	CMemory GetAddress(const CCache& hKey) const noexcept;
+
+	bool LoadCacheFile();
+	bool WriteCacheFile() const; // Of SaveCacheFile, may throw.
+	void IndexSections(const std::array<std::string_view, s_nSectionKinds>& aSectionNames); // After the sections are added.
+	const CReferenceIndex* IndexReferences() const; // Under m_referencesMutex, publishes a new index.
+	[[nodiscard]] std::size_t GetImageSize() const noexcept; // Extent of the sections from the base.
+	bool GetFileIdentity(CMappedImage::FileIdentity_t& identity) const; // Of the file of the loaded image.
+	const CMappedImage::FileSection_t* FindFileSection(const Section_t& section, std::shared_ptr<const CMappedImage>& pImage) const;
+
+	enum class ResolveKind : std::uint8_t
+	{
+		Pattern,
+		VirtualTable,
+		DecoratedVirtualTable,
+		Function,
+	}; // enum class ResolveKind
+
+	struct ResolveRequest_t;
+	struct ResolveQueue_t;
+
+	static std::shared_ptr<ResolveQueue_t> CreateResolveQueue(); // nullptr for CNullMutex.
+	void SwapResolveQueue(CAssemblyModule& other) noexcept;
+	void CloseResolves(); // On destruction.
+	CResolveHandle QueueResolve(ResolveKind eKind, const std::string_view svPattern, const std::string_view svMask, const Section_t* pModuleSection);
+	void ResolveBatch(std::vector<ResolveRequest_t>& vecRequests) const;
+
+	using ScanCallback_t = bool (*)(const void* pContext, std::size_t nIndex, CMemory pMatch);
+	std::size_t ScanAllPatterns(const std::uint8_t* pPattern, const std::string_view svMask, const CMemory& pStartAddress, const Section_t* pModuleSection, std::size_t nMaxCount, ScanCallback_t pfnCallback, const void* pContext) const;
+	std::size_t PublishTypes(std::shared_ptr<const CTypeIndex> pTypes); // Returns the count of the types.
+	void AddScanStats(const ScanEvent_t& event, std::size_t nScans) const noexcept; // Of a pass (of nScans patterns).
 
 	std::string m_sPath;
 	std::string m_sLastError;
+	std::string m_sCacheFile;
 	std::vector<Section_t> m_vecSections;
+	std::vector<std::uint32_t> m_vecSectionHashes; // Of the names.
+	std::vector<std::uint32_t> m_vecSectionSlots; // Open addressing: index of the section + 1, 0 if free.
+	std::array<const Section_t*, s_nSectionKinds> m_aSections {};
+	mutable std::shared_ptr<const CMappedImage> m_pImage;
+	DYNLIB_NUA mutable Mutex m_imageMutex;
+	bool m_bStaleFile = false; // The file isn't of the loaded image (rebuilt or gone since), it's neither mapped nor scanned.
+	CSymbolIndex m_symbols;
+	std::shared_ptr<const CTypeIndex> m_pTypes; // Replaced whole by BuildTypeIndex, under m_typesMutex.
+	DYNLIB_NUA mutable Mutex m_typesMutex;
+	mutable std::atomic<const CReferenceIndex*> m_pReferences {nullptr}; // The last one built, of m_vecReferences.
+	mutable std::vector<std::unique_ptr<const CReferenceIndex>> m_vecReferences; // The previous ones too (their spans), until Release. Under m_referencesMutex.
+	DYNLIB_NUA mutable Mutex m_referencesMutex;
 
 	const Section_t *m_pExecutableSection;
 
-	mutable std::unordered_map<CCache, CMemory, CHash> m_mapCached;
-	DYNLIB_NUA mutable Mutex m_mutex;
+	mutable CAddressCache<Mutex> m_cache;
+	mutable std::size_t m_nSavedCacheSize;
+
+	std::size_t m_nParallelScanSize;
+	ScanExecutor_t m_fnScanExecutor;
+	ScanSource m_eScanSource = ScanSource::Memory;
+
+	mutable BasicModuleStats_t<std::atomic<std::uint64_t>> m_stats;
+	StatsSink_t m_fnStatsSink;
+
+	std::shared_ptr<ResolveQueue_t> m_pResolves;
+
+	struct Released_t // Of the module released for a hot reload (see Release).
+	{
+		std::string m_sIdentity;
+		CMappedImage::FileIdentity_t m_file;
+		bool m_bFile; // Has the file been found.
+		std::uintptr_t m_nBase;
+		std::size_t m_nSize;
+		CAddressCache<Mutex> m_cache;
+	}; // struct Released_t
+
+	std::unique_ptr<Released_t> m_pReleased;
 
 public:
-	CAssemblyModule() : m_pExecutableSection(nullptr) {}
+	CAssemblyModule() : m_pExecutableSection(nullptr), m_nSavedCacheSize(0), m_nParallelScanSize(0), m_pResolves(CreateResolveQueue()) {}
 	~CAssemblyModule();
 
 	CAssemblyModule(const CAssemblyModule&) = delete;
-	CAssemblyModule(CAssemblyModule&& moveFrom) noexcept { MoveFrom(std::move(moveFrom)); }
+	CAssemblyModule(CAssemblyModule&& moveFrom) noexcept : m_pResolves(CreateResolveQueue()) { MoveFrom(std::move(moveFrom)); }
 	CAssemblyModule(const CMemory& pModuleMemory);
 	explicit CAssemblyModule(const std::string_view svModuleName);
 	explicit CAssemblyModule(const char* pszModuleName) : CAssemblyModule(std::string_view(pszModuleName)) {}
@@ -449,10 +1151,31 @@ public:
 	CAssemblyModule &CopyFrom(const CAssemblyModule&) = delete;
 	CAssemblyModule &MoveFrom(CAssemblyModule&& other)
 	{
+		WaitResolves();
+		other.WaitResolves();
+
 		*static_cast<CMemory *>(this) = std::exchange(static_cast<CMemory &>(other), DYNLIB_INVALID_MEMORY);
 		m_sPath = std::move(other.m_sPath);
+		m_sCacheFile = std::move(other.m_sCacheFile);
 		m_vecSections = std::move(other.m_vecSections);
+		m_vecSectionHashes = std::move(other.m_vecSectionHashes);
+		m_vecSectionSlots = std::move(other.m_vecSectionSlots);
+		m_aSections = std::exchange(other.m_aSections, {});
+		m_pImage = std::move(other.m_pImage);
+		m_bStaleFile = std::exchange(other.m_bStaleFile, false);
+		m_symbols = std::move(other.m_symbols);
+		m_pTypes = std::move(other.m_pTypes);
+		m_pReferences.store(other.m_pReferences.exchange(nullptr, std::memory_order_relaxed), std::memory_order_relaxed);
+		m_vecReferences = std::move(other.m_vecReferences);
 		m_pExecutableSection = std::move(other.m_pExecutableSection);
+		m_cache = std::move(other.m_cache); // Otherwise the persistent cache would be overwritten by an empty one.
+		m_nSavedCacheSize = std::exchange(other.m_nSavedCacheSize, 0);
+		m_nParallelScanSize = other.m_nParallelScanSize;
+		m_fnScanExecutor = std::move(other.m_fnScanExecutor);
+		m_eScanSource = other.m_eScanSource;
+		m_fnStatsSink = std::move(other.m_fnStatsSink);
+		m_pReleased = std::move(other.m_pReleased);
+		SwapResolveQueue(other); // Both are empty.
 
 		return *this;
 	}
@@ -463,6 +1186,83 @@ public:
 	bool InitFromName(const std::string_view svModuleName, bool bExtension = false);
 	bool InitFromMemory(const CMemory& pModuleMemory, bool bForce = true);
 
+	//-----------------------------------------------------------------------------
+	// Purpose: Releases the reference of the module to the library before the host
+	//          unloads it for a hot reload: the module holds one of its own, so the
+	//          library would stay loaded otherwise and the host would get the same
+	//          image back. The module is invalid until Reload, the cached addresses
+	//          are kept aside for it
+	//-----------------------------------------------------------------------------
+	void Release();
+	[[nodiscard]] bool IsReleased() const noexcept { return m_pReleased != nullptr; }
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Reloads the module once the host has reloaded the library (at a new
+	//          base, of a new build possibly): releases the handle if isn't yet and
+	//          loads the file again, the indices are rebuilt. The cached addresses
+	//          are rebased to the new base if both the identity and the file (device,
+	//          index, mtime) are the same, dropped otherwise
+	// Input  : svPath - of the new file, the current one if empty
+	// Output : true if the module is loaded
+	//-----------------------------------------------------------------------------
+	bool Reload(const std::string_view svPath = {});
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Opts in to the persistent cache: resolved addresses are stored as
+	//          module-relative ones keyed by the module identity, loaded on LoadFromPath
+	//          (or right away if the module is loaded) and written back on destruction.
+	//          The ones out of the image (forwarded exports) aren't stored.
+	//          A file of another build of the module is ignored
+	// Input  : svPath
+	// Output : true if the cache was loaded from the file
+	//-----------------------------------------------------------------------------
+	bool SetCacheFile(const std::string_view svPath);
+	bool SaveCacheFile() const noexcept;
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Opts in to scanning of the ranges from nMinSize bytes by overlapping
+	//          chunks across worker threads (a built-in pool unless fnExecutor is set).
+	//          The result is the same first match as the one of a serial scan.
+	//          A single CPU (no worker) scans serially
+	// Input  : nMinSize - 0 disables the parallel scan
+	//          fnExecutor
+	//-----------------------------------------------------------------------------
+	void SetParallelScan(std::size_t nMinSize = s_nDefaultParallelScanSize, ScanExecutor_t fnExecutor = nullptr)
+	{
+		m_nParallelScanSize = nMinSize;
+		m_fnScanExecutor = std::move(fnExecutor);
+	}
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Opts in to scanning the sections of the module file instead of the memory,
+	//          so that cold pages of the loaded image aren't faulted in (nor shared
+	//          CoW ones touched). File offsets are converted by the section table.
+	//          The bytes are of the file, not the memory: wherever relocations apply
+	//          they differ, i.e. the pointers of .data.rel.ro, __const and .data, the
+	//          absolute operands of x86-32 code (text relocations) and of a PE image
+	//          loaded off its preferred base (base relocations). A pattern over such
+	//          bytes is to wildcard them, or is to be scanned in memory.
+	//          FindPattern and FindPatterns follow it, FindAllPatterns scans memory.
+	//          A section not in the file as whole is scanned in memory
+	// Input  : eSource
+	//-----------------------------------------------------------------------------
+	void SetScanSource(ScanSource eSource) noexcept { m_eScanSource = eSource; }
+	[[nodiscard]] ScanSource GetScanSource() const noexcept { return m_eScanSource; }
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Sets the callback of the pattern scans (not the cache hits), to tell
+	//          which of the patterns are slow. Called by the scanning thread, after
+	//          the scan. Only if the library is built with DYNLIBUTILS_STATS
+	// Input  : fnSink - nullptr to unset
+	//-----------------------------------------------------------------------------
+	void SetStatsSink(StatsSink_t fnSink) { m_fnStatsSink = std::move(fnSink); }
+
+	// The counters since the construction (to be diffed), zeros unless the library is built with DYNLIBUTILS_STATS.
+	[[nodiscard]] ModuleStats_t GetStats() const noexcept;
+
+	// ELF build-id, PE timestamp + checksum + image size or Mach-O UUID (raw bytes).
+	[[nodiscard]] std::string GetIdentity() const;
+
 	template<std::size_t N>
 	[[nodiscard]]
 	inline auto CreateSignature(const Pattern_t<N> &copyFrom)
@@ -491,71 +1291,159 @@ public:
 	//-----------------------------------------------------------------------------
 	CMemory FindPattern(const CMemoryView<std::uint8_t>& pPatternMem, const std::string_view svMask, const CMemory& pStartAddress, const Section_t* pModuleSection) const;
 
+	//-----------------------------------------------------------------------------
+	// Purpose: Same with the prepared pattern (the masks and hash aren't computed)
+	// Input  : pattern
+	//          pStartAddress
+	//          *pModuleSection
+	// Output : CMemory
+	//-----------------------------------------------------------------------------
+	CMemory FindPattern(const PatternView_t& pattern, const CMemory& pStartAddress = nullptr, const Section_t* pModuleSection = nullptr) const;
+
 	template<std::size_t SIZE>
 	[[nodiscard]]
-	inline CMemory FindPattern(const Pattern_t<SIZE>& copyPattern, const CMemory pStartAddress = nullptr, const Section_t* pModuleSection = nullptr) const
+	inline CMemory FindPattern(const Pattern_t<SIZE>& pattern, const CMemory pStartAddress = nullptr, const Section_t* pModuleSection = nullptr) const
 	{
-		return FindPattern(copyPattern.m_aBytes.data(), std::string_view(copyPattern.m_aMask.data(), copyPattern.m_nSize), pStartAddress, pModuleSection);
+		return FindPattern(pattern.GetView(), pStartAddress, pModuleSection);
 	}
 
-	template<std::size_t SIZE>
-	[[nodiscard]]
-	inline CMemory FindPattern(Pattern_t<SIZE>&& movePattern, const CMemory pStartAddress = nullptr, const Section_t* pModuleSection = nullptr) const
+	//-----------------------------------------------------------------------------
+	// Purpose: Resolves every pattern of the set in a single pass over the section
+	//          (first match of each one, as FindPattern does) and caches the hits
+	// Input  : set - results are stored to its entries
+	//          *pModuleSection
+	// Output : count of the found patterns
+	//-----------------------------------------------------------------------------
+	std::size_t FindPatterns(CSignatureSet& set, const Section_t* pModuleSection = nullptr) const;
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Queues the pattern to be resolved asynchronously. The queued patterns
+	//          of a section are resolved together in a single pass (FindPatterns) and
+	//          cached as FindPattern caches them. The queue is resolved in the
+	//          background after SubmitResolves (by the executor of SetParallelScan
+	//          or the built-in pool), or by the first CResolveHandle::Get at last.
+	//          Of the std::shared_mutex instantiation only: the module is used by
+	//          the other threads meanwhile (the indices and sections mustn't change)
+	// Input  : pattern - copied
+	//          *pModuleSection
+	// Output : CResolveHandle
+	//-----------------------------------------------------------------------------
+	template<typename M = Mutex, std::enable_if_t<!std::is_same_v<M, CNullMutex>, int> = 0>
+	[[nodiscard]] CResolveHandle ResolveAsync(const PatternView_t& pattern, const Section_t* pModuleSection = nullptr)
 	{
-		return FindPattern(std::move(movePattern.m_aBytes).data(), std::string_view(std::move(movePattern.m_aMask).data(), std::move(movePattern.m_nSize)), pStartAddress, pModuleSection);
+		return QueueResolve(ResolveKind::Pattern, std::string_view(reinterpret_cast<const char*>(pattern.m_pBytes), pattern.m_svMask.size()), pattern.m_svMask, pModuleSection);
 	}
 
+	template<std::size_t SIZE, typename M = Mutex, std::enable_if_t<!std::is_same_v<M, CNullMutex>, int> = 0>
+	[[nodiscard]] CResolveHandle ResolveAsync(const Pattern_t<SIZE>& pattern, const Section_t* pModuleSection = nullptr) { return ResolveAsync(pattern.GetView(), pModuleSection); }
+
+	// Same for GetVirtualTableByName and GetFunctionByName.
+	template<typename M = Mutex, std::enable_if_t<!std::is_same_v<M, CNullMutex>, int> = 0>
+	[[nodiscard]] CResolveHandle ResolveVirtualTableAsync(const std::string_view svTableName, bool bDecorated = false) { return QueueResolve(bDecorated ? ResolveKind::DecoratedVirtualTable : ResolveKind::VirtualTable, svTableName, {}, nullptr); }
+	template<typename M = Mutex, std::enable_if_t<!std::is_same_v<M, CNullMutex>, int> = 0>
+	[[nodiscard]] CResolveHandle ResolveFunctionAsync(const std::string_view svFunctionName) { return QueueResolve(ResolveKind::Function, svFunctionName, {}, nullptr); }
+
+	// Starts resolving the queue in the background (the requests queued meanwhile join it).
+	void SubmitResolves();
+
+	// Resolves the queue on the calling thread too, returns when all the queued requests are.
+	void WaitResolves();
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Enumerates the (non-overlapping) matches of the pattern in a single pass
+	//          over the section. The matches aren't cached
+	// Input  : sig
+	//          callback - returns false to stop
+	//          pStartAddress
+	//          *pModuleSection
+	//          nMaxCount - stops after that count of matches
+	// Output : count of the found patterns
+	//-----------------------------------------------------------------------------
 	template<std::size_t SIZE, PatternCallback_t FUNC>
 	[[nodiscard]]
-	std::size_t FindAllPatterns(const CSignatureView<SIZE>& sig, const FUNC& callback, CMemory pStartAddress = nullptr, const Section_t* pModuleSection = nullptr) const
+	std::size_t FindAllPatterns(const CSignatureView<SIZE>& sig, const FUNC& callback, CMemory pStartAddress = nullptr, const Section_t* pModuleSection = nullptr, std::size_t nMaxCount = static_cast<std::size_t>(-1)) const
 	{
-		const Section_t* pSection = pModuleSection ? pModuleSection : m_pExecutableSection;
-
-		if (!pSection || !pSection->IsValid())
-			return 0;
-
-		const CMemory pBase = *pSection;
+		auto pfnCallback = [](const void* pContext, std::size_t nIndex, CMemory pMatch) -> bool
+		{
+			return (*static_cast<const FUNC*>(pContext))(nIndex, pMatch);
+		};
 
-		CMemory pIter = pStartAddress ? pStartAddress : pBase;
+		return ScanAllPatterns(sig.m_aBytes.data(), std::string_view(sig.m_aMask.data(), sig.m_nSize), pStartAddress, pModuleSection, nMaxCount, pfnCallback, &callback);
+	}
 
-		std::size_t foundCount = 0;
+	[[nodiscard]] CMemory GetVirtualTableByName(const std::string_view svTableName, bool bDecorated = false) const;
 
-		pIter = sig(pIter, pSection);
+	//-----------------------------------------------------------------------------
+	// Purpose: Walks the RTTI of the module once (Itanium type_info, MSVC complete object
+	//          locators) and indexes all virtual tables by the type name, so that
+	//          GetVirtualTableByName doesn't scan the sections for the indexed types.
+	//          The index is built aside and swapped in, the lookups meanwhile use
+	//          the previous one. Isn't supported on Apple (returns 0, see GetLastError)
+	// Output : count of the indexed types
+	//-----------------------------------------------------------------------------
+	std::size_t BuildTypeIndex();
+	[[nodiscard]] std::shared_ptr<const CTypeIndex> GetTypes() const; // nullptr unless built.
 
-		do
-		{
-			if (!callback(foundCount, pIter)) // foundCount = the index of found pattern now.
-				break;
+	//-----------------------------------------------------------------------------
+	// Purpose: Decodes the executable section once and indexes its references to
+	//          the module by the target: rel32 calls and jumps, RIP-relative operands
+	//          (x86-64), adrp + add/ldr pairs, bl and b (AArch64). The decode is
+	//          a linear sweep of the instructions, so the data in the code (jump
+	//          tables) may yield rare false references. A new index is built aside
+	//          and swapped in: the spans of the previous one stay valid until Release.
+	//          FindReferences builds it on the first call otherwise
+	// Output : count of the indexed references
+	//-----------------------------------------------------------------------------
+	std::size_t BuildReferenceIndex();
 
-			++foundCount;
+	//-----------------------------------------------------------------------------
+	// Purpose: Finds the instructions referencing the address by the index
+	// Input  : pTarget
+	// Output : the references (offsets from GetBase), empty if none
+	//-----------------------------------------------------------------------------
+	[[nodiscard]] Span_t<CReferenceIndex::Reference_t> FindReferences(const CMemory& pTarget) const;
+	[[nodiscard]] const CReferenceIndex& GetReferences() const noexcept // Empty unless built.
+	{
+		static const CReferenceIndex s_empty;
 
-			// Prevent excessive iterations: ensure pattern is correct.
-			assert(1000 > foundCount);
-		}
-		while((pIter = sig.OffsetFromSelfAndFind(pIter, pSection)).IsValid());
+		const CReferenceIndex* pIndex = m_pReferences.load(std::memory_order_acquire);
 
-		return foundCount; // Count of the found patterns.
+		return pIndex ? *pIndex : s_empty;
 	}
 
-	[[nodiscard]] CMemory GetVirtualTableByName(const std::string_view svTableName, bool bDecorated = false) const;
 	[[nodiscard]] CMemory GetFunctionByName(const std::string_view svFunctionName) const noexcept;
 
+	//-----------------------------------------------------------------------------
+	// Purpose: Resolves a symbol by the own index of the module symbol tables
+	//          (ELF .dynsym + .symtab, so local and hidden ones too; PE exports).
+	//          Falls back to GetFunction if the platform has no index
+	// Input  : svSymbolName
+	// Output : CMemory
+	//-----------------------------------------------------------------------------
+	[[nodiscard]] CMemory GetSymbol(const std::string_view svSymbolName) const noexcept;
+	[[nodiscard]] const CSymbolIndex& GetSymbols() const noexcept { return m_symbols; }
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Returns the read-only mapping of the module file, shared with the other
+	//          modules of the path, to read the headers and tables (symbols, relocations)
+	//          in place. Mapped on the first call unless the load needed it already
+	// Output : nullptr if the module isn't loaded or the file can't be mapped
+	//-----------------------------------------------------------------------------
+	[[nodiscard]] std::shared_ptr<const CMappedImage> GetImage() const;
+
 	[[nodiscard]] void* GetHandle() const noexcept { return GetPtr(); }
 	[[nodiscard]] CMemory GetBase() const noexcept;
 	[[nodiscard]] std::string_view GetPath() const { return m_sPath; }
 	[[nodiscard]] std::string_view GetLastError() const { return m_sLastError; }
+	[[nodiscard]] std::string_view GetCacheFile() const { return m_sCacheFile; }
+	[[nodiscard]] std::size_t GetCacheSize() const noexcept { return m_cache.Size(); } // Count of the cached addresses.
 	[[nodiscard]] std::string_view GetName() const { std::string_view svModulePath(m_sPath); return svModulePath.substr(svModulePath.find_last_of("/\\") + 1); }
-	[[nodiscard]] const Section_t *GetSectionByName(const std::string_view svSectionName) const
-	{
-		for (const auto& section : m_vecSections)
-			if (svSectionName == section.m_svSectionName)
-				return &section;
-
-		return nullptr;
-	}
+	[[nodiscard]] const Section_t *GetSectionByName(const std::string_view svSectionName) const noexcept; // The first one of the name.
+	[[nodiscard]] const Section_t *GetSection(SectionKind eKind) const noexcept { return m_aSections[static_cast<std::size_t>(eKind)]; } // nullptr if the module has none.
 
 protected:
 	void SaveLastError();
+	void Unload(); // Releases the handle of the loader (the descriptors are kept).
 }; // class CAssemblyModule
 
 using CModule = CAssemblyModule<CNullMutex>;
@@ -567,6 +1455,9 @@ public:
 	using CBase::CBase;
 };
 
+extern template class CAddressCache<CNullMutex>;
+extern template class CAddressCache<std::shared_mutex>;
+
 extern template class CAssemblyModule<CNullMutex>;
 extern template class CAssemblyModule<std::shared_mutex>;
 
@@ -0,0 +1,113 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#ifndef DYNLIBUTILS_MODULELOADER_HPP
+#define DYNLIBUTILS_MODULELOADER_HPP
+
+#pragma once
+
+#include "module.hpp"
+
+#include <cstddef>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace DynLibUtils {
+
+static constexpr std::size_t s_nLoaderChunkPatterns = 16; // The least patterns of a set scanned by one job.
+
+// Loads the modules of a manifest together and resolves their signature sets: the modules are opened and parsed
+// concurrently, then the sets are scanned (FindPatterns) by the jobs of a work-stealing pool, the results are
+// published into the cache of each module. So the load takes about as long as the largest module does, not the sum of them.
+// The jobs of a module are pushed to the worker which has opened it, the idle ones steal them.
+// The sets of the modules with a mutex (std::shared_mutex) are split by the patterns into several jobs,
+// the ones of CNullMutex are scanned by one job each (their cache isn't to be shared).
+//
+// Example usage:
+//
+//   CAssemblyModule<std::shared_mutex> server, engine;
+//   CSignatureSet serverSigs, engineSigs;
+//   ...
+//
+//   CModuleLoader<std::shared_mutex> loader;
+//
+//   loader.Add(server, "server", &serverSigs);
+//   loader.AddPath(engine, "/opt/game/bin/libengine.so", &engineSigs);
+//
+//   if (loader.Load() != loader.Size())
+//       ... // See GetResult.
+template<typename Mutex = std::shared_mutex>
+class CModuleLoader
+{
+public:
+	using Module_t = CAssemblyModule<Mutex>;
+
+	struct Entry_t
+	{
+		Module_t* m_pModule; // Owned by the caller, kept loaded if it's valid already.
+		std::string m_sName; // Of InitFromName, or the path of LoadFromPath.
+		bool m_bPath;
+		bool m_bExtension; // Of InitFromName.
+		CSignatureSet* m_pSet; // Optional.
+		SectionKind m_eSection;
+	}; // struct Entry_t
+
+	struct Result_t
+	{
+		bool m_bLoaded = false;
+		std::size_t m_nFound = 0; // Of the set.
+	}; // struct Result_t
+
+	static constexpr std::size_t s_nInvalidIndex = static_cast<std::size_t>(-1);
+
+	CModuleLoader() = default;
+	explicit CModuleLoader(std::size_t nReserve) { m_vecEntries.reserve(nReserve); }
+
+	// Returns the index of the added module to get the result by, or s_nInvalidIndex if the module
+	// is added already (its jobs would run concurrently): use one set per module.
+	std::size_t Add(Module_t& module, const std::string_view svName, CSignatureSet* pSet = nullptr, SectionKind eSection = SectionKind::Text, bool bExtension = false) { return Add({ &module, std::string(svName), false, bExtension, pSet, eSection }); }
+	std::size_t AddPath(Module_t& module, const std::string_view svPath, CSignatureSet* pSet = nullptr, SectionKind eSection = SectionKind::Text) { return Add({ &module, std::string(svPath), true, true, pSet, eSection }); }
+	std::size_t Add(Entry_t entry)
+	{
+		for (const auto& other : m_vecEntries)
+			if (other.m_pModule == entry.m_pModule)
+				return s_nInvalidIndex;
+
+		m_vecEntries.push_back(std::move(entry));
+
+		return m_vecEntries.size() - 1;
+	}
+
+	//-----------------------------------------------------------------------------
+	// Purpose: Loads the modules and scans their sets across the workers, the calling
+	//          thread is one of them. The modules and the sets mustn't be used
+	//          meanwhile. If a job throws, the other ones still run and the first
+	//          exception is rethrown once all the workers are joined
+	// Input  : nThreads - of the workers, of the hardware if 0
+	// Output : the count of the modules loaded
+	//-----------------------------------------------------------------------------
+	std::size_t Load(std::size_t nThreads = 0);
+
+	[[nodiscard]] const Result_t& GetResult(std::size_t nIndex) const { return m_vecResults[nIndex]; } // After Load.
+	[[nodiscard]] const Entry_t& GetEntry(std::size_t nIndex) const { return m_vecEntries[nIndex]; }
+
+	[[nodiscard]] std::size_t Size() const noexcept { return m_vecEntries.size(); }
+	[[nodiscard]] bool IsEmpty() const noexcept { return m_vecEntries.empty(); }
+	void Clear() noexcept { m_vecEntries.clear(); m_vecResults.clear(); }
+
+private:
+	std::vector<Entry_t> m_vecEntries;
+	std::vector<Result_t> m_vecResults;
+}; // class CModuleLoader
+
+extern template class CModuleLoader<CNullMutex>;
+extern template class CModuleLoader<std::shared_mutex>;
+
+} // namespace DynLibUtils
+
+#endif // DYNLIBUTILS_MODULELOADER_HPP
@@ -0,0 +1,82 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#ifndef DYNLIBUTILS_THREADSUSPENDER_HPP
+#define DYNLIBUTILS_THREADSUSPENDER_HPP
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace DynLibUtils
+{
+	/**
+	 * @class CThreadSuspender
+	 * @brief Stops the other threads of the process for the time code is patched, so that their
+	 * instruction pointers can be moved out of the patched bytes.
+	 *
+	 * The threads are suspended by SuspendThread (Windows), thread_suspend (Apple) or a real-time signal
+	 * whose handler waits (Linux, the highest one without a handler, taken for good). So on Linux a thread
+	 * which masks the signal isn't stopped, and one blocked in a call that isn't restarted after a handler
+	 * (e.g. pause, nanosleep, epoll_wait) returns EINTR. There each thread stops once it's scheduled, which takes
+	 * a time slice per running thread on a loaded CPU. One suspension runs at a time.
+	 *
+	 * While the threads are suspended, the suspending one must not take a lock they may hold (of the heap either),
+	 * so do the allocations before.
+	 */
+	class CThreadSuspender
+	{
+	public:
+		CThreadSuspender() = default;
+		CThreadSuspender(const CThreadSuspender &other) = delete;
+		CThreadSuspender &operator=(const CThreadSuspender &other) = delete;
+
+		/**
+		 * @brief Resumes the threads if they're suspended.
+		 */
+		~CThreadSuspender() { Resume(); }
+
+		/**
+		 * @brief Suspends all the other threads of the process, the ones started meanwhile too.
+		 * @return True if all are suspended, false (and none is) if one can't be in time.
+		 */
+		bool Suspend() noexcept;
+
+		/**
+		 * @brief Resumes the threads, at the instruction pointers set by ForEachInstructionPointer.
+		 */
+		void Resume() noexcept;
+
+		/**
+		 * @brief Checks whether the threads are suspended.
+		 */
+		bool IsSuspended() const noexcept { return m_bSuspended; }
+
+		/**
+		 * @brief Calls func(std::uintptr_t &ip) with the instruction pointer of each suspended thread,
+		 * which resumes at the one func leaves.
+		 * @return False if the state of a thread can't be read or written.
+		 */
+		template<typename F>
+		bool ForEachInstructionPointer(F &&func) noexcept
+		{
+			return VisitThreads([](void *pContext, std::uintptr_t &ip) { (*static_cast<std::remove_reference_t<F> *>(pContext))(ip); }, &func);
+		}
+
+	private: // Platform.
+		using Visitor_t = void (*)(void *pContext, std::uintptr_t &ip);
+
+		bool VisitThreads(Visitor_t pfnVisit, void *pContext) noexcept;
+
+	private:
+		std::vector<std::uintptr_t> m_vecThreads; /**< Ids (Linux), handles (Windows) or ports (Apple) of the suspended ones. */
+		bool m_bSuspended = false;
+	};
+} // namespace DynLibUtils
+
+#endif // DYNLIBUTILS_THREADSUSPENDER_HPP
@@ -143,6 +143,8 @@ public: // Constructors.
 	CVirtualTable(CVirtualTable &&) = default;
 	CVirtualTable(void* pClass) : m_pVTFs(*reinterpret_cast<void***>(pClass)) {} // Interprets the object’s first memory slot as a pointer to its vtable.
 	CVirtualTable(CMemory pVTFs) : m_pVTFs(pVTFs.RCast<void**>()) {}
+	CVirtualTable &operator=(const CVirtualTable &) = default;
+	CVirtualTable &operator=(CVirtualTable &&) = default;
 
 public: // Difference operators.
 	// Compare two CVirtualTable instances by their integer representation of the vtable pointer 
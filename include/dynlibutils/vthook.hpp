@@ -22,17 +22,117 @@
 #endif
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace DynLibUtils {
 
 using ProtectFlags_t = unsigned long;
 
+// Collects vtable slot writes and applies them together: the slots are grouped by page
+// and each page is made writable (RW) once for all of its writes, then restored.
+// Pending writes are committed on destruction.
+//
+// Example usage:
+//
+//   {
+//       CHookTransaction transaction;
+//
+//       hookA.Hook(transaction, pVTable, 1, &HookA);
+//       hookB.Hook(transaction, pVTable, 2, &HookB);
+//   } // Both slots are written here, with one protection change for the page.
+class CHookTransaction
+{
+public:
+	CHookTransaction() = default;
+	CHookTransaction(const CHookTransaction &other) = delete;
+	CHookTransaction(CHookTransaction &&other) = default;
+	~CHookTransaction() { Commit(); }
+
+	CHookTransaction &operator=(const CHookTransaction &other) = delete;
+
+	std::size_t Size() const noexcept { return m_vecWrites.size(); }
+	bool IsEmpty() const noexcept { return m_vecWrites.empty(); }
+
+	// Queues *ppSlot = pValue. The later of the writes to the same slot wins.
+	void Write(void **ppSlot, void *pValue) { m_vecWrites.push_back({ppSlot, pValue}); }
+
+	// Applies the queued writes. The writes of a page that can't be unprotected are dropped.
+	//   - Returns false if any page failed.
+	bool Commit() noexcept
+	{
+		if (m_vecWrites.empty())
+		{
+			return true;
+		}
+
+		std::stable_sort(m_vecWrites.begin(), m_vecWrites.end(), [](const Write_t &lhs, const Write_t &rhs) { return lhs.m_ppSlot < rhs.m_ppSlot; });
+
+		const std::uintptr_t nPageSize = GetPageSize(), nPageMask = ~(nPageSize - 1);
+
+		bool bResult = true;
+
+		for (auto it = m_vecWrites.begin(); it != m_vecWrites.end();)
+		{
+			const std::uintptr_t nPage = reinterpret_cast<std::uintptr_t>(it->m_ppSlot) & nPageMask;
+
+			auto itPageEnd = std::find_if(it, m_vecWrites.end(), [nPage, nPageMask](const Write_t &write) { return (reinterpret_cast<std::uintptr_t>(write.m_ppSlot) & nPageMask) != nPage; });
+
+			CMemProtector unprotect(nPage, nPageSize, ProtFlag::R | ProtFlag::W);
+
+			if (unprotect.IsValid())
+			{
+				for (; it != itPageEnd; ++it)
+				{
+					*it->m_ppSlot = it->m_pValue;
+				}
+			}
+			else
+			{
+				bResult = false;
+			}
+
+			it = itPageEnd;
+		}
+
+		m_vecWrites.clear();
+
+		return bResult;
+	}
+
+	static std::uintptr_t GetPageSize() noexcept
+	{
+#if _WIN32
+		static const std::uintptr_t s_nPageSize = []() { SYSTEM_INFO info; GetSystemInfo(&info); return static_cast<std::uintptr_t>(info.dwPageSize); }();
+#else
+		static const std::uintptr_t s_nPageSize = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+#endif
+
+		return s_nPageSize;
+	}
+
+private:
+	struct Write_t
+	{
+		void **m_ppSlot;
+		void *m_pValue;
+	};
+
+	std::vector<Write_t> m_vecWrites;
+}; // class CHookTransaction
+
 // A template class that allows hooking (i.e., replacing) a single virtual method 
 // in a class’s vtable. It derives from CMemory to leverage memory‐reading/writing utilities.
 // Template Parameters:
@@ -56,6 +156,9 @@ public:
 		}
 	}
 
+	CVTHook &operator=(const CVTHook &other) = delete;
+	CVTHook &operator=(CVTHook &&other) { Unhook(); return MoveFrom(std::move(other)); } // Unhooks the own slot first.
+
 	CVTHook &CopyFrom(const CVTHook &other) = delete;
 	CVTHook &MoveFrom(CVTHook &&other)
 	{
@@ -96,10 +199,24 @@ public:
 		HookImpl(pFn);
 	}
 
+	// Same, but the slot write is queued to the transaction (the hook is installed on its commit).
+	template<auto METHOD>
+	void Hook(CHookTransaction &transaction, CVirtualTable pVTable, Function_t pFn) { Hook(transaction, pVTable, GetVirtualIndex<METHOD>(), pFn); }
+	void Hook(CHookTransaction &transaction, CVirtualTable pVTable, std::ptrdiff_t nIndex, Function_t pFn)
+	{
+		assert(!IsHooked());
+		assert(nIndex != DYNLIB_INVALID_VCALL);
+
+		SetPtr(&pVTable.GetMethod<void *>(nIndex));
+		m_pOriginalFn = Deref();
+
+		transaction.Write(GetTargetPtr<void **>(), reinterpret_cast<void *>(pFn));
+	}
+
 	// If no hook is installed, returns false.
 	// Otherwise:
 	//   * Restores the original function pointer. 
-	//   * Resets internal state. 
+	//   * Resets the slot (the original one is kept for Call of the calls still in the hook, until Clear or the next Hook). 
 	//   * Returns true.
 	bool Unhook()
 	{
@@ -109,7 +226,21 @@ public:
 		}
 
 		UnhookImpl();
-		Clear();
+		SetPtr(nullptr);
+
+		return true;
+	}
+
+	// Same, but the original pointer is restored on the commit of the transaction.
+	bool Unhook(CHookTransaction &transaction)
+	{
+		if (!IsHooked())
+		{
+			return false;
+		}
+
+		transaction.Write(GetTargetPtr<void **>(), m_pOriginalFn.GetPtr());
+		SetPtr(nullptr);
 
 		return true;
 	}
@@ -137,24 +268,326 @@ public:
 protected: // Implementation methods.
 	void HookImpl(Function_t pfnTarget) noexcept
 	{
-		CMemProtector unprotect(GetPtr(), sizeof(void*), ProtFlag::RWX);
+		CHookTransaction transaction;
 
-		*GetTargetPtr() = pfnTarget;
+		transaction.Write(GetTargetPtr<void **>(), reinterpret_cast<void *>(pfnTarget));
 	}
 
 	void UnhookImpl() noexcept
 	{
-		CMemProtector unprotect(GetPtr(), sizeof(void*), ProtFlag::RWX);
+		CHookTransaction transaction;
 
-		*GetTargetPtr<void **>() = m_pOriginalFn.GetPtr();
+		transaction.Write(GetTargetPtr<void **>(), m_pOriginalFn.GetPtr());
 	}
 
 private:
 	CMemory m_pOriginalFn;
 }; // class CVTHook<R, Args...>
 
+#ifndef DYNLIBUTILS_HOOK_PROFILING
+#	define DYNLIBUTILS_HOOK_PROFILING 0 // Counts the calls of CVTFHook and CVTFMHook callbacks (see CHookProfile).
+#endif
+
+static constexpr std::size_t s_nHookProfileBuckets = 24;
+
+// Counters of a hook merged by CHookProfile::Get (zeros unless DYNLIBUTILS_HOOK_PROFILING is set).
+struct HookProfile_t
+{
+	std::uint64_t m_nCalls;
+	std::uint64_t m_nTime; // Nanoseconds, in the callbacks.
+	std::uint64_t m_nMaxTime;
+	std::array<std::uint64_t, s_nHookProfileBuckets> m_aHistogram; // By the latency: 0, then [2^(i - 1), 2^i) nanoseconds, the last one is open.
+}; // struct HookProfile_t
+
+// Call counters and a latency histogram of a hook. Each thread counts into a cache line of its own
+// (of a few shards, by the order the threads first count), so the callbacks of the threads don't share
+// one; the shards are merged on read.
+class CHookProfile
+{
+public:
+	static constexpr std::size_t s_nShards = 8;
+
+	// Records the time of the scope.
+	class CTimer
+	{
+	public:
+		explicit CTimer(CHookProfile &profile) noexcept : m_profile(profile), m_start(std::chrono::steady_clock::now()) {}
+		CTimer(const CTimer &other) = delete;
+		~CTimer() { m_profile.Record(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count())); }
+
+		CTimer &operator=(const CTimer &other) = delete;
+
+	private:
+		CHookProfile &m_profile;
+		std::chrono::steady_clock::time_point m_start;
+	}; // class CTimer
+
+	CHookProfile() = default;
+	CHookProfile(const CHookProfile &other) = delete;
+	CHookProfile &operator=(const CHookProfile &other) = delete;
+
+	void Record(std::uint64_t nTime) noexcept
+	{
+		Shard_t &shard = m_aShards[GetShard()];
+
+		std::size_t nBucket = 0;
+
+		while (nBucket < s_nHookProfileBuckets - 1 && (nTime >> nBucket))
+		{
+			nBucket++;
+		}
+
+		shard.m_nCalls.fetch_add(1, std::memory_order_relaxed);
+		shard.m_nTime.fetch_add(nTime, std::memory_order_relaxed);
+		shard.m_aHistogram[nBucket].fetch_add(1, std::memory_order_relaxed);
+
+		for (std::uint64_t nMaxTime = shard.m_nMaxTime.load(std::memory_order_relaxed); nTime > nMaxTime && !shard.m_nMaxTime.compare_exchange_weak(nMaxTime, nTime, std::memory_order_relaxed);)
+		{
+		}
+	}
+
+	HookProfile_t Get() const noexcept
+	{
+		HookProfile_t profile {};
+
+		for (const auto &shard : m_aShards)
+		{
+			profile.m_nCalls += shard.m_nCalls.load(std::memory_order_relaxed);
+			profile.m_nTime += shard.m_nTime.load(std::memory_order_relaxed);
+			profile.m_nMaxTime = std::max(profile.m_nMaxTime, shard.m_nMaxTime.load(std::memory_order_relaxed));
+
+			for (std::size_t n = 0; n < s_nHookProfileBuckets; n++)
+			{
+				profile.m_aHistogram[n] += shard.m_aHistogram[n].load(std::memory_order_relaxed);
+			}
+		}
+
+		return profile;
+	}
+
+	// The shard of the calling thread, of s_nShards.
+	static std::size_t GetShard() noexcept
+	{
+		static std::atomic<std::size_t> s_nThreads {};
+		thread_local const std::size_t s_nShard = s_nThreads.fetch_add(1, std::memory_order_relaxed) % s_nShards;
+
+		return s_nShard;
+	}
+
+private:
+	struct alignas(64) Shard_t
+	{
+		std::atomic<std::uint64_t> m_nCalls {};
+		std::atomic<std::uint64_t> m_nTime {};
+		std::atomic<std::uint64_t> m_nMaxTime {};
+		std::array<std::atomic<std::uint64_t>, s_nHookProfileBuckets> m_aHistogram {};
+	};
+
+	std::array<Shard_t, s_nShards> m_aShards {};
+
+}; // class CHookProfile
+
+#ifndef DYNLIBUTILS_THUNK_POOL_SIZE
+#	define DYNLIBUTILS_THUNK_POOL_SIZE 64 // Per signature.
+#endif
+
+// A pool of compile-time generated trampolines of a signature. Each slot has its own
+// static thunk that forwards the call to the invoker bound to the slot, together with
+// the context pointer of the slot. So a hook with state doesn't need a static callback
+// of its own nor a lookup by the this pointer.
+// The context is published atomically and the thunks count the calls in flight: a released
+// context is freed by the last call inside it (or by Release if there's none), and a call which
+// has loaded the thunk before the unhook but enters it after the release goes to the origin.
+// A slot whose context is freed is quarantined for a grace period before it's bound again: until
+// two quiescent points (no call in flight in any thunk of the pool, seen by an Acquire or a Release)
+// have passed since, and the free slots are reused the oldest first.
+// Template Parameters:
+//   R    – Return type of the thunks.
+//   Args – Argument types of the thunks.
+template<typename R, typename ...Args>
+class CThunkPool
+{
+public:
+	using Thunk_t = R (*)(Args...);
+	using Invoker_t = R (*)(void *pContext, Args...);
+	using Deleter_t = void (*)(void *pContext);
+
+	static constexpr std::size_t s_nSize = DYNLIBUTILS_THUNK_POOL_SIZE;
+	static constexpr std::size_t s_nInvalidSlot = static_cast<std::size_t>(-1);
+
+	// Binds a free slot to the invoker and the context,
+	// the calls after the release go to pfnOrigin (the original function of the hooked entry).
+	//   - Returns the slot, or s_nInvalidSlot when the pool is exhausted.
+	static std::size_t Acquire(Invoker_t pfnInvoker, void *pContext, Thunk_t pfnOrigin) noexcept
+	{
+		std::lock_guard lock(sm_mutex);
+
+		const std::uint64_t nEpoch = Advance();
+
+		std::size_t nFound = s_nInvalidSlot;
+		std::uint64_t nFoundEpoch = 0;
+
+		for (std::size_t n = 0; n < s_nSize; n++)
+		{
+			Slot_t &slot = sm_aSlots[n];
+
+			// A late call may still be inside a freed slot.
+			if (slot.m_bUsed.load(std::memory_order_acquire) || slot.m_nState.load(std::memory_order_acquire))
+			{
+				continue;
+			}
+
+			const std::uint64_t nFreed = slot.m_nEpoch.load(std::memory_order_relaxed);
+
+			if (nFreed && nEpoch <= nFreed)
+			{
+				continue; // In the grace period.
+			}
+
+			if (nFound == s_nInvalidSlot || nFreed < nFoundEpoch)
+			{
+				nFound = n;
+				nFoundEpoch = nFreed;
+			}
+		}
+
+		if (nFound != s_nInvalidSlot)
+		{
+			Slot_t &slot = sm_aSlots[nFound];
+
+			slot.m_bUsed.store(true, std::memory_order_relaxed);
+			slot.m_pfnOrigin.store(pfnOrigin, std::memory_order_relaxed);
+			slot.m_pfnInvoker.store(pfnInvoker, std::memory_order_relaxed);
+			slot.m_pContext.store(pContext, std::memory_order_release);
+		}
+
+		return nFound;
+	}
+
+	// Unbinds the slot, the context is deleted once no call is inside it (right away if none is),
+	// so the thunk must be out of the tables by now.
+	// A late call (which has read the thunk from a table before the unhook) goes to the origin
+	// while the slot is quarantined; one which is held off for longer than the grace period may
+	// still enter the slot once it's bound again, it gets the new context or the new origin then.
+	static void Release(std::size_t nSlot, Deleter_t pfnDeleter) noexcept
+	{
+		assert(nSlot < s_nSize);
+
+		Slot_t &slot = sm_aSlots[nSlot];
+
+		slot.m_pRetired.store(slot.m_pContext.exchange(nullptr, std::memory_order_acq_rel), std::memory_order_relaxed);
+		slot.m_pfnDeleter.store(pfnDeleter, std::memory_order_relaxed);
+		slot.m_nState.fetch_or(s_nRetired, std::memory_order_acq_rel);
+
+		Reclaim(slot); // Out of the lock, the deleter may unhook another.
+
+		std::lock_guard lock(sm_mutex);
+
+		Advance();
+	}
+
+	static Thunk_t GetThunk(std::size_t nSlot) noexcept
+	{
+		static constexpr std::array<Thunk_t, s_nSize> s_aThunks = MakeThunks(std::make_index_sequence<s_nSize>{});
+
+		assert(nSlot < s_nSize);
+
+		return s_aThunks[nSlot];
+	}
+
+private:
+	struct Slot_t
+	{
+		std::atomic<Invoker_t> m_pfnInvoker {};
+		std::atomic<void *> m_pContext {}; // nullptr once released.
+		std::atomic<Thunk_t> m_pfnOrigin {};
+		std::atomic<std::size_t> m_nState {}; // The calls in flight, and s_nRetired.
+		std::atomic<void *> m_pRetired {}; // The context released, to be deleted.
+		std::atomic<Deleter_t> m_pfnDeleter {};
+		std::atomic<std::uint64_t> m_nEpoch {}; // Of sm_nEpoch when the context was freed, plus one (0 if never bound).
+		std::atomic<bool> m_bUsed {}; // Bound, or its context isn't freed yet.
+	};
+
+	static constexpr std::size_t s_nRetired = ~(static_cast<std::size_t>(-1) >> 1);
+
+	// By the release or the last call out after it: whichever turns the state
+	// from retired with no call in flight to 0 frees the context, once.
+	static void Reclaim(Slot_t &slot) noexcept
+	{
+		std::size_t nState = s_nRetired;
+
+		if (!slot.m_nState.compare_exchange_strong(nState, 0, std::memory_order_acq_rel))
+		{
+			return;
+		}
+
+		if (void *pContext = slot.m_pRetired.exchange(nullptr, std::memory_order_relaxed))
+		{
+			slot.m_pfnDeleter.load(std::memory_order_relaxed)(pContext);
+		}
+
+		slot.m_nEpoch.store(sm_nEpoch.load(std::memory_order_acquire) + 1, std::memory_order_relaxed);
+		slot.m_bUsed.store(false, std::memory_order_release);
+	}
+
+	// Starts the next epoch if no call is in flight in any thunk, a quiescent point (under sm_mutex).
+	//   - Returns the current epoch.
+	static std::uint64_t Advance() noexcept
+	{
+		for (const Slot_t &slot : sm_aSlots)
+		{
+			if (slot.m_nState.load(std::memory_order_acquire) & ~s_nRetired)
+			{
+				return sm_nEpoch.load(std::memory_order_relaxed);
+			}
+		}
+
+		return sm_nEpoch.fetch_add(1, std::memory_order_acq_rel) + 1;
+	}
+
+	template<std::size_t N>
+	static R Thunk(Args... args)
+	{
+		Slot_t &slot = sm_aSlots[N];
+
+		slot.m_nState.fetch_add(1, std::memory_order_acq_rel);
+
+		struct Call_t
+		{
+			Slot_t &m_slot;
+
+			~Call_t()
+			{
+				if (m_slot.m_nState.fetch_sub(1, std::memory_order_acq_rel) == (s_nRetired | 1))
+				{
+					Reclaim(m_slot);
+				}
+			}
+		} call { slot };
+
+		if (void *pContext = slot.m_pContext.load(std::memory_order_acquire))
+		{
+			return slot.m_pfnInvoker.load(std::memory_order_relaxed)(pContext, args...);
+		}
+
+		return slot.m_pfnOrigin.load(std::memory_order_relaxed)(args...);
+	}
+
+	template<std::size_t ...N>
+	static constexpr std::array<Thunk_t, s_nSize> MakeThunks(std::index_sequence<N...>) noexcept { return { &Thunk<N>... }; }
+
+	inline static std::mutex sm_mutex;
+	inline static std::atomic<std::uint64_t> sm_nEpoch {}; // The quiescent points seen.
+	inline static std::array<Slot_t, s_nSize> sm_aSlots {};
+}; // class CThunkPool<R, Args...>
+
 // A template class allows hooking a virtual function by providing a 
 // lambda callback (which can capture state) instead of a raw function pointer.
+// Each hook owns its callback and a slot of CThunkPool, which is installed into the vtable,
+// so any number of hooks (up to the pool size) may share a signature. The callback is called
+// with its own type (without std::function, unless one is passed).
+// The callback outlives the calls in it after the unhook (see CThunkPool), the hook object doesn't:
+// a callback which calls the original through the hook needs the hook alive until the calls are done.
 // Template Parameters:
 //   R    – Return type of the virtual function being hooked.
 //   Args – Argument types of the virtual function being hooked. 
@@ -166,35 +599,272 @@ public:
 	using CBase = CVTHook<R, Args...>;
 	using CBase::CBase;
 	using Function_t = std::function<R (Args...)>; // Allowing lambdas or other callable objects that match R(Args...) to be used as the hook target.
+	using Pool_t = CThunkPool<R, Args...>;
+
+	CVTFHook() = default;
+	CVTFHook(CVTFHook &&other) : CBase(std::move(other)) { MoveFrom(std::move(other)); }
+	~CVTFHook()
+	{
+		CBase::Unhook();
+		Release();
+	}
+
+	CVTFHook &operator=(CVTFHook &&other)
+	{
+		Unhook();
+		CBase::MoveFrom(std::move(other));
+
+		return MoveFrom(std::move(other));
+	}
+
+	CVTFHook &MoveFrom(CVTFHook &&other)
+	{
+		m_nSlot = std::exchange(other.m_nSlot, Pool_t::s_nInvalidSlot);
+		m_pCallback = std::move(other.m_pCallback);
+#if DYNLIBUTILS_HOOK_PROFILING
+		m_pProfile = std::exchange(other.m_pProfile, nullptr);
+#endif
+
+		return *this;
+	}
 
-	void Clear() { CBase::Clear(); sm_callback = nullptr; }
+	void Clear() { CBase::Clear(); Release(); }
+
+	// The calls of the callback since it's bound (DYNLIBUTILS_HOOK_PROFILING).
+	HookProfile_t GetProfile() const noexcept
+	{
+#if DYNLIBUTILS_HOOK_PROFILING
+		if (m_pProfile)
+		{
+			return m_pProfile->Get();
+		}
+#endif
+
+		return {};
+	}
 
 	// Hooks takes labda callback:
 	//   - pVTable:  CVirtualTable instance pointing to the target class’s vtable.
 	//   - nIndex (optional):  Zero‐based index into the vtable to replace.
 	//   - func:  Lambda callback to store and invoke when the hooked virtual function is called.
-	template<auto METHOD> void Hook(CVirtualTable pVTable, Function_t &&func) noexcept { Hook(pVTable, GetVirtualIndex<METHOD>(), std::move(func)); }
-	void Hook(CVirtualTable pVTable, std::ptrdiff_t nIndex, Function_t &&func) noexcept
+	// Returns false (isn't hooked) when the thunk pool of the signature is exhausted.
+	// The slots unhooked lately count as used for a grace period (see CThunkPool).
+	// The storing of the callback may throw (as its copy or the allocation), nothing is hooked then.
+	// Unhooking while other threads call the entry is safe: the callback is freed after the last call in it,
+	// and the calls which enter the thunk afterwards go to the original function.
+	template<auto METHOD, typename F> bool Hook(CVirtualTable pVTable, F &&func) { return Hook(pVTable, GetVirtualIndex<METHOD>(), std::forward<F>(func)); }
+	template<typename F>
+	bool Hook(CVirtualTable pVTable, std::ptrdiff_t nIndex, F &&func)
 	{
-		assert(!sm_callback);
+		auto pfnThunk = Bind(pVTable.GetMethod<typename CBase::Function_t>(nIndex), std::forward<F>(func));
+
+		if (!pfnThunk)
+		{
+			return false;
+		}
+
+		CBase::Hook(pVTable, nIndex, pfnThunk);
+
+		return true;
+	}
+
+	template<auto METHOD, typename F> bool Hook(CHookTransaction &transaction, CVirtualTable pVTable, F &&func) { return Hook(transaction, pVTable, GetVirtualIndex<METHOD>(), std::forward<F>(func)); }
+	template<typename F>
+	bool Hook(CHookTransaction &transaction, CVirtualTable pVTable, std::ptrdiff_t nIndex, F &&func)
+	{
+		auto pfnThunk = Bind(pVTable.GetMethod<typename CBase::Function_t>(nIndex), std::forward<F>(func));
+
+		if (!pfnThunk)
+		{
+			return false;
+		}
 
-		sm_callback = std::move(func);
-		CBase::Hook(pVTable, nIndex, +[](Args... args) -> R { return sm_callback(args...); });
+		CBase::Hook(transaction, pVTable, nIndex, pfnThunk);
+
+		return true;
 	}
 
 	bool Unhook()
 	{
 		bool bResult = CBase::Unhook();
 
-		sm_callback = nullptr;
+		Release();
 
 		return bResult;
 	}
 
 protected:
-	inline static Function_t sm_callback;
+	// Stores the callback and binds a thunk to it, pfnOrigin is called after the release.
+	//   - Returns the thunk, or nullptr when the pool is exhausted.
+	template<typename F>
+	typename CBase::Function_t Bind(typename CBase::Function_t pfnOrigin, F &&func)
+	{
+#if DYNLIBUTILS_HOOK_PROFILING
+		struct Callback_t
+		{
+			std::decay_t<F> m_func;
+			CHookProfile m_profile;
+
+			R operator()(Args... args)
+			{
+				const CHookProfile::CTimer timer(m_profile);
+
+				return m_func(args...);
+			}
+		};
+
+		assert(m_nSlot == Pool_t::s_nInvalidSlot);
+
+		std::unique_ptr<Callback_t> pCallback(new Callback_t { std::forward<F>(func), {} });
+#else
+		using Callback_t = std::decay_t<F>;
+
+		assert(m_nSlot == Pool_t::s_nInvalidSlot);
+
+		auto pCallback = std::make_unique<Callback_t>(std::forward<F>(func));
+#endif
+
+		std::size_t nSlot = Pool_t::Acquire(+[](void *pContext, Args... args) -> R { return (*static_cast<Callback_t *>(pContext))(args...); }, pCallback.get(), pfnOrigin);
+
+		if (nSlot == Pool_t::s_nInvalidSlot)
+		{
+			return nullptr;
+		}
+
+		m_nSlot = nSlot;
+#if DYNLIBUTILS_HOOK_PROFILING
+		m_pProfile = &pCallback->m_profile;
+#endif
+		m_pCallback = Callback_u(pCallback.release(), +[](void *pContext) { delete static_cast<Callback_t *>(pContext); });
+
+		return Pool_t::GetThunk(nSlot);
+	}
+
+	// The callback is handed to the pool, which deletes it after the calls in flight.
+	void Release() noexcept
+	{
+		if (m_nSlot != Pool_t::s_nInvalidSlot)
+		{
+			auto pfnDeleter = m_pCallback.get_deleter();
+
+			Pool_t::Release(std::exchange(m_nSlot, Pool_t::s_nInvalidSlot), pfnDeleter);
+			m_pCallback.release();
+		}
+
+		m_pCallback.reset();
+#if DYNLIBUTILS_HOOK_PROFILING
+		m_pProfile = nullptr;
+#endif
+	}
+
+private:
+	using Callback_u = std::unique_ptr<void, void (*)(void *)>;
+
+	std::size_t m_nSlot = Pool_t::s_nInvalidSlot;
+	Callback_u m_pCallback { nullptr, +[](void *) {} };
+#if DYNLIBUTILS_HOOK_PROFILING
+	const CHookProfile *m_pProfile = nullptr; // In the callback.
+#endif
 }; // class CVTFHook<R, Args...>
 
+// Results of CVTMHookBase::CallAll<N>: the first N are stored in place and all of them
+// are moved to the heap past that, so they are contiguous either way.
+// Template Parameters:
+//   T - Result type.
+//   N - Count of the results stored in place.
+template<typename T, std::size_t N>
+class CHookResults
+{
+	static_assert(N > 0, "In place count must be > 0");
+
+public:
+	CHookResults() = default;
+	CHookResults(const CHookResults &other) = delete;
+	CHookResults(CHookResults &&other) noexcept(std::is_nothrow_move_constructible_v<T>) { MoveFrom(std::move(other)); }
+	~CHookResults() { Clear(); }
+
+	CHookResults &operator=(const CHookResults &other) = delete;
+	CHookResults &operator=(CHookResults &&other) noexcept(std::is_nothrow_move_constructible_v<T>) { Clear(); return MoveFrom(std::move(other)); }
+
+	CHookResults &MoveFrom(CHookResults &&other) noexcept(std::is_nothrow_move_constructible_v<T>)
+	{
+		m_vecSpilled = std::move(other.m_vecSpilled);
+
+		for (std::size_t n = 0; n < other.m_nInline; n++)
+		{
+			new (GetInline(n)) T(std::move(*other.GetInline(n)));
+		}
+
+		m_nInline = other.m_nInline;
+		other.Clear();
+
+		return *this;
+	}
+
+	void PushBack(T &&value)
+	{
+		if (!IsSpilled() && m_nInline < N)
+		{
+			new (GetInline(m_nInline++)) T(std::move(value));
+
+			return;
+		}
+
+		if (!IsSpilled())
+		{
+			m_vecSpilled.reserve(N * 2 + 1);
+
+			for (std::size_t n = 0; n < m_nInline; n++)
+			{
+				m_vecSpilled.push_back(std::move(*GetInline(n)));
+			}
+
+			ClearInline();
+		}
+
+		m_vecSpilled.push_back(std::move(value));
+	}
+
+	void Clear() noexcept
+	{
+		ClearInline();
+		m_vecSpilled.clear();
+	}
+
+	std::size_t Size() const noexcept { return IsSpilled() ? m_vecSpilled.size() : m_nInline; }
+	bool IsEmpty() const noexcept { return !Size(); }
+	bool IsSpilled() const noexcept { return !m_vecSpilled.empty(); } // The results are on the heap.
+
+	T *Data() noexcept { return IsSpilled() ? m_vecSpilled.data() : GetInline(0); }
+	const T *Data() const noexcept { return IsSpilled() ? m_vecSpilled.data() : GetInline(0); }
+
+	T &operator[](std::size_t nIndex) noexcept { return Data()[nIndex]; }
+	const T &operator[](std::size_t nIndex) const noexcept { return Data()[nIndex]; }
+
+	T *begin() noexcept { return Data(); }
+	T *end() noexcept { return Data() + Size(); }
+	const T *begin() const noexcept { return Data(); }
+	const T *end() const noexcept { return Data() + Size(); }
+
+private:
+	T *GetInline(std::size_t nIndex) noexcept { return reinterpret_cast<T *>(m_aInline) + nIndex; }
+	const T *GetInline(std::size_t nIndex) const noexcept { return reinterpret_cast<const T *>(m_aInline) + nIndex; }
+
+	void ClearInline() noexcept
+	{
+		for (std::size_t n = 0; n < m_nInline; n++)
+		{
+			GetInline(n)->~T();
+		}
+
+		m_nInline = 0;
+	}
+
+	alignas(T) unsigned char m_aInline[N * sizeof(T)];
+	std::size_t m_nInline = 0;
+	std::vector<T> m_vecSpilled;
+}; // class CHookResults<T, N>
+
 // A template class represents a generic manager for multiple virtual-table hooks of the same signature.
 // Template Parameters:
 //   TH - A hook element template (e.g., CVTHook or CVTFHook).
@@ -218,10 +888,13 @@ public:
 
 	using Element_t = TH<R, C, Args...>;
 	using Function_t = typename Element_t::Function_t;
+	using Entry_t = std::pair<CVirtualTable, Element_t>;
 
 public:
+	// The hooks are held by a sorted vector: the iterators returned by Find and AddHook are invalidated
+	// by the next AddHook (an insertion may reallocate or shift the elements), RemoveHook and Clear.
 	bool IsEmpty() const noexcept { return m_storage.empty(); } // Returns true if no hooks are currently stored.
-	auto Find(const CVirtualTable pVTable) { return m_storage.equal_range(pVTable); } // Delimiting all entries (each Element_t) that were registered under that exact virtual table key.
+	auto Find(const CVirtualTable pVTable) { return std::equal_range(m_storage.begin(), m_storage.end(), pVTable, Less_t{}); } // Delimiting all entries (each Element_t) that were registered under that exact virtual table key.
 	const auto End() const noexcept { return m_storage.cend(); } // Returns a const iterator pointing to the end (for comparison).
 	void Clear() noexcept { m_storage.clear(); }
 
@@ -232,7 +905,8 @@ public:
 	//      * Saves the original function pointer in vth’s internal state.
 	//      * Replaces the vtable entry [pVTable + nIndex] with vfunc.
 	//   3. Inserts the newly‐constructed vth into m_storage under the key pVTable,
-	//      returning an iterator to the inserted element.
+	//      returning an iterator to the inserted element, valid until the next
+	//      AddHook, RemoveHook or Clear (don't keep it, Find the hooks again).
 	template<auto METHOD>
 	auto AddHook(CVirtualTable pVTable, Function_t vfunc) { return AddHook(pVTable, GetVirtualIndex<METHOD>(), vfunc); }
 	auto AddHook(CVirtualTable pVTable, std::ptrdiff_t nIndex, Function_t vfunc)
@@ -241,7 +915,19 @@ public:
 
 		vth.Hook(pVTable, nIndex, vfunc);
 
-		return m_storage.emplace(pVTable, std::move(vth));
+		return Insert(pVTable, std::move(vth));
+	}
+
+	// Same, but the slot write is queued to the transaction.
+	template<auto METHOD>
+	auto AddHook(CHookTransaction &transaction, CVirtualTable pVTable, Function_t vfunc) { return AddHook(transaction, pVTable, GetVirtualIndex<METHOD>(), vfunc); }
+	auto AddHook(CHookTransaction &transaction, CVirtualTable pVTable, std::ptrdiff_t nIndex, Function_t vfunc)
+	{
+		Element_t vth;
+
+		vth.Hook(transaction, pVTable, nIndex, vfunc);
+
+		return Insert(pVTable, std::move(vth));
 	}
 
 	R Call(C pThis, Args... args)
@@ -271,7 +957,7 @@ public:
 
 		assert(found.first != found.second);
 
-		// results.reserve(vhooks.size());
+		results.reserve(static_cast<std::size_t>(found.second - found.first));
 
 		for (auto it = found.first; it != found.second; it++)
 		{
@@ -281,12 +967,73 @@ public:
 		return results;
 	}
 
+	// Same, but the first N results are stored in place (see CHookResults), so that a few hooks don't allocate.
+	template<std::size_t N, typename Ret = R, typename = std::enable_if_t<!std::is_void_v<Ret>>>
+	CHookResults<Ret, N> CallAll(C pThis, Args... args)
+	{
+		CHookResults<Ret, N> results;
+
+		VisitAll(pThis, [&results](Ret &&result) { results.PushBack(std::move(result)); }, args...);
+
+		return results;
+	}
+
+	// Calls each hook of the vtable in order of insertion and passes its result to func (none for void),
+	// without a container of the results.
+	//   - Returns the number of the hooks called.
+	template<typename FUNC>
+	std::size_t VisitAll(C pThis, FUNC &&func, Args... args)
+	{
+		auto found = Find(CVirtualTable(pThis));
+
+		for (auto it = found.first; it != found.second; it++)
+		{
+			if constexpr (std::is_void_v<R>)
+			{
+				it->second.Call(pThis, args...);
+				func();
+			}
+			else
+			{
+				func(it->second.Call(pThis, args...));
+			}
+		}
+
+		return static_cast<std::size_t>(found.second - found.first);
+	}
+
+	// Folds the results of the hooks of the vtable in order of insertion: value = func(value, result).
+	template<typename T, typename FUNC, typename Ret = R, typename = std::enable_if_t<!std::is_void_v<Ret>>>
+	T ReduceAll(C pThis, T value, FUNC &&func, Args... args)
+	{
+		VisitAll(pThis, [&value, &func](Ret &&result) { value = func(std::move(value), std::move(result)); }, args...);
+
+		return value;
+	}
+
 	// erases all hook elements associated with that vtable.
 	//   - Returns the number of elements removed (std::size_t).
-	std::size_t RemoveHook(CVirtualTable pVTable) { return m_storage.erase(pVTable); }
+	std::size_t RemoveHook(CVirtualTable pVTable)
+	{
+		auto found = Find(pVTable);
+		const auto nCount = static_cast<std::size_t>(found.second - found.first);
+
+		m_storage.erase(found.first, found.second);
+
+		return nCount;
+	}
 
 private:
-	std::multimap<CVirtualTable, Element_t> m_storage;
+	struct Less_t
+	{
+		bool operator()(const Entry_t &entry, const CVirtualTable &pVTable) const noexcept { return entry.first < pVTable; }
+		bool operator()(const CVirtualTable &pVTable, const Entry_t &entry) const noexcept { return pVTable < entry.first; }
+	};
+
+	// After the hooks of the same vtable (in order of insertion, as a multimap does).
+	auto Insert(CVirtualTable pVTable, Element_t &&vth) { return m_storage.emplace(std::upper_bound(m_storage.begin(), m_storage.end(), pVTable, Less_t{}), pVTable, std::move(vth)); }
+
+	std::vector<Entry_t> m_storage; // Sorted by the vtables, so the hooks of one are contiguous.
 }; // class CVTMHookBase<TH, R, C, Args...>
 
 template<typename R, typename ...Args>
@@ -301,7 +1048,7 @@ using CVTMHook = CVTMHookBase<CVTHook, R, Args...>;
 //
 // Inheritance:
 //   CVTFMHook inherits from CVTMHook<R, Args...>, which provides storage and basic hook‐installation 
-//   logic for a multimap of CVirtualTable → hook elements. Each hook element in this context 
+//   logic for a flat table of CVirtualTable → hook elements. Each hook element in this context 
 //   must itself know how to call a function pointer with signature R (Args...).
 //
 // CVTFMHook extends that by maintaining, for each hooked class (keyed by its CVirtualTable), a 
@@ -333,14 +1080,30 @@ using CVTMHook = CVTMHookBase<CVTHook, R, Args...>;
 //
 //
 // Implementation Details:
-//   - sm_vcallbacks: A static std::map from CVirtualTable → std::vector<Function_t>.
+//   - sm_vcallbacks: A static std::map from CVirtualTable → std::vector of the owned callbacks.
 //                     For each distinct vtable (i.e., each derived class or polymorphic type),
-//                     we store a list of callbacks of type R(T, Args...).
+//                     we store a list of callbacks of type R(T, Args...). It's the writer side,
+//                     guarded by sm_mutex.
+//   - sm_pDispatch:  An immutable snapshot of sm_vcallbacks the trampoline reads without locks:
+//                     a flat open-addressing table of vtables over one contiguous callback array.
+//                     Every change publishes a new snapshot (copy-on-write); the replaced ones and
+//                     the removed callbacks are retired, as other threads may still dispatch through them.
+//   - sm_aReaders:   The trampolines in flight, counted per thread shard. The retired snapshots and
+//                     callbacks are freed at a quiescent point, when no shard counts a call: checked by
+//                     each change and by the last call out while something is retired. Callbacks may be
+//                     destroyed on the thread of that call.
 //   - AddHook: Adds a new callback to sm_vcallbacks[vtable], and installs (via base AddHook) a
-//              single vtable‐slot hook that dispatches to all callbacks in the vector.
+//              single vtable‐slot hook that dispatches to all callbacks in the vector, once per vtable.
+//              The trampoline doesn't know the index it's called by, so all the callbacks of a vtable
+//              are of the index it's hooked at first (sm_indices): another one is refused.
 //   - RemoveHook: Erases the entry for a given CVirtualTable from sm_vcallbacks, then removes
 //                 all registered hooks in the base class for that vtable.
-//   - Clear:     Clears sm_vcallbacks entirely and then clears all hooks from the base class.
+//   - Clear:     Clears sm_vcallbacks entirely, clears all hooks from the base class and frees
+//                the callbacks and the retired snapshots. It must not race with the dispatch.
+//   - GetProfile: The calls and the latency of the callbacks of a vtable, merged from the counters
+//                 the trampoline records per thread (DYNLIBUTILS_HOOK_PROFILING).
+//
+// AddHook and RemoveHook may run while other threads call the hooked method.
 //
 // Disclaimer: This code snippet assumes that Element_t (from the base class) is capable of
 //             installing a hook that, when invoked, calls a single raw function pointer that
@@ -353,7 +1116,7 @@ class CVTFMHook : public CVTMHook<R, T, Args...>
 public:
 	using Base_t = CVTMHook<R, T, Args...>;
 	using Function_t = std::function<R (T, Args...)>;
-	using Functions_t = std::vector<std::function<R (T, Args...)>>;
+	using Functions_t = std::vector<const Function_t *>;
 
 	// AddHook (by index):
 	//   Installs or appends a callback for a given vtable index.
@@ -363,42 +1126,61 @@ public:
 	//     - nIndex (optional):  Zero‐based index into the vtable indicating which virtual slot to hook.
 	//     - funcCallback:  The std::function<R(T, Args...)> to append to the callback list.
 	//
+	//   Returns false (asserts, nothing is added) if the vtable is hooked at another index already.
+	//
 	//   Behavior:
-	//     1. Insert or append funcCallback into the static map sm_vcallbacks at key `pVTable`.
-	//     2. Call the base class’s
+	//     1. Insert or append funcCallback into the static map sm_vcallbacks at key `pVTable`
+	//        and publish a new dispatch snapshot.
+	//     2. Call the base class’s AddHook with the trampoline if the vtable had no callbacks
 	//      - The unary '+' ensures the lambda is converted to a raw function pointer of type Function_t.
 	//      - When the hooked method is invoked on an object `pClass`, the trampoline lambda:
-	//          a) Constructs a CVirtualTable(pClass) to look up the correct list of callbacks.
-	//          b) Retrieves `callbacks`, which is a std::vector<Function_t> stored in sm_vcallbacks.
-	//          c) Iterates through each callback in the vector and invokes it with (pClass, args...).
+	//          a) Loads the current dispatch snapshot.
+	//          b) Looks up the callbacks of CVirtualTable(pClass) in it.
+	//          c) Iterates through each callback and invokes it with (pClass, args...).
 	template<auto METHOD>
-	void AddHook(CVirtualTable pVTable, Function_t funcCallback) { return AddHook(pVTable, GetVirtualIndex<METHOD>(), funcCallback); }
-	void AddHook(CVirtualTable pVTable, std::ptrdiff_t nIndex, Function_t funcCallback)
+	bool AddHook(CVirtualTable pVTable, Function_t funcCallback) { return AddHook(pVTable, GetVirtualIndex<METHOD>(), funcCallback); }
+	bool AddHook(CVirtualTable pVTable, std::ptrdiff_t nIndex, Function_t funcCallback)
 	{
-		auto found = sm_vcallbacks.find(pVTable);
+		Retired_t retired; // Freed out of the lock.
 
-		if(found != sm_vcallbacks.cend())
+		std::lock_guard lock(sm_mutex);
+
+		if (const auto [itIndex, bInserted] = sm_indices.try_emplace(pVTable, nIndex); !bInserted && itIndex->second != nIndex)
 		{
-			found->second.push_back(std::move(funcCallback));
+			assert(!"The vtable is hooked at another index");
+
+			return false;
 		}
-		else
+
+		sm_vcallbacks[pVTable].push_back(std::make_unique<const Function_t>(std::move(funcCallback)));
+
+		Publish(retired);
+
+		if (auto hooked = Base_t::Find(pVTable); hooked.first != hooked.second)
 		{
-			sm_vcallbacks.emplace(pVTable, Functions_t{std::move(funcCallback)});
+			return true; // The slot already dispatches to the trampoline.
 		}
 
 		Base_t::AddHook(pVTable, nIndex,
 			+[](T pClass, Args... args) -> R
 			{
-				auto found = sm_vcallbacks.find(CVirtualTable(pClass));
+				const CReader reader;
+
+				const Dispatch_t *pDispatch = sm_pDispatch.load(std::memory_order_seq_cst);
+				const typename Dispatch_t::Entry_t *pEntry = pDispatch ? pDispatch->Find(CVirtualTable(pClass).m_diff) : nullptr;
 
 				if constexpr (std::is_void_v<R>)
 				{
-					if (found == sm_vcallbacks.cend())
+					if (!pEntry)
 						return;
 
-					for (const auto &callback : found->second)
+#if DYNLIBUTILS_HOOK_PROFILING
+					const CHookProfile::CTimer timer(*pEntry->m_pProfile);
+#endif
+
+					for (auto it = pDispatch->Begin(*pEntry), end = pDispatch->End(*pEntry); it != end; ++it)
 					{
-						callback(pClass, args...);
+						(**it)(pClass, args...);
 					}
 
 					return;
@@ -407,35 +1189,258 @@ public:
 				{
 					R result {};
 
-					if (found == sm_vcallbacks.cend())
+					if (!pEntry)
 						return result;
 
-					for (const auto &callback : found->second)
+#if DYNLIBUTILS_HOOK_PROFILING
+					const CHookProfile::CTimer timer(*pEntry->m_pProfile);
+#endif
+
+					for (auto it = pDispatch->Begin(*pEntry), end = pDispatch->End(*pEntry); it != end; ++it)
 					{
-						result = callback(pClass, args...);
+						result = (**it)(pClass, args...);
 					}
 
 					return result;
 				}
 			}
 		);
+
+		return true;
 	}
 
+	// The callbacks of the vtable are freed with the snapshots which point at them,
+	// once no thread dispatches (see Trim).
 	bool RemoveHook(CVirtualTable pVTable)
 	{
-		sm_vcallbacks.erase(pVTable);
+		Retired_t retired; // Freed out of the lock.
+
+		std::lock_guard lock(sm_mutex);
+
+		if (auto found = sm_vcallbacks.find(pVTable); found != sm_vcallbacks.end())
+		{
+			auto &vecCallbacks = found->second;
+
+			sm_retired.m_vecCallbacks.insert(sm_retired.m_vecCallbacks.end(), std::make_move_iterator(vecCallbacks.begin()), std::make_move_iterator(vecCallbacks.end()));
+			sm_vcallbacks.erase(found);
+		}
+
+		sm_indices.erase(pVTable);
+
+		Publish(retired);
 
 		return Base_t::RemoveHook(pVTable) != 0;
 	}
 
 	void Clear()
 	{
+		std::lock_guard lock(sm_mutex);
+
 		sm_vcallbacks.clear();
+		sm_indices.clear();
 		Base_t::Clear();
+
+		sm_pDispatch.store(nullptr, std::memory_order_release);
+		sm_pCurrent.reset();
+		sm_retired = {};
+		sm_bRetired.store(false, std::memory_order_relaxed);
+#if DYNLIBUTILS_HOOK_PROFILING
+		sm_profiles.clear();
+#endif
+	}
+
+	// The calls of the callbacks of the vtable since it's hooked first (DYNLIBUTILS_HOOK_PROFILING).
+	static HookProfile_t GetProfile(CVirtualTable pVTable)
+	{
+#if DYNLIBUTILS_HOOK_PROFILING
+		std::lock_guard lock(sm_mutex);
+
+		if (auto found = sm_profiles.find(pVTable); found != sm_profiles.cend())
+		{
+			return found->second.Get();
+		}
+#else
+		(void)pVTable;
+#endif
+
+		return {};
 	}
 
 protected:
-	inline static std::map<CVirtualTable, Functions_t> sm_vcallbacks;
+	// An immutable dispatch snapshot.
+	struct Dispatch_t
+	{
+		struct Entry_t
+		{
+			std::ptrdiff_t m_nVTable; // 0 for the empty ones.
+			std::uint32_t m_nFirst; // In m_vecCallbacks.
+			std::uint32_t m_nCount;
+#if DYNLIBUTILS_HOOK_PROFILING
+			CHookProfile *m_pProfile; // Of sm_profiles.
+#endif
+		};
+
+		std::vector<Entry_t> m_vecEntries; // Size is a power of two, at most half full.
+		Functions_t m_vecCallbacks; // Grouped by the vtables.
+		unsigned m_nShift = 0;
+
+		std::size_t Slot(std::ptrdiff_t nVTable) const noexcept { return static_cast<std::size_t>((static_cast<std::uint64_t>(nVTable) * 0x9E3779B97F4A7C15ull) >> m_nShift); }
+
+		const Entry_t *Find(std::ptrdiff_t nVTable) const noexcept
+		{
+			const std::size_t nMask = m_vecEntries.size() - 1;
+
+			for (std::size_t i = Slot(nVTable);; i = (i + 1) & nMask)
+			{
+				const Entry_t &entry = m_vecEntries[i];
+
+				if (entry.m_nVTable == nVTable)
+					return &entry;
+
+				if (!entry.m_nVTable)
+					return nullptr;
+			}
+		}
+
+		auto Begin(const Entry_t &entry) const noexcept { return m_vecCallbacks.cbegin() + entry.m_nFirst; }
+		auto End(const Entry_t &entry) const noexcept { return m_vecCallbacks.cbegin() + entry.m_nFirst + entry.m_nCount; }
+	}; // struct Dispatch_t
+
+	using Callbacks_t = std::vector<std::unique_ptr<const Function_t>>;
+
+	// Replaced snapshots and removed callbacks, until no thread dispatches.
+	struct Retired_t
+	{
+		std::vector<std::unique_ptr<Dispatch_t>> m_vecDispatches;
+		Callbacks_t m_vecCallbacks;
+	}; // struct Retired_t
+
+	// Counts the trampoline in flight in the shard of the thread, and trims
+	// the retired ones on the way out of the last call if there are any.
+	class CReader
+	{
+	public:
+		CReader() noexcept : m_nShard(CHookProfile::GetShard()) { sm_aReaders[m_nShard].m_nCount.fetch_add(1, std::memory_order_seq_cst); }
+		CReader(const CReader &other) = delete;
+		~CReader()
+		{
+			if (sm_aReaders[m_nShard].m_nCount.fetch_sub(1, std::memory_order_seq_cst) != 1 || !sm_bRetired.load(std::memory_order_relaxed))
+			{
+				return;
+			}
+
+			Retired_t retired; // Freed out of the lock.
+
+			if (std::unique_lock lock(sm_mutex, std::try_to_lock); lock.owns_lock())
+			{
+				Trim(retired);
+			}
+		}
+
+		CReader &operator=(const CReader &other) = delete;
+
+	private:
+		std::size_t m_nShard;
+	}; // class CReader
+
+	// Moves the retired snapshots and callbacks out to be freed if no trampoline is in flight (under sm_mutex).
+	// A trampoline which starts after the check loads the current snapshot, so it can't reach them.
+	// The retired ones are kept while the calls never let up (or a callback calls the hooked method),
+	// until the next quiescent point: the next change, or the way out of the last call.
+	static void Trim(Retired_t &retired) noexcept
+	{
+		for (const auto &readers : sm_aReaders)
+		{
+			if (readers.m_nCount.load(std::memory_order_seq_cst))
+			{
+				return;
+			}
+		}
+
+		retired = std::move(sm_retired);
+		sm_retired = {};
+		sm_bRetired.store(false, std::memory_order_relaxed);
+	}
+
+	// Builds a snapshot of sm_vcallbacks and makes it current, then trims
+	// the retired ones into retired (under sm_mutex).
+	static void Publish(Retired_t &retired)
+	{
+		auto pDispatch = std::make_unique<Dispatch_t>();
+
+		std::size_t nSize = 8;
+
+		while (nSize < sm_vcallbacks.size() * 2)
+		{
+			nSize <<= 1;
+		}
+
+		pDispatch->m_vecEntries.resize(nSize, typename Dispatch_t::Entry_t{});
+
+		unsigned nBits = 0;
+
+		while ((std::size_t(1) << nBits) < nSize)
+		{
+			nBits++;
+		}
+
+		pDispatch->m_nShift = 64 - nBits;
+
+		for (const auto &[pVTable, vecCallbacks] : sm_vcallbacks)
+		{
+			const std::size_t nMask = nSize - 1;
+
+			std::size_t i = pDispatch->Slot(pVTable.m_diff);
+
+			while (pDispatch->m_vecEntries[i].m_nVTable)
+			{
+				i = (i + 1) & nMask;
+			}
+
+			auto &entry = pDispatch->m_vecEntries[i];
+
+			entry.m_nVTable = pVTable.m_diff;
+			entry.m_nFirst = static_cast<std::uint32_t>(pDispatch->m_vecCallbacks.size());
+			entry.m_nCount = static_cast<std::uint32_t>(vecCallbacks.size());
+#if DYNLIBUTILS_HOOK_PROFILING
+			entry.m_pProfile = &sm_profiles[pVTable];
+#endif
+
+			for (const auto &pCallback : vecCallbacks)
+			{
+				pDispatch->m_vecCallbacks.push_back(pCallback.get());
+			}
+		}
+
+		sm_pDispatch.store(pDispatch.get(), std::memory_order_seq_cst);
+
+		if (sm_pCurrent)
+		{
+			sm_retired.m_vecDispatches.push_back(std::move(sm_pCurrent));
+		}
+
+		sm_pCurrent = std::move(pDispatch);
+		sm_bRetired.store(!sm_retired.m_vecDispatches.empty() || !sm_retired.m_vecCallbacks.empty(), std::memory_order_relaxed);
+
+		Trim(retired);
+	}
+
+	struct alignas(64) Readers_t
+	{
+		std::atomic<std::size_t> m_nCount {};
+	};
+
+	inline static std::mutex sm_mutex;
+	inline static std::map<CVirtualTable, Callbacks_t> sm_vcallbacks;
+	inline static std::map<CVirtualTable, std::ptrdiff_t> sm_indices; // The hooked one of each vtable.
+	inline static std::unique_ptr<Dispatch_t> sm_pCurrent; // Of sm_pDispatch.
+	inline static Retired_t sm_retired;
+	inline static std::atomic<bool> sm_bRetired = false; // If sm_retired isn't empty.
+	inline static std::array<Readers_t, CHookProfile::s_nShards> sm_aReaders {}; // The trampolines in flight, by the shards of the threads.
+	inline static std::atomic<const Dispatch_t *> sm_pDispatch = nullptr;
+#if DYNLIBUTILS_HOOK_PROFILING
+	inline static std::map<CVirtualTable, CHookProfile> sm_profiles; // Kept over RemoveHook, as the snapshots point at them.
+#endif
 }; // class CVTFHookSet<R, T, Args...>
 
 // ========================================================================================
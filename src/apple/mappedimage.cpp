@@ -0,0 +1,133 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#include "os.h"
+
+#include <dynlibutils/mappedimage.hpp>
+
+#include <cerrno>
+#include <cstring>
+
+using namespace DynLibUtils;
+
+static CMappedImage::FileIdentity_t GetStatIdentity(const struct stat& st) noexcept
+{
+	return { static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino), static_cast<std::uint64_t>(st.st_mtimespec.tv_sec) * 1000000000 + static_cast<std::uint64_t>(st.st_mtimespec.tv_nsec), static_cast<std::uint64_t>(st.st_size) };
+}
+
+bool CMappedImage::GetFileIdentity(const std::string& sPath, FileIdentity_t& identity) noexcept
+{
+	struct stat st;
+	if (stat(sPath.c_str(), &st) != 0)
+		return false;
+
+	identity = GetStatIdentity(st);
+
+	return true;
+}
+
+bool CMappedImage::Map(const std::string& sPath)
+{
+	int fd = open(sPath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+
+	struct stat st;
+	void* map = MAP_FAILED;
+
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		map = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+	close(fd); // The mapping keeps the file.
+
+	if (map == MAP_FAILED)
+		return false;
+
+	m_pData = static_cast<const std::uint8_t*>(map);
+	m_nSize = static_cast<std::size_t>(st.st_size);
+	m_identity = GetStatIdentity(st);
+
+	return true;
+}
+
+void CMappedImage::Unmap() noexcept
+{
+	munmap(const_cast<std::uint8_t*>(m_pData), m_nSize);
+}
+
+void* CMappedImage::OpenStream(const std::string& sPath) noexcept
+{
+	int fd = open(sPath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return nullptr;
+
+	fcntl(fd, F_RDAHEAD, 1);
+	fcntl(fd, F_NOCACHE, 1); // Not to be reused.
+
+	return reinterpret_cast<void*>(static_cast<std::intptr_t>(fd) + 1);
+}
+
+bool CMappedImage::ReadStream(void* pStream, std::size_t nOffset, void* pBuffer, std::size_t nSize) noexcept
+{
+	const int fd = static_cast<int>(reinterpret_cast<std::intptr_t>(pStream) - 1);
+
+	for (auto* pDest = static_cast<std::uint8_t*>(pBuffer); nSize;)
+	{
+		const ssize_t nRead = pread(fd, pDest, nSize, static_cast<off_t>(nOffset));
+
+		if (nRead < 0 && errno == EINTR)
+			continue;
+
+		if (nRead <= 0)
+			return false;
+
+		pDest += nRead;
+		nOffset += static_cast<std::size_t>(nRead);
+		nSize -= static_cast<std::size_t>(nRead);
+	}
+
+	return true;
+}
+
+void CMappedImage::CloseStream(void* pStream) noexcept
+{
+	close(static_cast<int>(reinterpret_cast<std::intptr_t>(pStream) - 1));
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads the sections of the 64-bit Mach-O segments (of a thin file)
+//-----------------------------------------------------------------------------
+void CMappedImage::ParseSections()
+{
+	const auto* header = GetSpan<mach_header_64>(0, 1).begin();
+	if (!header || header->magic != MH_MAGIC_64)
+		return;
+
+	std::size_t nOffset = sizeof(mach_header_64);
+
+	for (std::uint32_t i = 0; i < header->ncmds; ++i)
+	{
+		const auto* cmd = GetSpan<load_command>(nOffset, 1).begin();
+		if (!cmd || cmd->cmdsize < sizeof(load_command))
+			return;
+
+		if (cmd->cmd == LC_SEGMENT_64)
+		{
+			const auto* seg = GetSpan<segment_command_64>(nOffset, 1).begin();
+			const auto sections = seg ? GetSpan<section_64>(nOffset + sizeof(segment_command_64), seg->nsects) : Span_t<section_64>{};
+
+			for (const auto& section : sections)
+			{
+				const auto nType = section.flags & SECTION_TYPE;
+				const bool bHasData = nType != S_ZEROFILL && nType != S_GB_ZEROFILL && nType != S_THREAD_LOCAL_ZEROFILL && section.offset + section.size <= m_nSize;
+
+				m_vecSections.push_back({ std::string_view(section.sectname, strnlen(section.sectname, sizeof(section.sectname))), static_cast<std::uintptr_t>(section.addr), static_cast<std::size_t>(section.size), static_cast<std::size_t>(section.offset), bHasData ? static_cast<std::size_t>(section.size) : 0 });
+			}
+		}
+
+		nOffset += cmd->cmdsize;
+	}
+}
@@ -32,13 +32,28 @@ bool CMemAccessor::SafeMemCopy(CMemory dest, CMemory src, size_t size, size_t& w
 
 bool CMemAccessor::SafeMemRead(CMemory src, CMemory dest, size_t size, size_t& read) noexcept
 {
-	bool res = std::memcpy(dest, src, size) != nullptr;
+	// Through the kernel, so that an unreadable source fails instead of faulting.
+	mach_vm_size_t done = 0;
+	bool res = mach_vm_read_overwrite(mach_task_self(), static_cast<mach_vm_address_t>(src.GetAddr()), static_cast<mach_vm_size_t>(size), static_cast<mach_vm_address_t>(dest.GetAddr()), &done) == KERN_SUCCESS;
 	if (res)
-		read = size;
+		read = static_cast<size_t>(done);
 	else
 		read = 0;
 
-	return res;
+	return res && read;
+}
+
+size_t CMemAccessor::SafeMemReadV(SafeRead_t* reads, size_t count) noexcept
+{
+	size_t done = 0;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		reads[i].m_nRead = 0;
+		done += SafeMemRead(reads[i].m_pSrc, reads[i].m_pDest, reads[i].m_nSize, reads[i].m_nRead) && reads[i].m_nRead;
+	}
+
+	return done;
 }
 
 ProtFlag CMemAccessor::MemProtect(CMemory dest, size_t size, ProtFlag prot, bool& status)
@@ -47,3 +62,7 @@ ProtFlag CMemAccessor::MemProtect(CMemory dest, size_t size, ProtFlag prot, bool
 	status = mach_vm_protect(mach_task_self(), static_cast<mach_vm_address_t>(MemoryRound(dest, pageSize)), static_cast<mach_vm_size_t>(MemoryRoundUp(size, pageSize)), FALSE, TranslateProtection(prot)) == KERN_SUCCESS;
 	return ProtFlag::R | ProtFlag::X;
 }
+
+void CMemAccessor::InvalidateRegions() noexcept
+{
+}
@@ -34,8 +34,13 @@ using namespace DynLibUtils;
 template<typename Mutex>
 CAssemblyModule<Mutex>::~CAssemblyModule()
 {
+	CloseResolves();
+
 	if (IsValid())
-		dlclose(GetPtr());
+	{
+		SaveCacheFile();
+		Unload();
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -124,6 +129,8 @@ bool CAssemblyModule<Mutex>::LoadFromPath(const std::string_view svModelePath, i
 	}
 */
 
+	std::size_t nConstRelocations = static_cast<std::size_t>(-1); // __const is of both __TEXT and __DATA_CONST.
+
 	const load_command* cmd = reinterpret_cast<const load_command*>(reinterpret_cast<uintptr_t>(header) + sizeof(MachHeader));
 	for (uint32_t i = 0; i < header->ncmds; ++i) {
 		if (cmd->cmd == MACH_LOADCMD_SEGMENT) {
@@ -132,19 +139,27 @@ bool CAssemblyModule<Mutex>::LoadFromPath(const std::string_view svModelePath, i
 
 			for (uint32_t j = 0; j < seg->nsects; ++j) {
 				const MachSection& section = sec[j];
+				if (!std::strncmp(section.segname, "__DATA_CONST", sizeof(section.segname)) && !std::strncmp(section.sectname, "__const", sizeof(section.sectname)))
+					nConstRelocations = m_vecSections.size();
+
 				m_vecSections.emplace_back(
 					GetAddr() + section.addr,
 					section.size,
-					section.sectname
+					std::string_view(section.sectname, strnlen(section.sectname, sizeof(section.sectname)))
 				);
 			}
 		}
 		cmd = reinterpret_cast<const load_command*>(reinterpret_cast<uintptr_t>(cmd) + cmd->cmdsize);
 	}
 
-	m_pExecutableSection = GetSectionByName("__TEXT");
+	IndexSections({ "__text", "__const", {}, {}, "__data" });
 	assert(m_pExecutableSection != nullptr);
 
+	if (nConstRelocations < m_vecSections.size())
+		m_aSections[static_cast<std::size_t>(SectionKind::ReadOnlyRelocations)] = &m_vecSections[nConstRelocations];
+
+	LoadCacheFile();
+
 	return true;
 }
 
@@ -171,6 +186,18 @@ CMemory CAssemblyModule<Mutex>::GetVirtualTable(const std::string_view svTableNa
 	return DYNLIB_INVALID_MEMORY;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Isn't supported (as GetVirtualTable), the index is left empty
+// Output : 0
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+std::size_t CAssemblyModule<Mutex>::BuildTypeIndex()
+{
+	m_sLastError = "BuildTypeIndex isn't supported on Apple";
+
+	return PublishTypes(nullptr);
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Gets an address of a virtual method table by rtti type descriptor name
 // Input  : svFunctionName
@@ -191,8 +218,38 @@ CMemory CAssemblyModule<Mutex>::GetBase() const noexcept
 	return CMemory(RCast<dlopen_handle*>()->module);
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Returns the build identity (LC_UUID)
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+std::string CAssemblyModule<Mutex>::GetIdentity() const
+{
+	if (!IsValid())
+		return {};
+
+	const auto* header = RCast<const MachHeader*>();
+
+	const load_command* cmd = reinterpret_cast<const load_command*>(reinterpret_cast<uintptr_t>(header) + sizeof(MachHeader));
+	for (uint32_t i = 0; i < header->ncmds; ++i) {
+		if (cmd->cmd == LC_UUID) {
+			const auto* uuid = reinterpret_cast<const uuid_command*>(cmd);
+			return std::string(reinterpret_cast<const char*>(uuid->uuid), sizeof(uuid->uuid));
+		}
+		cmd = reinterpret_cast<const load_command*>(reinterpret_cast<uintptr_t>(cmd) + cmd->cmdsize);
+	}
+
+	return {};
+}
+
 template<typename Mutex>
 void CAssemblyModule<Mutex>::SaveLastError()
 {
 	m_sLastError = dlerror();
+}
+
+template<typename Mutex>
+void CAssemblyModule<Mutex>::Unload()
+{
+	dlclose(GetPtr());
+	*static_cast<CMemory*>(this) = DYNLIB_INVALID_MEMORY;
 }
\ No newline at end of file
@@ -0,0 +1,178 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#include "os.h"
+
+#include <dynlibutils/threadsuspender.hpp>
+
+#include <algorithm>
+#include <mutex>
+
+using namespace DynLibUtils;
+
+static constexpr std::size_t s_nMinThreads = 64; // Capacity of the first try.
+
+static std::mutex s_mutex; // Of the suspension.
+
+static void ResumeThreads(std::vector<std::uintptr_t> &vecThreads) noexcept
+{
+	for (const std::uintptr_t nThread : vecThreads)
+	{
+		thread_resume(static_cast<thread_act_t>(nThread));
+		mach_port_deallocate(mach_task_self(), static_cast<mach_port_t>(nThread));
+	}
+
+	vecThreads.clear();
+}
+
+bool CThreadSuspender::Suspend() noexcept
+{
+	if (m_bSuspended)
+		return true;
+
+	s_mutex.lock();
+
+	const thread_act_t nSelf = mach_thread_self();
+
+	// The ports are only added in the capacity while the threads are suspended, retried with more if it's short.
+	for (std::size_t nCapacity = s_nMinThreads;; nCapacity *= 2)
+	{
+		try
+		{
+			m_vecThreads.clear();
+			m_vecThreads.reserve(nCapacity);
+		}
+		catch (...)
+		{
+			break;
+		}
+
+		bool bFull = false, bFailed = false;
+
+		// Until a pass suspends none, as the running ones may start others.
+		for (bool bNew = true; bNew && !bFull && !bFailed;)
+		{
+			bNew = false;
+
+			thread_act_array_t pThreads;
+			mach_msg_type_number_t nThreads;
+
+			if (task_threads(mach_task_self(), &pThreads, &nThreads) != KERN_SUCCESS) // Of vm_allocate, not the heap.
+			{
+				bFailed = true;
+
+				break;
+			}
+
+			for (mach_msg_type_number_t i = 0; i < nThreads; i++)
+			{
+				const thread_act_t nThread = pThreads[i];
+
+				bool bKeep = false;
+
+				if (nThread != nSelf && std::find(m_vecThreads.begin(), m_vecThreads.end(), static_cast<std::uintptr_t>(nThread)) == m_vecThreads.end())
+				{
+					if (m_vecThreads.size() == m_vecThreads.capacity())
+						bFull = true;
+					else if (thread_suspend(nThread) == KERN_SUCCESS)
+						bKeep = bNew = true;
+				}
+
+				if (bKeep)
+					m_vecThreads.push_back(static_cast<std::uintptr_t>(nThread));
+				else
+					mach_port_deallocate(mach_task_self(), nThread); // The kept ones have a reference already.
+			}
+
+			vm_deallocate(mach_task_self(), reinterpret_cast<vm_address_t>(pThreads), nThreads * sizeof(thread_act_t));
+		}
+
+		if (!bFull && !bFailed)
+		{
+			mach_port_deallocate(mach_task_self(), nSelf);
+
+			m_bSuspended = true;
+
+			return true;
+		}
+
+		ResumeThreads(m_vecThreads);
+
+		if (bFailed)
+			break;
+	}
+
+	mach_port_deallocate(mach_task_self(), nSelf);
+
+	s_mutex.unlock();
+
+	return false;
+}
+
+void CThreadSuspender::Resume() noexcept
+{
+	if (!m_bSuspended)
+		return;
+
+	ResumeThreads(m_vecThreads);
+
+	m_bSuspended = false;
+
+	s_mutex.unlock();
+}
+
+bool CThreadSuspender::VisitThreads(Visitor_t pfnVisit, void *pContext) noexcept
+{
+	if (!m_bSuspended)
+		return false;
+
+	for (const std::uintptr_t nThread : m_vecThreads)
+	{
+#if defined(__x86_64__)
+		x86_thread_state64_t state;
+		mach_msg_type_number_t nCount = x86_THREAD_STATE64_COUNT;
+
+		if (thread_get_state(static_cast<thread_act_t>(nThread), x86_THREAD_STATE64, reinterpret_cast<thread_state_t>(&state), &nCount) != KERN_SUCCESS)
+			return false;
+
+		std::uintptr_t nAddr = static_cast<std::uintptr_t>(state.__rip);
+
+		pfnVisit(pContext, nAddr);
+
+		if (nAddr == state.__rip)
+			continue;
+
+		state.__rip = nAddr;
+
+		if (thread_set_state(static_cast<thread_act_t>(nThread), x86_THREAD_STATE64, reinterpret_cast<thread_state_t>(&state), nCount) != KERN_SUCCESS)
+			return false;
+#elif defined(__aarch64__)
+		arm_thread_state64_t state;
+		mach_msg_type_number_t nCount = ARM_THREAD_STATE64_COUNT;
+
+		if (thread_get_state(static_cast<thread_act_t>(nThread), ARM_THREAD_STATE64, reinterpret_cast<thread_state_t>(&state), &nCount) != KERN_SUCCESS)
+			return false;
+
+		const auto nOld = static_cast<std::uintptr_t>(arm_thread_state64_get_pc(state));
+
+		std::uintptr_t nAddr = nOld;
+
+		pfnVisit(pContext, nAddr);
+
+		if (nAddr == nOld)
+			continue;
+
+		arm_thread_state64_set_pc_fptr(state, reinterpret_cast<void *>(nAddr));
+
+		if (thread_set_state(static_cast<thread_act_t>(nThread), ARM_THREAD_STATE64, reinterpret_cast<thread_state_t>(&state), nCount) != KERN_SUCCESS)
+			return false;
+#else
+#	error "Unsupported architecture"
+#endif
+	}
+
+	return true;
+}
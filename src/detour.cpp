@@ -0,0 +1,950 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#include <dynlibutils/detour.hpp>
+#include <dynlibutils/memaccessor.hpp>
+#include <dynlibutils/memprotector.hpp>
+#include <dynlibutils/threadsuspender.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#	include <intrin.h>
+#endif
+
+namespace DynLibUtils
+{
+
+#if DYNLIBUTILS_ARCH_ARM
+static constexpr bool s_bX86 = false;
+static constexpr bool s_bArm64 = DYNLIBUTILS_ARCH_BITS == 64;
+static constexpr std::size_t s_nMaxDistance = 0x7FF0000; // Of B (±128 MB).
+#else
+static constexpr bool s_bX86 = true;
+static constexpr bool s_bArm64 = false;
+static constexpr bool s_b64 = DYNLIBUTILS_ARCH_BITS == 64;
+static constexpr std::size_t s_nMaxDistance = s_b64 ? 0x7FFF0000 : static_cast<std::size_t>(-1); // Of rel32 (±2 GB).
+#endif
+
+static constexpr std::size_t s_nRelaySize = 16; // Jump to the detour, if it may be out of reach.
+static constexpr std::size_t s_nTrampolineSize = 80;
+static constexpr std::uint8_t s_nNoOffset = 0xFF; // Of an instruction which isn't relocated.
+
+#if !DYNLIBUTILS_ARCH_ARM
+// Modes of the one-byte opcodes.
+enum : std::uint8_t
+{
+	OP_NONE = 0, // No operands.
+	OP_MODRM = 1 << 0,
+	OP_IMM8 = 1 << 1,
+	OP_IMM16 = 1 << 2,
+	OP_IMMZ = 1 << 3, // 16 or 32 bits.
+	OP_REL8 = 1 << 4,
+	OP_RELZ = 1 << 5,
+	OP_PREFIX = 1 << 6,
+	OP_INVALID = 1 << 7,
+};
+
+static constexpr std::uint8_t OP_INVALID64 = OP_INVALID; // Only in the 32-bit mode, marked below.
+
+static constexpr std::array<std::uint8_t, 256> MakeOneByteOpcodes() noexcept
+{
+	std::array<std::uint8_t, 256> aOpcodes {};
+
+	for (std::size_t n = 0x00; n < 0x40; n += 0x08) // ALU.
+	{
+		aOpcodes[n + 0] = aOpcodes[n + 1] = aOpcodes[n + 2] = aOpcodes[n + 3] = OP_MODRM;
+		aOpcodes[n + 4] = OP_IMM8;
+		aOpcodes[n + 5] = OP_IMMZ;
+	}
+
+	aOpcodes[0x26] = aOpcodes[0x2E] = aOpcodes[0x36] = aOpcodes[0x3E] = OP_PREFIX;
+	aOpcodes[0x0F] = OP_NONE; // Escape, handled apart.
+
+	aOpcodes[0x62] = OP_MODRM; // BOUND or EVEX.
+	aOpcodes[0x63] = OP_MODRM;
+	aOpcodes[0x64] = aOpcodes[0x65] = aOpcodes[0x66] = aOpcodes[0x67] = OP_PREFIX;
+	aOpcodes[0x68] = OP_IMMZ;
+	aOpcodes[0x69] = OP_MODRM | OP_IMMZ;
+	aOpcodes[0x6A] = OP_IMM8;
+	aOpcodes[0x6B] = OP_MODRM | OP_IMM8;
+
+	for (std::size_t n = 0x70; n < 0x80; n++)
+		aOpcodes[n] = OP_REL8;
+
+	aOpcodes[0x80] = aOpcodes[0x82] = aOpcodes[0x83] = OP_MODRM | OP_IMM8;
+	aOpcodes[0x81] = OP_MODRM | OP_IMMZ;
+
+	for (std::size_t n = 0x84; n < 0x90; n++)
+		aOpcodes[n] = OP_MODRM;
+
+	aOpcodes[0x9A] = OP_INVALID64; // CALLF, its operand is resolved apart.
+
+	aOpcodes[0xA8] = OP_IMM8;
+	aOpcodes[0xA9] = OP_IMMZ;
+
+	for (std::size_t n = 0xB0; n < 0xB8; n++)
+		aOpcodes[n] = OP_IMM8;
+
+	for (std::size_t n = 0xB8; n < 0xC0; n++)
+		aOpcodes[n] = OP_IMMZ; // Or imm64 with REX.W.
+
+	aOpcodes[0xC0] = aOpcodes[0xC1] = OP_MODRM | OP_IMM8;
+	aOpcodes[0xC2] = aOpcodes[0xCA] = OP_IMM16;
+	aOpcodes[0xC4] = aOpcodes[0xC5] = OP_MODRM; // LES/LDS or VEX.
+	aOpcodes[0xC6] = OP_MODRM | OP_IMM8;
+	aOpcodes[0xC7] = OP_MODRM | OP_IMMZ;
+	aOpcodes[0xC8] = OP_IMM16 | OP_IMM8;
+	aOpcodes[0xCD] = OP_IMM8;
+
+	for (std::size_t n = 0xD0; n < 0xD4; n++)
+		aOpcodes[n] = OP_MODRM;
+
+	aOpcodes[0xD4] = aOpcodes[0xD5] = OP_IMM8;
+
+	for (std::size_t n = 0xD8; n < 0xE0; n++)
+		aOpcodes[n] = OP_MODRM; // x87.
+
+	for (std::size_t n = 0xE0; n < 0xE4; n++)
+		aOpcodes[n] = OP_REL8; // LOOPcc, JrCXZ.
+
+	for (std::size_t n = 0xE4; n < 0xE8; n++)
+		aOpcodes[n] = OP_IMM8;
+
+	aOpcodes[0xE8] = aOpcodes[0xE9] = OP_RELZ;
+	aOpcodes[0xEA] = OP_INVALID64; // JMPF.
+	aOpcodes[0xEB] = OP_REL8;
+
+	aOpcodes[0xF0] = aOpcodes[0xF2] = aOpcodes[0xF3] = OP_PREFIX;
+	aOpcodes[0xF6] = aOpcodes[0xF7] = OP_MODRM; // Immediate by the reg field.
+	aOpcodes[0xFE] = aOpcodes[0xFF] = OP_MODRM;
+
+	return aOpcodes;
+}
+
+static constexpr std::array<std::uint8_t, 256> s_aOneByteOpcodes = MakeOneByteOpcodes();
+
+// Whether a 0F xx opcode has a ModRM byte.
+static constexpr bool HasTwoByteModRM(std::uint8_t nOpcode) noexcept
+{
+	switch (nOpcode)
+	{
+		case 0x05: case 0x06: case 0x07: case 0x08: case 0x09: case 0x0B: case 0x0E:
+		case 0x30: case 0x31: case 0x32: case 0x33: case 0x34: case 0x35: case 0x37:
+		case 0x77:
+		case 0xA0: case 0xA1: case 0xA2: case 0xA8: case 0xA9: case 0xAA:
+			return false;
+
+		default:
+			return !(nOpcode >= 0x80 && nOpcode <= 0x8F) && !(nOpcode >= 0xC8 && nOpcode <= 0xCF);
+	}
+}
+
+// Whether a 0F xx opcode (also of VEX/EVEX map 1) has an imm8.
+static constexpr bool HasTwoByteImm8(std::uint8_t nOpcode) noexcept
+{
+	switch (nOpcode)
+	{
+		case 0x0F: // 3DNow! suffix.
+		case 0x70: case 0x71: case 0x72: case 0x73:
+		case 0xA4: case 0xAC: case 0xBA:
+		case 0xC2: case 0xC4: case 0xC5: case 0xC6:
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Decodes the ModRM (and SIB, displacement) at pCode
+// Output : size of them
+//-----------------------------------------------------------------------------
+static std::size_t DecodeModRM(const std::uint8_t *pCode, std::size_t nOffset, bool bAddress16, Instruction_t &insn) noexcept
+{
+	const std::uint8_t nModRM = pCode[nOffset];
+	const std::uint8_t nMod = nModRM >> 6, nRM = nModRM & 7;
+
+	std::size_t nSize = 1;
+
+	if (nMod == 3)
+		return nSize;
+
+	if (bAddress16)
+	{
+		if (nMod == 1)
+			return nSize + 1;
+
+		if (nMod == 2 || nRM == 6)
+			return nSize + 2;
+
+		return nSize;
+	}
+
+	if (nRM == 4) // SIB.
+	{
+		const std::uint8_t nBase = pCode[nOffset + 1] & 7;
+
+		nSize++;
+
+		if (nMod == 0 && nBase == 5)
+			return nSize + 4;
+	}
+	else if (nMod == 0 && nRM == 5)
+	{
+		if (s_b64)
+		{
+			insn.m_nDispOffset = static_cast<std::uint8_t>(nOffset + nSize);
+			insn.m_bPCRelative = true;
+		}
+
+		return nSize + 4;
+	}
+
+	if (nMod == 1)
+		return nSize + 1;
+
+	if (nMod == 2)
+		return nSize + 4;
+
+	return nSize;
+}
+
+bool DecodeInstruction(const CMemory pCode, Instruction_t &insn) noexcept
+{
+	static constexpr std::size_t s_nMaxLength = 15;
+
+	const auto *pBytes = pCode.RCast<const std::uint8_t *>();
+
+	insn = {};
+
+	if (!pBytes)
+		return false;
+
+	std::size_t n = 0;
+
+	bool bOperand16 = false, bAddressOverride = false, bRexW = false;
+
+	// Legacy prefixes.
+	while (n < s_nMaxLength && s_aOneByteOpcodes[pBytes[n]] & OP_PREFIX)
+	{
+		if (pBytes[n] == 0x66)
+			bOperand16 = true;
+		else if (pBytes[n] == 0x67)
+			bAddressOverride = true;
+
+		n++;
+	}
+
+	const bool bAddress16 = bAddressOverride && !s_b64; // 32-bit addressing of the long mode is decoded the same.
+
+	if (s_b64 && (pBytes[n] & 0xF0) == 0x40) // REX.
+	{
+		bRexW = pBytes[n] & 0x08;
+		n++;
+	}
+
+	const std::size_t nOpcode = n;
+
+	insn.m_nOpcodeOffset = static_cast<std::uint8_t>(nOpcode);
+
+	const std::uint8_t nByte = pBytes[n++];
+
+	std::size_t nImmSize = 0;
+
+	auto funcImmZ = [&]() -> std::size_t { return bOperand16 ? 2 : 4; };
+
+	// VEX and EVEX (LES/LDS/BOUND in the 32-bit mode have a memory operand).
+	if ((nByte == 0xC4 || nByte == 0xC5 || nByte == 0x62) && (s_b64 || (pBytes[n] >> 6) == 3))
+	{
+		std::uint8_t nMap = 1;
+
+		if (nByte == 0xC5)
+		{
+			n += 1;
+		}
+		else if (nByte == 0xC4)
+		{
+			nMap = pBytes[n] & 0x1F;
+			n += 2;
+		}
+		else
+		{
+			nMap = pBytes[n] & 0x07;
+			n += 3;
+		}
+
+		const std::uint8_t nVexOpcode = pBytes[n++];
+
+		if (nMap == 1 && nVexOpcode == 0x77) // VZEROUPPER, VZEROALL.
+		{
+			insn.m_nLength = static_cast<std::uint8_t>(n);
+
+			return true;
+		}
+
+		n += DecodeModRM(pBytes, n, bAddress16, insn);
+
+		if (nMap == 3 || (nMap == 1 && HasTwoByteImm8(nVexOpcode)))
+			nImmSize = 1;
+		else if (nMap != 1 && nMap != 2 && nMap != 5 && nMap != 6)
+			return false;
+	}
+	else if (nByte == 0x0F)
+	{
+		const std::uint8_t nSecond = pBytes[n++];
+
+		if (nSecond == 0x38 || nSecond == 0x3A)
+		{
+			n++; // Opcode of the three-byte maps.
+			n += DecodeModRM(pBytes, n, bAddress16, insn);
+
+			if (nSecond == 0x3A)
+				nImmSize = 1;
+		}
+		else if (nSecond >= 0x80 && nSecond <= 0x8F) // Jcc rel16/32.
+		{
+			insn.m_nRelOffset = static_cast<std::uint8_t>(n);
+			insn.m_nRelSize = static_cast<std::uint8_t>(s_b64 ? 4 : funcImmZ());
+			insn.m_bPCRelative = true;
+
+			nImmSize = insn.m_nRelSize;
+		}
+		else
+		{
+			if (HasTwoByteModRM(nSecond))
+				n += DecodeModRM(pBytes, n, bAddress16, insn);
+
+			if (HasTwoByteImm8(nSecond))
+				nImmSize = 1;
+		}
+	}
+	else
+	{
+		const std::uint8_t nMode = s_aOneByteOpcodes[nByte];
+
+		if (s_b64 && ((nByte < 0x40 && ((nByte & 7) == 6 || (nByte & 7) == 7) && nByte != 0x0F && nByte != 0x26 && nByte != 0x2E && nByte != 0x36 && nByte != 0x3E) || nByte == 0x60 || nByte == 0x61 || nByte == 0x82 || nByte == 0xD4 || nByte == 0xD5 || nMode == OP_INVALID64))
+			return false; // PUSH/POP of segments, DAA/DAS/AAA/AAS, PUSHA/POPA and others invalid in the long mode.
+
+		if (nMode == OP_INVALID64) // CALLF, JMPF of the 32-bit mode.
+		{
+			nImmSize = funcImmZ() + 2;
+		}
+		else if (nByte >= 0xA0 && nByte <= 0xA3) // MOV moffs.
+		{
+			nImmSize = s_b64 ? (bAddressOverride ? 4 : 8) : (bAddressOverride ? 2 : 4);
+		}
+		else
+		{
+			if (nMode & OP_MODRM)
+			{
+				const std::uint8_t nReg = (pBytes[n] >> 3) & 7;
+
+				if ((nByte == 0xF6 || nByte == 0xF7) && nReg < 2) // TEST.
+					nImmSize = nByte == 0xF6 ? 1 : funcImmZ();
+
+				if (nByte == 0xC7 && pBytes[n] == 0xF8) // XBEGIN.
+				{
+					insn.m_nRelOffset = static_cast<std::uint8_t>(n + 1);
+					insn.m_nRelSize = static_cast<std::uint8_t>(funcImmZ());
+					insn.m_bPCRelative = true;
+				}
+
+				n += DecodeModRM(pBytes, n, bAddress16, insn);
+			}
+
+			if (nMode & OP_IMM8)
+				nImmSize += 1;
+
+			if (nMode & OP_IMM16)
+				nImmSize += 2;
+
+			if (nMode & OP_IMMZ)
+				nImmSize += (bRexW && nByte >= 0xB8 && nByte <= 0xBF) ? 8 : funcImmZ();
+
+			if (nMode & (OP_REL8 | OP_RELZ))
+			{
+				insn.m_nRelOffset = static_cast<std::uint8_t>(n);
+				insn.m_nRelSize = static_cast<std::uint8_t>((nMode & OP_REL8) ? 1 : (s_b64 ? 4 : funcImmZ()));
+				insn.m_bPCRelative = true;
+
+				nImmSize = insn.m_nRelSize;
+			}
+		}
+	}
+
+	n += nImmSize;
+
+	if (n > s_nMaxLength)
+		return false;
+
+	insn.m_nLength = static_cast<std::uint8_t>(n);
+
+	return true;
+}
+#elif DYNLIBUTILS_ARCH_BITS == 64
+bool DecodeInstruction(const CMemory pCode, Instruction_t &insn) noexcept
+{
+	insn = {};
+
+	if (!pCode)
+		return false;
+
+	const std::uint32_t nInsn = pCode.Get<std::uint32_t>();
+
+	insn.m_nLength = 4;
+	insn.m_bPCRelative = (nInsn & 0x7C000000) == 0x14000000 || // B, BL.
+	                     (nInsn & 0xFF000010) == 0x54000000 || // B.cond.
+	                     (nInsn & 0x7E000000) == 0x34000000 || // CBZ, CBNZ.
+	                     (nInsn & 0x7E000000) == 0x36000000 || // TBZ, TBNZ.
+	                     (nInsn & 0x3B000000) == 0x18000000 || // LDR (literal), PRFM (literal).
+	                     (nInsn & 0x1F000000) == 0x10000000;   // ADR, ADRP.
+
+	return true;
+}
+#else
+bool DecodeInstruction(const CMemory, Instruction_t &insn) noexcept
+{
+	insn = {};
+
+	return false; // Not supported.
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Purpose: Whether WriteCode can publish the code at nAddr: the first two bytes
+//          are to fit an aligned qword (x86)
+//-----------------------------------------------------------------------------
+static constexpr bool CanWriteCode(std::uintptr_t nAddr) noexcept
+{
+	return !s_bX86 || (nAddr & 7) != 7;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Stores the bytes into the aligned qword at nAligned at once
+//-----------------------------------------------------------------------------
+static void StoreQword(std::uintptr_t nAligned, std::size_t nOffset, const std::uint8_t *pSource, std::size_t nSize) noexcept
+{
+	assert(!(nAligned & 7) && nOffset + nSize <= 8);
+
+	std::uint64_t nWord;
+
+	std::memcpy(&nWord, reinterpret_cast<const void *>(nAligned), sizeof(nWord));
+	std::memcpy(reinterpret_cast<std::uint8_t *>(&nWord) + nOffset, pSource, nSize);
+
+#if defined(_MSC_VER)
+	_InterlockedExchange64(reinterpret_cast<volatile long long *>(nAligned), static_cast<long long>(nWord));
+#else
+	__atomic_store_n(reinterpret_cast<std::uint64_t *>(nAligned), nWord, __ATOMIC_SEQ_CST);
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes the code at pDest (see CanWriteCode), so that a thread which
+//          enters it sees either the old or the new first instruction. The ones
+//          inside the rest of the bytes aren't moved
+//-----------------------------------------------------------------------------
+static void WriteCode(std::uint8_t *pDest, const std::uint8_t *pSource, std::size_t nSize) noexcept
+{
+	if constexpr (s_bX86)
+	{
+		const std::uintptr_t nAddr = reinterpret_cast<std::uintptr_t>(pDest);
+		const std::uintptr_t nAligned = nAddr & ~std::uintptr_t(7);
+
+		assert(CanWriteCode(nAddr));
+
+		if (nAddr + nSize <= nAligned + 8) // Fits an aligned qword, write it at once.
+		{
+			StoreQword(nAligned, nAddr - nAligned, pSource, nSize);
+
+			return;
+		}
+
+		// Park the threads on a "jmp $" for the time the tail is written, the head is stored through its aligned qword.
+		static constexpr std::uint8_t s_aSpin[2] = { 0xEB, 0xFE };
+
+		StoreQword(nAligned, nAddr - nAligned, s_aSpin, sizeof(s_aSpin));
+
+		std::memcpy(pDest + 2, pSource + 2, nSize - 2);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		StoreQword(nAligned, nAddr - nAligned, pSource, sizeof(s_aSpin));
+	}
+	else
+	{
+		assert(nSize == 4 && !(reinterpret_cast<std::uintptr_t>(pDest) & 3));
+
+		std::uint32_t nInsn;
+
+		std::memcpy(&nInsn, pSource, sizeof(nInsn));
+		reinterpret_cast<std::atomic<std::uint32_t> *>(pDest)->store(nInsn);
+	}
+}
+
+#if !DYNLIBUTILS_ARCH_ARM
+static void Emit(std::uint8_t *pOut, std::size_t &nOut, const void *pData, std::size_t nSize) noexcept
+{
+	std::memcpy(pOut + nOut, pData, nSize);
+	nOut += nSize;
+}
+
+static bool EmitRel32(std::uint8_t *pOut, std::size_t &nOut, std::uintptr_t nNext, std::uintptr_t nDest) noexcept
+{
+	const auto nRel = static_cast<std::int64_t>(static_cast<std::intptr_t>(nDest - nNext));
+
+	if (nRel < INT32_MIN || nRel > INT32_MAX)
+		return false;
+
+	const auto nRel32 = static_cast<std::int32_t>(nRel);
+
+	Emit(pOut, nOut, &nRel32, sizeof(nRel32));
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Copies the instructions of [nTarget, nTarget + nPatchSize) to the trampoline
+//          at nTrampoline, fixing the relative ones, then jumps back
+// Input  : pOffsets - gets the offset in the trampoline of each instruction, by its
+//          offset in the target (s_nNoOffset past an unconditional jump)
+// Output : size of the trampoline, 0 on failure
+//-----------------------------------------------------------------------------
+static std::size_t RelocateCode(std::uintptr_t nTarget, std::size_t nPatchSize, std::uintptr_t nTrampoline, std::uint8_t *pOut, std::size_t nMaxSize, std::uint8_t *pOffsets) noexcept
+{
+	static constexpr std::size_t s_nMaxExpandedSize = 6 + 15; // Of an instruction, with the jump back.
+
+	std::size_t nOut = 0;
+
+	for (std::size_t nIn = 0; nIn < nPatchSize;)
+	{
+		if (nOut + s_nMaxExpandedSize > nMaxSize)
+			return 0;
+
+		const std::uintptr_t nAddr = nTarget + nIn;
+		const auto *pInsn = reinterpret_cast<const std::uint8_t *>(nAddr);
+
+		Instruction_t insn;
+
+		if (!DecodeInstruction(CMemory(nAddr), insn))
+			return 0;
+
+		pOffsets[nIn] = static_cast<std::uint8_t>(nOut);
+
+		if (insn.m_nRelOffset)
+		{
+			std::int64_t nRel;
+
+			if (insn.m_nRelSize == 1)
+				nRel = static_cast<std::int8_t>(pInsn[insn.m_nRelOffset]);
+			else if (insn.m_nRelSize == 4)
+				nRel = static_cast<std::int32_t>(pInsn[insn.m_nRelOffset] | pInsn[insn.m_nRelOffset + 1] << 8 | pInsn[insn.m_nRelOffset + 2] << 16 | static_cast<std::uint32_t>(pInsn[insn.m_nRelOffset + 3]) << 24);
+			else
+				return 0; // rel16.
+
+			const std::uintptr_t nDest = nAddr + insn.m_nLength + static_cast<std::uintptr_t>(nRel);
+
+			if (nDest > nTarget && nDest < nTarget + nPatchSize)
+				return 0; // Into the patched instructions.
+
+			const std::uint8_t nOpcode = pInsn[insn.m_nOpcodeOffset];
+
+			if (nOpcode == 0xEB || nOpcode == 0xE9) // JMP.
+			{
+				const std::uint8_t nJmp = 0xE9;
+
+				Emit(pOut, nOut, &nJmp, 1);
+				if (!EmitRel32(pOut, nOut, nTrampoline + nOut + 4, nDest))
+					return 0;
+
+				return nOut; // Nothing past it runs.
+			}
+			else if (nOpcode == 0xE8) // CALL.
+			{
+				Emit(pOut, nOut, pInsn, insn.m_nRelOffset);
+				if (!EmitRel32(pOut, nOut, nTrampoline + nOut + 4, nDest))
+					return 0;
+			}
+			else if ((nOpcode & 0xF0) == 0x70 || nOpcode == 0x0F) // Jcc.
+			{
+				const std::uint8_t aJcc[2] = { 0x0F, static_cast<std::uint8_t>(0x80 | ((nOpcode == 0x0F ? pInsn[insn.m_nOpcodeOffset + 1] : nOpcode) & 0x0F)) };
+
+				Emit(pOut, nOut, aJcc, sizeof(aJcc));
+				if (!EmitRel32(pOut, nOut, nTrampoline + nOut + 4, nDest))
+					return 0;
+			}
+			else
+			{
+				return 0; // LOOPcc, JrCXZ, XBEGIN.
+			}
+		}
+		else if (insn.m_nDispOffset)
+		{
+			const std::int32_t nDisp = static_cast<std::int32_t>(pInsn[insn.m_nDispOffset] | pInsn[insn.m_nDispOffset + 1] << 8 | pInsn[insn.m_nDispOffset + 2] << 16 | static_cast<std::uint32_t>(pInsn[insn.m_nDispOffset + 3]) << 24);
+			const std::uintptr_t nDest = nAddr + insn.m_nLength + static_cast<std::uintptr_t>(static_cast<std::intptr_t>(nDisp));
+			const std::size_t nStart = nOut;
+
+			Emit(pOut, nOut, pInsn, insn.m_nLength);
+
+			const auto nNewDisp = static_cast<std::int64_t>(static_cast<std::intptr_t>(nDest - (nTrampoline + nStart + insn.m_nLength)));
+
+			if (nNewDisp < INT32_MIN || nNewDisp > INT32_MAX)
+				return 0;
+
+			const auto nNewDisp32 = static_cast<std::int32_t>(nNewDisp);
+
+			std::memcpy(pOut + nStart + insn.m_nDispOffset, &nNewDisp32, sizeof(nNewDisp32));
+		}
+		else
+		{
+			Emit(pOut, nOut, pInsn, insn.m_nLength);
+
+			if (pInsn[insn.m_nOpcodeOffset] == 0xC3 || pInsn[insn.m_nOpcodeOffset] == 0xC2 || pInsn[insn.m_nOpcodeOffset] == 0xCC)
+				return 0; // The function ends (or traps) in the patch.
+		}
+
+		nIn += insn.m_nLength;
+	}
+
+	const std::uint8_t nJmp = 0xE9;
+
+	Emit(pOut, nOut, &nJmp, 1);
+	if (!EmitRel32(pOut, nOut, nTrampoline + nOut + 4, nTarget + nPatchSize))
+		return 0;
+
+	return nOut;
+}
+#else
+static void EmitInsn(std::uint8_t *pOut, std::size_t &nOut, std::uint32_t nInsn) noexcept
+{
+	std::memcpy(pOut + nOut, &nInsn, sizeof(nInsn));
+	nOut += sizeof(nInsn);
+}
+
+static void EmitAddress(std::uint8_t *pOut, std::size_t &nOut, std::uint64_t nAddr) noexcept
+{
+	std::memcpy(pOut + nOut, &nAddr, sizeof(nAddr));
+	nOut += sizeof(nAddr);
+}
+
+static constexpr std::int64_t SignExtend(std::uint64_t nValue, unsigned nBits) noexcept
+{
+	return static_cast<std::int64_t>(nValue << (64 - nBits)) >> (64 - nBits);
+}
+
+static constexpr std::uint32_t s_nLdrX17 = 0x58000051; // LDR X17, #8.
+static constexpr std::uint32_t s_nBrX17 = 0xD61F0220;
+static constexpr std::uint32_t s_nBlrX17 = 0xD63F0220;
+
+//-----------------------------------------------------------------------------
+// Purpose: Copies the first instruction to the trampoline, expanding a PC-relative one
+//          to an absolute form, then jumps back
+// Input  : pOffsets - gets the offset in the trampoline of the instruction (0)
+// Output : size of the trampoline, 0 on failure
+//-----------------------------------------------------------------------------
+static std::size_t RelocateCode(std::uintptr_t nTarget, std::size_t nPatchSize, std::uintptr_t nTrampoline, std::uint8_t *pOut, std::size_t nMaxSize, std::uint8_t *pOffsets) noexcept
+{
+	assert(nPatchSize == 4 && nMaxSize >= 48);
+
+	pOffsets[0] = 0;
+
+	const std::uint32_t nInsn = *reinterpret_cast<const std::uint32_t *>(nTarget);
+
+	std::size_t nOut = 0;
+
+	if ((nInsn & 0x7C000000) == 0x14000000) // B, BL.
+	{
+		const std::uintptr_t nDest = nTarget + static_cast<std::uintptr_t>(SignExtend(nInsn & 0x03FFFFFF, 26) * 4);
+
+		if (nInsn & 0x80000000) // BL.
+		{
+			EmitInsn(pOut, nOut, 0x58000071); // LDR X17, #12.
+			EmitInsn(pOut, nOut, s_nBlrX17);
+			EmitInsn(pOut, nOut, 0x14000003); // B #12.
+			EmitAddress(pOut, nOut, nDest);
+		}
+		else
+		{
+			EmitInsn(pOut, nOut, s_nLdrX17);
+			EmitInsn(pOut, nOut, s_nBrX17);
+			EmitAddress(pOut, nOut, nDest);
+
+			return nOut; // Nothing past it runs.
+		}
+	}
+	else if ((nInsn & 0x1F000000) == 0x10000000) // ADR, ADRP.
+	{
+		const std::uint64_t nImm = ((nInsn >> 29) & 3) | ((nInsn >> 3) & 0x1FFFFC);
+		const std::uintptr_t nDest = (nInsn & 0x80000000) ? (nTarget & ~std::uintptr_t(0xFFF)) + static_cast<std::uintptr_t>(SignExtend(nImm, 21) << 12) : nTarget + static_cast<std::uintptr_t>(SignExtend(nImm, 21));
+
+		EmitInsn(pOut, nOut, 0x58000040 | (nInsn & 0x1F)); // LDR Xd, #8.
+		EmitInsn(pOut, nOut, 0x14000003); // B #12.
+		EmitAddress(pOut, nOut, nDest);
+	}
+	else if ((nInsn & 0xFF000010) == 0x54000000 || (nInsn & 0x7E000000) == 0x34000000 || (nInsn & 0x7E000000) == 0x36000000) // B.cond, CBZ/CBNZ, TBZ/TBNZ.
+	{
+		const bool bTest = (nInsn & 0x7E000000) == 0x36000000;
+		const std::uintptr_t nDest = bTest ? nTarget + static_cast<std::uintptr_t>(SignExtend((nInsn >> 5) & 0x3FFF, 14) * 4) : nTarget + static_cast<std::uintptr_t>(SignExtend((nInsn >> 5) & 0x7FFFF, 19) * 4);
+
+		// The same condition to the taken stub past the jump back.
+		EmitInsn(pOut, nOut, bTest ? (nInsn & ~(0x3FFFu << 5)) | (2u << 5) : (nInsn & ~(0x7FFFFu << 5)) | (2u << 5)); // #8.
+		EmitInsn(pOut, nOut, 0x14000005); // B #20.
+		EmitInsn(pOut, nOut, s_nLdrX17);
+		EmitInsn(pOut, nOut, s_nBrX17);
+		EmitAddress(pOut, nOut, nDest);
+	}
+	else if ((nInsn & 0x3B000000) == 0x18000000) // LDR (literal).
+	{
+		return 0;
+	}
+	else
+	{
+		EmitInsn(pOut, nOut, nInsn);
+	}
+
+	EmitInsn(pOut, nOut, s_nLdrX17);
+	EmitInsn(pOut, nOut, s_nBrX17);
+	EmitAddress(pOut, nOut, nTarget + nPatchSize);
+
+	return nOut;
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Purpose: Whether the instruction is a call, which is to be checked for its return
+//          address (x86)
+//-----------------------------------------------------------------------------
+static bool IsCall(const std::uint8_t *pInsn, const Instruction_t &insn) noexcept
+{
+	if constexpr (!s_bX86)
+		return false;
+
+	const std::uint8_t nOpcode = pInsn[insn.m_nOpcodeOffset];
+
+	if (nOpcode == 0xE8 || nOpcode == 0x9A) // CALL rel, CALL far.
+		return true;
+
+	if (nOpcode != 0xFF)
+		return false;
+
+	const std::uint8_t nReg = (pInsn[insn.m_nOpcodeOffset + 1] >> 3) & 7;
+
+	return nReg == 2 || nReg == 3; // CALL r/m, CALL far m.
+}
+
+CExecArena &CDetour::GetArena() noexcept
+{
+	static CExecArena &s_arena = *new CExecArena; // Outlives the static detours, which may unhook on exit.
+
+	return s_arena;
+}
+
+bool CDetour::Hook(const CMemory pTarget, const CMemory pDetour) noexcept
+{
+	assert(!IsHooked());
+
+	if (!pTarget || !pDetour || (!s_bX86 && !s_bArm64))
+		return false;
+
+	const std::uintptr_t nTarget = pTarget.GetAddr();
+
+	if (!CanWriteCode(nTarget))
+		return false;
+
+	// Instructions to replace.
+	std::size_t nPatchSize = 0;
+
+	const std::size_t nJumpSize = s_bX86 ? 5 : 4;
+
+	while (nPatchSize < nJumpSize)
+	{
+		Instruction_t insn;
+
+		if (!DecodeInstruction(pTarget.Offset(nPatchSize), insn))
+			return false;
+
+		if (IsCall(pTarget.Offset(nPatchSize).RCast<const std::uint8_t *>(), insn) && nPatchSize + insn.m_nLength < nJumpSize)
+			return false; // Its callees would return into the jump.
+
+		nPatchSize += insn.m_nLength;
+	}
+
+	if (nPatchSize > s_nMaxPatchSize)
+		return false;
+
+	// Block of [relay][trampoline].
+	CExecArena &arena = GetArena();
+
+	auto *pBlock = static_cast<std::uint8_t *>(arena.Alloc(s_nRelaySize + s_nTrampolineSize, pTarget, s_nMaxDistance));
+
+	if (!pBlock)
+		return false;
+
+	const auto nRelay = reinterpret_cast<std::uintptr_t>(pBlock);
+	const std::uintptr_t nTrampoline = nRelay + s_nRelaySize;
+
+	std::array<std::uint8_t, s_nRelaySize + s_nTrampolineSize> aBlock {};
+
+	std::array<std::uint8_t, s_nMaxPatchSize> aOffsets;
+
+	aOffsets.fill(s_nNoOffset);
+
+	const std::size_t nTrampolineSize = RelocateCode(nTarget, nPatchSize, nTrampoline, aBlock.data() + s_nRelaySize, s_nTrampolineSize, aOffsets.data());
+
+	if (!nTrampolineSize)
+	{
+		arena.Free(pBlock, s_nRelaySize + s_nTrampolineSize);
+
+		return false;
+	}
+
+	std::array<std::uint8_t, s_nMaxPatchSize> aPatch {};
+
+	std::memcpy(aPatch.data(), pTarget.RCast<const void *>(), nPatchSize);
+
+	const std::uint64_t nDetour = pDetour.GetAddr();
+
+	if constexpr (s_bX86)
+	{
+		std::uintptr_t nJumpDest = nRelay;
+
+		if (s_nMaxDistance == static_cast<std::size_t>(-1) || CExecArena::IsNear(pDetour.GetAddr(), 0, nTarget, s_nMaxDistance))
+		{
+			nJumpDest = pDetour.GetAddr(); // In reach of rel32, no relay.
+		}
+		else
+		{
+			static constexpr std::uint8_t s_aJmpAbs[6] = { 0xFF, 0x25, 0x00, 0x00, 0x00, 0x00 }; // JMP [RIP+0].
+
+			std::memcpy(aBlock.data(), s_aJmpAbs, sizeof(s_aJmpAbs));
+			std::memcpy(aBlock.data() + sizeof(s_aJmpAbs), &nDetour, sizeof(nDetour));
+		}
+
+		const auto nRel32 = static_cast<std::int32_t>(nJumpDest - (nTarget + 5));
+
+		aPatch[0] = 0xE9;
+		std::memcpy(&aPatch[1], &nRel32, sizeof(nRel32));
+	}
+	else
+	{
+		static constexpr std::uint32_t s_aJmpAbs[2] = { 0x58000050, 0xD61F0200 }; // LDR X16, #8; BR X16.
+
+		std::memcpy(aBlock.data(), s_aJmpAbs, sizeof(s_aJmpAbs));
+		std::memcpy(aBlock.data() + sizeof(s_aJmpAbs), &nDetour, sizeof(nDetour));
+
+		const std::uint32_t nBranch = 0x14000000 | ((static_cast<std::uint32_t>((nRelay - nTarget) >> 2)) & 0x03FFFFFF); // B.
+
+		std::memcpy(aPatch.data(), &nBranch, sizeof(nBranch));
+	}
+
+	if (!arena.Write(pBlock, aBlock.data(), s_nRelaySize + nTrampolineSize))
+	{
+		arena.Free(pBlock, s_nRelaySize + s_nTrampolineSize);
+
+		return false;
+	}
+
+	{
+		CMemProtector unprotect(pTarget, nPatchSize, ProtFlag::RWX);
+
+		if (!unprotect.IsValid())
+		{
+			arena.Free(pBlock, s_nRelaySize + s_nTrampolineSize);
+
+			return false;
+		}
+
+		// Moves the threads inside the replaced bytes (past the first) to the same instructions in the trampoline.
+		// A single instruction (ARM64) has none.
+		CThreadSuspender suspender;
+
+		if constexpr (s_bX86)
+		{
+			bool bMovable = true;
+
+			auto funcCheck = [&](std::uintptr_t &nIP)
+			{
+				if (nIP > nTarget && nIP < nTarget + nJumpSize && aOffsets[nIP - nTarget] == s_nNoOffset)
+					bMovable = false; // Past a jump, or jumped into.
+			};
+
+			if (!suspender.Suspend() || !suspender.ForEachInstructionPointer(funcCheck) || !bMovable)
+			{
+				suspender.Resume();
+				arena.Free(pBlock, s_nRelaySize + s_nTrampolineSize);
+
+				return false;
+			}
+		}
+
+		std::memcpy(m_aOriginal.data(), pTarget.RCast<const void *>(), nPatchSize);
+
+		WriteCode(pTarget.RCast<std::uint8_t *>(), aPatch.data(), nJumpSize);
+
+		if constexpr (s_bX86)
+		{
+			auto funcMove = [&](std::uintptr_t &nIP)
+			{
+				if (nIP > nTarget && nIP < nTarget + nJumpSize)
+					nIP = nTrampoline + aOffsets[nIP - nTarget];
+			};
+
+			if (!suspender.ForEachInstructionPointer(funcMove))
+			{
+				WriteCode(pTarget.RCast<std::uint8_t *>(), m_aOriginal.data(), nJumpSize); // The moved ones go back by the trampoline.
+
+				suspender.Resume();
+				arena.Free(pBlock, s_nRelaySize + s_nTrampolineSize);
+
+				return false;
+			}
+		}
+	}
+
+	CExecArena::FlushCode(pTarget, nJumpSize);
+
+	SetPtr(pTarget);
+	m_pDetour = pDetour;
+	m_pTrampoline = nTrampoline;
+	m_nPatchSize = nPatchSize;
+	m_aPatch = aPatch;
+
+	return true;
+}
+
+bool CDetour::Unhook() noexcept
+{
+	if (!IsHooked())
+		return false;
+
+	const std::size_t nJumpSize = s_bX86 ? 5 : 4;
+
+	if (std::memcmp(RCast<const void *>(), m_aPatch.data(), nJumpSize))
+		return false; // Patched over.
+
+	{
+		CMemProtector unprotect(*this, m_nPatchSize, ProtFlag::RWX);
+
+		if (!unprotect.IsValid())
+			return false;
+
+		WriteCode(RCast<std::uint8_t *>(), m_aOriginal.data(), nJumpSize);
+	}
+
+	CExecArena::FlushCode(*this, nJumpSize);
+
+	GetArena().Free(m_pTrampoline.RCast<std::uint8_t *>() - s_nRelaySize, s_nRelaySize + s_nTrampolineSize); // Reused after a Collect().
+
+	SetPtr(nullptr);
+	m_pDetour = nullptr;
+	m_pTrampoline = nullptr;
+	m_nPatchSize = 0;
+
+	return true;
+}
+
+} // namespace DynLibUtils
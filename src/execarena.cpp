@@ -0,0 +1,171 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#include <dynlibutils/execarena.hpp>
+#include <dynlibutils/memprotector.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace DynLibUtils;
+
+CExecArena::~CExecArena()
+{
+	for (const auto &region : m_vecRegions)
+		UnmapRegion(region);
+}
+
+CExecArena::Region_t *CExecArena::FindRegion(std::uintptr_t addr) noexcept
+{
+	for (auto &region : m_vecRegions)
+	{
+		if (addr >= region.m_nAddr && addr < region.m_nAddr + s_nRegionSize)
+			return &region;
+	}
+
+	return nullptr;
+}
+
+void *CExecArena::Alloc(std::size_t size, CMemory pNear, std::size_t maxDistance) noexcept
+{
+	size = (size + s_nAlignment - 1) & ~(s_nAlignment - 1);
+
+	if (!size || size > s_nRegionSize)
+		return nullptr;
+
+	const std::uintptr_t nNear = pNear.GetAddr();
+
+	std::lock_guard lock(m_mutex);
+
+	// The collected blocks first.
+	for (auto it = m_vecFree.begin(); it != m_vecFree.end(); ++it)
+	{
+		if (it->m_nSize < size || !IsNear(it->m_nAddr, size, nNear, maxDistance))
+			continue;
+
+		const std::uintptr_t nBlock = it->m_nAddr;
+
+		if (it->m_nSize == size)
+		{
+			m_vecFree.erase(it);
+		}
+		else
+		{
+			it->m_nAddr += size;
+			it->m_nSize -= size;
+		}
+
+		FindRegion(nBlock)->m_nLive += size;
+
+		return reinterpret_cast<void *>(nBlock);
+	}
+
+	for (auto &region : m_vecRegions)
+	{
+		const std::uintptr_t nBlock = region.m_nAddr + region.m_nUsed;
+
+		if (region.m_nUsed + size <= s_nRegionSize && IsNear(nBlock, size, nNear, maxDistance))
+		{
+			region.m_nUsed += size;
+			region.m_nLive += size;
+
+			return reinterpret_cast<void *>(nBlock);
+		}
+	}
+
+	Region_t region;
+
+	if (!MapRegion(nNear, nNear ? (maxDistance > s_nRegionSize ? maxDistance - s_nRegionSize : 0) : static_cast<std::size_t>(-1), region))
+		return nullptr;
+
+	region.m_nUsed = region.m_nLive = size;
+
+	m_vecRegions.push_back(region);
+
+	return reinterpret_cast<void *>(region.m_nAddr);
+}
+
+bool CExecArena::Write(void *pDest, const void *pSource, std::size_t size) noexcept
+{
+	const auto nDest = reinterpret_cast<std::uintptr_t>(pDest);
+
+	{
+		std::lock_guard lock(m_mutex);
+
+		const Region_t *pRegion = FindRegion(nDest);
+
+		if (!pRegion || nDest + size > pRegion->m_nAddr + s_nRegionSize)
+			return false;
+
+		if (pRegion->m_nWriteDelta)
+		{
+			std::memcpy(reinterpret_cast<void *>(nDest + pRegion->m_nWriteDelta), pSource, size);
+		}
+		else
+		{
+			CMemProtector unprotect(pDest, size, ProtFlag::RWX); // Stays executable for the other blocks of the page.
+
+			if (!unprotect.IsValid())
+				return false;
+
+			std::memcpy(pDest, pSource, size);
+		}
+	}
+
+	FlushCode(pDest, size);
+
+	return true;
+}
+
+void CExecArena::Free(void *pBlock, std::size_t size) noexcept
+{
+	if (!pBlock)
+		return;
+
+	size = (size + s_nAlignment - 1) & ~(s_nAlignment - 1);
+
+	std::lock_guard lock(m_mutex);
+
+	m_vecRetired.push_back({ reinterpret_cast<std::uintptr_t>(pBlock), size });
+}
+
+std::size_t CExecArena::Collect() noexcept
+{
+	std::lock_guard lock(m_mutex);
+
+	std::size_t nFreed = 0;
+
+	for (const auto &block : m_vecRetired)
+	{
+		Region_t *pRegion = FindRegion(block.m_nAddr);
+
+		if (!pRegion)
+			continue;
+
+		pRegion->m_nLive -= block.m_nSize;
+		nFreed += block.m_nSize;
+
+		m_vecFree.push_back(block);
+	}
+
+	m_vecRetired.clear();
+
+	// Unmap the empty regions, with their free blocks.
+	auto itEmpty = std::stable_partition(m_vecRegions.begin(), m_vecRegions.end(), [](const Region_t &region) { return region.m_nLive != 0; });
+
+	for (auto it = itEmpty; it != m_vecRegions.end(); ++it)
+	{
+		const std::uintptr_t nStart = it->m_nAddr, nEnd = nStart + s_nRegionSize;
+
+		m_vecFree.erase(std::remove_if(m_vecFree.begin(), m_vecFree.end(), [nStart, nEnd](const Block_t &block) { return block.m_nAddr >= nStart && block.m_nAddr < nEnd; }), m_vecFree.end());
+
+		UnmapRegion(*it);
+	}
+
+	m_vecRegions.erase(itEmpty, m_vecRegions.end());
+
+	return nFreed;
+}
@@ -0,0 +1,121 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#include "os.h"
+
+#include <dynlibutils/execarena.hpp>
+
+#include <sys/syscall.h>
+
+using namespace DynLibUtils;
+
+//-----------------------------------------------------------------------------
+// Purpose: Maps a region with the hints near nNear, alternately above and below,
+//          as the kernel takes a hint when it's free
+//-----------------------------------------------------------------------------
+template<typename F>
+static void *MapNear(std::uintptr_t nNear, std::size_t nMaxDistance, std::size_t nSize, F &&funcMap) noexcept
+{
+	static constexpr std::uintptr_t s_nStep = 0x100000; // Of the hints.
+
+	auto funcTry = [&](std::uintptr_t nHint) -> void *
+	{
+		void *pView = funcMap(reinterpret_cast<void *>(nHint));
+
+		if (pView == MAP_FAILED)
+			return nullptr;
+
+		if (CExecArena::IsNear(reinterpret_cast<std::uintptr_t>(pView), nSize, nNear, nMaxDistance))
+			return pView;
+
+		munmap(pView, nSize);
+
+		return nullptr;
+	};
+
+	if (!nNear)
+		return funcTry(0);
+
+	const std::uintptr_t nLow = nNear > nMaxDistance ? nNear - nMaxDistance : 0;
+	const std::uintptr_t nHigh = nNear + nMaxDistance < nNear ? static_cast<std::uintptr_t>(-1) : nNear + nMaxDistance;
+
+	for (std::uintptr_t nOffset = 0; nOffset < nMaxDistance; nOffset += s_nStep)
+	{
+		const std::uintptr_t nAbove = (nNear & ~(s_nStep - 1)) + nOffset + s_nStep;
+
+		if (nAbove > nNear && nAbove + nSize <= nHigh)
+		{
+			if (void *pView = funcTry(nAbove))
+				return pView;
+		}
+
+		const std::uintptr_t nBelow = (nNear & ~(s_nStep - 1)) - nOffset;
+
+		if (nBelow <= nNear && nBelow >= nLow + s_nStep)
+		{
+			if (void *pView = funcTry(nBelow - s_nStep))
+				return pView;
+		}
+	}
+
+	return nullptr;
+}
+
+bool CExecArena::MapRegion(std::uintptr_t pNear, std::size_t maxDistance, Region_t &region) noexcept
+{
+	region = {};
+
+	// Dual-mapping: the executable view near, the writable one anywhere.
+	int fd = static_cast<int>(syscall(SYS_memfd_create, "dynlibutils", 1u /* MFD_CLOEXEC */));
+
+	if (fd != -1)
+	{
+		void *pView = nullptr;
+
+		if (ftruncate(fd, s_nRegionSize) == 0)
+			pView = MapNear(pNear, maxDistance, s_nRegionSize, [fd](void *pHint) { return mmap(pHint, s_nRegionSize, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0); });
+
+		void *pWritable = pView ? mmap(nullptr, s_nRegionSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+
+		close(fd);
+
+		if (pWritable != MAP_FAILED)
+		{
+			region.m_nAddr = reinterpret_cast<std::uintptr_t>(pView);
+			region.m_nWriteDelta = static_cast<std::ptrdiff_t>(reinterpret_cast<std::uintptr_t>(pWritable) - region.m_nAddr);
+
+			return true;
+		}
+
+		if (pView)
+			munmap(pView, s_nRegionSize);
+	}
+
+	// Flips on writes (memfd is unavailable or can't be executed).
+	void *pView = MapNear(pNear, maxDistance, s_nRegionSize, [](void *pHint) { return mmap(pHint, s_nRegionSize, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0); });
+
+	if (!pView)
+		return false;
+
+	region.m_nAddr = reinterpret_cast<std::uintptr_t>(pView);
+
+	return true;
+}
+
+void CExecArena::UnmapRegion(const Region_t &region) noexcept
+{
+	munmap(reinterpret_cast<void *>(region.m_nAddr), s_nRegionSize);
+
+	if (region.m_nWriteDelta)
+		munmap(reinterpret_cast<void *>(region.m_nAddr + region.m_nWriteDelta), s_nRegionSize);
+}
+
+void CExecArena::FlushCode(void *pCode, std::size_t size) noexcept
+{
+	auto *pBegin = static_cast<char *>(pCode);
+
+	__builtin___clear_cache(pBegin, pBegin + size);
+}
@@ -0,0 +1,130 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#include "os.h"
+
+#include <dynlibutils/mappedimage.hpp>
+
+#include <cerrno>
+#include <cstring>
+
+using namespace DynLibUtils;
+
+static CMappedImage::FileIdentity_t GetStatIdentity(const struct stat& st) noexcept
+{
+	return { static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino), static_cast<std::uint64_t>(st.st_mtim.tv_sec) * 1000000000 + static_cast<std::uint64_t>(st.st_mtim.tv_nsec), static_cast<std::uint64_t>(st.st_size) };
+}
+
+bool CMappedImage::GetFileIdentity(const std::string& sPath, FileIdentity_t& identity) noexcept
+{
+	struct stat st;
+	if (stat(sPath.c_str(), &st) != 0)
+		return false;
+
+	identity = GetStatIdentity(st);
+
+	return true;
+}
+
+bool CMappedImage::Map(const std::string& sPath)
+{
+	int fd = open(sPath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+
+	struct stat st;
+	void* map = MAP_FAILED;
+
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+		map = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+	close(fd); // The mapping keeps the file.
+
+	if (map == MAP_FAILED)
+		return false;
+
+	m_pData = static_cast<const std::uint8_t*>(map);
+	m_nSize = static_cast<std::size_t>(st.st_size);
+	m_identity = GetStatIdentity(st);
+
+	return true;
+}
+
+void CMappedImage::Unmap() noexcept
+{
+	munmap(const_cast<std::uint8_t*>(m_pData), m_nSize);
+}
+
+void* CMappedImage::OpenStream(const std::string& sPath) noexcept
+{
+	int fd = open(sPath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return nullptr;
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE);
+
+	return reinterpret_cast<void*>(static_cast<std::intptr_t>(fd) + 1);
+}
+
+bool CMappedImage::ReadStream(void* pStream, std::size_t nOffset, void* pBuffer, std::size_t nSize) noexcept
+{
+	const int fd = static_cast<int>(reinterpret_cast<std::intptr_t>(pStream) - 1);
+
+	for (auto* pDest = static_cast<std::uint8_t*>(pBuffer); nSize;)
+	{
+		const ssize_t nRead = pread(fd, pDest, nSize, static_cast<off_t>(nOffset));
+
+		if (nRead < 0 && errno == EINTR)
+			continue;
+
+		if (nRead <= 0)
+			return false;
+
+		pDest += nRead;
+		nOffset += static_cast<std::size_t>(nRead);
+		nSize -= static_cast<std::size_t>(nRead);
+	}
+
+	return true;
+}
+
+void CMappedImage::CloseStream(void* pStream) noexcept
+{
+	close(static_cast<int>(reinterpret_cast<std::intptr_t>(pStream) - 1));
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads the ELF section headers of the build class, the names are of .shstrtab
+//-----------------------------------------------------------------------------
+void CMappedImage::ParseSections()
+{
+	const auto* ehdr = GetSpan<ElfW(Ehdr)>(0, 1).begin();
+	if (!ehdr || std::memcmp(ehdr->e_ident, ELFMAG, SELFMAG) || ehdr->e_ident[EI_CLASS] != (sizeof(void*) == 8 ? ELFCLASS64 : ELFCLASS32))
+		return;
+
+	if (ehdr->e_shentsize != sizeof(ElfW(Shdr)) || ehdr->e_shstrndx >= ehdr->e_shnum)
+		return;
+
+	const auto shdrs = GetSpan<ElfW(Shdr)>(ehdr->e_shoff, ehdr->e_shnum);
+	if (shdrs.IsEmpty())
+		return;
+
+	const auto strTab = GetSpan<char>(shdrs[ehdr->e_shstrndx].sh_offset, shdrs[ehdr->e_shstrndx].sh_size);
+
+	m_vecSections.reserve(shdrs.Size());
+
+	for (const auto& shdr : shdrs)
+	{
+		if (shdr.sh_name >= strTab.Size())
+			continue;
+
+		const char* pszName = strTab.begin() + shdr.sh_name;
+		const bool bHasData = shdr.sh_type != SHT_NOBITS && shdr.sh_offset + shdr.sh_size <= m_nSize;
+
+		m_vecSections.push_back({ std::string_view(pszName, strnlen(pszName, strTab.Size() - shdr.sh_name)), static_cast<std::uintptr_t>(shdr.sh_addr), static_cast<std::size_t>(shdr.sh_size), static_cast<std::size_t>(shdr.sh_offset), bHasData ? static_cast<std::size_t>(shdr.sh_size) : 0 });
+	}
+}
@@ -9,8 +9,17 @@
 #include <dynlibutils/memaccessor.hpp>
 #include <dynlibutils/memprotector.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstring>
-#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 using namespace DynLibUtils;
 
@@ -20,42 +29,349 @@ struct region_t {
 	ProtFlag prot;
 };
 
-static region_t GetRegionFromAddr(uintptr_t addr)
+static constexpr size_t s_read_batch = 256; // Of IOV_MAX (1024) at most.
+
+//-----------------------------------------------------------------------------
+// Purpose: Checks whether the page of the address is mapped, by mincore (it's
+//          ENOMEM for a hole) rather than by parsing the maps
+//-----------------------------------------------------------------------------
+static bool IsMapped(uintptr_t addr) noexcept
 {
-	region_t res{};
+	static const auto pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+	unsigned char resident;
+	return mincore(reinterpret_cast<void*>(MemoryRound(addr, pageSize)), 1, &resident) == 0 || errno != ENOMEM;
+}
 
-	std::ifstream f("/proc/self/maps");
-	std::string s;
-	while (std::getline(f, s))
+//-----------------------------------------------------------------------------
+// Purpose: A sorted snapshot of /proc/self/maps. It's parsed again when an address
+//          misses it in a mapped page (a new mapping) or a read by it faults (an
+//          unmapping or mprotect elsewhere), and is kept in sync with our own
+//          mprotect calls. An address in a hole costs a mincore, not a parse
+//-----------------------------------------------------------------------------
+class CRegionMap
+{
+public:
+	region_t Find(uintptr_t addr) noexcept
 	{
-		if (!s.empty() && s.find("vdso") == std::string::npos && s.find("vsyscall") == std::string::npos)
 		{
-			char* strend = &s[0];
-			uintptr_t start = strtoul(strend  , &strend, 16);
-			uintptr_t end   = strtoul(strend+1, &strend, 16);
-			if (start != 0 && end != 0 && start <= addr && addr < end)
+			std::shared_lock lock(m_mutex);
+
+			if (m_valid)
 			{
-				res.start = start;
-				res.end = end;
+				region_t res;
+				if (Lookup(addr, res))
+					return res;
 
-				++strend;
-				if (strend[0] == 'r')
-					res.prot = res.prot | ProtFlag::R;
-	
-				if (strend[1] == 'w')
-					res.prot = res.prot | ProtFlag::W;
-	
-				if (strend[2] == 'x')
-					res.prot = res.prot | ProtFlag::X;
+				if (!IsMapped(addr))
+					return {};
+			}
+		}
 
-				if (res.prot == ProtFlag::UNSET)
-					res.prot = ProtFlag::N;
+		std::unique_lock lock(m_mutex);
 
-				break;
+		Parse();
+
+		region_t res{};
+		Lookup(addr, res);
+		return res;
+	}
+
+	// Sets the readable sizes of the reads by one snapshot, it's parsed again once at most.
+	void Validate(CMemAccessor::SafeRead_t* reads, size_t count) noexcept
+	{
+		bool missed = false;
+
+		{
+			std::shared_lock lock(m_mutex);
+
+			missed = !m_valid || !ValidateAll(reads, count);
+		}
+
+		if (!missed)
+			return;
+
+		std::unique_lock lock(m_mutex);
+
+		Parse();
+		ValidateAll(reads, count);
+	}
+
+	// Parses it again as the reads of the indices have faulted, and sets their readable sizes.
+	void Revalidate(CMemAccessor::SafeRead_t* reads, const size_t* indices, size_t count) noexcept
+	{
+		std::unique_lock lock(m_mutex);
+
+		Parse();
+
+		for (size_t i = 0; i < count; ++i)
+			ValidateAll(&reads[indices[i]], 1);
+	}
+
+	void Apply(uintptr_t start, uintptr_t end, ProtFlag prot) noexcept
+	{
+		std::unique_lock lock(m_mutex);
+
+		if (!m_valid || start >= end)
+			return;
+
+		// Split the regions at the bounds, then overwrite the protection in between.
+		if (!Split(start) || !Split(end))
+		{
+			m_valid = false; // Out of memory, parsed again on the next lookup.
+			return;
+		}
+
+		auto it = std::lower_bound(m_regions.begin(), m_regions.end(), start, [](const region_t& region, uintptr_t value) { return region.start < value; });
+		for (; it != m_regions.end() && it->start < end; ++it)
+			it->prot = prot;
+	}
+
+	void Invalidate() noexcept
+	{
+		std::unique_lock lock(m_mutex);
+
+		m_valid = false;
+	}
+
+private:
+	// Returns false if a source misses the snapshot in a mapped page.
+	bool ValidateAll(CMemAccessor::SafeRead_t* reads, size_t count) const noexcept
+	{
+		bool found = true;
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			auto& read = reads[i];
+
+			region_t region;
+			if (!Lookup(read.m_pSrc, region))
+			{
+				read.m_nRead = 0;
+				found = found && !IsMapped(read.m_pSrc);
+				continue;
 			}
+
+			read.m_nRead = (region.prot & ProtFlag::R) ? std::min<uintptr_t>(region.end - read.m_pSrc, read.m_nSize) : 0;
 		}
+
+		return found;
 	}
-	return res;
+
+	bool Lookup(uintptr_t addr, region_t& res) const noexcept
+	{
+		auto it = std::upper_bound(m_regions.begin(), m_regions.end(), addr, [](uintptr_t value, const region_t& region) { return value < region.start; });
+		if (it == m_regions.begin())
+			return false;
+
+		--it;
+		if (addr >= it->end)
+			return false;
+
+		res = *it;
+		return true;
+	}
+
+	// Returns false if it's out of memory.
+	bool Split(uintptr_t addr) noexcept
+	{
+		auto it = std::upper_bound(m_regions.begin(), m_regions.end(), addr, [](uintptr_t value, const region_t& region) { return value < region.start; });
+		if (it == m_regions.begin())
+			return true;
+
+		auto prev = std::prev(it);
+		if (addr <= prev->start || addr >= prev->end)
+			return true;
+
+		region_t tail = { addr, prev->end, prev->prot };
+
+		try
+		{
+			it = m_regions.insert(it, tail);
+		}
+		catch (const std::bad_alloc&)
+		{
+			return false;
+		}
+
+		std::prev(it)->end = addr;
+		return true;
+	}
+
+	// Adds the region of a line of the maps, returns false if it's out of memory.
+	bool ParseLine(std::string_view line) noexcept
+	{
+		if (line.empty() || line.find("vdso") != std::string_view::npos || line.find("vsyscall") != std::string_view::npos)
+			return true;
+
+		char* strend = const_cast<char*>(line.data());
+		uintptr_t start = strtoul(strend  , &strend, 16);
+		uintptr_t end   = strtoul(strend+1, &strend, 16);
+		if (start == 0 || end == 0 || static_cast<size_t>(strend + 4 - line.data()) > line.size())
+			return true;
+
+		region_t region{start, end, ProtFlag::UNSET};
+
+		++strend;
+		if (strend[0] == 'r')
+			region.prot = region.prot | ProtFlag::R;
+
+		if (strend[1] == 'w')
+			region.prot = region.prot | ProtFlag::W;
+
+		if (strend[2] == 'x')
+			region.prot = region.prot | ProtFlag::X;
+
+		if (region.prot == ProtFlag::UNSET)
+			region.prot = ProtFlag::N;
+
+		try
+		{
+			m_regions.push_back(region);
+		}
+		catch (const std::bad_alloc&)
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+	// Reads the maps by a chunk on the stack, a line longer than it (of a path) is cut.
+	void Parse() noexcept
+	{
+		m_regions.clear();
+		m_valid = false;
+
+		int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+			return;
+
+		char chunk[16384];
+		size_t size = 0;
+		bool skip = false, ok = true; // Skips the rest of a cut line.
+		ssize_t n;
+		while (ok && (n = read(fd, chunk + size, sizeof(chunk) - size)) > 0)
+		{
+			size += static_cast<size_t>(n);
+
+			size_t pos = 0;
+			for (const char* eol; ok && (eol = static_cast<const char*>(std::memchr(chunk + pos, '\n', size - pos)));)
+			{
+				const std::string_view line(chunk + pos, static_cast<size_t>(eol - chunk) - pos);
+				pos = static_cast<size_t>(eol - chunk) + 1;
+
+				if (!std::exchange(skip, false))
+					ok = ParseLine(line);
+			}
+
+			if (pos == 0 && size == sizeof(chunk))
+			{
+				ok = skip || ParseLine(std::string_view(chunk, size));
+				skip = true;
+				pos = size;
+			}
+
+			std::memmove(chunk, chunk + pos, size - pos);
+			size -= pos;
+		}
+
+		close(fd);
+
+		if (ok && !skip && size)
+			ok = ParseLine(std::string_view(chunk, size));
+
+		if (!ok)
+		{
+			m_regions.clear(); // Out of memory, nothing is found.
+			return;
+		}
+
+		m_valid = true; // The kernel lists them sorted.
+	}
+
+	std::shared_mutex m_mutex;
+	std::vector<region_t> m_regions;
+	bool m_valid = false;
+}; // class CRegionMap
+
+static CRegionMap s_regions;
+
+static region_t GetRegionFromAddr(uintptr_t addr) noexcept
+{
+	return s_regions.Find(addr);
+}
+
+static std::atomic<bool> s_vm_readv{true}; // Unless the syscall is unavailable (seccomp).
+
+//-----------------------------------------------------------------------------
+// Purpose: Copies the readable sizes of the reads (s_read_batch at most) through
+//          the kernel, so that a source unmapped or protected since the snapshot
+//          fails instead of faulting. The ones which fail are zeroed and their
+//          indices are put in faulted. Falls back to memcpy if process_vm_readv
+//          is unavailable
+// Output : The number of the faulted ones
+//-----------------------------------------------------------------------------
+static size_t ReadRanges(CMemAccessor::SafeRead_t* reads, size_t count, size_t* faulted) noexcept
+{
+	iovec local[s_read_batch], remote[s_read_batch];
+	size_t indices[s_read_batch];
+
+	const pid_t pid = getpid();
+
+	size_t n = 0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		auto& read = reads[i];
+		if (!read.m_nRead)
+			continue;
+
+		local[n] = { read.m_pDest, read.m_nRead };
+		remote[n] = { read.m_pSrc, read.m_nRead };
+		indices[n++] = i;
+	}
+
+	size_t nfaulted = 0;
+
+	// A transfer stops before the element which faults, it never splits one.
+	size_t k = 0;
+	while (k < n)
+	{
+		if (!s_vm_readv.load(std::memory_order_relaxed))
+		{
+			for (; k < n; ++k)
+				std::memcpy(local[k].iov_base, remote[k].iov_base, local[k].iov_len);
+
+			break;
+		}
+
+		const ssize_t res = process_vm_readv(pid, &local[k], n - k, &remote[k], n - k, 0);
+		if (res < 0)
+		{
+			if (errno == ENOSYS || errno == EPERM)
+			{
+				s_vm_readv.store(false, std::memory_order_relaxed);
+				continue;
+			}
+
+			if (errno == EINTR)
+				continue;
+		}
+		else
+		{
+			size_t left = static_cast<size_t>(res);
+			for (; k < n && left >= remote[k].iov_len; ++k)
+				left -= remote[k].iov_len;
+
+			if (k == n)
+				break;
+		}
+
+		reads[indices[k]].m_nRead = 0;
+		faulted[nfaulted++] = indices[k++];
+	}
+
+	return nfaulted;
 }
 
 bool CMemAccessor::MemCopy(CMemory dest, CMemory src, size_t size)
@@ -82,18 +398,45 @@ bool CMemAccessor::SafeMemCopy(CMemory dest, CMemory src, size_t size, size_t& w
 
 bool CMemAccessor::SafeMemRead(CMemory src, CMemory dest, size_t size, size_t& read) noexcept
 {
-	region_t region_infos = GetRegionFromAddr(src);
-	
-	// Make sure that the region we query is readable
-	if (!(region_infos.prot & ProtFlag::R))
-		return false;
+	SafeRead_t range{ src, dest, size };
 
-	size = std::min<uintptr_t>(region_infos.end - src, size);
+	const bool res = SafeMemReadV(&range, 1) != 0;
+	read = range.m_nRead;
 
-	std::memcpy(dest, src, size);
-	read = size;
+	return res;
+}
 
-	return true;
+//-----------------------------------------------------------------------------
+// Purpose: Bounds the reads by the snapshot, then reads them checked. The ones
+//          which fault are bounded by a fresh snapshot and read again once
+//-----------------------------------------------------------------------------
+size_t CMemAccessor::SafeMemReadV(SafeRead_t* reads, size_t count) noexcept
+{
+	s_regions.Validate(reads, count);
+
+	size_t faulted[s_read_batch];
+
+	for (size_t i = 0; i < count; i += s_read_batch)
+	{
+		auto* batch = &reads[i];
+
+		const size_t nfaulted = ReadRanges(batch, std::min(count - i, s_read_batch), faulted);
+		if (!nfaulted)
+			continue;
+
+		s_regions.Revalidate(batch, faulted, nfaulted);
+
+		size_t again;
+		for (size_t k = 0; k < nfaulted; ++k)
+			ReadRanges(&batch[faulted[k]], 1, &again);
+	}
+
+	size_t done = 0;
+
+	for (size_t i = 0; i < count; ++i)
+		done += reads[i].m_nRead != 0;
+
+	return done;
 }
 
 ProtFlag CMemAccessor::MemProtect(CMemory dest, size_t size, ProtFlag prot, bool& status)
@@ -103,5 +446,12 @@ ProtFlag CMemAccessor::MemProtect(CMemory dest, size_t size, ProtFlag prot, bool
 	uintptr_t alignedDest = MemoryRound(dest, pageSize);
 	uintptr_t alignedSize = MemoryRoundUp(size, pageSize);
 	status = mprotect(reinterpret_cast<void*>(alignedDest), alignedSize, TranslateProtection(prot)) == 0;
+	if (status)
+		s_regions.Apply(alignedDest, alignedDest + alignedSize, TranslateProtection(TranslateProtection(prot))); // As the maps would list it.
 	return regionInfo.prot;
 }
+
+void CMemAccessor::InvalidateRegions() noexcept
+{
+	s_regions.Invalidate();
+}
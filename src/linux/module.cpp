@@ -5,19 +5,29 @@
 //
 
 #include "os.h"
+#include "moduleregistry.h"
 
 #include <dynlibutils/module.hpp>
 #include <dynlibutils/memaddr.hpp>
 
+#include <algorithm>
+#include <array>
 #include <cstring>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace DynLibUtils;
 
 template<typename Mutex>
 CAssemblyModule<Mutex>::~CAssemblyModule()
 {
+	CloseResolves();
+
 	if (IsValid())
-		dlclose(GetPtr());
+	{
+		SaveCacheFile();
+		Unload();
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -39,30 +49,13 @@ bool CAssemblyModule<Mutex>::InitFromName(const std::string_view svModuleName, b
 	if (!bExtension)
 		sModuleName.append(".so");
 
-	struct dl_data
-	{
-		ElfW(Addr) addr;
-		const char* moduleName;
-		const char* modulePath;
-	} dldata{ 0, sModuleName.c_str(), {} };
-
-	dl_iterate_phdr([](dl_phdr_info* info, std::size_t /* size */, void* data)
-	{
-		dl_data* dldata = reinterpret_cast<dl_data*>(data);
-
-		if (std::strstr(info->dlpi_name, dldata->moduleName) != nullptr)
-		{
-			dldata->addr = info->dlpi_addr;
-			dldata->modulePath = info->dlpi_name;
-		}
+	const auto pObject = CModuleRegistry::Get().FindByName(sModuleName);
 
-		return 0;
-	}, &dldata);
-
-	if (!dldata.addr)
+	if (!pObject || !pObject->GetBase())
 		return false;
 
-	if (!LoadFromPath(dldata.modulePath))
+	// Loaded already: it's referenced, not loaded again.
+	if (!LoadFromPath(pObject->GetPath(), RTLD_LAZY | RTLD_NOLOAD))
 		return false;
 
 	return true;
@@ -83,22 +76,24 @@ bool CAssemblyModule<Mutex>::InitFromMemory(const CMemory& pModuleMemory, bool b
 		return false;
 
 	Dl_info info;
-	if (!dladdr(pModuleMemory, &info) || !info.dli_fbase || !info.dli_fname)
+	link_map* lmap;
+	if (!dladdr1(pModuleMemory, &info, reinterpret_cast<void**>(&lmap), RTLD_DL_LINKMAP) || !info.dli_fbase || !info.dli_fname)
 		return false;
 
-	if (!LoadFromPath(info.dli_fname))
+	// The program (which the loader names "") isn't opened by its path.
+	if (!LoadFromPath(lmap->l_name[0] ? std::string_view(info.dli_fname) : std::string_view()))
 		return false;
 
 	return true;
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: Initializes a module descriptors
+// Purpose: Initializes a module descriptors (of the program if the path is empty)
 //-----------------------------------------------------------------------------
 template<typename Mutex>
 bool CAssemblyModule<Mutex>::LoadFromPath(const std::string_view svModelePath, int flags)
 {
-	void* handle = dlopen(svModelePath.data(), flags);
+	void* handle = dlopen(svModelePath.empty() ? nullptr : svModelePath.data(), flags);
 	if (!handle)
 	{
 		SaveLastError();
@@ -112,44 +107,43 @@ bool CAssemblyModule<Mutex>::LoadFromPath(const std::string_view svModelePath, i
 		return false;
 	}
 
-	int fd = open(lmap->l_name, O_RDONLY);
-	if (fd == -1)
+	const auto pObject = CModuleRegistry::Get().FindByBase(lmap->l_addr);
+	const auto* pMetadata = pObject ? pObject->GetMetadata() : nullptr;
+
+	// Isn't in the snapshot: of the file, as the loader has it.
+	std::unique_ptr<const CModuleRegistry::Metadata_t> pFileMetadata;
+
+	if (!pMetadata)
 	{
-		dlclose(handle);
-		return false;
+		pFileMetadata = CModuleRegistry::ReadFile(lmap->l_name[0] ? lmap->l_name : "/proc/self/exe");
+		pMetadata = pFileMetadata.get();
 	}
 
-	struct stat st;
-	if (fstat(fd, &st) == 0)
+	if (!pMetadata)
 	{
-		void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-		if (map != MAP_FAILED)
-		{
-			ElfW(Ehdr)* ehdr = static_cast<ElfW(Ehdr)*>(map);
-			ElfW(Shdr)* shdrs = reinterpret_cast<ElfW(Shdr)*>(reinterpret_cast<std::uintptr_t>(ehdr) + ehdr->e_shoff);
-			const char* strTab = reinterpret_cast<const char*>(reinterpret_cast<std::uintptr_t>(ehdr) + shdrs[ehdr->e_shstrndx].sh_offset);
+		dlclose(handle);
+		return false;
+	}
 
-			for (auto i = 0; i < ehdr->e_shnum; ++i) // Loop through the sections.
-			{
-				ElfW(Shdr)* shdr = reinterpret_cast<ElfW(Shdr)*>(reinterpret_cast<std::uintptr_t>(shdrs) + i * ehdr->e_shentsize);
-				if (*(strTab + shdr->sh_name) == '\0')
-					continue;
+	m_pImage = pMetadata->m_pImage;
+	m_bStaleFile = !m_pImage;
 
-				m_vecSections.emplace_back(static_cast<std::uintptr_t>(lmap->l_addr + shdr->sh_addr), shdr->sh_size, strTab + shdr->sh_name);
-			}
+	m_vecSections.clear();
+	m_vecSections.reserve(pMetadata->m_vecSections.size());
 
-			munmap(map, st.st_size);
-		}
-	}
+	for (const auto* pSection : pMetadata->m_vecSections)
+		m_vecSections.emplace_back(static_cast<std::uintptr_t>(lmap->l_addr + pSection->m_nAddress), pSection->m_nSize, pSection->m_svName);
 
-	close(fd);
+	m_symbols = pMetadata->m_symbols;
 
 	SetPtr(handle);
 	m_sPath.assign(svModelePath);
 
-	m_pExecutableSection = GetSectionByName(".text");
+	IndexSections({ ".text", ".rodata", ".data.rel.ro", ".data.rel.ro.local", ".data" });
 	assert(m_pExecutableSection != nullptr);
 
+	LoadCacheFile();
+
 	return true;
 }
 
@@ -171,7 +165,7 @@ CMemory CAssemblyModule<Mutex>::GetVirtualTable(const std::string_view svTableNa
 	if (svTableName.empty())
 		return DYNLIB_INVALID_MEMORY;
 
-	const Section_t *pReadOnlyData = GetSectionByName(".rodata"), *pReadOnlyRelocations = GetSectionByName(".data.rel.ro");
+	const Section_t *pReadOnlyData = GetSection(SectionKind::ReadOnlyData), *pReadOnlyRelocations = GetSection(SectionKind::ReadOnlyRelocations);
 
 	assert(pReadOnlyData != nullptr);
 	assert(pReadOnlyRelocations != nullptr);
@@ -180,6 +174,11 @@ CMemory CAssemblyModule<Mutex>::GetVirtualTable(const std::string_view svTableNa
 		return DYNLIB_INVALID_MEMORY;
 
 	std::string sDecoratedTableName(bDecorated ? svTableName : std::to_string(svTableName.length()) + std::string(svTableName));
+
+	if (const auto pTypes = GetTypes())
+		if (const auto* pTable = pTypes->Find(sDecoratedTableName).GetPrimary())
+			return GetBase() + pTable->m_nOffset;
+
 	std::string sMask(sDecoratedTableName.length() + 1, 'x');
 
 	CMemory typeInfoName = FindPattern(sDecoratedTableName.data(), sMask, nullptr, pReadOnlyData);
@@ -192,9 +191,9 @@ CMemory CAssemblyModule<Mutex>::GetVirtualTable(const std::string_view svTableNa
 
 	CMemory typeInfo = referenceTypeName.Offset(-0x8); // Offset -0x8 to typeinfo.
 
-	for (const auto& sectionName : { std::string_view(".data.rel.ro"), std::string_view(".data.rel.ro.local") })
+	for (const auto eKind : { SectionKind::ReadOnlyRelocations, SectionKind::ReadOnlyRelocationsLocal })
 	{
-		const Section_t *pSection = GetSectionByName(sectionName);
+		const Section_t *pSection = GetSection(eKind);
 		if (!pSection)
 			continue;
 
@@ -213,6 +212,207 @@ CMemory CAssemblyModule<Mutex>::GetVirtualTable(const std::string_view svTableNa
 	return DYNLIB_INVALID_MEMORY;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Indexes the vtables by the Itanium RTTI: type_info objects start with
+//          a vtable of the __cxxabiv1 classes and the vtables are
+//          [offset to top][type_info*][virtual functions...]. The base pointers of
+//          the class type_infos aren't vtables, nor are the construction vtables
+//          (of the bases in a class with virtual bases): they're told by the VTTs,
+//          which list the address point of the primary vtable of a class first and
+//          the ones of its construction vtables (of the other types) after it
+// Output : count of the indexed types
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+std::size_t CAssemblyModule<Mutex>::BuildTypeIndex()
+{
+	if (!IsValid())
+		return PublishTypes(nullptr);
+
+	// __class_type_info, __si_class_type_info, __vmi_class_type_info.
+	const std::array<std::string_view, 3> aTypeInfoNames { "_ZTVN10__cxxabiv117__class_type_infoE", "_ZTVN10__cxxabiv120__si_class_type_infoE", "_ZTVN10__cxxabiv121__vmi_class_type_infoE" };
+
+	std::array<std::uintptr_t, 3> aTypeInfoVTables {};
+
+	bool bTypeInfoVTables = false;
+
+	for (std::size_t n = 0; n < aTypeInfoNames.size(); ++n)
+	{
+		CMemory pVTable = GetSymbol(aTypeInfoNames[n]);
+
+		if (!pVTable)
+			pVTable = GetFunction(aTypeInfoNames[n]); // Of libstdc++ generally.
+
+		if (pVTable)
+		{
+			aTypeInfoVTables[n] = pVTable.GetAddr() + 2 * sizeof(void*); // Past offset to top and type_info.
+			bTypeInfoVTables = true;
+		}
+	}
+
+	if (!bTypeInfoVTables)
+		return PublishTypes(nullptr);
+
+	std::vector<const Section_t*> vecSections;
+
+	for (const auto eKind : { SectionKind::ReadOnlyRelocations, SectionKind::ReadOnlyRelocationsLocal, SectionKind::ReadOnlyData, SectionKind::Data })
+		if (const Section_t* pSection = GetSection(eKind); pSection && pSection->m_nSectionSize) // Of the names too, however small.
+			vecSections.push_back(pSection);
+
+	auto funcFindSection = [&](std::uintptr_t nAddr) -> const Section_t*
+	{
+		for (const auto* pSection : vecSections)
+			if (const auto nSectionAddr = static_cast<std::uintptr_t>(pSection->GetAddr()); nAddr >= nSectionAddr && nAddr < nSectionAddr + pSection->m_nSectionSize)
+				return pSection;
+
+		return nullptr;
+	};
+
+	// type_info -> name.
+	std::unordered_map<std::uintptr_t, std::string_view> mapTypeInfos;
+
+	// The words of the type_infos which point to the ones of the bases.
+	std::unordered_set<std::uintptr_t> setBaseSlots;
+
+	for (const auto* pSection : vecSections)
+	{
+		const auto* pWords = pSection->RCast<const std::uintptr_t*>();
+		const std::size_t nWords = pSection->m_nSectionSize / sizeof(std::uintptr_t);
+
+		for (std::size_t i = 0; i + 1 < nWords; ++i)
+		{
+			const auto itKind = std::find(aTypeInfoVTables.begin(), aTypeInfoVTables.end(), pWords[i]);
+			if (!pWords[i] || itKind == aTypeInfoVTables.end())
+				continue;
+
+			const Section_t* pNameSection = funcFindSection(pWords[i + 1]);
+			if (!pNameSection)
+				continue;
+
+			const auto* pszName = reinterpret_cast<const char*>(pWords[i + 1]);
+			const std::size_t nMaxSize = static_cast<std::uintptr_t>(pNameSection->GetAddr()) + pNameSection->m_nSectionSize - pWords[i + 1];
+
+			std::string_view svName(pszName, strnlen(pszName, nMaxSize));
+
+			if (!svName.empty() && svName.front() == '*') // Of the local types.
+				svName.remove_prefix(1);
+
+			if (svName.empty())
+				continue;
+
+			mapTypeInfos.emplace(reinterpret_cast<std::uintptr_t>(&pWords[i]), svName);
+
+			switch (itKind - aTypeInfoVTables.begin())
+			{
+				case 1: // [vtable][name][base type_info*].
+				{
+					if (i + 2 < nWords)
+						setBaseSlots.insert(reinterpret_cast<std::uintptr_t>(&pWords[i + 2]));
+
+					break;
+				}
+
+				case 2: // [vtable][name][unsigned flags][unsigned base count]{[base type_info*][long offset flags]}...
+				{
+					if (i + 3 > nWords)
+						break;
+
+					const auto* pFlags = reinterpret_cast<const std::uint32_t*>(&pWords[i + 2]);
+					const auto* pBases = reinterpret_cast<const std::uintptr_t*>(pFlags + 2);
+					const std::size_t nBases = pFlags[1], nBasesMax = (nWords * sizeof(std::uintptr_t) - (reinterpret_cast<std::uintptr_t>(pBases) - reinterpret_cast<std::uintptr_t>(pWords))) / (2 * sizeof(std::uintptr_t));
+
+					for (std::size_t n = 0; n < std::min(nBases, nBasesMax); ++n)
+						setBaseSlots.insert(reinterpret_cast<std::uintptr_t>(&pBases[2 * n]));
+
+					break;
+				}
+			}
+		}
+	}
+
+	struct Candidate_t
+	{
+		std::string_view m_svName;
+		std::uintptr_t m_nAddressPoint; // Of the first virtual function.
+		std::ptrdiff_t m_nOffsetToTop;
+	};
+
+	std::vector<Candidate_t> vecCandidates;
+
+	for (const auto* pSection : vecSections)
+	{
+		const auto* pWords = pSection->RCast<const std::uintptr_t*>();
+		const std::size_t nWords = pSection->m_nSectionSize / sizeof(std::uintptr_t);
+
+		for (std::size_t i = 1; i + 1 < nWords; ++i)
+		{
+			auto it = mapTypeInfos.find(pWords[i]);
+			if (it == mapTypeInfos.end() || setBaseSlots.count(reinterpret_cast<std::uintptr_t>(&pWords[i])))
+				continue;
+
+			// Offset to top of a secondary vtable is negative.
+			const auto nOffsetToTop = static_cast<std::intptr_t>(pWords[i - 1]);
+			if (nOffsetToTop > 0 || nOffsetToTop < -(std::intptr_t(1) << 24))
+				continue;
+
+			vecCandidates.push_back({ it->second, reinterpret_cast<std::uintptr_t>(&pWords[i + 1]), nOffsetToTop });
+		}
+	}
+
+	// Address point -> candidate.
+	std::unordered_map<std::uintptr_t, std::size_t> mapAddressPoints;
+
+	for (std::size_t n = 0; n < vecCandidates.size(); ++n)
+		mapAddressPoints.emplace(vecCandidates[n].m_nAddressPoint, n);
+
+	std::vector<bool> vecConstruction(vecCandidates.size());
+
+	// VTTs are in the relocated read-only data, as the construction vtables.
+	for (const auto eKind : { SectionKind::ReadOnlyRelocations, SectionKind::ReadOnlyRelocationsLocal })
+	{
+		const Section_t* pSection = GetSection(eKind);
+		if (!pSection)
+			continue;
+
+		const auto* pWords = pSection->RCast<const std::uintptr_t*>();
+		const std::size_t nWords = pSection->m_nSectionSize / sizeof(std::uintptr_t);
+
+		for (std::size_t i = 0; i < nWords; ++i)
+		{
+			auto it = mapAddressPoints.find(pWords[i]);
+			if (it == mapAddressPoints.end() || vecCandidates[it->second].m_nOffsetToTop)
+				continue;
+
+			const std::string_view svComplete = vecCandidates[it->second].m_svName;
+
+			std::size_t j = i + 1;
+
+			for (; j < nWords; ++j)
+			{
+				auto itEntry = mapAddressPoints.find(pWords[j]);
+				if (itEntry == mapAddressPoints.end())
+					break;
+
+				if (vecCandidates[itEntry->second].m_svName != svComplete)
+					vecConstruction[itEntry->second] = true;
+			}
+
+			i = j - 1;
+		}
+	}
+
+	const std::uintptr_t nBase = GetBase().GetAddr();
+
+	auto pTypes = std::make_shared<CTypeIndex>();
+
+	for (std::size_t n = 0; n < vecCandidates.size(); ++n)
+		if (!vecConstruction[n])
+			pTypes->Add(vecCandidates[n].m_svName, vecCandidates[n].m_nAddressPoint - nBase, vecCandidates[n].m_nOffsetToTop);
+
+	pTypes->Build();
+
+	return PublishTypes(std::move(pTypes));
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Gets an address of a virtual method table by rtti type descriptor name
 // Input  : svFunctionName
@@ -233,8 +433,65 @@ CMemory CAssemblyModule<Mutex>::GetBase() const noexcept
 	return RCast<link_map*>()->l_addr;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Returns the build identity (GNU build-id note or file size + mtime,
+//          none if the file isn't of the loaded image)
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+std::string CAssemblyModule<Mutex>::GetIdentity() const
+{
+	if (!IsValid())
+		return {};
+
+	// The notes of the segment are of the sections in memory (see CModuleRegistry::Metadata_t).
+	for (const auto svNotes : { std::string_view(".note.gnu.build-id"), std::string_view(".note") })
+	{
+		const Section_t* pNotes = GetSectionByName(svNotes);
+		if (!pNotes)
+			continue;
+
+		const auto* pData = pNotes->RCast<const std::uint8_t*>();
+
+		for (std::size_t nPos = 0; nPos + sizeof(ElfW(Nhdr)) <= pNotes->m_nSectionSize;)
+		{
+			const auto* pNote = reinterpret_cast<const ElfW(Nhdr)*>(pData + nPos);
+			const auto* pName = reinterpret_cast<const char*>(pNote + 1);
+			const std::size_t nNameSize = (pNote->n_namesz + 3) & ~std::size_t(3), nDescSize = (pNote->n_descsz + 3) & ~std::size_t(3);
+
+			if (sizeof(ElfW(Nhdr)) + nNameSize + pNote->n_descsz > pNotes->m_nSectionSize - nPos)
+				break;
+
+			if (pNote->n_type == NT_GNU_BUILD_ID && pNote->n_namesz == sizeof("GNU") && !std::strcmp(pName, "GNU"))
+				return std::string(pName + nNameSize, pNote->n_descsz);
+
+			nPos += sizeof(ElfW(Nhdr)) + nNameSize + nDescSize;
+		}
+	}
+
+	if (m_bStaleFile)
+		return {};
+
+	struct stat st;
+	if (stat(m_sPath.c_str(), &st) != 0)
+		return {};
+
+	std::string sIdentity;
+
+	sIdentity.append(reinterpret_cast<const char*>(&st.st_size), sizeof(st.st_size));
+	sIdentity.append(reinterpret_cast<const char*>(&st.st_mtime), sizeof(st.st_mtime));
+
+	return sIdentity;
+}
+
 template<typename Mutex>
 void CAssemblyModule<Mutex>::SaveLastError()
 {
 	m_sLastError = dlerror();
+}
+
+template<typename Mutex>
+void CAssemblyModule<Mutex>::Unload()
+{
+	dlclose(GetPtr());
+	*static_cast<CMemory*>(this) = DYNLIB_INVALID_MEMORY;
 }
\ No newline at end of file
@@ -0,0 +1,454 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#include "moduleregistry.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+
+using namespace DynLibUtils;
+
+static constexpr unsigned long long s_nUnknownSubs = static_cast<unsigned long long>(-1); // The loader has no counters.
+
+//-----------------------------------------------------------------------------
+// Purpose: Adds the defined functions and objects of a symbol table
+// Input  : symbols
+//          *syms
+//          nSyms
+//          *strTab
+//          nStrSize
+//          *versyms - of .dynsym, the non-default versions are skipped
+//-----------------------------------------------------------------------------
+static void AddSymbols(CSymbolIndex& symbols, const ElfW(Sym)* syms, std::size_t nSyms, const char* strTab, std::size_t nStrSize, const ElfW(Versym)* versyms)
+{
+	symbols.Reserve(symbols.Size() + nSyms, nStrSize);
+
+	for (std::size_t j = 1; j < nSyms; ++j) // 0 is the undefined one.
+	{
+		const ElfW(Sym)& sym = syms[j];
+		const auto nSymType = ELF64_ST_TYPE(sym.st_info); // Same as ELF32_ST_TYPE.
+
+		if (sym.st_shndx == SHN_UNDEF || sym.st_shndx == SHN_ABS || sym.st_name >= nStrSize)
+			continue;
+
+		if (versyms && (versyms[j] & 0x8000)) // VERSYM_HIDDEN.
+			continue;
+
+		if (nSymType != STT_FUNC && nSymType != STT_OBJECT && nSymType != STT_GNU_IFUNC && nSymType != STT_NOTYPE)
+			continue;
+
+		const char* name = strTab + sym.st_name;
+
+		symbols.Add(std::string_view(name, strnlen(name, nStrSize - sym.st_name)), sym.st_value, sym.st_size, nSymType == STT_GNU_IFUNC);
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Adds the defined symbols of .dynsym and .symtab (if isn't stripped)
+// Input  : symbols
+//          *ehdr - mapped file
+//          nFileSize
+//-----------------------------------------------------------------------------
+static void IndexSymbols(CSymbolIndex& symbols, const ElfW(Ehdr)* ehdr, std::size_t nFileSize)
+{
+	const auto nFile = reinterpret_cast<std::uintptr_t>(ehdr);
+
+	auto funcSection = [&](std::size_t i) { return reinterpret_cast<const ElfW(Shdr)*>(nFile + ehdr->e_shoff + i * ehdr->e_shentsize); };
+
+	// Versions of .dynsym: the non-default ones (memcpy@GLIBC_2.2.5 beside memcpy@@GLIBC_2.14) are hidden.
+	const ElfW(Versym)* versyms = nullptr;
+
+	for (auto i = 0; i < ehdr->e_shnum; ++i)
+	{
+		const ElfW(Shdr)* shdr = funcSection(i);
+		if (shdr->sh_type == SHT_GNU_versym && shdr->sh_offset + shdr->sh_size <= nFileSize)
+			versyms = reinterpret_cast<const ElfW(Versym)*>(nFile + shdr->sh_offset);
+	}
+
+	for (const auto nType : { SHT_DYNSYM, SHT_SYMTAB })
+	{
+		for (auto i = 0; i < ehdr->e_shnum; ++i)
+		{
+			const ElfW(Shdr)* shdr = funcSection(i);
+			if (shdr->sh_type != static_cast<ElfW(Word)>(nType) || !shdr->sh_entsize || shdr->sh_link >= ehdr->e_shnum)
+				continue;
+
+			const ElfW(Shdr)* strShdr = funcSection(shdr->sh_link);
+			if (shdr->sh_offset + shdr->sh_size > nFileSize || strShdr->sh_offset + strShdr->sh_size > nFileSize)
+				continue;
+
+			AddSymbols(symbols, reinterpret_cast<const ElfW(Sym)*>(nFile + shdr->sh_offset), shdr->sh_size / shdr->sh_entsize, reinterpret_cast<const char*>(nFile + strShdr->sh_offset), strShdr->sh_size, nType == SHT_DYNSYM ? versyms : nullptr);
+		}
+	}
+
+	symbols.Build();
+}
+
+CModuleRegistry::CObject::CObject(const dl_phdr_info* pInfo, unsigned long long nSubs, bool bProgram)
+	: m_sPath(pInfo->dlpi_name ? pInfo->dlpi_name : "")
+	, m_sFilePath(m_sPath.empty() && bProgram ? "/proc/self/exe" : m_sPath)
+	, m_nBase(pInfo->dlpi_addr)
+	, m_pProgramHeaders(pInfo->dlpi_phdr)
+	, m_bIdentity(false)
+	, m_nSubs(nSubs)
+{
+	m_vecSegments.reserve(pInfo->dlpi_phnum);
+
+	for (ElfW(Half) i = 0; i < pInfo->dlpi_phnum; ++i)
+	{
+		const ElfW(Phdr)& phdr = pInfo->dlpi_phdr[i];
+
+		m_vecSegments.push_back({ phdr.p_vaddr, phdr.p_memsz, phdr.p_type, phdr.p_flags });
+	}
+
+	m_bIdentity = !m_sFilePath.empty() && CMappedImage::GetFileIdentity(m_sFilePath, m_identity);
+}
+
+bool CModuleRegistry::CObject::IsSame(const dl_phdr_info* pInfo, unsigned long long nSubs) const noexcept
+{
+	if (pInfo->dlpi_addr != m_nBase || pInfo->dlpi_phdr != m_pProgramHeaders || pInfo->dlpi_phnum != m_vecSegments.size() || m_sPath != (pInfo->dlpi_name ? pInfo->dlpi_name : ""))
+		return false;
+
+	for (ElfW(Half) i = 0; i < pInfo->dlpi_phnum; ++i)
+	{
+		const ElfW(Phdr)& phdr = pInfo->dlpi_phdr[i];
+		const Segment_t& segment = m_vecSegments[i];
+
+		if (phdr.p_vaddr != segment.m_nAddress || phdr.p_memsz != segment.m_nSize || phdr.p_type != segment.m_nType || phdr.p_flags != segment.m_nFlags)
+			return false;
+	}
+
+	if (nSubs != s_nUnknownSubs && nSubs == m_nSubs) // None is unloaded since.
+		return true;
+
+	CMappedImage::FileIdentity_t identity;
+
+	const bool bIdentity = !m_sFilePath.empty() && CMappedImage::GetFileIdentity(m_sFilePath, identity);
+
+	return bIdentity == m_bIdentity && (!bIdentity || identity == m_identity);
+}
+
+bool CModuleRegistry::CObject::IsLoaded(std::uintptr_t nAddress, std::size_t nSize) const noexcept
+{
+	for (const auto& segment : m_vecSegments)
+		if (segment.m_nType == PT_LOAD && nAddress >= segment.m_nAddress && nAddress - segment.m_nAddress <= segment.m_nSize && nSize <= segment.m_nSize - (nAddress - segment.m_nAddress))
+			return true;
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Is the file of the object by the program headers: the ones of
+//          a rebuilt file differ generally
+//-----------------------------------------------------------------------------
+bool CModuleRegistry::CObject::IsImageOf(const CMappedImage& image) const noexcept
+{
+	if (m_bIdentity && image.GetIdentity() != m_identity)
+		return false;
+
+	const auto* ehdr = image.GetSpan<ElfW(Ehdr)>(0, 1).begin();
+	if (!ehdr || std::memcmp(ehdr->e_ident, ELFMAG, SELFMAG) || ehdr->e_phentsize != sizeof(ElfW(Phdr)) || ehdr->e_phnum != m_vecSegments.size())
+		return false;
+
+	const auto phdrs = image.GetSpan<ElfW(Phdr)>(ehdr->e_phoff, ehdr->e_phnum);
+	if (phdrs.Size() != m_vecSegments.size())
+		return false;
+
+	for (std::size_t i = 0; i < phdrs.Size(); ++i)
+		if (phdrs[i].p_vaddr != m_vecSegments[i].m_nAddress || phdrs[i].p_memsz != m_vecSegments[i].m_nSize || phdrs[i].p_type != m_vecSegments[i].m_nType || phdrs[i].p_flags != m_vecSegments[i].m_nFlags)
+			return false;
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Takes the sections of the segments in memory: the executable one is
+//          .text, the read-only one after it .rodata, the writable one .data,
+//          PT_GNU_RELRO .data.rel.ro and PT_NOTE .note
+//-----------------------------------------------------------------------------
+void CModuleRegistry::CObject::ReadSegments(Metadata_t& metadata) const
+{
+	bool bText = false, bReadOnly = false, bData = false;
+
+	metadata.m_vecSegmentSections.reserve(m_vecSegments.size());
+
+	for (const auto& segment : m_vecSegments)
+	{
+		std::string_view svName;
+
+		switch (segment.m_nType)
+		{
+			case PT_LOAD:
+			{
+				if (segment.m_nFlags & PF_X)
+					svName = std::exchange(bText, true) ? "LOAD" : ".text";
+				else if (segment.m_nFlags & PF_W)
+					svName = std::exchange(bData, true) ? "LOAD" : ".data";
+				else
+					svName = !bText || std::exchange(bReadOnly, true) ? "LOAD" : ".rodata"; // The first one is of the headers.
+
+				break;
+			}
+
+			case PT_GNU_RELRO:
+				svName = ".data.rel.ro";
+				break;
+
+			case PT_NOTE:
+				svName = ".note";
+				break;
+
+			default:
+				continue;
+		}
+
+		metadata.m_vecSegmentSections.push_back({ svName, static_cast<std::uintptr_t>(segment.m_nAddress), static_cast<std::size_t>(segment.m_nSize), 0, 0 });
+	}
+
+	for (const auto& section : metadata.m_vecSegmentSections)
+		metadata.m_vecSections.push_back(&section);
+
+	IndexDynamicSymbols(metadata.m_symbols);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Adds the defined symbols of .dynsym in memory by the dynamic section,
+//          the count of them is of DT_HASH or of the last chain of DT_GNU_HASH
+//-----------------------------------------------------------------------------
+void CModuleRegistry::CObject::IndexDynamicSymbols(CSymbolIndex& symbols) const
+{
+	const auto itDynamic = std::find_if(m_vecSegments.begin(), m_vecSegments.end(), [](const Segment_t& segment) { return segment.m_nType == PT_DYNAMIC; });
+
+	if (itDynamic == m_vecSegments.end())
+		return;
+
+	// The loader relocates the pointers in place, but on the targets of the read-only dynamic section.
+	// Of a program at 0 (ET_EXEC) they're absolute already.
+	auto funcAddress = [this](ElfW(Addr) nPtr) { return nPtr < m_nBase ? m_nBase + nPtr : nPtr; };
+
+	const ElfW(Sym)* syms = nullptr;
+	const char* strTab = nullptr;
+	std::size_t nStrSize = 0;
+	const ElfW(Word)* hash = nullptr;
+	const ElfW(Word)* gnuHash = nullptr;
+	const ElfW(Versym)* versyms = nullptr;
+
+	for (const auto* dyn = reinterpret_cast<const ElfW(Dyn)*>(m_nBase + itDynamic->m_nAddress); dyn->d_tag != DT_NULL; ++dyn)
+	{
+		switch (dyn->d_tag)
+		{
+			case DT_SYMTAB: syms = reinterpret_cast<const ElfW(Sym)*>(funcAddress(dyn->d_un.d_ptr)); break;
+			case DT_STRTAB: strTab = reinterpret_cast<const char*>(funcAddress(dyn->d_un.d_ptr)); break;
+			case DT_STRSZ: nStrSize = dyn->d_un.d_val; break;
+			case DT_HASH: hash = reinterpret_cast<const ElfW(Word)*>(funcAddress(dyn->d_un.d_ptr)); break;
+			case DT_GNU_HASH: gnuHash = reinterpret_cast<const ElfW(Word)*>(funcAddress(dyn->d_un.d_ptr)); break;
+			case DT_VERSYM: versyms = reinterpret_cast<const ElfW(Versym)*>(funcAddress(dyn->d_un.d_ptr)); break;
+		}
+	}
+
+	if (!syms || !strTab)
+		return;
+
+	std::size_t nSyms = 0;
+
+	if (hash)
+	{
+		nSyms = hash[1]; // nchain.
+	}
+	else if (gnuHash)
+	{
+		const ElfW(Word) nBuckets = gnuHash[0], nSymOffset = gnuHash[1], nBloomSize = gnuHash[2];
+		const auto* buckets = reinterpret_cast<const ElfW(Word)*>(reinterpret_cast<const ElfW(Addr)*>(gnuHash + 4) + nBloomSize);
+		const auto* chains = buckets + nBuckets;
+
+		ElfW(Word) nLast = 0;
+
+		for (ElfW(Word) i = 0; i < nBuckets; ++i)
+			nLast = std::max(nLast, buckets[i]);
+
+		if (nLast < nSymOffset)
+			nSyms = nSymOffset;
+		else
+		{
+			while (!(chains[nLast - nSymOffset] & 1)) // The end of the chain.
+				++nLast;
+
+			nSyms = nLast + 1;
+		}
+	}
+
+	AddSymbols(symbols, syms, nSyms, strTab, nStrSize, versyms);
+
+	symbols.Build();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Maps the file once and takes the sections in the loaded segments
+//          (the non-allocated ones, as .symtab or .comment, aren't in memory)
+//          and the symbols. If the file isn't of the object (rebuilt or gone
+//          since), they're of the program headers in memory
+//-----------------------------------------------------------------------------
+const CModuleRegistry::Metadata_t* CModuleRegistry::CObject::GetMetadata() const
+{
+	std::call_once(m_metadataFlag, [this]
+	{
+		auto pMetadata = std::make_unique<Metadata_t>();
+		auto pImage = m_sFilePath.empty() ? nullptr : CMappedImage::Open(m_sFilePath);
+
+		if (pImage && IsImageOf(*pImage))
+		{
+			for (const auto& section : pImage->GetSections())
+				if (!section.m_svName.empty() && IsLoaded(section.m_nAddress, section.m_nSize))
+					pMetadata->m_vecSections.push_back(&section);
+
+			IndexSymbols(pMetadata->m_symbols, reinterpret_cast<const ElfW(Ehdr)*>(pImage->GetData()), pImage->GetSize());
+
+			pMetadata->m_pImage = std::move(pImage);
+		}
+		else
+		{
+			ReadSegments(*pMetadata);
+		}
+
+		m_pMetadata = std::move(pMetadata);
+	});
+
+	return m_pMetadata.get();
+}
+
+CModuleRegistry& CModuleRegistry::Get()
+{
+	static CModuleRegistry s_registry;
+
+	return s_registry;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Takes a new snapshot if the loader has added or removed objects since
+//          (the counters are read from the first object only)
+//-----------------------------------------------------------------------------
+void CModuleRegistry::Update()
+{
+	struct Counters_t
+	{
+		unsigned long long m_nAdds, m_nSubs;
+		bool m_bValid;
+	} counters { 0, 0, false };
+
+	dl_iterate_phdr([](dl_phdr_info* info, std::size_t size, void* data)
+	{
+		auto* pCounters = static_cast<Counters_t*>(data);
+
+		if (size >= offsetof(dl_phdr_info, dlpi_subs) + sizeof(info->dlpi_subs))
+			*pCounters = { info->dlpi_adds, info->dlpi_subs, true };
+
+		return 1;
+	}, &counters);
+
+	if (m_bSnapshot && counters.m_bValid && counters.m_nAdds == m_nAdds && counters.m_nSubs == m_nSubs)
+		return;
+
+	struct Snapshot_t
+	{
+		const CModuleRegistry* m_pRegistry;
+		unsigned long long m_nSubs;
+		std::vector<std::shared_ptr<const CObject>> m_vecObjects;
+	} snapshot { this, counters.m_bValid ? counters.m_nSubs : s_nUnknownSubs, {} };
+
+	dl_iterate_phdr([](dl_phdr_info* info, std::size_t /* size */, void* data)
+	{
+		auto* pSnapshot = static_cast<Snapshot_t*>(data);
+		const auto& registry = *pSnapshot->m_pRegistry;
+
+		// The objects still loaded are kept with their metadata.
+		if (auto it = registry.m_mapBases.find(info->dlpi_addr); it != registry.m_mapBases.end())
+		{
+			const auto& pObject = registry.m_vecObjects[it->second];
+
+			if (pObject->IsSame(info, pSnapshot->m_nSubs))
+			{
+				pSnapshot->m_vecObjects.push_back(pObject);
+
+				return 0;
+			}
+		}
+
+		pSnapshot->m_vecObjects.push_back(std::make_shared<const CObject>(info, pSnapshot->m_nSubs, pSnapshot->m_vecObjects.empty())); // The program is the first.
+
+		return 0;
+	}, &snapshot);
+
+	m_vecObjects = std::move(snapshot.m_vecObjects);
+	m_mapNames.clear();
+	m_mapBases.clear();
+
+	for (std::size_t i = 0; i < m_vecObjects.size(); ++i)
+	{
+		m_mapNames.emplace(m_vecObjects[i]->GetName(), i); // The first one is kept.
+		m_mapBases.emplace(m_vecObjects[i]->GetBase(), i);
+	}
+
+	m_nAdds = counters.m_nAdds;
+	m_nSubs = counters.m_nSubs;
+	m_bSnapshot = counters.m_bValid;
+}
+
+std::shared_ptr<const CModuleRegistry::CObject> CModuleRegistry::FindByName(const std::string_view svName)
+{
+	if (svName.empty())
+		return nullptr;
+
+	std::lock_guard lock(m_mutex);
+
+	Update();
+
+	if (auto it = m_mapNames.find(svName); it != m_mapNames.end())
+		return m_vecObjects[it->second];
+
+	for (auto it = m_vecObjects.rbegin(); it != m_vecObjects.rend(); ++it)
+		if ((*it)->GetPath().find(svName) != std::string::npos)
+			return *it;
+
+	return nullptr;
+}
+
+std::shared_ptr<const CModuleRegistry::CObject> CModuleRegistry::FindByBase(ElfW(Addr) nBase)
+{
+	std::lock_guard lock(m_mutex);
+
+	Update();
+
+	auto it = m_mapBases.find(nBase);
+
+	return it != m_mapBases.end() ? m_vecObjects[it->second] : nullptr;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Maps the file and takes its named sections and the symbols, without
+//          the program headers of a loaded object to check them by
+//-----------------------------------------------------------------------------
+std::unique_ptr<const CModuleRegistry::Metadata_t> CModuleRegistry::ReadFile(const std::string& sPath)
+{
+	auto pImage = CMappedImage::Open(sPath);
+
+	if (!pImage)
+		return nullptr;
+
+	auto pMetadata = std::make_unique<Metadata_t>();
+
+	for (const auto& section : pImage->GetSections())
+		if (!section.m_svName.empty() && section.m_nAddress) // The non-allocated ones are at 0.
+			pMetadata->m_vecSections.push_back(&section);
+
+	if (pImage->GetSize() >= sizeof(ElfW(Ehdr)))
+		IndexSymbols(pMetadata->m_symbols, reinterpret_cast<const ElfW(Ehdr)*>(pImage->GetData()), pImage->GetSize());
+
+	pMetadata->m_pImage = std::move(pImage);
+
+	return pMetadata;
+}
\ No newline at end of file
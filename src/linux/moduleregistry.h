@@ -0,0 +1,104 @@
+// Registry of the loaded objects, private to the Linux sources
+#pragma once
+
+#include "os.h"
+
+#include <dynlibutils/mappedimage.hpp>
+#include <dynlibutils/module.hpp>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace DynLibUtils {
+
+// Snapshot of the loaded objects (dl_iterate_phdr) with the segments of their program headers in memory.
+// It's renewed when the loader reports objects added or removed since, the objects still loaded are kept.
+// The metadata of an object (the file sections, the symbols) is built once and shared by all its modules.
+class CModuleRegistry
+{
+public:
+	struct Segment_t
+	{
+		ElfW(Addr) m_nAddress; // Relative to the base.
+		ElfW(Xword) m_nSize; // In memory.
+		ElfW(Word) m_nType;
+		ElfW(Word) m_nFlags;
+	}; // struct Segment_t
+
+	// Of the file if it's the one loaded, of the program headers in memory otherwise (the file is rebuilt or gone since):
+	// the sections are the segments then (named for their role, as .text for the executable one), the symbols are of .dynsym.
+	struct Metadata_t
+	{
+		std::shared_ptr<const CMappedImage> m_pImage; // nullptr if isn't of the file.
+		std::vector<const CMappedImage::FileSection_t*> m_vecSections; // Of the loaded segments, into the image or m_vecSegmentSections.
+		std::vector<CMappedImage::FileSection_t> m_vecSegmentSections; // Of the program headers, without the file data.
+		CSymbolIndex m_symbols;
+	}; // struct Metadata_t
+
+	class CObject
+	{
+	public:
+		CObject(const dl_phdr_info* pInfo, unsigned long long nSubs, bool bProgram);
+
+		// Is the same object loaded still: of the base, the path and the program headers, and if the loader has removed
+		// any objects since, of the same file (a rebuilt one loaded at the same base has another identity).
+		[[nodiscard]] bool IsSame(const dl_phdr_info* pInfo, unsigned long long nSubs) const noexcept;
+
+		[[nodiscard]] const std::string& GetPath() const noexcept { return m_sPath; }
+		[[nodiscard]] std::string_view GetName() const noexcept { return std::string_view(m_sPath).substr(m_sPath.find_last_of('/') + 1); }
+		[[nodiscard]] ElfW(Addr) GetBase() const noexcept { return m_nBase; }
+		[[nodiscard]] const std::vector<Segment_t>& GetSegments() const noexcept { return m_vecSegments; }
+
+		// Built on the first call, nullptr if the file can't be mapped.
+		[[nodiscard]] const Metadata_t* GetMetadata() const;
+
+		[[nodiscard]] bool IsLoaded(std::uintptr_t nAddress, std::size_t nSize) const noexcept; // Relative range, in a PT_LOAD segment.
+
+	private:
+		[[nodiscard]] bool IsImageOf(const CMappedImage& image) const noexcept;
+		void ReadSegments(Metadata_t& metadata) const; // Of the program headers in memory.
+		void IndexDynamicSymbols(CSymbolIndex& symbols) const;
+
+		std::string m_sPath;
+		std::string m_sFilePath; // Of the file, /proc/self/exe for the program (which the loader names "").
+		ElfW(Addr) m_nBase; // 0 of a program not position-independent (ET_EXEC): its addresses are absolute.
+		std::vector<Segment_t> m_vecSegments;
+		const ElfW(Phdr)* m_pProgramHeaders; // In memory.
+
+		CMappedImage::FileIdentity_t m_identity; // Of the file when the object is found.
+		bool m_bIdentity; // Has the file been found.
+		unsigned long long m_nSubs; // Of the loader when the object is found.
+
+		mutable std::once_flag m_metadataFlag;
+		mutable std::unique_ptr<Metadata_t> m_pMetadata;
+	}; // class CObject
+
+	static CModuleRegistry& Get();
+
+	// The first object of the exact file name (early exit), otherwise the last one containing it, as the loader orders them.
+	[[nodiscard]] std::shared_ptr<const CObject> FindByName(const std::string_view svName);
+
+	// The object loaded at the base.
+	[[nodiscard]] std::shared_ptr<const CObject> FindByBase(ElfW(Addr) nBase);
+
+	// Of the file alone, for an object the registry doesn't have: its named sections (the non-allocated ones aside)
+	// and the symbols, nullptr if it can't be mapped.
+	[[nodiscard]] static std::unique_ptr<const Metadata_t> ReadFile(const std::string& sPath);
+
+private:
+	void Update(); // Under the lock.
+
+	std::mutex m_mutex;
+	unsigned long long m_nAdds = 0, m_nSubs = 0; // Of the loader at the snapshot.
+	bool m_bSnapshot = false;
+
+	std::vector<std::shared_ptr<const CObject>> m_vecObjects; // In the loader order.
+	std::unordered_map<std::string_view, std::size_t> m_mapNames; // File name -> first object.
+	std::unordered_map<ElfW(Addr), std::size_t> m_mapBases;
+}; // class CModuleRegistry
+
+} // namespace DynLibUtils
@@ -7,4 +7,5 @@
 #include <unistd.h>
 #include <link.h>
 #include <sys/mman.h>
-#include <sys/stat.h>
\ No newline at end of file
+#include <sys/stat.h>
+#include <sys/uio.h>
\ No newline at end of file
@@ -0,0 +1,317 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#include "os.h"
+
+#include <dynlibutils/threadsuspender.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <ctime>
+#include <mutex>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <ucontext.h>
+
+using namespace DynLibUtils;
+
+namespace
+{
+	// A stopped thread, on the stack of its handler.
+	struct Stopped_t
+	{
+		pid_t m_nTid;
+		ucontext_t *m_pContext;
+		Stopped_t *m_pNext;
+	};
+}
+
+static constexpr long s_nStopTimeout = 1000000000; // Nanoseconds.
+static constexpr long s_nPassTimeout = 1000000; // Of a wait for the stops, nanoseconds.
+
+static std::mutex s_mutex; // Of the suspension.
+static int s_nSignal = 0; // Of the handler, under the mutex.
+
+// Futexes.
+static std::atomic<std::uint32_t> s_nRound {0}; // Odd while the threads are to stop.
+static std::atomic<std::uint32_t> s_nStops {0}; // Of the handlers.
+static std::atomic<std::uint32_t> s_nInside {0}; // Handlers running.
+
+static std::atomic<Stopped_t *> s_pStopped {nullptr};
+
+static long Futex(std::atomic<std::uint32_t> &word, int nOp, std::uint32_t nValue, long nTimeout = -1) noexcept
+{
+	timespec ts { 0, nTimeout };
+
+	return syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(&word), nOp, nValue, nTimeout < 0 ? nullptr : &ts, nullptr, 0);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Parks the thread until the round ends, a late signal (of a round which
+//          gave up on it) returns at once
+//-----------------------------------------------------------------------------
+static void OnStop(int, siginfo_t *, void *pContext)
+{
+	const int nErrno = errno;
+
+	s_nInside.fetch_add(1);
+
+	const std::uint32_t nRound = s_nRound.load();
+
+	if (nRound & 1)
+	{
+		Stopped_t stopped { static_cast<pid_t>(syscall(SYS_gettid)), static_cast<ucontext_t *>(pContext), s_pStopped.load() };
+
+		while (!s_pStopped.compare_exchange_weak(stopped.m_pNext, &stopped))
+		{
+		}
+
+		s_nStops.fetch_add(1);
+		Futex(s_nStops, FUTEX_WAKE_PRIVATE, 1);
+
+		while (s_nRound.load() == nRound)
+			Futex(s_nRound, FUTEX_WAIT_PRIVATE, nRound);
+	}
+
+	if (s_nInside.fetch_sub(1) == 1)
+		Futex(s_nInside, FUTEX_WAKE_PRIVATE, 1);
+
+	errno = nErrno;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Installs the handler on the highest real-time signal which has none
+//          (under the mutex)
+//-----------------------------------------------------------------------------
+static bool InstallHandler() noexcept
+{
+	if (s_nSignal)
+		return true;
+
+	for (int nSignal = SIGRTMAX; nSignal >= SIGRTMIN; nSignal--)
+	{
+		struct sigaction old {};
+
+		if (sigaction(nSignal, nullptr, &old) || (old.sa_flags & SA_SIGINFO) || old.sa_handler != SIG_DFL)
+			continue;
+
+		struct sigaction action {};
+
+		action.sa_sigaction = OnStop;
+		action.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigfillset(&action.sa_mask);
+
+		if (sigaction(nSignal, &action, nullptr))
+			continue;
+
+		s_nSignal = nSignal;
+
+		return true;
+	}
+
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Calls func(tid) for each thread of the process, by the syscalls only
+//          (opendir allocates)
+//-----------------------------------------------------------------------------
+template<typename F>
+static bool ForEachTask(F &&func) noexcept
+{
+	const int fd = open("/proc/self/task", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	if (fd == -1)
+		return false;
+
+	struct Dirent64_t
+	{
+		std::uint64_t m_nInode;
+		std::int64_t m_nOffset;
+		unsigned short m_nSize;
+		unsigned char m_nType;
+		char m_szName[1];
+	};
+
+	alignas(Dirent64_t) char aBuffer[2048];
+
+	for (long nRead; (nRead = syscall(SYS_getdents64, fd, aBuffer, sizeof(aBuffer))) > 0;)
+	{
+		for (long nPos = 0; nPos < nRead;)
+		{
+			const auto *pEntry = reinterpret_cast<const Dirent64_t *>(aBuffer + nPos);
+
+			pid_t nTid = 0;
+
+			for (const char *p = pEntry->m_szName; *p >= '0' && *p <= '9'; p++)
+				nTid = nTid * 10 + (*p - '0');
+
+			if (nTid)
+				func(nTid);
+
+			nPos += pEntry->m_nSize;
+		}
+	}
+
+	close(fd);
+
+	return true;
+}
+
+static bool IsStopped(pid_t nTid) noexcept
+{
+	for (const Stopped_t *pStopped = s_pStopped.load(); pStopped; pStopped = pStopped->m_pNext)
+	{
+		if (pStopped->m_nTid == nTid)
+			return true;
+	}
+
+	return false;
+}
+
+static long GetTime() noexcept
+{
+	timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+bool CThreadSuspender::Suspend() noexcept
+{
+	if (m_bSuspended)
+		return true;
+
+	s_mutex.lock();
+
+	// The ids are only added in the capacity while the threads stop.
+	std::size_t nThreads = 0;
+
+	if (!InstallHandler() || !ForEachTask([&nThreads](pid_t) { nThreads++; }))
+	{
+		s_mutex.unlock();
+
+		return false;
+	}
+
+	try
+	{
+		m_vecThreads.clear();
+		m_vecThreads.reserve(nThreads * 2 + 64);
+	}
+	catch (...)
+	{
+		s_mutex.unlock();
+
+		return false;
+	}
+
+	// A late handler (of a round which gave up on it) may have added itself after the last one.
+	for (std::uint32_t nInside; (nInside = s_nInside.load());)
+		Futex(s_nInside, FUTEX_WAIT_PRIVATE, nInside, s_nPassTimeout);
+
+	s_pStopped.store(nullptr);
+
+	m_bSuspended = true;
+
+	s_nRound.fetch_add(1);
+
+	const pid_t nPid = getpid(), nSelf = static_cast<pid_t>(syscall(SYS_gettid));
+	const long nDeadline = GetTime() + s_nStopTimeout;
+
+	// Until a pass finds all stopped, as the running ones may start others.
+	for (;;)
+	{
+		const std::uint32_t nStops = s_nStops.load();
+
+		bool bAll = true, bFull = false;
+
+		ForEachTask([&](pid_t nTid)
+		{
+			if (nTid == nSelf || IsStopped(nTid))
+				return;
+
+			bAll = false;
+
+			if (std::find(m_vecThreads.begin(), m_vecThreads.end(), static_cast<std::uintptr_t>(nTid)) != m_vecThreads.end())
+				return;
+
+			if (m_vecThreads.size() == m_vecThreads.capacity())
+			{
+				bFull = true;
+
+				return;
+			}
+
+			m_vecThreads.push_back(static_cast<std::uintptr_t>(nTid));
+			syscall(SYS_tgkill, nPid, nTid, s_nSignal); // Gone if ESRCH, till the next pass.
+		});
+
+		if (bAll)
+			return true;
+
+		if (bFull || GetTime() > nDeadline)
+		{
+			Resume();
+
+			return false;
+		}
+
+		Futex(s_nStops, FUTEX_WAIT_PRIVATE, nStops, s_nPassTimeout);
+	}
+}
+
+void CThreadSuspender::Resume() noexcept
+{
+	if (!m_bSuspended)
+		return;
+
+	s_nRound.fetch_add(1);
+	Futex(s_nRound, FUTEX_WAKE_PRIVATE, INT_MAX);
+
+	s_pStopped.store(nullptr); // On the stacks of the handlers.
+
+	m_vecThreads.clear();
+	m_bSuspended = false;
+
+	s_mutex.unlock();
+}
+
+bool CThreadSuspender::VisitThreads(Visitor_t pfnVisit, void *pContext) noexcept
+{
+	if (!m_bSuspended)
+		return false;
+
+	for (Stopped_t *pStopped = s_pStopped.load(); pStopped; pStopped = pStopped->m_pNext)
+	{
+		mcontext_t &mcontext = pStopped->m_pContext->uc_mcontext;
+
+#if defined(__x86_64__)
+		auto &nIP = mcontext.gregs[REG_RIP];
+#elif defined(__i386__)
+		auto &nIP = mcontext.gregs[REG_EIP];
+#elif defined(__aarch64__)
+		auto &nIP = mcontext.pc;
+#elif defined(__arm__)
+		auto &nIP = mcontext.arm_pc;
+#else
+#	error "Unsupported architecture"
+#endif
+
+		std::uintptr_t nAddr = static_cast<std::uintptr_t>(nIP);
+
+		pfnVisit(pContext, nAddr);
+
+		nIP = static_cast<std::remove_reference_t<decltype(nIP)>>(nAddr);
+	}
+
+	return true;
+}
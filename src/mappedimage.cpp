@@ -0,0 +1,160 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#include <dynlibutils/mappedimage.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using namespace DynLibUtils;
+
+CMappedImage::~CMappedImage()
+{
+	if (m_pData)
+		Unmap();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Maps the file once per path: the registry holds the mappings weakly,
+//          so the last user unmaps one
+// Input  : svPath
+// Output : std::shared_ptr<const CMappedImage>
+//-----------------------------------------------------------------------------
+std::shared_ptr<const CMappedImage> CMappedImage::Open(const std::string_view svPath)
+{
+	static std::mutex s_mutex;
+	static std::unordered_map<std::string, std::weak_ptr<const CMappedImage>> s_mapImages;
+
+	if (svPath.empty())
+		return nullptr;
+
+	std::string sPath(svPath);
+
+	FileIdentity_t identity;
+
+	const bool bIdentity = GetFileIdentity(sPath, identity);
+
+	std::lock_guard lock(s_mutex);
+
+	auto& pShared = s_mapImages[sPath];
+
+	if (auto pImage = pShared.lock(); pImage && (!bIdentity || pImage->m_identity == identity)) // Gone since, the mapping is of the last one.
+		return pImage;
+
+	std::shared_ptr<CMappedImage> pImage(new CMappedImage);
+
+	if (!pImage->Map(sPath))
+	{
+		s_mapImages.erase(sPath);
+
+		return nullptr;
+	}
+
+	pImage->m_sPath = sPath;
+	pImage->ParseSections();
+	pImage->IndexSections();
+
+	// Drop the expired ones meanwhile.
+	for (auto it = s_mapImages.begin(); it != s_mapImages.end();)
+		it = it->second.expired() && it->first != sPath ? s_mapImages.erase(it) : std::next(it);
+
+	pShared = pImage;
+
+	return pImage;
+}
+
+void CMappedImage::IndexSections()
+{
+	m_vecSectionsByName.resize(m_vecSections.size());
+
+	for (std::uint32_t i = 0; i < m_vecSectionsByName.size(); ++i)
+		m_vecSectionsByName[i] = i;
+
+	std::stable_sort(m_vecSectionsByName.begin(), m_vecSectionsByName.end(), [this](std::uint32_t a, std::uint32_t b) { return m_vecSections[a].m_svName < m_vecSections[b].m_svName; });
+}
+
+const CMappedImage::FileSection_t* CMappedImage::GetSectionByName(const std::string_view svSectionName) const noexcept
+{
+	auto it = std::lower_bound(m_vecSectionsByName.begin(), m_vecSectionsByName.end(), svSectionName, [this](std::uint32_t nIndex, const std::string_view svName) { return m_vecSections[nIndex].m_svName < svName; });
+
+	if (it == m_vecSectionsByName.end() || m_vecSections[*it].m_svName != svSectionName)
+		return nullptr;
+
+	return &m_vecSections[*it];
+}
+
+const CMappedImage::FileSection_t* CMappedImage::GetSectionByAddress(std::uintptr_t nAddress) const noexcept
+{
+	for (const auto& section : m_vecSections)
+		if (section.m_nFileSize && nAddress >= section.m_nAddress && nAddress - section.m_nAddress < section.m_nFileSize)
+			return &section;
+
+	return nullptr;
+}
+
+std::uintptr_t CMappedImage::OffsetToAddress(std::size_t nOffset) const noexcept
+{
+	for (const auto& section : m_vecSections)
+		if (section.m_nFileSize && nOffset >= section.m_nOffset && nOffset - section.m_nOffset < section.m_nFileSize)
+			return section.m_nAddress + (nOffset - section.m_nOffset);
+
+	return static_cast<std::uintptr_t>(-1);
+}
+
+std::size_t CMappedImage::AddressToOffset(std::uintptr_t nAddress) const noexcept
+{
+	const FileSection_t* pSection = GetSectionByAddress(nAddress);
+
+	return pSection ? pSection->m_nOffset + (nAddress - pSection->m_nAddress) : static_cast<std::size_t>(-1);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads the range by chunks, the tail of overlap is moved to the front
+//          of the buffer before the next one is read after it
+//-----------------------------------------------------------------------------
+bool CMappedImage::Stream(std::size_t nOffset, std::size_t nSize, std::size_t nOverlap, StreamCallback_t pfnCallback, const void* pContext) const
+{
+	if (nOverlap >= s_nStreamChunkSize || nOffset > m_nSize || nSize > m_nSize - nOffset)
+		return false;
+
+	void* pStream = OpenStream(m_sPath);
+
+	if (!pStream)
+		return false;
+
+	std::vector<std::uint8_t> vecBuffer(std::min(nSize, s_nStreamChunkSize + nOverlap));
+
+	const std::size_t nEnd = nOffset + nSize;
+
+	bool bResult = true;
+
+	for (std::size_t nPos = nOffset, nKept = 0; nPos + nKept < nEnd;)
+	{
+		const std::size_t nRead = std::min(vecBuffer.size() - nKept, nEnd - (nPos + nKept));
+
+		if (!ReadStream(pStream, nPos + nKept, vecBuffer.data() + nKept, nRead))
+		{
+			bResult = false;
+			break;
+		}
+
+		const std::size_t nFilled = nKept + nRead;
+
+		if (!pfnCallback(pContext, vecBuffer.data(), nFilled, nPos))
+			break;
+
+		nKept = std::min(nOverlap, nFilled);
+		std::memmove(vecBuffer.data(), vecBuffer.data() + nFilled - nKept, nKept);
+		nPos += nFilled - nKept;
+	}
+
+	CloseStream(pStream);
+
+	return bResult;
+}
@@ -5,243 +5,2721 @@
 //
 
 #include <dynlibutils/module.hpp>
+#include <dynlibutils/detour.hpp>
 #include <dynlibutils/memaddr.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <thread>
+
+#if DYNLIBUTILS_ARCH_ARM
+#	include <arm_neon.h>
+#else
+#	include <immintrin.h>
+#	if defined(_MSC_VER)
+#		include <intrin.h>
+#	else
+#		include <cpuid.h>
+#	endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#	define DYNLIB_TARGET(features) __attribute__((target(features)))
+#else
+#	define DYNLIB_TARGET(features)
+#endif
+
+#if DYNLIBUTILS_STATS
+#	define DYNLIB_STATS(...) __VA_ARGS__
+#else
+#	define DYNLIB_STATS(...)
+#endif
+
 using namespace DynLibUtils;
 
-//-----------------------------------------------------------------------------
-// Purpose: constructor
-// Input  : szModuleName (without extension .dll/.so)
-//-----------------------------------------------------------------------------
+#if DYNLIBUTILS_STATS
+// Of the scans of the thread: the kernels are stateless, the callers take the difference.
+static thread_local std::uint64_t s_nScanCandidates = 0;
+
+static std::uint64_t GetStatsTime() noexcept
+{
+	return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+#endif
+
+static bool ComparePattern(const std::uint8_t* pData, const std::uint8_t* pPattern, const std::string_view svMask) noexcept
+{
+	for (std::size_t i = 0, nSize = svMask.size(); i < nSize; ++i)
+	{
+		if (svMask[i] == 'x' && pData[i] != pPattern[i])
+			return false;
+	}
+
+	return true;
+}
+
+// Pattern prepared for the SIMD kernels.
+struct ScanPattern_t
+{
+	ScanPattern_t(const std::uint8_t* pPattern, const std::string_view svMask) noexcept
+		: ScanPattern_t({ pPattern, svMask, SelectPatternAnchors(pPattern, svMask.data(), svMask.size()), nullptr, 0 })
+	{
+	}
+
+	ScanPattern_t(const std::uint8_t* pPattern, const std::string_view svMask, const PatternAnchors_t& anchors) noexcept
+		: ScanPattern_t({ pPattern, svMask, anchors, nullptr, 0 })
+	{
+	}
+
+	explicit ScanPattern_t(const PatternView_t& view) noexcept
+		: m_nSize(view.m_svMask.size())
+		, m_nMasks(static_cast<std::uint8_t>((view.m_svMask.size() + 15) / 16))
+		, m_nAnchor(view.m_anchors.m_nAnchor == s_nInvalidAnchor ? 0 : view.m_anchors.m_nAnchor)
+		, m_nNext(view.m_anchors.m_nNextAnchor == s_nInvalidAnchor ? 0 : view.m_anchors.m_nNextAnchor)
+		, m_bWildcard(view.m_anchors.m_nAnchor == s_nInvalidAnchor)
+		, m_aMasks{}
+	{
+		// Padded copy: the blocks are compared by 16 bytes.
+		std::memcpy(m_aBytes, view.m_pBytes, m_nSize);
+		std::memset(m_aBytes + m_nSize, 0, sizeof(m_aBytes) - m_nSize);
+
+		if (view.m_pBlockMasks)
+		{
+			for (std::size_t i = 0; i < m_nMasks; ++i)
+				m_aMasks[i] = view.m_pBlockMasks[i];
+		}
+		else
+		{
+			for (std::size_t i = 0; i < m_nSize; ++i)
+			{
+				if (view.m_svMask[i] == 'x')
+					m_aMasks[i / 16] |= 1 << (i % 16);
+			}
+		}
+
+#if DYNLIBUTILS_ARCH_ARM
+		std::memset(m_aMaskBytes, 0, m_nMasks * 16);
+
+		for (std::size_t i = 0; i < m_nSize; ++i)
+		{
+			if (m_aMasks[i / 16] & (1 << (i % 16)))
+				m_aMaskBytes[i] = 0xFF;
+		}
+#endif
+	}
+
+	alignas(16) std::uint8_t m_aBytes[s_nMaxSimdBlocks * 16];
+	std::size_t m_nSize;
+	std::uint8_t m_nMasks;
+	std::size_t m_nAnchor; // Rarest non-wildcard byte.
+	std::size_t m_nNext; // Second rarest one, or the anchor again.
+	bool m_bWildcard;
+	std::array<int, s_nMaxSimdBlocks> m_aMasks; // 64*16 = enough masks for 1024 bytes.
+
+#if DYNLIBUTILS_ARCH_ARM
+	alignas(16) std::uint8_t m_aMaskBytes[s_nMaxSimdBlocks * 16]; // 0xFF for the non-wildcards (NEON has no movemask).
+#endif
+}; // struct ScanPattern_t
+
+// A kernel returns the first match starting in [pData, pEnd - size], or nullptr.
+using ScanKernel_t = const std::uint8_t* (*)(const ScanPattern_t& pattern, const std::uint8_t* pData, const std::uint8_t* pEnd);
+
+#if DYNLIBUTILS_ARCH_ARM
+static bool CompareBlocks(const ScanPattern_t& pattern, const std::uint8_t* pData) noexcept
+{
+	for (std::uint8_t i = 0; i < pattern.m_nMasks; ++i)
+	{
+		const uint8x16_t v1 = vld1q_u8(pData + i * 16);
+		const uint8x16_t v2 = vld1q_u8(pattern.m_aBytes + i * 16);
+		const uint8x16_t vMask = vld1q_u8(pattern.m_aMaskBytes + i * 16);
+
+		const uint64x2_t vDiff = vreinterpretq_u64_u8(vandq_u8(veorq_u8(v1, v2), vMask));
+
+		if (vgetq_lane_u64(vDiff, 0) | vgetq_lane_u64(vDiff, 1))
+			return false;
+	}
+
+	return true;
+}
+#else
+static bool CompareBlocks(const ScanPattern_t& pattern, const std::uint8_t* pData) noexcept
+{
+	for (std::uint8_t i = 0; i < pattern.m_nMasks; ++i)
+	{
+		const __m128i xmm1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pData + i * 16));
+		const __m128i xmm2 = _mm_load_si128(reinterpret_cast<const __m128i*>(pattern.m_aBytes + i * 16));
+
+		if ((_mm_movemask_epi8(_mm_cmpeq_epi8(xmm1, xmm2)) & pattern.m_aMasks[i]) != pattern.m_aMasks[i])
+			return false;
+	}
+
+	return true;
+}
+#endif // DYNLIBUTILS_ARCH_ARM
+
+// Scalar tail: the blocks would be read past the end of the data.
+static const std::uint8_t* ScanTail(const ScanPattern_t& pattern, const std::uint8_t* pData, const std::uint8_t* pEnd) noexcept
+{
+	const std::uint8_t* pLast = pEnd - pattern.m_nSize;
+
+	const std::uint8_t nAnchor = pattern.m_aBytes[pattern.m_nAnchor];
+
+	for (; pData <= pLast; ++pData)
+	{
+		if (pData[pattern.m_nAnchor] != nAnchor)
+			continue;
+
+		DYNLIB_STATS(++s_nScanCandidates);
+
+		bool bFound = true;
+
+		for (std::size_t i = 0; i < pattern.m_nSize; ++i)
+		{
+			if ((pattern.m_aMasks[i / 16] & (1 << (i % 16))) && pData[i] != pattern.m_aBytes[i])
+			{
+				bFound = false;
+				break;
+			}
+		}
+
+		if (bFound)
+			return pData;
+	}
+
+	return nullptr;
+}
+
+// Tests the candidates of an anchor match bitmask in ascending order.
+// STRIDE is a count of the bits per candidate.
+template<std::size_t STRIDE = 1, typename T>
+DYNLIB_FORCE_INLINE static const std::uint8_t* CheckCandidates(const ScanPattern_t& pattern, const std::uint8_t* pData, T bits) noexcept
+{
+	while (bits)
+	{
+		int nBit;
+
+#if defined(_MSC_VER)
+		unsigned long nIndex;
+
+		if constexpr (sizeof(T) == 8)
+		{
+#	if defined(_M_X64) || defined(_M_ARM64)
+			_BitScanForward64(&nIndex, bits);
+#	else // No 64-bit scan of 32-bit targets: the low half, then the high one.
+			if (!_BitScanForward(&nIndex, static_cast<unsigned long>(bits)))
+			{
+				_BitScanForward(&nIndex, static_cast<unsigned long>(bits >> 32));
+				nIndex += 32;
+			}
+#	endif
+		}
+		else
+			_BitScanForward(&nIndex, bits);
+
+		nBit = static_cast<int>(nIndex);
+#else
+		if constexpr (sizeof(T) == 8)
+			nBit = __builtin_ctzll(bits);
+		else
+			nBit = __builtin_ctz(bits);
+#endif
+
+		nBit /= STRIDE;
+
+		DYNLIB_STATS(++s_nScanCandidates);
+
+		if (CompareBlocks(pattern, pData + nBit))
+			return pData + nBit;
+
+		bits &= bits - 1;
+	}
+
+	return nullptr;
+}
+
+// The kernels below test N candidate offsets per iteration by the anchor bytes
+// and fully compare the candidates only.
+#if DYNLIBUTILS_ARCH_ARM
+static const std::uint8_t* ScanNEON(const ScanPattern_t& pattern, const std::uint8_t* pData, const std::uint8_t* pEnd)
+{
+	constexpr std::size_t N = 16;
+
+	const std::size_t nSpan = N - 1 + pattern.m_nMasks * 16;
+
+	if (static_cast<std::size_t>(pEnd - pData) >= nSpan)
+	{
+		const uint8x16_t vAnchor = vdupq_n_u8(pattern.m_aBytes[pattern.m_nAnchor]);
+		const uint8x16_t vNext = vdupq_n_u8(pattern.m_aBytes[pattern.m_nNext]);
+
+		for (const std::uint8_t* pLast = pEnd - nSpan; pData <= pLast; pData += N)
+		{
+			const uint8x16_t v1 = vceqq_u8(vAnchor, vld1q_u8(pData + pattern.m_nAnchor));
+			const uint8x16_t v2 = vceqq_u8(vNext, vld1q_u8(pData + pattern.m_nNext));
+
+			// Narrow 0xFF/0x00 lanes to nibbles: the movemask of 4 bits per candidate.
+			const uint8x8_t vNibbles = vshrn_n_u16(vreinterpretq_u16_u8(vandq_u8(v1, v2)), 4);
+
+			std::uint64_t bits = vget_lane_u64(vreinterpret_u64_u8(vNibbles), 0) & 0x8888888888888888ull;
+
+			if (bits)
+			{
+				if (auto* pFound = CheckCandidates<4>(pattern, pData, bits))
+					return pFound;
+			}
+		}
+	}
+
+	return ScanTail(pattern, pData, pEnd);
+}
+
+static ScanKernel DetectScanKernel() noexcept
+{
+	return ScanKernel::NEON;
+}
+
+static ScanKernel_t GetScanKernelFunc(ScanKernel eKernel) noexcept
+{
+	return eKernel == ScanKernel::NEON ? ScanNEON : nullptr;
+}
+#else
+static const std::uint8_t* ScanSSE2(const ScanPattern_t& pattern, const std::uint8_t* pData, const std::uint8_t* pEnd)
+{
+	constexpr std::size_t N = 16;
+
+	const std::size_t nSpan = N - 1 + pattern.m_nMasks * 16;
+
+	if (static_cast<std::size_t>(pEnd - pData) >= nSpan)
+	{
+		const __m128i xmmAnchor = _mm_set1_epi8(static_cast<char>(pattern.m_aBytes[pattern.m_nAnchor]));
+		const __m128i xmmNext = _mm_set1_epi8(static_cast<char>(pattern.m_aBytes[pattern.m_nNext]));
+
+		for (const std::uint8_t* pLast = pEnd - nSpan; pData <= pLast; pData += N)
+		{
+			const __m128i xmm1 = _mm_cmpeq_epi8(xmmAnchor, _mm_loadu_si128(reinterpret_cast<const __m128i*>(pData + pattern.m_nAnchor)));
+			const __m128i xmm2 = _mm_cmpeq_epi8(xmmNext, _mm_loadu_si128(reinterpret_cast<const __m128i*>(pData + pattern.m_nNext)));
+
+			auto bits = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_and_si128(xmm1, xmm2)));
+
+			if (bits)
+			{
+				if (auto* pFound = CheckCandidates(pattern, pData, bits))
+					return pFound;
+			}
+		}
+	}
+
+	return ScanTail(pattern, pData, pEnd);
+}
+
+DYNLIB_TARGET("avx2")
+static const std::uint8_t* ScanAVX2(const ScanPattern_t& pattern, const std::uint8_t* pData, const std::uint8_t* pEnd)
+{
+	constexpr std::size_t N = 32;
+
+	const std::size_t nSpan = N - 1 + pattern.m_nMasks * 16;
+
+	if (static_cast<std::size_t>(pEnd - pData) >= nSpan)
+	{
+		const __m256i ymmAnchor = _mm256_set1_epi8(static_cast<char>(pattern.m_aBytes[pattern.m_nAnchor]));
+		const __m256i ymmNext = _mm256_set1_epi8(static_cast<char>(pattern.m_aBytes[pattern.m_nNext]));
+
+		for (const std::uint8_t* pLast = pEnd - nSpan; pData <= pLast; pData += N)
+		{
+			const __m256i ymm1 = _mm256_cmpeq_epi8(ymmAnchor, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pData + pattern.m_nAnchor)));
+			const __m256i ymm2 = _mm256_cmpeq_epi8(ymmNext, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pData + pattern.m_nNext)));
+
+			auto bits = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(ymm1, ymm2)));
+
+			if (bits)
+			{
+				if (auto* pFound = CheckCandidates(pattern, pData, bits))
+					return pFound;
+			}
+		}
+	}
+
+	return ScanTail(pattern, pData, pEnd);
+}
+
+DYNLIB_TARGET("avx512f,avx512bw")
+static const std::uint8_t* ScanAVX512(const ScanPattern_t& pattern, const std::uint8_t* pData, const std::uint8_t* pEnd)
+{
+	constexpr std::size_t N = 64;
+
+	const std::size_t nSpan = N - 1 + pattern.m_nMasks * 16;
+
+	if (static_cast<std::size_t>(pEnd - pData) >= nSpan)
+	{
+		const __m512i zmmAnchor = _mm512_set1_epi8(static_cast<char>(pattern.m_aBytes[pattern.m_nAnchor]));
+		const __m512i zmmNext = _mm512_set1_epi8(static_cast<char>(pattern.m_aBytes[pattern.m_nNext]));
+
+		for (const std::uint8_t* pLast = pEnd - nSpan; pData <= pLast; pData += N)
+		{
+			const __mmask64 k1 = _mm512_cmpeq_epi8_mask(zmmAnchor, _mm512_loadu_si512(pData + pattern.m_nAnchor));
+			const __mmask64 bits = _mm512_mask_cmpeq_epi8_mask(k1, zmmNext, _mm512_loadu_si512(pData + pattern.m_nNext));
+
+			if (bits)
+			{
+				if (auto* pFound = CheckCandidates(pattern, pData, static_cast<std::uint64_t>(bits)))
+					return pFound;
+			}
+		}
+	}
+
+	return ScanTail(pattern, pData, pEnd);
+}
+
+static void GetCPUID(int nLeaf, int nSubLeaf, unsigned int (&aRegs)[4]) noexcept
+{
+#if defined(_MSC_VER)
+	int aInfo[4];
+	__cpuidex(aInfo, nLeaf, nSubLeaf);
+
+	for (int i = 0; i < 4; ++i)
+		aRegs[i] = static_cast<unsigned int>(aInfo[i]);
+#else
+	__cpuid_count(nLeaf, nSubLeaf, aRegs[0], aRegs[1], aRegs[2], aRegs[3]);
+#endif
+}
+
+static std::uint64_t GetXCR0() noexcept
+{
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+
+	return (static_cast<std::uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Picks the widest scan kernel supported by the CPU and the OS
+// Output : ScanKernel
+//-----------------------------------------------------------------------------
+static ScanKernel DetectScanKernel() noexcept
+{
+	unsigned int aRegs[4];
+
+	GetCPUID(0, 0, aRegs);
+
+	if (aRegs[0] < 7)
+		return ScanKernel::SSE2;
+
+	GetCPUID(1, 0, aRegs);
+
+	constexpr unsigned int nOSXSAVE = 1u << 27, nAVX = 1u << 28;
+
+	if ((aRegs[2] & (nOSXSAVE | nAVX)) != (nOSXSAVE | nAVX))
+		return ScanKernel::SSE2;
+
+	const std::uint64_t nXCR0 = GetXCR0();
+
+	if ((nXCR0 & 0x6) != 0x6) // XMM & YMM states.
+		return ScanKernel::SSE2;
+
+	GetCPUID(7, 0, aRegs);
+
+	constexpr unsigned int nAVX2 = 1u << 5, nAVX512F = 1u << 16, nAVX512BW = 1u << 30;
+
+	if ((aRegs[1] & (nAVX512F | nAVX512BW)) == (nAVX512F | nAVX512BW) && (nXCR0 & 0xE6) == 0xE6) // + opmask & ZMM states.
+		return ScanKernel::AVX512;
+
+	if (aRegs[1] & nAVX2)
+		return ScanKernel::AVX2;
+
+	return ScanKernel::SSE2;
+}
+
+static ScanKernel_t GetScanKernelFunc(ScanKernel eKernel) noexcept
+{
+	switch (eKernel)
+	{
+		case ScanKernel::SSE2:
+			return ScanSSE2;
+
+		case ScanKernel::AVX2:
+			return ScanAVX2;
+
+		case ScanKernel::AVX512:
+			return ScanAVX512;
+
+		default:
+			return nullptr;
+	}
+}
+#endif // DYNLIBUTILS_ARCH_ARM
+
+static ScanKernel GetDetectedScanKernel() noexcept
+{
+	static const ScanKernel s_eDetected = DetectScanKernel();
+
+	return s_eDetected;
+}
+
+static std::atomic<ScanKernel>& GetScanKernelState() noexcept
+{
+	static std::atomic<ScanKernel> s_eKernel { GetDetectedScanKernel() };
+
+	return s_eKernel;
+}
+
+static ScanKernel_t GetScanKernelFunc() noexcept
+{
+	return GetScanKernelFunc(GetScanKernelState().load(std::memory_order_relaxed));
+}
+
+ScanKernel DynLibUtils::GetScanKernel() noexcept
+{
+	return GetScanKernelState().load(std::memory_order_relaxed);
+}
+
+const char* DynLibUtils::GetScanKernelName(ScanKernel eKernel) noexcept
+{
+	switch (eKernel)
+	{
+		case ScanKernel::SSE2:
+			return "sse2";
+
+		case ScanKernel::AVX2:
+			return "avx2";
+
+		case ScanKernel::AVX512:
+			return "avx512";
+
+		case ScanKernel::NEON:
+			return "neon";
+
+		default:
+			return "auto";
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Forces the kernel of the scans, the kernels of the architecture are
+//          ordered by width: any up to the detected one is supported
+//-----------------------------------------------------------------------------
+bool DynLibUtils::SetScanKernel(ScanKernel eKernel) noexcept
+{
+	const ScanKernel eDetected = GetDetectedScanKernel();
+
+	if (eKernel == ScanKernel::Auto)
+		eKernel = eDetected;
+	else if (!GetScanKernelFunc(eKernel) || eKernel > eDetected)
+		return false;
+
+	GetScanKernelState().store(eKernel, std::memory_order_relaxed);
+
+	return true;
+}
+
+// Built-in workers of the parallel scans (created on the first one).
+class CScanThreadPool
+{
+public:
+	CScanThreadPool()
+		: m_bStop(false)
+	{
+		const std::size_t nThreads = std::max(std::thread::hardware_concurrency(), 1u) - 1; // None on a single CPU.
+
+		m_vecThreads.reserve(nThreads);
+
+		for (std::size_t n = 0; n < nThreads; ++n)
+			m_vecThreads.emplace_back([this] { Work(); });
+	}
+
+	~CScanThreadPool()
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_bStop = true;
+		}
+
+		m_cv.notify_all();
+
+		for (auto& thread : m_vecThreads)
+			thread.join();
+	}
+
+	static CScanThreadPool& Get()
+	{
+		static CScanThreadPool s_pool;
+
+		return s_pool;
+	}
+
+	void Submit(std::function<void()> job)
+	{
+		{
+			std::lock_guard lock(m_mutex);
+			m_dequeJobs.emplace_back(std::move(job));
+		}
+
+		m_cv.notify_one();
+	}
+
+	std::size_t GetThreadCount() const noexcept { return m_vecThreads.size(); }
+
+private:
+	void Work()
+	{
+		std::unique_lock lock(m_mutex);
+
+		while (true)
+		{
+			m_cv.wait(lock, [this] { return m_bStop || !m_dequeJobs.empty(); });
+
+			if (m_dequeJobs.empty())
+				return;
+
+			auto job = std::move(m_dequeJobs.front());
+
+			m_dequeJobs.pop_front();
+			lock.unlock();
+			job();
+			lock.lock();
+		}
+	}
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::deque<std::function<void()>> m_dequeJobs;
+	std::vector<std::thread> m_vecThreads;
+	bool m_bStop;
+}; // class CScanThreadPool
+
+// State of a parallel scan, shared with the jobs (a late one may start after the scan has returned).
+struct ParallelScan_t
+{
+	ParallelScan_t(ScanKernel_t pfnKernel, const ScanPattern_t& pattern, const std::uint8_t* pData, const std::uint8_t* pEnd)
+		: m_pfnKernel(pfnKernel)
+		, m_pattern(pattern)
+		, m_pData(pData)
+		, m_pEnd(pEnd)
+		, m_nChunks((static_cast<std::size_t>(pEnd - pData) - pattern.m_nSize) / s_nParallelScanChunkSize + 1)
+		, m_vecFound(m_nChunks, nullptr)
+		, m_nNextChunk(0)
+		, m_nDoneChunks(0)
+		, m_nFoundChunk(m_nChunks)
+		, m_nCandidates(0)
+	{
+	}
+
+	// Takes the chunks in order until none is left. The ones past a found match are skipped.
+	void Run() noexcept
+	{
+		for (std::size_t i; (i = m_nNextChunk.fetch_add(1, std::memory_order_relaxed)) < m_nChunks;)
+		{
+			if (i < m_nFoundChunk.load(std::memory_order_relaxed))
+			{
+				// Chunks overlap by pattern size - 1, so a match on a boundary is found in the first one.
+				const std::uint8_t* pChunk = m_pData + i * s_nParallelScanChunkSize;
+				const std::uint8_t* pChunkEnd = std::min(m_pEnd, pChunk + s_nParallelScanChunkSize + m_pattern.m_nSize - 1);
+
+				DYNLIB_STATS(const std::uint64_t nCandidates = s_nScanCandidates);
+
+				if (const auto* pFound = m_pfnKernel(m_pattern, pChunk, pChunkEnd))
+				{
+					m_vecFound[i] = pFound;
+
+					for (std::size_t nFound = m_nFoundChunk.load(std::memory_order_relaxed); i < nFound && !m_nFoundChunk.compare_exchange_weak(nFound, i, std::memory_order_relaxed);)
+						;
+				}
+
+				DYNLIB_STATS(m_nCandidates.fetch_add(s_nScanCandidates - nCandidates, std::memory_order_relaxed); s_nScanCandidates = nCandidates);
+			}
+
+			if (m_nDoneChunks.fetch_add(1, std::memory_order_acq_rel) + 1 == m_nChunks)
+			{
+				std::lock_guard lock(m_mutex);
+				m_cv.notify_all();
+			}
+		}
+	}
+
+	const std::uint8_t* Wait()
+	{
+		std::unique_lock lock(m_mutex);
+		m_cv.wait(lock, [this] { return m_nDoneChunks.load(std::memory_order_acquire) == m_nChunks; });
+
+		const std::size_t nFound = m_nFoundChunk.load(std::memory_order_relaxed);
+
+		return nFound < m_nChunks ? m_vecFound[nFound] : nullptr;
+	}
+
+	const ScanKernel_t m_pfnKernel;
+	const ScanPattern_t m_pattern;
+	const std::uint8_t* const m_pData;
+	const std::uint8_t* const m_pEnd;
+	const std::size_t m_nChunks;
+
+	std::vector<const std::uint8_t*> m_vecFound;
+	std::atomic<std::size_t> m_nNextChunk;
+	std::atomic<std::size_t> m_nDoneChunks;
+	std::atomic<std::size_t> m_nFoundChunk;
+	std::atomic<std::uint64_t> m_nCandidates; // Of all the chunks, the scanned ones past the match too (DYNLIBUTILS_STATS).
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+};
+
+//-----------------------------------------------------------------------------
+// Purpose: Scans the range by chunks across the workers
+// Input  : pattern
+//          *pData
+//          *pEnd
+//          fnExecutor - built-in pool if empty
+// Output : first match or nullptr
+//-----------------------------------------------------------------------------
+static const std::uint8_t* ScanParallel(const ScanPattern_t& pattern, const std::uint8_t* pData, const std::uint8_t* pEnd, const ScanExecutor_t& fnExecutor)
+{
+	const std::size_t nThreads = fnExecutor ? std::max(std::thread::hardware_concurrency(), 1u) - 1 : CScanThreadPool::Get().GetThreadCount();
+
+	if (!nThreads)
+		return GetScanKernelFunc()(pattern, pData, pEnd); // A single CPU, the chunks would only add their overhead.
+
+	auto pScan = std::make_shared<ParallelScan_t>(GetScanKernelFunc(), pattern, pData, pEnd);
+
+	const std::size_t nJobs = std::min(nThreads, pScan->m_nChunks - 1);
+
+	for (std::size_t n = 0; n < nJobs; ++n)
+	{
+		auto job = [pScan] { pScan->Run(); };
+
+		if (fnExecutor)
+			fnExecutor(std::move(job));
+		else
+			CScanThreadPool::Get().Submit(std::move(job));
+	}
+
+	pScan->Run();
+
+	const std::uint8_t* pFound = pScan->Wait();
+
+	DYNLIB_STATS(s_nScanCandidates += pScan->m_nCandidates.load(std::memory_order_relaxed));
+
+	return pFound;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Scans the data of a section in the module file instead of the memory
+// Input  : image
+//          section
+//          nStart - offset in the section
+//          pattern
+//          bStream - reads the file by chunks instead of the mapping
+// Output : offset of the first match in the section, or -1
+//-----------------------------------------------------------------------------
+static std::size_t ScanImage(const CMappedImage& image, const CMappedImage::FileSection_t& section, std::size_t nStart, const ScanPattern_t& pattern, bool bStream)
+{
+	static constexpr std::size_t s_nNotFound = static_cast<std::size_t>(-1);
+
+	if (nStart >= section.m_nFileSize || section.m_nFileSize - nStart < pattern.m_nSize)
+		return s_nNotFound;
+
+	const ScanKernel_t pfnKernel = GetScanKernelFunc();
+
+	if (!bStream)
+	{
+		const auto* pData = image.GetData() + section.m_nOffset;
+		const auto* pFound = pfnKernel(pattern, pData + nStart, pData + section.m_nFileSize);
+
+		return pFound ? static_cast<std::size_t>(pFound - pData) : s_nNotFound;
+	}
+
+	struct Context_t
+	{
+		ScanKernel_t m_pfnKernel;
+		const ScanPattern_t& m_pattern;
+		std::size_t m_nFound;
+	} context { pfnKernel, pattern, s_nNotFound };
+
+	image.Stream(section.m_nOffset + nStart, section.m_nFileSize - nStart, pattern.m_nSize - 1, [](const void* pContext, const std::uint8_t* pChunk, std::size_t nChunkSize, std::size_t nChunkOffset) -> bool
+	{
+		auto* pScan = const_cast<Context_t*>(static_cast<const Context_t*>(pContext));
+
+		if (nChunkSize < pScan->m_pattern.m_nSize)
+			return true;
+
+		const auto* pFound = pScan->m_pfnKernel(pScan->m_pattern, pChunk, pChunk + nChunkSize);
+
+		if (!pFound)
+			return true;
+
+		pScan->m_nFound = nChunkOffset + static_cast<std::size_t>(pFound - pChunk);
+
+		return false;
+	}, &context);
+
+	return context.m_nFound != s_nNotFound ? context.m_nFound - section.m_nOffset : s_nNotFound;
+}
+
+void CSymbolIndex::Reserve(std::size_t nSymbols, std::size_t nNamesSize)
+{
+	m_vecSymbols.reserve(nSymbols);
+	m_sNames.reserve(nNamesSize);
+}
+
+void CSymbolIndex::Add(const std::string_view svName, std::uintptr_t nOffset, std::size_t nSize, bool bIndirect)
+{
+	if (svName.empty())
+		return;
+
+	m_vecSymbols.push_back({ Hash(svName), static_cast<std::uint32_t>(m_sNames.size()), static_cast<std::uint32_t>(svName.size()), bIndirect, nOffset, nSize });
+
+	m_sNames.append(svName);
+	m_sNames.push_back('\0');
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Groups the symbols by the buckets and fills the bloom filter
+//-----------------------------------------------------------------------------
+void CSymbolIndex::Build()
+{
+	const std::size_t nSymbols = m_vecSymbols.size();
+
+	m_vecBuckets.assign(std::max<std::size_t>(nSymbols / 4, 1) + 1, 0);
+	m_vecBloom.assign(nSymbols / 4 + 1, 0); // 4 symbols (8 bits of 64) per word, ~1.5% false positives.
+
+	const std::size_t nBuckets = m_vecBuckets.size() - 1;
+
+	for (const auto& symbol : m_vecSymbols)
+	{
+		m_vecBuckets[symbol.m_nHash % nBuckets + 1]++;
+
+		auto& nWord = m_vecBloom[(symbol.m_nHash / 64) % m_vecBloom.size()];
+
+		nWord |= (1ull << (symbol.m_nHash % 64)) | (1ull << ((symbol.m_nHash >> s_nBloomShift) % 64));
+	}
+
+	for (std::size_t i = 1; i <= nBuckets; ++i)
+		m_vecBuckets[i] += m_vecBuckets[i - 1];
+
+	// Stable: the first of the same names (.dynsym is added before .symtab) is found.
+	std::vector<Symbol_t> vecSorted(nSymbols);
+	std::vector<std::uint32_t> vecFill(m_vecBuckets.begin(), m_vecBuckets.end() - 1);
+
+	for (const auto& symbol : m_vecSymbols)
+		vecSorted[vecFill[symbol.m_nHash % nBuckets]++] = symbol;
+
+	m_vecSymbols = std::move(vecSorted);
+}
+
+void CSymbolIndex::Clear() noexcept
+{
+	m_sNames.clear();
+	m_vecSymbols.clear();
+	m_vecBuckets.clear();
+	m_vecBloom.clear();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the symbol by the name
+// Input  : svName
+// Output : Symbol_t* (nullptr if none)
+//-----------------------------------------------------------------------------
+const CSymbolIndex::Symbol_t* CSymbolIndex::Find(const std::string_view svName) const noexcept
+{
+	if (m_vecBuckets.empty())
+		return nullptr;
+
+	const std::uint32_t nHash = Hash(svName);
+	const std::uint64_t nWord = m_vecBloom[(nHash / 64) % m_vecBloom.size()];
+	const std::uint64_t nBits = (1ull << (nHash % 64)) | (1ull << ((nHash >> s_nBloomShift) % 64));
+
+	if ((nWord & nBits) != nBits)
+		return nullptr;
+
+	const std::size_t nBucket = nHash % (m_vecBuckets.size() - 1);
+
+	for (std::uint32_t i = m_vecBuckets[nBucket], nEnd = m_vecBuckets[nBucket + 1]; i < nEnd; ++i)
+	{
+		const Symbol_t& symbol = m_vecSymbols[i];
+
+		if (symbol.m_nHash == nHash && symbol.m_nNameSize == svName.size() && !std::memcmp(GetName(symbol), svName.data(), svName.size()))
+			return &symbol;
+	}
+
+	return nullptr;
+}
+
+void CTypeIndex::Add(const std::string_view svName, std::uintptr_t nOffset, std::ptrdiff_t nOffsetToTop)
+{
+	m_vecPending.push_back({ std::string(svName), { nOffset, nOffsetToTop } });
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Groups the tables by the types and indexes the names
+//-----------------------------------------------------------------------------
+void CTypeIndex::Build()
+{
+	std::stable_sort(m_vecPending.begin(), m_vecPending.end(), [](const Pending_t& a, const Pending_t& b) { return a.m_sName < b.m_sName; });
+
+	m_vecTables.clear();
+	m_vecTables.reserve(m_vecPending.size());
+	m_names.Clear();
+
+	for (std::size_t i = 0; i < m_vecPending.size();)
+	{
+		std::size_t j = i;
+
+		for (; j < m_vecPending.size() && m_vecPending[j].m_sName == m_vecPending[i].m_sName; ++j)
+			m_vecTables.push_back(m_vecPending[j].m_table);
+
+		m_names.Add(m_vecPending[i].m_sName, i, j - i);
+
+		i = j;
+	}
+
+	m_names.Build();
+	m_vecPending.clear();
+	m_vecPending.shrink_to_fit();
+}
+
+void CTypeIndex::Clear() noexcept
+{
+	m_vecPending.clear();
+	m_vecTables.clear();
+	m_names.Clear();
+}
+
+CTypeIndex::Type_t CTypeIndex::Find(const std::string_view svName) const noexcept
+{
+	if (const auto* pName = m_names.Find(svName))
+		return { m_vecTables.data() + pName->m_nOffset, pName->m_nSize };
+
+	return { nullptr, 0 };
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Groups the references by the targets (in the source order) and
+//          hashes each target into an open addressing table (of twice the count
+//          of the targets at least)
+//-----------------------------------------------------------------------------
+void CReferenceIndex::Build()
+{
+	std::sort(m_vecReferences.begin(), m_vecReferences.end(), [](const Reference_t& a, const Reference_t& b) { return a.m_nTarget != b.m_nTarget ? a.m_nTarget < b.m_nTarget : a.m_nSource < b.m_nSource; });
+
+	std::size_t nTargets = 0;
+
+	for (std::size_t i = 0; i < m_vecReferences.size(); ++i)
+		nTargets += !i || m_vecReferences[i].m_nTarget != m_vecReferences[i - 1].m_nTarget;
+
+	std::size_t nCapacity = 16;
+
+	m_nShift = 64 - 4;
+
+	while (nCapacity < 2 * nTargets)
+	{
+		nCapacity <<= 1;
+		m_nShift--;
+	}
+
+	m_vecSlots.assign(nCapacity, 0);
+
+	const std::size_t nMask = nCapacity - 1;
+
+	for (std::size_t i = 0; i < m_vecReferences.size(); ++i)
+	{
+		if (i && m_vecReferences[i].m_nTarget == m_vecReferences[i - 1].m_nTarget)
+			continue;
+
+		std::size_t nSlot = Hash(m_vecReferences[i].m_nTarget, m_nShift);
+
+		while (m_vecSlots[nSlot])
+			nSlot = (nSlot + 1) & nMask;
+
+		m_vecSlots[nSlot] = static_cast<std::uint32_t>(i + 1);
+	}
+
+	m_vecReferences.shrink_to_fit();
+}
+
+void CReferenceIndex::Clear() noexcept
+{
+	m_vecReferences.clear();
+	m_vecSlots.clear();
+	m_nShift = 64;
+}
+
+Span_t<CReferenceIndex::Reference_t> CReferenceIndex::Find(std::uint32_t nTarget) const noexcept
+{
+	if (m_vecSlots.empty())
+		return {};
+
+	const std::size_t nMask = m_vecSlots.size() - 1;
+
+	for (std::size_t nSlot = Hash(nTarget, m_nShift);; nSlot = (nSlot + 1) & nMask)
+	{
+		const std::uint32_t nIndex = m_vecSlots[nSlot];
+
+		if (!nIndex)
+			return {};
+
+		if (m_vecReferences[nIndex - 1].m_nTarget != nTarget)
+			continue;
+
+		std::size_t nEnd = nIndex;
+
+		while (nEnd < m_vecReferences.size() && m_vecReferences[nEnd].m_nTarget == nTarget)
+			nEnd++;
+
+		return { m_vecReferences.data() + nIndex - 1, nEnd - (nIndex - 1) };
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Decodes the references of the code by a linear sweep of the instructions
+//          (DecodeInstruction on x86, a byte which doesn't decode is stepped over):
+//          x86 - call/jmp/jcc rel32, and any [rip + disp32] operand on x86-64;
+//          AArch64 - b, bl, b.cond and adrp followed by add/ldr of the register.
+//          ARM32 and the absolute (relocated) operands of x86-32 aren't decoded
+// Input  : pCode - of the executable section
+//          nSize
+//          nCodeOffset - of the section from the module base
+//          nImageEnd - of the module extent from the base, out of it the targets
+//                      are dropped
+//          index
+//-----------------------------------------------------------------------------
+static void DecodeReferences(const std::uint8_t* pCode, std::size_t nSize, std::uint32_t nCodeOffset, std::uint32_t nImageEnd, CReferenceIndex& index)
+{
+	auto funcAdd = [&](std::int64_t nTarget, std::size_t nSource, ReferenceKind eKind) -> bool
+	{
+		if (nTarget < 0 || nTarget >= nImageEnd)
+			return false;
+
+		index.Add(static_cast<std::uint32_t>(nTarget), static_cast<std::uint32_t>(nCodeOffset + nSource), eKind);
+
+		return true;
+	};
+
+#if DYNLIBUTILS_ARCH_ARM
+#	if DYNLIBUTILS_ARCH_BITS == 64
+	auto funcSignExtend = [](std::uint32_t nValue, unsigned nBits) -> std::int64_t
+	{
+		return static_cast<std::int64_t>(static_cast<std::uint64_t>(nValue) << (64 - nBits)) >> (64 - nBits);
+	};
+
+	for (std::size_t i = 0; i + 4 <= nSize; i += 4)
+	{
+		std::uint32_t nInsn;
+
+		std::memcpy(&nInsn, pCode + i, sizeof(nInsn));
+
+		const std::int64_t nPC = static_cast<std::int64_t>(nCodeOffset) + static_cast<std::int64_t>(i);
+
+		if ((nInsn & 0x7C000000) == 0x14000000) // b, bl.
+		{
+			funcAdd(nPC + funcSignExtend(nInsn & 0x03FFFFFF, 26) * 4, i, (nInsn & 0x80000000) ? ReferenceKind::Call : ReferenceKind::Jump);
+		}
+		else if ((nInsn & 0xFF000010) == 0x54000000) // b.cond
+		{
+			funcAdd(nPC + funcSignExtend((nInsn >> 5) & 0x7FFFF, 19) * 4, i, ReferenceKind::Jump);
+		}
+		else if ((nInsn & 0x9F000000) == 0x90000000 && i + 8 <= nSize) // adrp, the base is page aligned.
+		{
+			std::uint32_t nNext;
+
+			std::memcpy(&nNext, pCode + i + 4, sizeof(nNext));
+
+			const std::uint32_t nRegister = nInsn & 0x1F;
+			const std::int64_t nPage = (nPC & ~std::int64_t(0xFFF)) + funcSignExtend((((nInsn >> 5) & 0x7FFFF) << 2) | ((nInsn >> 29) & 0x3), 21) * 0x1000;
+			const std::uint32_t nImmediate = (nNext >> 10) & 0xFFF;
+
+			if (((nNext >> 5) & 0x1F) != nRegister)
+				continue;
+
+			if ((nNext & 0xFFC00000) == 0x91000000) // add Xd, Xn, #imm
+				funcAdd(nPage + nImmediate, i, ReferenceKind::Address);
+			else if ((nNext & 0xFFC00000) == 0xF9400000) // ldr Xt, [Xn, #imm]
+				funcAdd(nPage + nImmediate * 8, i, ReferenceKind::Data);
+		}
+	}
+#	else
+	(void)pCode;
+	(void)nSize;
+	(void)funcAdd;
+#	endif
+#else
+	auto funcRelative = [&](const std::uint8_t* pOperand, std::size_t nEnd) -> std::int64_t
+	{
+		std::int32_t nDisplacement;
+
+		std::memcpy(&nDisplacement, pOperand, sizeof(nDisplacement));
+
+		return static_cast<std::int64_t>(nCodeOffset) + static_cast<std::int64_t>(nEnd) + nDisplacement;
+	};
+
+	static constexpr std::size_t s_nMaxLength = 15;
+
+	std::uint8_t aTail[2 * s_nMaxLength] = {}; // The last instructions, padded for the decoder.
+
+	for (std::size_t i = 0; i < nSize;)
+	{
+		const std::uint8_t* pInsn = pCode + i;
+
+		if (nSize - i < s_nMaxLength)
+		{
+			std::memcpy(aTail, pInsn, nSize - i);
+			pInsn = aTail;
+		}
+
+		Instruction_t insn;
+
+		if (!DecodeInstruction(CMemory(reinterpret_cast<std::uintptr_t>(pInsn)), insn) || !insn.m_nLength || insn.m_nLength > nSize - i)
+		{
+			i++; // Padding or data, resynchronizes.
+			continue;
+		}
+
+		const std::size_t nEnd = i + insn.m_nLength;
+
+		if (insn.m_nRelOffset && insn.m_nRelSize == 4) // call/jmp/jcc rel32
+			funcAdd(funcRelative(pInsn + insn.m_nRelOffset, nEnd), i, pInsn[insn.m_nOpcodeOffset] == 0xE8 ? ReferenceKind::Call : ReferenceKind::Jump);
+		else if (insn.m_nDispOffset) // [rip + disp32]
+			funcAdd(funcRelative(pInsn + insn.m_nDispOffset, nEnd), i, pInsn[insn.m_nOpcodeOffset] == 0x8D ? ReferenceKind::Address : ReferenceKind::Data);
+
+		i = nEnd;
+	}
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Locks the mutex, counting the wait if it's contended (DYNLIBUTILS_STATS)
+// Input  : mutex
+//          nWaits
+//          nWaitTime - nanoseconds
+// Output : std::unique_lock<Mutex>
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+static std::unique_lock<Mutex> LockTimed(Mutex& mutex, std::atomic<std::uint64_t>& nWaits, std::atomic<std::uint64_t>& nWaitTime)
+{
+#if DYNLIBUTILS_STATS
+	std::unique_lock<Mutex> lock(mutex, std::try_to_lock);
+
+	if (!lock.owns_lock())
+	{
+		const std::uint64_t nStartTime = GetStatsTime();
+
+		lock.lock();
+
+		nWaits.fetch_add(1, std::memory_order_relaxed);
+		nWaitTime.fetch_add(GetStatsTime() - nStartTime, std::memory_order_relaxed);
+	}
+
+	return lock;
+#else
+	(void)nWaits;
+	(void)nWaitTime;
+
+	return std::unique_lock<Mutex>(mutex);
+#endif
+}
+
+template<typename Mutex>
+auto CAddressCache<Mutex>::Lock() const -> UniqueLock_t
+{
+	return LockTimed(m_mutex, m_nLockWaits, m_nLockWaitTime);
+}
+
+template<typename Mutex>
+auto CAddressCache<Mutex>::Probe(const Table_t& table, const CCacheKey& key, std::size_t nHash) noexcept -> std::atomic<Node_t*>*
+{
+	for (std::size_t i = nHash & table.m_nMask;; i = (i + 1) & table.m_nMask)
+	{
+		auto& slot = table.m_aSlots[i];
+		const Node_t* pNode = slot.load(std::memory_order_acquire);
+
+		if (!pNode || (pNode->m_nHash == nHash && pNode->GetKey() == key))
+			return &slot;
+	}
+}
+
+template<typename Mutex>
+std::size_t CAddressCache<Mutex>::GetShard() noexcept
+{
+	static std::atomic<std::size_t> s_nThreads {};
+	thread_local const std::size_t s_nShard = s_nThreads.fetch_add(1, std::memory_order_relaxed) % s_nReaderShards;
+
+	return s_nShard;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Looks up the address without locking or allocation, counted in flight
+//          so the table it walks isn't freed meanwhile
+// Input  : key
+//          nHash - key.Hash()
+// Output : CMemory (invalid if isn't cached)
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+CMemory CAddressCache<Mutex>::Find(const CCacheKey& key, std::size_t nHash) const noexcept
+{
+	constexpr bool bShared = !std::is_same_v<Mutex, CNullMutex>;
+
+	std::atomic<std::size_t>* pReaders = bShared ? &m_aReaders[GetShard()].m_nCount : nullptr;
+
+	if (bShared)
+		pReaders->fetch_add(1, std::memory_order_seq_cst);
+
+	const Table_t* pTable = m_pTable.load(bShared ? std::memory_order_seq_cst : std::memory_order_acquire);
+	const Node_t* pNode = pTable ? Probe(*pTable, key, nHash)->load(std::memory_order_acquire) : nullptr;
+	const CMemory pAddr = pNode ? CMemory(pNode->m_pAddr.load(std::memory_order_relaxed)) : CMemory(nullptr);
+
+	if (bShared)
+		pReaders->fetch_sub(1, std::memory_order_release);
+
+	return pAddr;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Makes the table current, the replaced one is retired
+// Input  : pTable
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+void CAddressCache<Mutex>::Publish(std::unique_ptr<Table_t> pTable)
+{
+	m_vecTables.reserve(m_vecTables.size() + 1); // The store is the last, to not throw after it.
+	m_pTable.store(pTable.get(), std::memory_order_seq_cst);
+	m_vecTables.push_back(std::move(pTable));
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Frees the retired tables and nodes if no lookup is in flight. A lookup
+//          which starts after the check loads the current table, so it can't reach them
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+void CAddressCache<Mutex>::Trim() noexcept
+{
+	if constexpr (!std::is_same_v<Mutex, CNullMutex>)
+	{
+		for (const auto& readers : m_aReaders)
+		{
+			if (readers.m_nCount.load(std::memory_order_seq_cst))
+				return;
+		}
+	}
+
+	if (m_vecTables.size() > 1)
+		m_vecTables.erase(m_vecTables.begin(), m_vecTables.end() - 1);
+
+	m_vecRetiredNodes.clear();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Stores the address (replaces the cached one)
+// Input  : key - copied
+//          pAddr
+//          nHash - key.Hash()
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+void CAddressCache<Mutex>::Insert(const CCacheKey& key, const CMemory& pAddr, std::size_t nHash)
+{
+	const UniqueLock_t lock = Lock();
+
+	Table_t* pTable = m_pTable.load(std::memory_order_relaxed);
+
+	if (pTable)
+	{
+		if (Node_t* pNode = Probe(*pTable, key, nHash)->load(std::memory_order_relaxed))
+		{
+			pNode->m_pAddr.store(pAddr.GetAddr(), std::memory_order_relaxed);
+
+			return;
+		}
+	}
+
+	const std::size_t nSize = m_nSize.load(std::memory_order_relaxed);
+
+	if (!pTable || (nSize + 1) * 2 > pTable->m_nMask + 1) // Keep the load under 1/2 for short probes.
+	{
+		auto pNewTable = std::make_unique<Table_t>(pTable ? (pTable->m_nMask + 1) * 2 : s_nMinCapacity);
+
+		for (std::size_t i = 0; i <= pNewTable->m_nMask; ++i)
+			pNewTable->m_aSlots[i].store(nullptr, std::memory_order_relaxed);
+
+		for (const auto& pNode : m_vecNodes)
+			Probe(*pNewTable, pNode->GetKey(), pNode->m_nHash)->store(pNode.get(), std::memory_order_relaxed);
+
+		pTable = pNewTable.get();
+		Publish(std::move(pNewTable));
+	}
+
+	auto pNode = std::make_unique<Node_t>();
+
+	pNode->m_nHash = nHash;
+	pNode->m_sPattern.assign(key.m_svPattern);
+	pNode->m_sMask.assign(key.m_svMask);
+	pNode->m_nStart = key.m_nStart;
+	pNode->m_pSectionAddr = key.m_pSectionAddr;
+	pNode->m_nSectionSize = key.m_nSectionSize;
+	pNode->m_pAddr.store(pAddr.GetAddr(), std::memory_order_relaxed);
+
+	if (m_vecNodes.size() == m_vecNodes.capacity())
+		m_vecNodes.reserve(std::max<std::size_t>(m_vecNodes.capacity() * 2, s_nMinCapacity)); // Geometric, an exact one would move all the nodes each time.
+
+	Probe(*pTable, key, nHash)->store(pNode.get(), std::memory_order_release);
+	m_vecNodes.push_back(std::move(pNode));
+	m_nSize.store(nSize + 1, std::memory_order_relaxed);
+
+	Trim();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Drops the entries. The memory is retired (lookups may be in the old table)
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+void CAddressCache<Mutex>::Clear()
+{
+	const UniqueLock_t lock = Lock();
+
+	auto pNewTable = std::make_unique<Table_t>(s_nMinCapacity);
+
+	for (std::size_t i = 0; i <= pNewTable->m_nMask; ++i)
+		pNewTable->m_aSlots[i].store(nullptr, std::memory_order_relaxed);
+
+	Publish(std::move(pNewTable));
+	m_vecRetiredNodes.insert(m_vecRetiredNodes.end(), std::make_move_iterator(m_vecNodes.begin()), std::make_move_iterator(m_vecNodes.end()));
+	m_vecNodes.clear();
+	m_nSize.store(0, std::memory_order_relaxed);
+
+	Trim();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Rebuilds the table of the rebased entries, the start and section
+//          addresses of the range are moved too. The replaced nodes are retired
+//          as by Clear
+// Input  : nOldBase
+//          nSize
+//          nNewBase
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+void CAddressCache<Mutex>::Rebase(std::uintptr_t nOldBase, std::size_t nSize, std::uintptr_t nNewBase)
+{
+	const UniqueLock_t lock = Lock();
+
+	auto funcRebase = [&](std::uintptr_t nAddr) { return nAddr - nOldBase < nSize ? nNewBase + (nAddr - nOldBase) : nAddr; };
+
+	std::vector<std::unique_ptr<Node_t>> vecNodes;
+
+	vecNodes.reserve(m_vecNodes.size());
+
+	for (const auto& pNode : m_vecNodes)
+	{
+		const std::uintptr_t pAddr = pNode->m_pAddr.load(std::memory_order_relaxed);
+
+		if (pAddr - nOldBase >= nSize)
+			continue;
+
+		auto pNewNode = std::make_unique<Node_t>();
+
+		pNewNode->m_sPattern = pNode->m_sPattern;
+		pNewNode->m_sMask = pNode->m_sMask;
+		pNewNode->m_nStart = funcRebase(pNode->m_nStart);
+		pNewNode->m_pSectionAddr = funcRebase(pNode->m_pSectionAddr);
+		pNewNode->m_nSectionSize = pNode->m_nSectionSize;
+		pNewNode->m_pAddr.store(nNewBase + (pAddr - nOldBase), std::memory_order_relaxed);
+		pNewNode->m_nHash = pNewNode->GetKey().Hash();
+
+		vecNodes.push_back(std::move(pNewNode));
+	}
+
+	std::size_t nCapacity = s_nMinCapacity;
+
+	while (vecNodes.size() * 2 > nCapacity)
+		nCapacity <<= 1;
+
+	auto pNewTable = std::make_unique<Table_t>(nCapacity);
+
+	for (std::size_t i = 0; i <= pNewTable->m_nMask; ++i)
+		pNewTable->m_aSlots[i].store(nullptr, std::memory_order_relaxed);
+
+	for (const auto& pNode : vecNodes)
+		Probe(*pNewTable, pNode->GetKey(), pNode->m_nHash)->store(pNode.get(), std::memory_order_relaxed);
+
+	Publish(std::move(pNewTable));
+	m_vecRetiredNodes.insert(m_vecRetiredNodes.end(), std::make_move_iterator(m_vecNodes.begin()), std::make_move_iterator(m_vecNodes.end()));
+	m_vecNodes = std::move(vecNodes);
+	m_nSize.store(m_vecNodes.size(), std::memory_order_relaxed);
+
+	Trim();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: constructor
+// Input  : szModuleName (without extension .dll/.so)
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+CAssemblyModule<Mutex>::CAssemblyModule(const std::string_view szModuleName) : m_pExecutableSection(nullptr), m_nSavedCacheSize(0), m_nParallelScanSize(0), m_pResolves(CreateResolveQueue())
+{
+	InitFromName(szModuleName);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Streams the matches of the pattern to the callback (one kernel setup for all)
+// Input  : *pPattern
+//          svMask
+//          pStartAddress
+//          *pModuleSection
+//          nMaxCount
+//          pfnCallback
+//          *pContext
+// Output : count of the found patterns
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+std::size_t CAssemblyModule<Mutex>::ScanAllPatterns(const std::uint8_t* pPattern, const std::string_view svMask, const CMemory& pStartAddress, const Section_t* pModuleSection, std::size_t nMaxCount, ScanCallback_t pfnCallback, const void* pContext) const
+{
+	const Section_t* pSection = pModuleSection ? pModuleSection : m_pExecutableSection;
+
+	if (!pSection || !pSection->IsValid())
+		return 0;
+
+	const std::size_t patternSize = svMask.size();
+
+	if (!patternSize || patternSize > pSection->m_nSectionSize || patternSize > s_nMaxSimdBlocks * 16)
+		return 0;
+
+	const auto* pData = pSection->RCast<const std::uint8_t*>();
+	const auto* pEnd = pData + pSection->m_nSectionSize;
+
+	if (pStartAddress)
+	{
+		const auto* start = pStartAddress.RCast<const std::uint8_t*>();
+		if (start < pData || start > pEnd - patternSize)
+			return 0;
+
+		pData = start;
+	}
+
+	const ScanPattern_t pattern(pPattern, svMask);
+	const ScanKernel_t pfnKernel = GetScanKernelFunc();
+
+	std::size_t foundCount = 0;
+
+	DYNLIB_STATS(const auto* pStart = pData; const auto* pScannedEnd = pEnd; const std::uint8_t* pFirst = nullptr; const std::uint64_t nStartTime = GetStatsTime(), nStartCandidates = s_nScanCandidates);
+
+	while (foundCount < nMaxCount && static_cast<std::size_t>(pEnd - pData) >= patternSize)
+	{
+		const auto* pFound = pattern.m_bWildcard ? pData : pfnKernel(pattern, pData, pEnd);
+
+		if (!pFound)
+			break;
+
+		DYNLIB_STATS(if (!pFirst) pFirst = pFound);
+
+		if (!pfnCallback(pContext, foundCount, const_cast<std::uint8_t*>(pFound))) // foundCount = the index of found pattern now.
+		{
+			DYNLIB_STATS(pScannedEnd = pFound + patternSize);
+			break;
+		}
+
+		++foundCount;
+
+		pData = pFound + patternSize;
+	}
+
+#if DYNLIBUTILS_STATS
+	if (foundCount >= nMaxCount)
+		pScannedEnd = pData;
+
+	const ScanEvent_t event
+	{
+		std::string_view(reinterpret_cast<const char*>(pPattern), patternSize), svMask, pSection, ScanSource::Memory,
+		GetStatsTime() - nStartTime, static_cast<std::size_t>(pScannedEnd - pStart), s_nScanCandidates - nStartCandidates,
+		foundCount, 1, const_cast<std::uint8_t*>(pFirst)
+	};
+
+	AddScanStats(event, 1);
+
+	if (m_fnStatsSink)
+		m_fnStatsSink(event);
+#endif
+
+	return foundCount;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: constructor
+// Input  : pModuleMemory
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+CAssemblyModule<Mutex>::CAssemblyModule(const CMemory& pModuleMemory) : m_pExecutableSection(nullptr), m_nSavedCacheSize(0), m_nParallelScanSize(0), m_pResolves(CreateResolveQueue())
+{
+	InitFromMemory(pModuleMemory);
+}
+
+template<typename Mutex>
+CMemory CAssemblyModule<Mutex>::GetFunctionByName(const std::string_view svFunctionName) const noexcept
+{
+	const CCacheKey hKey(svFunctionName, 1);
+	if (auto pAddr = m_cache.Find(hKey))
+	{
+		DYNLIB_STATS(m_stats.m_nCacheHits.fetch_add(1, std::memory_order_relaxed));
+		return pAddr;
+	}
+	DYNLIB_STATS(m_stats.m_nCacheMisses.fetch_add(1, std::memory_order_relaxed));
+	auto pAddr = GetFunction(svFunctionName);
+	try
+	{
+		m_cache.Insert(hKey, pAddr);
+	}
+	catch (...)
+	{
+		// Not cached when out of memory, the address is still right.
+	}
+	return pAddr;
+}
+
+template<typename Mutex>
+CMemory CAssemblyModule<Mutex>::GetVirtualTableByName(const std::string_view svTableName, bool bDecorated) const
+{
+	const CCacheKey hKey(svTableName, bDecorated ? 3 : 2);
+	if (auto pAddr = m_cache.Find(hKey))
+	{
+		DYNLIB_STATS(m_stats.m_nCacheHits.fetch_add(1, std::memory_order_relaxed));
+		return pAddr;
+	}
+	DYNLIB_STATS(m_stats.m_nCacheMisses.fetch_add(1, std::memory_order_relaxed));
+	auto pAddr = GetVirtualTable(svTableName, bDecorated);
+	m_cache.Insert(hKey, pAddr);
+	return pAddr;
+}
+
+template<typename Mutex>
+CMemory CAssemblyModule<Mutex>::GetSymbol(const std::string_view svSymbolName) const noexcept
+{
+	if (m_symbols.IsEmpty())
+		return GetFunction(svSymbolName);
+
+	const auto* pSymbol = m_symbols.Find(svSymbolName);
+
+	if (!pSymbol)
+		return DYNLIB_INVALID_MEMORY;
+
+	if (pSymbol->m_bIndirect)
+		return GetFunction(m_symbols.GetName(*pSymbol)); // The resolver is called by the loader.
+
+	return GetBase() + pSymbol->m_nOffset;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Returns the extent of the module sections from the base
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+std::size_t CAssemblyModule<Mutex>::GetImageSize() const noexcept
+{
+	const std::uintptr_t nBase = GetBase().GetAddr();
+
+	std::size_t nSize = 0;
+
+	for (const auto& section : m_vecSections)
+		if (const std::uintptr_t nAddr = static_cast<std::uintptr_t>(section.GetAddr()); nAddr >= nBase)
+			nSize = std::max(nSize, nAddr - nBase + section.m_nSectionSize);
+
+	return nSize;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Decodes the executable section into a new reference index and
+//          publishes it, the targets are kept within the extent of the module
+//          sections. The previous indices are kept for their spans
+// Output : the published index
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+const CReferenceIndex* CAssemblyModule<Mutex>::IndexReferences() const
+{
+	auto pIndex = std::make_unique<CReferenceIndex>();
+
+	const std::uintptr_t nBase = GetBase().GetAddr();
+
+	const std::uintptr_t nCode = IsValid() && m_pExecutableSection ? static_cast<std::uintptr_t>(m_pExecutableSection->GetAddr()) : 0;
+
+	constexpr std::uintptr_t s_nMaxOffset = std::numeric_limits<std::uint32_t>::max();
+
+	if (nCode && m_pExecutableSection->m_nSectionSize && nCode >= nBase && nCode - nBase + m_pExecutableSection->m_nSectionSize <= s_nMaxOffset)
+	{
+		const std::uintptr_t nImageEnd = GetImageSize();
+
+		pIndex->Reserve(m_pExecutableSection->m_nSectionSize / 32);
+
+		DecodeReferences(m_pExecutableSection->RCast<const std::uint8_t*>(), m_pExecutableSection->m_nSectionSize, static_cast<std::uint32_t>(nCode - nBase), static_cast<std::uint32_t>(std::min(nImageEnd, s_nMaxOffset)), *pIndex);
+
+		pIndex->Build();
+	}
+
+	m_vecReferences.push_back(std::move(pIndex));
+
+	const CReferenceIndex* pPublished = m_vecReferences.back().get();
+
+	m_pReferences.store(pPublished, std::memory_order_release);
+
+	return pPublished;
+}
+
+template<typename Mutex>
+std::size_t CAssemblyModule<Mutex>::BuildReferenceIndex()
+{
+	const auto lock = LockTimed(m_referencesMutex, m_stats.m_nLockWaits, m_stats.m_nLockWaitTime);
+
+	return IndexReferences()->Size();
+}
+
+template<typename Mutex>
+Span_t<CReferenceIndex::Reference_t> CAssemblyModule<Mutex>::FindReferences(const CMemory& pTarget) const
+{
+	const CReferenceIndex* pIndex = m_pReferences.load(std::memory_order_acquire);
+
+	if (!pIndex)
+	{
+		const auto lock = LockTimed(m_referencesMutex, m_stats.m_nLockWaits, m_stats.m_nLockWaitTime);
+
+		pIndex = m_pReferences.load(std::memory_order_relaxed);
+
+		if (!pIndex)
+			pIndex = IndexReferences();
+	}
+
+	const std::uintptr_t nBase = GetBase().GetAddr();
+
+	const std::uintptr_t nTarget = static_cast<std::uintptr_t>(pTarget.GetAddr());
+
+	if (!pTarget || nTarget < nBase || nTarget - nBase > std::numeric_limits<std::uint32_t>::max())
+		return {};
+
+	return pIndex->Find(static_cast<std::uint32_t>(nTarget - nBase));
+}
+
+template<typename Mutex>
+std::shared_ptr<const CTypeIndex> CAssemblyModule<Mutex>::GetTypes() const
+{
+	const auto lock = LockTimed(m_typesMutex, m_stats.m_nLockWaits, m_stats.m_nLockWaitTime);
+
+	return m_pTypes;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Swaps the type index in, the lookups which hold the previous one
+//          keep it until they're done
+// Input  : pTypes
+// Output : count of the types
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+std::size_t CAssemblyModule<Mutex>::PublishTypes(std::shared_ptr<const CTypeIndex> pTypes)
+{
+	const std::size_t nTypes = pTypes ? pTypes->Size() : 0;
+
+	{
+		const auto lock = LockTimed(m_typesMutex, m_stats.m_nLockWaits, m_stats.m_nLockWaitTime);
+
+		m_pTypes.swap(pTypes);
+	}
+
+	return nTypes; // The previous one is released out of the lock.
+}
+
+template<typename Mutex>
+void CAssemblyModule<Mutex>::AddScanStats(const ScanEvent_t& event, std::size_t nScans) const noexcept
+{
+	m_stats.m_nScans.fetch_add(nScans, std::memory_order_relaxed);
+	m_stats.m_nScanTime.fetch_add(event.m_nTime, std::memory_order_relaxed);
+	m_stats.m_nScannedBytes.fetch_add(event.m_nScannedBytes, std::memory_order_relaxed);
+	m_stats.m_nCandidates.fetch_add(event.m_nCandidates, std::memory_order_relaxed);
+	m_stats.m_nMatches.fetch_add(event.m_nMatches, std::memory_order_relaxed);
+}
+
+template<typename Mutex>
+ModuleStats_t CAssemblyModule<Mutex>::GetStats() const noexcept
+{
+	ModuleStats_t stats;
+
+	stats.m_nScans = m_stats.m_nScans.load(std::memory_order_relaxed);
+	stats.m_nScanTime = m_stats.m_nScanTime.load(std::memory_order_relaxed);
+	stats.m_nScannedBytes = m_stats.m_nScannedBytes.load(std::memory_order_relaxed);
+	stats.m_nCandidates = m_stats.m_nCandidates.load(std::memory_order_relaxed);
+	stats.m_nMatches = m_stats.m_nMatches.load(std::memory_order_relaxed);
+	stats.m_nCacheHits = m_stats.m_nCacheHits.load(std::memory_order_relaxed);
+	stats.m_nCacheMisses = m_stats.m_nCacheMisses.load(std::memory_order_relaxed);
+	stats.m_nLockWaits = m_stats.m_nLockWaits.load(std::memory_order_relaxed) + m_cache.GetLockWaits();
+	stats.m_nLockWaitTime = m_stats.m_nLockWaitTime.load(std::memory_order_relaxed) + m_cache.GetLockWaitTime();
+
+	return stats;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Hashes the section names into an open addressing table (of twice
+//          the count at least) and caches the sections of the common roles
+// Input  : aSectionNames - as the platform names them, empty for none
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+void CAssemblyModule<Mutex>::IndexSections(const std::array<std::string_view, s_nSectionKinds>& aSectionNames)
+{
+	std::size_t nCapacity = 16;
+
+	while (nCapacity < 2 * m_vecSections.size())
+		nCapacity <<= 1;
+
+	m_vecSectionHashes.resize(m_vecSections.size());
+	m_vecSectionSlots.assign(nCapacity, 0);
+
+	const std::size_t nMask = nCapacity - 1;
+
+	for (std::uint32_t i = 0; i < m_vecSections.size(); ++i)
+	{
+		const std::uint32_t nHash = m_vecSectionHashes[i] = CSymbolIndex::Hash(m_vecSections[i].m_svSectionName);
+
+		for (std::size_t nSlot = nHash & nMask;; nSlot = (nSlot + 1) & nMask)
+		{
+			const std::uint32_t nIndex = m_vecSectionSlots[nSlot];
+
+			if (!nIndex)
+			{
+				m_vecSectionSlots[nSlot] = i + 1;
+				break;
+			}
+
+			if (m_vecSectionHashes[nIndex - 1] == nHash && m_vecSections[nIndex - 1].m_svSectionName == m_vecSections[i].m_svSectionName)
+				break; // The first one is kept.
+		}
+	}
+
+	for (std::size_t i = 0; i < s_nSectionKinds; ++i)
+		m_aSections[i] = aSectionNames[i].empty() ? nullptr : GetSectionByName(aSectionNames[i]);
+
+	m_pExecutableSection = m_aSections[static_cast<std::size_t>(SectionKind::Text)];
+}
+
+template<typename Mutex>
+const Section_t* CAssemblyModule<Mutex>::GetSectionByName(const std::string_view svSectionName) const noexcept
+{
+	if (m_vecSectionSlots.empty())
+		return nullptr;
+
+	const std::uint32_t nHash = CSymbolIndex::Hash(svSectionName);
+	const std::size_t nMask = m_vecSectionSlots.size() - 1;
+
+	for (std::size_t nSlot = nHash & nMask;; nSlot = (nSlot + 1) & nMask)
+	{
+		const std::uint32_t nIndex = m_vecSectionSlots[nSlot];
+
+		if (!nIndex)
+			return nullptr;
+
+		if (m_vecSectionHashes[nIndex - 1] == nHash && m_vecSections[nIndex - 1].m_svSectionName == svSectionName)
+			return &m_vecSections[nIndex - 1];
+	}
+}
+
+template<typename Mutex>
+std::shared_ptr<const CMappedImage> CAssemblyModule<Mutex>::GetImage() const
+{
+	const auto lock = LockTimed(m_imageMutex, m_stats.m_nLockWaits, m_stats.m_nLockWaitTime);
+
+	if (!m_pImage && IsValid() && !m_bStaleFile)
+		m_pImage = CMappedImage::Open(m_sPath);
+
+	return m_pImage;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds the data of the module section in the file (maps it if isn't yet)
+// Input  : section
+//          pImage - set to the mapping, to be kept while the section is used
+// Output : nullptr if the section isn't of the file as whole (at another address,
+//          or of another size: the raw data of a PE section is clamped)
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+const CMappedImage::FileSection_t* CAssemblyModule<Mutex>::FindFileSection(const Section_t& section, std::shared_ptr<const CMappedImage>& pImage) const
+{
+	pImage = GetImage();
+
+	if (!pImage)
+		return nullptr;
+
+	const std::uintptr_t nAddress = section.GetAddr() - GetBase().GetAddr();
+	const auto* pFileSection = pImage->GetSectionByAddress(nAddress);
+
+	return pFileSection && pFileSection->m_nAddress == nAddress && pFileSection->m_nFileSize == section.m_nSectionSize ? pFileSection : nullptr;
+}
+
+template<typename Mutex>
+CMemory CAssemblyModule<Mutex>::FindPattern(const CMemoryView<std::uint8_t>& pPatternMem, const std::string_view svMask, const CMemory& pStartAddress, const Section_t* pModuleSection) const
+{
+	const auto* pPattern = pPatternMem.RCastView();
+
+	return FindPattern(PatternView_t{ pPattern, svMask, SelectPatternAnchors(pPattern, svMask.data(), svMask.size()), nullptr, HashPattern(pPattern, svMask.data(), svMask.size()) }, pStartAddress, pModuleSection);
+}
+
+template<typename Mutex>
+CMemory CAssemblyModule<Mutex>::FindPattern(const PatternView_t& view, const CMemory& pStartAddress, const Section_t* pModuleSection) const
+{
+	const std::string_view svMask = view.m_svMask;
+
+	const CCacheKey sKey(view.m_pBytes, svMask, pStartAddress, pModuleSection);
+	const std::size_t nKeyHash = sKey.Hash(view.m_nHash);
+	if (auto pAddr = m_cache.Find(sKey, nKeyHash))
+	{
+		DYNLIB_STATS(m_stats.m_nCacheHits.fetch_add(1, std::memory_order_relaxed));
+		return pAddr;
+	}
+	DYNLIB_STATS(m_stats.m_nCacheMisses.fetch_add(1, std::memory_order_relaxed));
+
+	const Section_t* pSection = pModuleSection ? pModuleSection : m_pExecutableSection;
+
+	if (!pSection || !pSection->IsValid())
+		return DYNLIB_INVALID_MEMORY;
+
+	const std::uintptr_t base = pSection->GetAddr();
+	const std::size_t sectionSize = pSection->m_nSectionSize;
+	const std::size_t patternSize = svMask.size();
+
+	if (!patternSize || patternSize > sectionSize)
+		return DYNLIB_INVALID_MEMORY;
+
+	auto* pData = reinterpret_cast<std::uint8_t*>(base);
+	const auto* pEnd = pData + sectionSize - patternSize;
+
+	if (pStartAddress)
+	{
+		auto* start = pStartAddress.RCast<std::uint8_t*>();
+		if (start < pData || start > pEnd)
+			return DYNLIB_INVALID_MEMORY;
+
+		pData = start;
+	}
+
+	assert(patternSize <= s_nMaxSimdBlocks * 16);
+
+	if (patternSize > s_nMaxSimdBlocks * 16)
+		return DYNLIB_INVALID_MEMORY;
+
+	const ScanPattern_t pattern(view);
+
+	DYNLIB_STATS(const std::uint64_t nStartTime = GetStatsTime(), nStartCandidates = s_nScanCandidates);
+
+	const auto* pSectionEnd = reinterpret_cast<const std::uint8_t*>(base + sectionSize);
+	const std::uint8_t* pFound = nullptr;
+
+	std::shared_ptr<const CMappedImage> pImage; // Kept for the scan, a concurrent Release drops the module's one.
+
+	if (const auto* pFileSection = m_eScanSource != ScanSource::Memory && !pattern.m_bWildcard ? FindFileSection(*pSection, pImage) : nullptr)
+	{
+		const std::size_t nFound = ScanImage(*pImage, *pFileSection, static_cast<std::size_t>(reinterpret_cast<std::uintptr_t>(pData) - base), pattern, m_eScanSource == ScanSource::StreamedFile);
+
+		if (nFound != static_cast<std::size_t>(-1))
+			pFound = reinterpret_cast<const std::uint8_t*>(base + nFound);
+	}
+	else
+	{
+		const bool bParallel = m_nParallelScanSize && static_cast<std::size_t>(pSectionEnd - pData) >= std::max(m_nParallelScanSize, s_nParallelScanChunkSize);
+
+		pFound = pattern.m_bWildcard ? pData : bParallel ? ScanParallel(pattern, pData, pSectionEnd, m_fnScanExecutor) : GetScanKernelFunc()(pattern, pData, pSectionEnd);
+	}
+
+#if DYNLIBUTILS_STATS
+	const ScanEvent_t event
+	{
+		std::string_view(reinterpret_cast<const char*>(view.m_pBytes), patternSize), svMask, pSection, m_eScanSource,
+		GetStatsTime() - nStartTime, static_cast<std::size_t>((pFound ? pFound + patternSize : pSectionEnd) - pData), s_nScanCandidates - nStartCandidates,
+		pFound ? 1u : 0u, 1, const_cast<std::uint8_t*>(pFound)
+	};
+
+	AddScanStats(event, 1);
+
+	if (m_fnStatsSink)
+		m_fnStatsSink(event);
+#endif
+
+	if (!pFound)
+		return DYNLIB_INVALID_MEMORY;
+
+	m_cache.Insert(sKey, const_cast<std::uint8_t*>(pFound), nKeyHash);
+	return const_cast<std::uint8_t*>(pFound);
+}
+
+template<typename Mutex>
+std::size_t CAssemblyModule<Mutex>::FindPatterns(CSignatureSet& set, const Section_t* pModuleSection) const
+{
+	const Section_t* pSection = pModuleSection ? pModuleSection : m_pExecutableSection;
+
+	if (!pSection || !pSection->IsValid())
+		return 0;
+
+	const auto* pMemory = pSection->RCast<const std::uint8_t*>();
+
+	std::size_t nExtent = pSection->m_nSectionSize; // Of the scanned data.
+
+	std::shared_ptr<const CMappedImage> pImage; // Kept for the scan, a concurrent Release drops the module's one.
+
+	const auto* pFileSection = m_eScanSource != ScanSource::Memory ? FindFileSection(*pSection, pImage) : nullptr; // Of nExtent bytes.
+
+	// Bucket pending patterns by the rarest non-wildcard byte (anchor), the next one is a quick reject.
+	struct Pending_t
+	{
+		CSignatureSet::Entry_t* m_pEntry;
+		std::size_t m_nAnchor;
+		std::ptrdiff_t m_nNext;
+		std::uint8_t m_nNextByte;
+	};
+
+	std::vector<Pending_t> vecPending;
+	std::array<std::uint32_t, 256 + 1> aBucketStarts = {};
+	std::array<std::uint32_t, 256> aBucketSizes = {};
+
+	vecPending.reserve(set.Size());
+
+	std::size_t nFound = 0;
+
+	for (auto& entry : set)
+	{
+		entry.m_pResult = DYNLIB_INVALID_MEMORY;
+
+		const std::string_view svMask = entry.m_svMask;
+
+		if (svMask.empty() || svMask.size() > nExtent)
+			continue;
+
+		if (auto pAddr = m_cache.Find(CCacheKey(entry.m_pBytes, svMask, nullptr, pModuleSection)))
+		{
+			DYNLIB_STATS(m_stats.m_nCacheHits.fetch_add(1, std::memory_order_relaxed));
+
+			entry.m_pResult = pAddr;
+			nFound++;
+
+			continue;
+		}
+
+		DYNLIB_STATS(m_stats.m_nCacheMisses.fetch_add(1, std::memory_order_relaxed));
+
+		const std::size_t nAnchor = entry.m_anchors.m_nAnchor, nNext = entry.m_anchors.m_nNextAnchor;
+
+		if (nAnchor == s_nInvalidAnchor) // If mask has no 'x', first position matches trivially.
+		{
+			entry.m_pResult = const_cast<std::uint8_t*>(pMemory);
+			nFound++;
+
+			continue;
+		}
+
+		vecPending.push_back({ &entry, nAnchor, static_cast<std::ptrdiff_t>(nNext) - static_cast<std::ptrdiff_t>(nAnchor), entry.m_pBytes[nNext] });
+
+		aBucketSizes[entry.m_pBytes[nAnchor]]++;
+	}
+
+	if (!vecPending.empty())
+	{
+		for (std::size_t i = 0; i < 256; ++i)
+			aBucketStarts[i + 1] = aBucketStarts[i] + aBucketSizes[i];
+
+		std::vector<Pending_t> vecBuckets(vecPending.size());
+
+		{
+			std::array<std::uint32_t, 256> aFill = {};
+
+			for (const auto& pending : vecPending)
+			{
+				const std::uint8_t nByte = pending.m_pEntry->m_pBytes[pending.m_nAnchor];
+
+				vecBuckets[aBucketStarts[nByte] + aFill[nByte]++] = pending;
+			}
+		}
+
+		std::size_t nRemaining = vecPending.size();
+
+		DYNLIB_STATS(const std::uint64_t nStartTime = GetStatsTime(), nStartCandidates = s_nScanCandidates);
+
+		std::size_t nScanned = 0;
+		std::size_t nMaxSize = 0;
+
+		for (const auto& pending : vecPending)
+			nMaxSize = std::max(nMaxSize, pending.m_pEntry->m_svMask.size());
+
+		// Scans [pBegin, pEnd) for the pending patterns wholly within it, nDelta is from the data to the memory.
+		const auto funcScan = [&](const std::uint8_t* pBegin, const std::uint8_t* pEnd, std::ptrdiff_t nDelta) -> bool
+		{
+			const auto* pData = pBegin;
+
+			for (; pData != pEnd && nRemaining; ++pData)
+			{
+				const std::uint8_t nByte = *pData;
+
+				std::uint32_t& nBucketSize = aBucketSizes[nByte];
+
+				if (!nBucketSize)
+					continue;
+
+				Pending_t* pBucket = &vecBuckets[aBucketStarts[nByte]];
+
+				for (std::uint32_t i = 0; i < nBucketSize;)
+				{
+					const Pending_t& pending = pBucket[i];
+					const auto* pCandidate = pData - pending.m_nAnchor;
+
+					if (pCandidate < pBegin || static_cast<std::size_t>(pEnd - pCandidate) < pending.m_pEntry->m_svMask.size() ||
+					    pData[pending.m_nNext] != pending.m_nNextByte)
+					{
+						++i;
+
+						continue;
+					}
+
+					DYNLIB_STATS(++s_nScanCandidates);
+
+					if (!ComparePattern(pCandidate, pending.m_pEntry->m_pBytes, pending.m_pEntry->m_svMask))
+					{
+						++i;
+
+						continue;
+					}
+
+					pending.m_pEntry->m_pResult = const_cast<std::uint8_t*>(pCandidate + nDelta);
+
+					pBucket[i] = pBucket[--nBucketSize]; // Found first, drop from the bucket.
+					nRemaining--;
+				}
+			}
+
+			nScanned += static_cast<std::size_t>(pData - pBegin);
+
+			return nRemaining != 0;
+		};
+
+		if (!pFileSection)
+		{
+			funcScan(pMemory, pMemory + nExtent, 0);
+		}
+		else if (m_eScanSource == ScanSource::MappedFile)
+		{
+			const auto* pFileData = pImage->GetData() + pFileSection->m_nOffset;
+
+			funcScan(pFileData, pFileData + nExtent, pMemory - pFileData);
+		}
+		else
+		{
+			// The chunks overlap by a pattern less a byte, so a match is whole in one. Found first, in the file order.
+			struct Context_t
+			{
+				const decltype(funcScan)& m_funcScan;
+				const std::uint8_t* m_pMemory;
+				std::size_t m_nOffset;
+			} context { funcScan, pMemory, pFileSection->m_nOffset };
+
+			if (!pImage->Stream(pFileSection->m_nOffset, nExtent, nMaxSize - 1, [](const void* pContext, const std::uint8_t* pChunk, std::size_t nChunkSize, std::size_t nChunkOffset) -> bool
+			{
+				const auto* pScan = static_cast<const Context_t*>(pContext);
+
+				return pScan->m_funcScan(pChunk, pChunk + nChunkSize, (pScan->m_pMemory + (nChunkOffset - pScan->m_nOffset)) - pChunk);
+			}, &context))
+				funcScan(pMemory, pMemory + pSection->m_nSectionSize, 0); // The file can't be read.
+		}
+
+		nFound += vecPending.size() - nRemaining;
+
+#if DYNLIBUTILS_STATS
+		ScanEvent_t event
+		{
+			{}, {}, pSection, m_eScanSource,
+			GetStatsTime() - nStartTime, nScanned, s_nScanCandidates - nStartCandidates,
+			vecPending.size() - nRemaining, vecPending.size(), nullptr
+		};
+
+		AddScanStats(event, vecPending.size());
+
+		if (m_fnStatsSink)
+		{
+			for (const auto& pending : vecPending)
+			{
+				event.m_svPattern = std::string_view(reinterpret_cast<const char*>(pending.m_pEntry->m_pBytes), pending.m_pEntry->m_svMask.size());
+				event.m_svMask = pending.m_pEntry->m_svMask;
+				event.m_nMatches = pending.m_pEntry->m_pResult ? 1 : 0;
+				event.m_pFound = pending.m_pEntry->m_pResult;
+
+				m_fnStatsSink(event);
+			}
+		}
+#endif
+	}
+
+	for (const auto& pending : vecPending)
+	{
+		const auto* pEntry = pending.m_pEntry;
+
+		if (pEntry->m_pResult)
+			m_cache.Insert(CCacheKey(pEntry->m_pBytes, pEntry->m_svMask, nullptr, pModuleSection), pEntry->m_pResult);
+	}
+
+	return nFound;
+}
+
+void CResolveHandle::State_t::Set(const CMemory& pResult)
+{
+	std::shared_ptr<void> pQueue; // Released out of the lock.
+
+	{
+		std::lock_guard lock(m_mutex);
+
+		m_pResult = pResult;
+		m_bReady.store(true, std::memory_order_release);
+		pQueue.swap(m_pQueue);
+	}
+
+	m_cv.notify_all();
+}
+
+CMemory CResolveHandle::Get() const
+{
+	if (!m_pState)
+		return DYNLIB_INVALID_MEMORY;
+
+	if (!m_pState->m_bReady.load(std::memory_order_acquire))
+	{
+		std::shared_ptr<void> pQueue;
+
+		{
+			std::lock_guard lock(m_pState->m_mutex);
+			pQueue = m_pState->m_pQueue;
+		}
+
+		if (pQueue)
+			m_pState->m_pfnResolve(pQueue.get()); // Possibly the request is taken by another thread already.
+
+		std::unique_lock lock(m_pState->m_mutex);
+		m_pState->m_cv.wait(lock, [this] { return m_pState->m_bReady.load(std::memory_order_relaxed); });
+	}
+
+	return m_pState->m_pResult;
+}
+
+template<typename Mutex>
+struct CAssemblyModule<Mutex>::ResolveRequest_t
+{
+	std::shared_ptr<CResolveHandle::State_t> m_pState;
+	ResolveKind m_eKind;
+	std::string m_sPattern; // Bytes of the pattern, or the name.
+	std::string m_sMask;
+	const Section_t* m_pSection;
+};
+
+// Requests of a module, shared with the handles and the background jobs (a late one may start after the module is gone).
+template<typename Mutex>
+struct CAssemblyModule<Mutex>::ResolveQueue_t
+{
+	//-----------------------------------------------------------------------------
+	// Purpose: Takes the queued requests by batches and resolves them until none is left
+	// Input  : *pQueue
+	//-----------------------------------------------------------------------------
+	static void Resolve(void* pQueue)
+	{
+		auto* pThis = static_cast<ResolveQueue_t*>(pQueue);
+
+		std::unique_lock lock(pThis->m_mutex);
+
+		while (pThis->m_pModule && !pThis->m_vecRequests.empty())
+		{
+			std::vector<ResolveRequest_t> vecBatch;
+
+			vecBatch.swap(pThis->m_vecRequests);
+			pThis->m_nBatches++;
+			lock.unlock();
+
+			BatchGuard_t guard{ pThis, lock, vecBatch };
+
+			pThis->m_pModule->ResolveBatch(vecBatch);
+		}
+
+		pThis->m_cv.notify_all();
+	}
+
+	// Ends the batch even if ResolveBatch throws: the requests left are set unresolved,
+	// so that neither WaitResolves nor their handles wait for it forever.
+	struct BatchGuard_t
+	{
+		ResolveQueue_t* m_pQueue;
+		std::unique_lock<std::mutex>& m_lock;
+		std::vector<ResolveRequest_t>& m_vecBatch;
+
+		~BatchGuard_t()
+		{
+			for (const auto& request : m_vecBatch)
+				if (!request.m_pState->m_bReady.load(std::memory_order_acquire))
+					request.m_pState->Set(DYNLIB_INVALID_MEMORY);
+
+			m_lock.lock();
+			m_pQueue->m_nBatches--;
+			m_pQueue->m_cv.notify_all();
+		}
+	}; // struct BatchGuard_t
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv; // Of the resolved batches.
+	const CAssemblyModule* m_pModule = nullptr; // Reset on destruction.
+	std::vector<ResolveRequest_t> m_vecRequests;
+	std::size_t m_nBatches = 0; // Being resolved.
+	bool m_bScheduled = false;
+};
+
 template<typename Mutex>
-CAssemblyModule<Mutex>::CAssemblyModule(const std::string_view szModuleName) : m_pExecutableSection(nullptr)
+std::shared_ptr<typename CAssemblyModule<Mutex>::ResolveQueue_t> CAssemblyModule<Mutex>::CreateResolveQueue()
 {
-	InitFromName(szModuleName);
+	if constexpr (std::is_same_v<Mutex, CNullMutex>)
+		return nullptr;
+	else
+		return std::make_shared<ResolveQueue_t>();
 }
 
-//-----------------------------------------------------------------------------
-// Purpose: constructor
-// Input  : pModuleMemory
-//-----------------------------------------------------------------------------
 template<typename Mutex>
-CAssemblyModule<Mutex>::CAssemblyModule(const CMemory& pModuleMemory) : m_pExecutableSection(nullptr)
+void CAssemblyModule<Mutex>::SwapResolveQueue(CAssemblyModule& other) noexcept
 {
-	InitFromMemory(pModuleMemory);
+	m_pResolves.swap(other.m_pResolves);
+
+	for (auto* pModule : { this, &other })
+	{
+		if (pModule->m_pResolves)
+		{
+			std::lock_guard lock(pModule->m_pResolves->m_mutex);
+			pModule->m_pResolves->m_pModule = pModule;
+		}
+	}
 }
 
 template<typename Mutex>
-CMemory CAssemblyModule<Mutex>::GetFunctionByName(const std::string_view svFunctionName) const noexcept
+CResolveHandle CAssemblyModule<Mutex>::QueueResolve(ResolveKind eKind, const std::string_view svPattern, const std::string_view svMask, const Section_t* pModuleSection)
+{
+	auto pState = std::make_shared<CResolveHandle::State_t>();
+
+	pState->m_pQueue = m_pResolves;
+	pState->m_pfnResolve = &ResolveQueue_t::Resolve;
+
+	std::lock_guard lock(m_pResolves->m_mutex);
+
+	m_pResolves->m_pModule = this;
+	m_pResolves->m_vecRequests.push_back({ pState, eKind, std::string(svPattern), std::string(svMask), pModuleSection });
+
+	return CResolveHandle(std::move(pState));
+}
+
+template<typename Mutex>
+void CAssemblyModule<Mutex>::SubmitResolves()
 {
-	CCache hKey(svFunctionName, 1);
-	if (auto pAddr = GetAddress(hKey))
+	if (!m_pResolves)
+		return;
+
 	{
-		return pAddr;
+		std::lock_guard lock(m_pResolves->m_mutex);
+
+		if (m_pResolves->m_vecRequests.empty() || m_pResolves->m_bScheduled)
+			return;
+
+		m_pResolves->m_bScheduled = true;
 	}
-	auto pAddr = GetFunction(svFunctionName);
+
+	// Of a pool thread (or the executor's), so it doesn't throw: a batch which does is failed by its guard.
+	auto job = [pQueue = m_pResolves]() noexcept
 	{
-		UniqueLock_t lock(m_mutex);
-		m_mapCached[std::move(hKey)] = pAddr;
-	}
-	return pAddr;
+		try
+		{
+			{
+				std::lock_guard lock(pQueue->m_mutex);
+				pQueue->m_bScheduled = false;
+			}
+
+			ResolveQueue_t::Resolve(pQueue.get());
+		}
+		catch (...)
+		{
+		}
+	};
+
+	if (m_fnScanExecutor)
+		m_fnScanExecutor(std::move(job));
+	else
+		CScanThreadPool::Get().Submit(std::move(job));
 }
 
 template<typename Mutex>
-CMemory CAssemblyModule<Mutex>::GetVirtualTableByName(const std::string_view svTableName, bool bDecorated) const
+void CAssemblyModule<Mutex>::WaitResolves()
+{
+	if (!m_pResolves)
+		return;
+
+	ResolveQueue_t::Resolve(m_pResolves.get());
+
+	std::unique_lock lock(m_pResolves->m_mutex);
+	m_pResolves->m_cv.wait(lock, [this] { return m_pResolves->m_vecRequests.empty() && !m_pResolves->m_nBatches; });
+}
+
+template<typename Mutex>
+void CAssemblyModule<Mutex>::CloseResolves()
+{
+	if (!m_pResolves)
+		return;
+
+	WaitResolves();
+
+	std::lock_guard lock(m_pResolves->m_mutex);
+	m_pResolves->m_pModule = nullptr; // For a late job.
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Resolves the patterns by sections (FindPatterns for many, FindPattern
+//          for one) and the names, then sets the results
+// Input  : vecRequests
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+void CAssemblyModule<Mutex>::ResolveBatch(std::vector<ResolveRequest_t>& vecRequests) const
 {
-	CCache hKey(svTableName, 2);
-	if (auto pAddr = GetAddress(hKey))
+	auto itPatterns = std::stable_partition(vecRequests.begin(), vecRequests.end(), [](const ResolveRequest_t& request) { return request.m_eKind != ResolveKind::Pattern; });
+
+	for (auto it = vecRequests.begin(); it != itPatterns; ++it)
 	{
-		return pAddr;
+		CMemory pResult;
+
+		if (it->m_eKind == ResolveKind::Function)
+			pResult = GetFunctionByName(it->m_sPattern);
+		else
+			pResult = GetVirtualTableByName(it->m_sPattern, it->m_eKind == ResolveKind::DecoratedVirtualTable);
+
+		it->m_pState->Set(pResult);
 	}
-	auto pAddr = GetVirtualTable(svTableName, bDecorated);
+
+	std::stable_sort(itPatterns, vecRequests.end(), [](const ResolveRequest_t& a, const ResolveRequest_t& b) { return std::less<const Section_t*>()(a.m_pSection, b.m_pSection); });
+
+	for (auto itBegin = itPatterns; itBegin != vecRequests.end();)
 	{
-		UniqueLock_t lock(m_mutex);
-		m_mapCached[std::move(hKey)] = pAddr;
+		const Section_t* pSection = itBegin->m_pSection;
+		const auto itEnd = std::find_if(itBegin, vecRequests.end(), [pSection](const ResolveRequest_t& request) { return request.m_pSection != pSection; });
+
+		if (itEnd - itBegin == 1)
+		{
+			const auto* pBytes = reinterpret_cast<const std::uint8_t*>(itBegin->m_sPattern.data());
+
+			itBegin->m_pState->Set(FindPattern(CMemoryView<std::uint8_t>(const_cast<std::uint8_t*>(pBytes)), itBegin->m_sMask, nullptr, pSection));
+		}
+		else
+		{
+			CSignatureSet set(static_cast<std::size_t>(itEnd - itBegin));
+
+			for (auto it = itBegin; it != itEnd; ++it)
+				set.Add(reinterpret_cast<const std::uint8_t*>(it->m_sPattern.data()), it->m_sMask);
+
+			FindPatterns(set, pSection);
+
+			std::size_t nIndex = 0;
+
+			for (auto it = itBegin; it != itEnd; ++it)
+				it->m_pState->Set(set.Get(nIndex++));
+		}
+
+		itBegin = itEnd;
 	}
-	return pAddr;
 }
 
-template<typename Mutex>
-CMemory CAssemblyModule<Mutex>::GetAddress(const CCache& hKey) const noexcept
+// Persistent cache file layout (native endianness):
+//   header: magic, version, identity size, identity bytes, count of records
+//   record: flags, pattern size, pattern, mask size, mask, start, section address, section size, address, checksum
+// The addresses are relative to the module base when the corresponding flag is set.
+static constexpr std::uint32_t s_nCacheFileMagic = 0x43554C44; // "DLUC"
+static constexpr std::uint32_t s_nCacheFileVersion = 2; // 1 flagged the addresses by the base only.
+
+enum CacheRecordFlags_t : std::uint8_t
+{
+	CACHE_RELATIVE_START = 1 << 0,
+	CACHE_RELATIVE_SECTION = 1 << 1,
+	CACHE_RELATIVE_ADDRESS = 1 << 2,
+};
+
+static std::uint64_t HashCacheBytes(std::uint64_t nHash, const void* pData, std::size_t nSize) noexcept
 {
-	SharedLock_t lock(m_mutex);
-	auto it = m_mapCached.find(hKey);
-	if (it == m_mapCached.end())
+	const auto* pBytes = static_cast<const std::uint8_t*>(pData);
+
+	for (std::size_t i = 0; i < nSize; ++i)
 	{
-		return nullptr;
+		nHash ^= pBytes[i];
+		nHash *= 0x100000001B3ull; // FNV-1a.
 	}
-	return it->second;
+
+	return nHash;
 }
 
-template<typename Mutex>
-CMemory CAssemblyModule<Mutex>::FindPattern(const CMemoryView<std::uint8_t>& pPatternMem, const std::string_view svMask, const CMemory& pStartAddress, const Section_t* pModuleSection) const
+class CCacheFileReader
 {
-	const auto* pPattern = pPatternMem.RCastView();
+public:
+	CCacheFileReader(const std::string& sData) : m_pData(sData.data()), m_nLeft(sData.size()) {}
 
-	CCache sKey(pPattern, svMask.size(), pStartAddress, pModuleSection);
-	if (auto pAddr = GetAddress(sKey))
+	template<typename T>
+	bool Read(T& value) noexcept
 	{
-		return pAddr;
-	}
+		if (m_nLeft < sizeof(T))
+			return false;
 
-	const Section_t* pSection = pModuleSection ? pModuleSection : m_pExecutableSection;
+		std::memcpy(&value, m_pData, sizeof(T));
+		m_pData += sizeof(T);
+		m_nLeft -= sizeof(T);
 
-	if (!pSection || !pSection->IsValid())
-		return DYNLIB_INVALID_MEMORY;
+		return true;
+	}
 
-	const std::uintptr_t base = pSection->GetAddr();
-	const std::size_t sectionSize = pSection->m_nSectionSize;
-	const std::size_t patternSize = svMask.size();
+	bool Read(std::string& sValue)
+	{
+		std::uint32_t nSize;
 
-	auto* pData = reinterpret_cast<std::uint8_t*>(base);
-	const auto* pEnd = pData + sectionSize - patternSize;
+		if (!Read(nSize) || m_nLeft < nSize)
+			return false;
 
-	if (pStartAddress)
-	{
-		auto* start = pStartAddress.RCast<std::uint8_t*>();
-		if (start < pData || start > pEnd)
-			return DYNLIB_INVALID_MEMORY;
+		sValue.assign(m_pData, nSize);
+		m_pData += nSize;
+		m_nLeft -= nSize;
 
-		pData = start;
+		return true;
 	}
 
-	auto numMasks = static_cast<std::uint8_t>(std::ceil(static_cast<float>(patternSize) / 16.f));
+private:
+	const char* m_pData;
+	std::size_t m_nLeft;
+}; // class CCacheFileReader
+
+class CCacheFileWriter
+{
+public:
+	template<typename T>
+	void Write(const T& value) { m_sData.append(reinterpret_cast<const char*>(&value), sizeof(T)); }
+	void Write(const std::string_view svValue) { Write(static_cast<std::uint32_t>(svValue.size())); m_sData.append(svValue); }
+	void Write(const std::string& sValue) { Write(std::string_view(sValue)); }
+	void Append(const CCacheFileWriter& other) { m_sData.append(other.m_sData); }
+
+	const std::string& Get() const noexcept { return m_sData; }
+
+private:
+	std::string m_sData;
+}; // class CCacheFileWriter
+
+template<typename Mutex>
+bool CAssemblyModule<Mutex>::SetCacheFile(const std::string_view svPath)
+{
+	m_sCacheFile.assign(svPath);
+
+	return IsValid() && LoadCacheFile();
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Loads the persistent cache of the module if the identity matches
+// Output : bool
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+bool CAssemblyModule<Mutex>::LoadCacheFile()
+{
+	if (m_sCacheFile.empty())
+		return false;
+
+	std::ifstream file(m_sCacheFile, std::ios::binary);
+
+	if (!file)
+		return false;
+
+	const std::string sData((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	const std::string sIdentity = GetIdentity();
+
+	CCacheFileReader reader(sData);
+
+	std::uint32_t nMagic, nVersion, nCount;
+	std::string sFileIdentity;
+
+	if (!reader.Read(nMagic) || nMagic != s_nCacheFileMagic ||
+	    !reader.Read(nVersion) || nVersion != s_nCacheFileVersion ||
+	    !reader.Read(sFileIdentity) || sIdentity.empty() || sFileIdentity != sIdentity ||
+	    !reader.Read(nCount))
+		return false;
 
-#if !DYNLIBUTILS_ARCH_ARM
-	std::array<int, 64> masks = {};// 64*16 = enough masks for 1024 bytes.
+	const std::uintptr_t nBase = GetBase().GetAddr();
 
-	for (std::uint8_t i = 0; i < numMasks; ++i)
+	struct Record_t
 	{
-		for (std::int8_t j = static_cast<std::int8_t>(std::min<std::size_t>(patternSize - i * 16, 16)) - 1; j >= 0; --j)
-		{
-			if (svMask[static_cast<std::size_t>(i * 16 + j)] == 'x')
-			{
-				masks[i] |= 1 << j;
-			}
-		}
+		std::string m_sPattern;
+		std::string m_sMask;
+		std::uintptr_t m_nStart;
+		std::uintptr_t m_pSectionAddr;
+		std::size_t m_nSectionSize;
+		std::uintptr_t m_pAddr;
+	};
+
+	std::vector<Record_t> vecRecords;
+
+	vecRecords.reserve(nCount);
+
+	for (std::uint32_t n = 0; n < nCount; ++n)
+	{
+		std::uint8_t nFlags;
+		std::uint64_t nStart, nSectionAddr, nSectionSize, nAddress, nChecksum;
+
+		Record_t record;
+
+		if (!reader.Read(nFlags) || !reader.Read(record.m_sPattern) || !reader.Read(record.m_sMask) ||
+		    !reader.Read(nStart) || !reader.Read(nSectionAddr) || !reader.Read(nSectionSize) ||
+		    !reader.Read(nAddress) || !reader.Read(nChecksum))
+			return false;
+
+		std::uint64_t nHash = 0xCBF29CE484222325ull;
+
+		nHash = HashCacheBytes(nHash, record.m_sPattern.data(), record.m_sPattern.size());
+		nHash = HashCacheBytes(nHash, record.m_sMask.data(), record.m_sMask.size());
+		nHash = HashCacheBytes(nHash, &nStart, sizeof(nStart));
+		nHash = HashCacheBytes(nHash, &nSectionAddr, sizeof(nSectionAddr));
+		nHash = HashCacheBytes(nHash, &nSectionSize, sizeof(nSectionSize));
+		nHash = HashCacheBytes(nHash, &nAddress, sizeof(nAddress));
+
+		if (nHash != nChecksum)
+			return false;
+
+		record.m_nStart = static_cast<std::uintptr_t>((nFlags & CACHE_RELATIVE_START) ? nBase + nStart : nStart);
+		record.m_pSectionAddr = static_cast<std::uintptr_t>((nFlags & CACHE_RELATIVE_SECTION) ? nBase + nSectionAddr : nSectionAddr);
+		record.m_nSectionSize = static_cast<std::size_t>(nSectionSize);
+		record.m_pAddr = static_cast<std::uintptr_t>((nFlags & CACHE_RELATIVE_ADDRESS) ? nBase + nAddress : nAddress);
+
+		vecRecords.push_back(std::move(record));
 	}
 
-	const __m128i xmm1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPattern));
-	__m128i xmm2, xmm3, msks;
-	for (; pData != pEnd; _mm_prefetch(reinterpret_cast<const char*>(++pData + 64), _MM_HINT_NTA))
+	for (const auto& record : vecRecords)
 	{
-		xmm2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pData));
-		msks = _mm_cmpeq_epi8(xmm1, xmm2);
-		if ((_mm_movemask_epi8(msks) & masks[0]) == masks[0])
-		{
-			bool found = true;
-			for (uint8_t i = 1; i < numMasks; ++i)
-			{
-				xmm2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>((pData + i * 16)));
-				xmm3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>((pPattern + i * 16)));
-				msks = _mm_cmpeq_epi8(xmm2, xmm3);
-				if ((_mm_movemask_epi8(msks) & masks[i]) != masks[i])
-				{
-					found = false;
-					break;
-				}
-			}
+		CCacheKey key(record.m_sPattern, record.m_nStart);
 
-			if (found)
-			{
-				UniqueLock_t lock(m_mutex);
-				m_mapCached[std::move(sKey)] = pData;
-				return pData;
-			}
-		}
+		key.m_svMask = record.m_sMask;
+		key.m_pSectionAddr = record.m_pSectionAddr;
+		key.m_nSectionSize = record.m_nSectionSize;
+
+		m_cache.Insert(key, record.m_pAddr);
 	}
-#else
-	// Precompute contiguous 'x' runs for memcmp.
-	struct SignatureMask_t
+
+	m_nSavedCacheSize = m_cache.Size();
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Writes the cache to the persistent file (if is set and has new entries).
+//          The addresses into the image are stored relative to the base, the ones
+//          out of it (of other modules, by forwarded exports) aren't stored, as
+//          Rebase drops them. Called on destruction, so fails rather than throws
+// Output : bool
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+bool CAssemblyModule<Mutex>::SaveCacheFile() const noexcept
+{
+	try
+	{
+		return WriteCacheFile();
+	}
+	catch (...)
+	{
+		return false;
+	}
+}
+
+template<typename Mutex>
+bool CAssemblyModule<Mutex>::WriteCacheFile() const
+{
+	if (m_sCacheFile.empty() || !IsValid())
+		return false;
+
+	const std::string sIdentity = GetIdentity();
+
+	if (sIdentity.empty())
+		return false;
+
+	const std::uintptr_t nBase = GetBase().GetAddr();
+	const std::size_t nSize = GetImageSize();
+
+	if (m_nSavedCacheSize == m_cache.Size())
+		return true;
+
+	// Name keys use small meta values as the start (not addresses), kept as they are.
+	auto funcRelative = [nBase, nSize](std::uintptr_t nAddr, std::uint8_t nFlag, std::uint8_t& nFlags) -> std::uint64_t
 	{
-		std::size_t offset;
-		std::size_t length;
+		if (nAddr - nBase >= nSize)
+			return nAddr;
+
+		nFlags |= nFlag;
+
+		return nAddr - nBase;
 	};
 
-	SignatureMask_t sigs[(s_nDefaultPatternSize - 1) / 2]; // upper bound is fine; SIZE is already capped upstream
-	std::size_t numSigs = 0;
+	CCacheFileWriter records;
+
+	std::uint32_t nCount = 0;
+	std::size_t nEntries = 0;
 
+	m_cache.ForEach([&](const CCacheKey& key, CMemory pAddr)
 	{
-		std::size_t i = 0;
-		while (i < patternSize)
-		{
-			// Skip wildcards
-			while (i < patternSize && svMask[i] != 'x')
-				++i;
+		nEntries++;
 
-			if (i >= patternSize)
-				break;
+		if (pAddr.GetAddr() && static_cast<std::uintptr_t>(pAddr.GetAddr()) - nBase >= nSize)
+			return;
 
-			const std::size_t start = i;
-			while (i < patternSize && svMask[i] == 'x')
-				++i;
+		std::uint8_t nFlags = 0;
 
-			const std::size_t len = i - start;
-			if (len)
-			{
-				if (numSigs < std::size(sigs))
-				{
-					sigs[numSigs++] = SignatureMask_t{ start, len };
-				}
-				else
-				{
-					// Fallback: if too many runs for the static buffer, do a simple byte-wise path later.
-					numSigs = 0;
-					break;
-				}
-			}
-		}
+		const std::uint64_t nStart = funcRelative(key.m_nStart, CACHE_RELATIVE_START, nFlags);
+		const std::uint64_t nSectionAddr = funcRelative(key.m_pSectionAddr, CACHE_RELATIVE_SECTION, nFlags);
+		const std::uint64_t nSectionSize = key.m_nSectionSize;
+		const std::uint64_t nAddress = funcRelative(pAddr.GetAddr(), CACHE_RELATIVE_ADDRESS, nFlags);
+
+		std::uint64_t nHash = 0xCBF29CE484222325ull;
+
+		nHash = HashCacheBytes(nHash, key.m_svPattern.data(), key.m_svPattern.size());
+		nHash = HashCacheBytes(nHash, key.m_svMask.data(), key.m_svMask.size());
+		nHash = HashCacheBytes(nHash, &nStart, sizeof(nStart));
+		nHash = HashCacheBytes(nHash, &nSectionAddr, sizeof(nSectionAddr));
+		nHash = HashCacheBytes(nHash, &nSectionSize, sizeof(nSectionSize));
+		nHash = HashCacheBytes(nHash, &nAddress, sizeof(nAddress));
+
+		records.Write(nFlags);
+		records.Write(key.m_svPattern);
+		records.Write(key.m_svMask);
+		records.Write(nStart);
+		records.Write(nSectionAddr);
+		records.Write(nSectionSize);
+		records.Write(nAddress);
+		records.Write(nHash);
+
+		nCount++;
+	});
+
+	m_nSavedCacheSize = nEntries;
+
+	CCacheFileWriter writer;
+
+	writer.Write(s_nCacheFileMagic);
+	writer.Write(s_nCacheFileVersion);
+	writer.Write(sIdentity);
+	writer.Write(nCount);
+	writer.Append(records);
+
+	// Replace the file at once, a concurrent reader sees either one.
+	const std::string sTempFile = m_sCacheFile + ".tmp";
+
+	{
+		std::ofstream file(sTempFile, std::ios::binary | std::ios::trunc);
+
+		if (!file)
+			return false;
+
+		file.write(writer.Get().data(), static_cast<std::streamsize>(writer.Get().size()));
+
+		if (!file)
+			return false;
 	}
 
-	// If mask has no 'x', first position matches trivially.
-	if (numSigs == 0 && std::find(svMask.begin(), svMask.end(), 'x') == svMask.end())
+	std::remove(m_sCacheFile.c_str()); // Windows doesn't replace by rename.
+
+	return std::rename(sTempFile.c_str(), m_sCacheFile.c_str()) == 0;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Gets the identity of the mapped file, or of the one at the path if
+//          isn't mapped yet
+// Output : false if the file isn't of the loaded image
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+bool CAssemblyModule<Mutex>::GetFileIdentity(CMappedImage::FileIdentity_t& identity) const
+{
+	if (m_bStaleFile)
+		return false;
+
+	if (m_pImage)
 	{
-		UniqueLock_t lock(m_mutex);
-		m_mapCached[std::move(sKey)] = pData;
-		return pData;
+		identity = m_pImage->GetIdentity();
+
+		return true;
 	}
 
-	// Main scan.
-	for (; pData <= pEnd; ++pData)
+	return CMappedImage::GetFileIdentity(m_sPath, identity);
+}
+
+template<typename Mutex>
+void CAssemblyModule<Mutex>::Release()
+{
+	if (!IsValid())
+		return;
+
+	WaitResolves();
+
+	auto pReleased = std::make_unique<Released_t>();
+
+	pReleased->m_sIdentity = GetIdentity();
+	pReleased->m_bFile = GetFileIdentity(pReleased->m_file);
+	pReleased->m_nBase = static_cast<std::uintptr_t>(GetBase().GetAddr());
+	pReleased->m_nSize = GetImageSize();
+
+	SaveCacheFile();
+	Unload();
+
+	pReleased->m_cache = std::move(m_cache);
+
+	m_nSavedCacheSize = 0;
+	m_vecSections.clear();
+	m_vecSectionHashes.clear();
+	m_vecSectionSlots.clear();
+	m_aSections = {};
+	m_pExecutableSection = nullptr;
+	m_pImage.reset();
+	m_bStaleFile = false;
+	m_symbols.Clear();
+	PublishTypes(nullptr);
+
 	{
-		bool bFound = true;
+		const auto lock = LockTimed(m_referencesMutex, m_stats.m_nLockWaits, m_stats.m_nLockWaitTime);
 
-		if (numSigs)
-		{
-			// memcmp only over the strict segments
-			for (std::size_t r = 0; r < numSigs; ++r)
-			{
-				const SignatureMask_t& run = sigs[r];
-				if (std::memcmp(pData + run.offset, pPattern + run.offset, run.length) != 0)
-				{
-					bFound = false;
-					break;
-				}
-			}
-		}
-		else
-		{
-			// Degenerate path if run buffer overflowed: byte-wise check honoring mask.
-			for (std::size_t j = 0; j < patternSize; ++j)
-			{
-				if (svMask[j] == 'x' && pData[j] != pPattern[j])
-				{
-					bFound = false;
-					break;
-				}
-			}
-		}
+		m_pReferences.store(nullptr, std::memory_order_release);
+		m_vecReferences.clear();
+	}
 
-		if (bFound)
-		{
-			UniqueLock_t lock(m_mutex);
-			m_mapCached[std::move(sKey)] = pData;
-			return pData;
-		}
+	m_pReleased = std::move(pReleased);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reloads the module from the file, keeping the cache of the same build
+//          (by the identity) rebased by the base delta
+// Input  : svPath
+// Output : bool
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+bool CAssemblyModule<Mutex>::Reload(const std::string_view svPath)
+{
+	const std::string sPath(svPath.empty() ? std::string_view(m_sPath) : svPath);
+
+	if (sPath.empty())
+		return false;
+
+	Release();
+
+	auto pReleased = std::move(m_pReleased);
+
+	if (!LoadFromPath(sPath)) // Reads the cache file of the new identity.
+	{
+		m_pReleased = std::move(pReleased); // For the next try.
+
+		return false;
 	}
-#endif // !DYNLIBUTILS_ARCH_ARM
 
-	return DYNLIB_INVALID_MEMORY;
+	if (!pReleased || pReleased->m_sIdentity.empty() || !pReleased->m_bFile || !pReleased->m_nSize || GetIdentity() != pReleased->m_sIdentity)
+		return true;
+
+	CMappedImage::FileIdentity_t file;
+
+	if (!GetFileIdentity(file) || file != pReleased->m_file)
+		return true;
+
+	pReleased->m_cache.Rebase(pReleased->m_nBase, pReleased->m_nSize, GetBase().GetAddr());
+	pReleased->m_cache.ForEach([this](const CCacheKey& key, CMemory pAddr) { m_cache.Insert(key, pAddr); });
+
+	return true;
 }
 
 #ifdef DYNLIBUTILS_SEPARATE_SOURCE_FILES
@@ -256,5 +2734,8 @@ CMemory CAssemblyModule<Mutex>::FindPattern(const CMemoryView<std::uint8_t>& pPa
 	#endif
 #endif
 
+template class DynLibUtils::CAddressCache<DynLibUtils::CNullMutex>;
+template class DynLibUtils::CAddressCache<std::shared_mutex>;
+
 template class DynLibUtils::CAssemblyModule<DynLibUtils::CNullMutex>;
 template class DynLibUtils::CAssemblyModule<std::shared_mutex>;
\ No newline at end of file
@@ -0,0 +1,298 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#include <dynlibutils/moduleloader.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+using namespace DynLibUtils;
+
+// Workers of one load, each one with its own deque of the jobs: the owner takes the last pushed one
+// (of the module it has just opened), the idle ones steal the first ones of the others.
+// The calling thread is the worker 0, the others run until no job is pending.
+// A job which throws is done as well, the first exception is rethrown by Run after the join.
+class CStealingPool
+{
+public:
+	using Job_t = std::function<void(std::size_t nWorker)>;
+
+	explicit CStealingPool(std::size_t nWorkers)
+		: m_nWorkers(std::max<std::size_t>(nWorkers, 1))
+		, m_pQueues(new Queue_t[m_nWorkers])
+		, m_nPending(0)
+		, m_nSignals(0)
+	{
+	}
+
+	// Pending until it's done, so the jobs pushed by a job keep the workers.
+	void Push(std::size_t nWorker, Job_t job)
+	{
+		m_nPending.fetch_add(1, std::memory_order_relaxed);
+
+		{
+			auto& queue = m_pQueues[nWorker % m_nWorkers];
+
+			std::lock_guard lock(queue.m_mutex);
+			queue.m_dequeJobs.emplace_back(std::move(job));
+		}
+
+		{
+			std::lock_guard lock(m_mutex);
+			m_nSignals.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		m_cv.notify_one();
+	}
+
+	// Returns once all the jobs are done. The workers which can't be started are
+	// made up for by the others, as they steal the jobs of any deque.
+	void Run()
+	{
+		std::vector<std::thread> vecThreads;
+
+		try
+		{
+			vecThreads.reserve(m_nWorkers - 1);
+
+			for (std::size_t n = 1; n < m_nWorkers; ++n)
+				vecThreads.emplace_back([this, n] { Work(n); });
+		}
+		catch (...)
+		{
+		}
+
+		Work(0);
+
+		for (auto& thread : vecThreads)
+			thread.join();
+
+		if (m_pError)
+			std::rethrow_exception(m_pError);
+	}
+
+private:
+	bool Take(std::size_t nWorker, Job_t& job)
+	{
+		for (std::size_t i = 0; i < m_nWorkers; ++i)
+		{
+			auto& queue = m_pQueues[(nWorker + i) % m_nWorkers];
+
+			std::lock_guard lock(queue.m_mutex);
+
+			if (queue.m_dequeJobs.empty())
+				continue;
+
+			if (i) // Steals.
+			{
+				job = std::move(queue.m_dequeJobs.front());
+				queue.m_dequeJobs.pop_front();
+			}
+			else
+			{
+				job = std::move(queue.m_dequeJobs.back());
+				queue.m_dequeJobs.pop_back();
+			}
+
+			return true;
+		}
+
+		return false;
+	}
+
+	void Work(std::size_t nWorker)
+	{
+		Job_t job;
+
+		while (true)
+		{
+			const std::size_t nSignals = m_nSignals.load(std::memory_order_acquire);
+
+			if (Take(nWorker, job))
+			{
+				try
+				{
+					job(nWorker);
+				}
+				catch (...)
+				{
+					std::lock_guard lock(m_mutex);
+
+					if (!m_pError)
+						m_pError = std::current_exception();
+				}
+
+				job = nullptr;
+
+				if (m_nPending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				{
+					{
+						std::lock_guard lock(m_mutex);
+					}
+
+					m_cv.notify_all();
+				}
+
+				continue;
+			}
+
+			// Signaled by a push since the deques were looked up, or by the last job done.
+			std::unique_lock lock(m_mutex);
+			m_cv.wait(lock, [this, nSignals] { return m_nSignals.load(std::memory_order_relaxed) != nSignals || !m_nPending.load(std::memory_order_acquire); });
+
+			if (!m_nPending.load(std::memory_order_acquire))
+				return;
+		}
+	}
+
+	struct alignas(64) Queue_t
+	{
+		std::mutex m_mutex;
+		std::deque<Job_t> m_dequeJobs;
+	}; // struct Queue_t
+
+	const std::size_t m_nWorkers;
+	std::unique_ptr<Queue_t[]> m_pQueues;
+	std::atomic<std::size_t> m_nPending;
+	std::atomic<std::size_t> m_nSignals; // Of the pushes, changed under the lock.
+
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::exception_ptr m_pError; // Of the first job thrown, under the lock.
+}; // class CStealingPool
+
+//-----------------------------------------------------------------------------
+// Purpose: Loads the modules and scans their sets across the workers: a job opens
+//          a module and pushes the scans of its set to the same worker, split by
+//          the patterns (of s_nLoaderChunkPatterns at least) if its cache is shared
+// Input  : nThreads
+// Output : std::size_t
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+std::size_t CModuleLoader<Mutex>::Load(std::size_t nThreads)
+{
+	constexpr bool bSplit = !std::is_same_v<Mutex, CNullMutex>;
+
+	const std::size_t nEntries = m_vecEntries.size();
+
+	m_vecResults.assign(nEntries, {});
+
+	if (!nEntries)
+		return 0;
+
+	if (!nThreads)
+		nThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+	std::vector<std::size_t> vecChunks(nEntries, 1);
+	std::size_t nJobs = 0;
+
+	for (std::size_t i = 0; i < nEntries; ++i)
+	{
+		const CSignatureSet* pSet = m_vecEntries[i].m_pSet;
+
+		if (bSplit && pSet)
+			vecChunks[i] = std::clamp<std::size_t>((pSet->Size() + s_nLoaderChunkPatterns - 1) / s_nLoaderChunkPatterns, 1, nThreads);
+
+		nJobs += pSet ? vecChunks[i] : 1;
+	}
+
+	CStealingPool pool(std::min(nThreads, nJobs));
+
+	std::unique_ptr<std::atomic<std::size_t>[]> pFound(new std::atomic<std::size_t>[nEntries]);
+
+	for (std::size_t i = 0; i < nEntries; ++i)
+		pFound[i].store(0, std::memory_order_relaxed);
+
+	const auto Scan = [this, &pFound](std::size_t nIndex, std::size_t nBegin, std::size_t nEnd, std::size_t nChunks)
+	{
+		const Entry_t& entry = m_vecEntries[nIndex];
+
+		CSignatureSet& set = *entry.m_pSet;
+
+		// The cache keys of the executable section are of none, as FindPattern's are.
+		const Section_t* pSection = entry.m_eSection == SectionKind::Text ? nullptr : entry.m_pModule->GetSection(entry.m_eSection);
+
+		if (entry.m_eSection != SectionKind::Text && !pSection)
+		{
+			for (auto* pEntry = set.begin() + nBegin; pEntry != set.begin() + nEnd; ++pEntry)
+				pEntry->m_pResult = DYNLIB_INVALID_MEMORY;
+
+			return;
+		}
+
+		if (nChunks == 1)
+		{
+			pFound[nIndex].fetch_add(entry.m_pModule->FindPatterns(set, pSection), std::memory_order_relaxed);
+
+			return;
+		}
+
+		CSignatureSet chunk(nEnd - nBegin);
+
+		for (auto* pEntry = set.begin() + nBegin; pEntry != set.begin() + nEnd; ++pEntry)
+			chunk.Add(pEntry->m_pBytes, pEntry->m_svMask, pEntry->m_anchors);
+
+		pFound[nIndex].fetch_add(entry.m_pModule->FindPatterns(chunk, pSection), std::memory_order_relaxed);
+
+		auto* pEntry = set.begin() + nBegin;
+
+		for (const auto& result : chunk)
+			(pEntry++)->m_pResult = result.m_pResult;
+	};
+
+	for (std::size_t i = 0; i < nEntries; ++i)
+	{
+		pool.Push(i, [this, i, &pool, &vecChunks, &Scan](std::size_t nWorker)
+		{
+			Entry_t& entry = m_vecEntries[i];
+
+			Module_t& module = *entry.m_pModule;
+
+			const bool bLoaded = module.IsValid() || (entry.m_bPath ? module.LoadFromPath(entry.m_sName) : module.InitFromName(entry.m_sName, entry.m_bExtension));
+
+			m_vecResults[i].m_bLoaded = bLoaded;
+
+			if (!entry.m_pSet)
+				return;
+
+			if (!bLoaded)
+			{
+				for (auto& sig : *entry.m_pSet)
+					sig.m_pResult = DYNLIB_INVALID_MEMORY;
+
+				return;
+			}
+
+			const std::size_t nSize = entry.m_pSet->Size(), nChunks = vecChunks[i];
+
+			for (std::size_t n = 0; n < nChunks; ++n)
+				pool.Push(nWorker, [i, nBegin = nSize * n / nChunks, nEnd = nSize * (n + 1) / nChunks, nChunks, &Scan](std::size_t) { Scan(i, nBegin, nEnd, nChunks); });
+		});
+	}
+
+	pool.Run();
+
+	std::size_t nLoaded = 0;
+
+	for (std::size_t i = 0; i < nEntries; ++i)
+	{
+		m_vecResults[i].m_nFound = pFound[i].load(std::memory_order_relaxed);
+		nLoaded += m_vecResults[i].m_bLoaded;
+	}
+
+	return nLoaded;
+}
+
+template class DynLibUtils::CModuleLoader<DynLibUtils::CNullMutex>;
+template class DynLibUtils::CModuleLoader<std::shared_mutex>;
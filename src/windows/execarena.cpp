@@ -0,0 +1,135 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#include "os.h"
+
+#include <dynlibutils/execarena.hpp>
+
+#include <algorithm>
+
+using namespace DynLibUtils;
+
+//-----------------------------------------------------------------------------
+// Purpose: Finds a free address near nNear and maps a view there by funcMap,
+//          above first, then below
+//-----------------------------------------------------------------------------
+template<typename F>
+static void *MapNear(std::uintptr_t nNear, std::size_t nMaxDistance, std::size_t nSize, F &&funcMap) noexcept
+{
+	if (!nNear)
+		return funcMap(nullptr);
+
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+
+	const std::uintptr_t nGranularity = info.dwAllocationGranularity;
+	const std::uintptr_t nMinAddr = reinterpret_cast<std::uintptr_t>(info.lpMinimumApplicationAddress), nMaxAddr = reinterpret_cast<std::uintptr_t>(info.lpMaximumApplicationAddress);
+
+	const std::uintptr_t nLow = std::max(nNear > nMaxDistance ? nNear - nMaxDistance : 0, nMinAddr);
+	const std::uintptr_t nHigh = std::min(nNear + nMaxDistance < nNear ? static_cast<std::uintptr_t>(-1) : nNear + nMaxDistance, nMaxAddr);
+
+	auto funcAlignUp = [nGranularity](std::uintptr_t nAddr) { return (nAddr + nGranularity - 1) & ~(nGranularity - 1); };
+	auto funcAlignDown = [nGranularity](std::uintptr_t nAddr) { return nAddr & ~(nGranularity - 1); };
+
+	MEMORY_BASIC_INFORMATION mbi;
+
+	// Above, by the free regions.
+	for (std::uintptr_t nAddr = funcAlignUp(nNear); nAddr + nSize <= nHigh;)
+	{
+		if (!VirtualQuery(reinterpret_cast<void *>(nAddr), &mbi, sizeof(mbi)))
+			break;
+
+		if (mbi.State == MEM_FREE)
+		{
+			if (void *pView = funcMap(reinterpret_cast<void *>(nAddr)))
+				return pView;
+		}
+
+		const std::uintptr_t nNext = funcAlignUp(reinterpret_cast<std::uintptr_t>(mbi.BaseAddress) + mbi.RegionSize);
+
+		if (nNext <= nAddr)
+			break;
+
+		nAddr = nNext;
+	}
+
+	// Below.
+	for (std::uintptr_t nAddr = funcAlignDown(nNear); nAddr > nLow + nGranularity;)
+	{
+		nAddr -= nGranularity;
+
+		if (!VirtualQuery(reinterpret_cast<void *>(nAddr), &mbi, sizeof(mbi)))
+			break;
+
+		if (mbi.State == MEM_FREE)
+		{
+			if (void *pView = funcMap(reinterpret_cast<void *>(nAddr)))
+				return pView;
+
+			continue;
+		}
+
+		nAddr = funcAlignDown(reinterpret_cast<std::uintptr_t>(mbi.AllocationBase));
+	}
+
+	return nullptr;
+}
+
+bool CExecArena::MapRegion(std::uintptr_t pNear, std::size_t maxDistance, Region_t &region) noexcept
+{
+	region = {};
+
+	// Dual-mapping: the executable view near, the writable one anywhere.
+	if (HANDLE hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_EXECUTE_READWRITE | SEC_COMMIT, 0, static_cast<DWORD>(s_nRegionSize), nullptr))
+	{
+		void *pView = MapNear(pNear, maxDistance, s_nRegionSize, [hMapping](void *pAddr) { return MapViewOfFileEx(hMapping, FILE_MAP_READ | FILE_MAP_EXECUTE, 0, 0, s_nRegionSize, pAddr); });
+		void *pWritable = pView ? MapViewOfFile(hMapping, FILE_MAP_WRITE, 0, 0, s_nRegionSize) : nullptr;
+
+		if (pWritable)
+		{
+			region.m_nAddr = reinterpret_cast<std::uintptr_t>(pView);
+			region.m_nWriteDelta = static_cast<std::ptrdiff_t>(reinterpret_cast<std::uintptr_t>(pWritable) - region.m_nAddr);
+			region.m_pHandle = hMapping;
+
+			return true;
+		}
+
+		if (pView)
+			UnmapViewOfFile(pView);
+
+		CloseHandle(hMapping);
+	}
+
+	// Flips on writes.
+	void *pView = MapNear(pNear, maxDistance, s_nRegionSize, [](void *pAddr) { return VirtualAlloc(pAddr, s_nRegionSize, MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READ); });
+
+	if (!pView)
+		return false;
+
+	region.m_nAddr = reinterpret_cast<std::uintptr_t>(pView);
+
+	return true;
+}
+
+void CExecArena::UnmapRegion(const Region_t &region) noexcept
+{
+	if (region.m_pHandle)
+	{
+		UnmapViewOfFile(reinterpret_cast<void *>(region.m_nAddr));
+		UnmapViewOfFile(reinterpret_cast<void *>(region.m_nAddr + region.m_nWriteDelta));
+		CloseHandle(region.m_pHandle);
+
+		return;
+	}
+
+	VirtualFree(reinterpret_cast<void *>(region.m_nAddr), 0, MEM_RELEASE);
+}
+
+void CExecArena::FlushCode(void *pCode, std::size_t size) noexcept
+{
+	FlushInstructionCache(GetCurrentProcess(), pCode, size);
+}
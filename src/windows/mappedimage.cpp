@@ -0,0 +1,137 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#include "os.h"
+
+#include <dynlibutils/mappedimage.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace DynLibUtils;
+
+static bool GetHandleIdentity(HANDLE hFile, CMappedImage::FileIdentity_t& identity) noexcept
+{
+	BY_HANDLE_FILE_INFORMATION info;
+	if (!GetFileInformationByHandle(hFile, &info))
+		return false;
+
+	identity.m_nDevice = info.dwVolumeSerialNumber;
+	identity.m_nIndex = (static_cast<std::uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+	identity.m_nModified = (static_cast<std::uint64_t>(info.ftLastWriteTime.dwHighDateTime) << 32) | info.ftLastWriteTime.dwLowDateTime;
+	identity.m_nSize = (static_cast<std::uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+
+	return true;
+}
+
+bool CMappedImage::GetFileIdentity(const std::string& sPath, FileIdentity_t& identity) noexcept
+{
+	HANDLE hFile = CreateFileA(sPath.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	const bool bResult = GetHandleIdentity(hFile, identity);
+
+	CloseHandle(hFile);
+
+	return bResult;
+}
+
+bool CMappedImage::Map(const std::string& sPath)
+{
+	HANDLE hFile = CreateFileA(sPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	HANDLE hMapping = nullptr;
+
+	if (GetFileSizeEx(hFile, &size) && size.QuadPart > 0 && GetHandleIdentity(hFile, m_identity))
+		hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	CloseHandle(hFile); // The mapping keeps the file.
+
+	if (!hMapping)
+		return false;
+
+	void* pView = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!pView)
+	{
+		CloseHandle(hMapping);
+		return false;
+	}
+
+	m_pData = static_cast<const std::uint8_t*>(pView);
+	m_nSize = static_cast<std::size_t>(size.QuadPart);
+	m_pHandle = hMapping;
+
+	return true;
+}
+
+void CMappedImage::Unmap() noexcept
+{
+	UnmapViewOfFile(m_pData);
+	CloseHandle(m_pHandle);
+}
+
+void* CMappedImage::OpenStream(const std::string& sPath) noexcept
+{
+	HANDLE hFile = CreateFileA(sPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	return hFile != INVALID_HANDLE_VALUE ? hFile : nullptr;
+}
+
+bool CMappedImage::ReadStream(void* pStream, std::size_t nOffset, void* pBuffer, std::size_t nSize) noexcept
+{
+	for (auto* pDest = static_cast<std::uint8_t*>(pBuffer); nSize;)
+	{
+		OVERLAPPED overlapped {};
+
+		overlapped.Offset = static_cast<DWORD>(nOffset);
+		overlapped.OffsetHigh = static_cast<DWORD>(static_cast<std::uint64_t>(nOffset) >> 32);
+
+		DWORD nRead = 0;
+
+		if (!ReadFile(pStream, pDest, static_cast<DWORD>(std::min<std::size_t>(nSize, 0x40000000)), &nRead, &overlapped) || !nRead)
+			return false;
+
+		pDest += nRead;
+		nOffset += nRead;
+		nSize -= nRead;
+	}
+
+	return true;
+}
+
+void CMappedImage::CloseStream(void* pStream) noexcept
+{
+	CloseHandle(pStream);
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Reads the PE section headers (the names are of 8 bytes at most)
+//-----------------------------------------------------------------------------
+void CMappedImage::ParseSections()
+{
+	const auto* pDOSHeader = GetSpan<IMAGE_DOS_HEADER>(0, 1).begin();
+	if (!pDOSHeader || pDOSHeader->e_magic != IMAGE_DOS_SIGNATURE)
+		return;
+
+	const auto nNTHeaders = static_cast<std::size_t>(pDOSHeader->e_lfanew);
+	const auto* pNTHeaders = GetSpan<IMAGE_NT_HEADERS>(nNTHeaders, 1).begin();
+	if (!pNTHeaders || pNTHeaders->Signature != IMAGE_NT_SIGNATURE)
+		return;
+
+	const std::size_t nSections = nNTHeaders + offsetof(IMAGE_NT_HEADERS, OptionalHeader) + pNTHeaders->FileHeader.SizeOfOptionalHeader;
+
+	for (const auto& section : GetSpan<IMAGE_SECTION_HEADER>(nSections, pNTHeaders->FileHeader.NumberOfSections))
+	{
+		const auto* pszName = reinterpret_cast<const char*>(section.Name);
+		const bool bHasData = section.PointerToRawData && section.PointerToRawData + section.SizeOfRawData <= m_nSize;
+
+		m_vecSections.push_back({ std::string_view(pszName, strnlen(pszName, IMAGE_SIZEOF_SHORT_NAME)), static_cast<std::uintptr_t>(section.VirtualAddress), static_cast<std::size_t>(section.Misc.VirtualSize), static_cast<std::size_t>(section.PointerToRawData), bHasData ? static_cast<std::size_t>(std::min<DWORD>(section.SizeOfRawData, section.Misc.VirtualSize ? section.Misc.VirtualSize : section.SizeOfRawData)) : 0 });
+	}
+}
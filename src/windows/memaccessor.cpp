@@ -9,7 +9,9 @@
 #include <dynlibutils/memaccessor.hpp>
 #include <dynlibutils/memprotector.hpp>
 
+#include <algorithm>
 #include <cstring>
+#include <vector>
 
 using namespace DynLibUtils;
 
@@ -47,9 +49,63 @@ bool CMemAccessor::SafeMemRead(CMemory src, CMemory dest, size_t size, size_t& r
 	return false;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Queries the regions in the address order of the sources, so that the
+//          reads of one region share its query
+//-----------------------------------------------------------------------------
+size_t CMemAccessor::SafeMemReadV(SafeRead_t* reads, size_t count) noexcept
+{
+	std::vector<size_t> order(count);
+
+	for (size_t i = 0; i < count; ++i)
+		order[i] = i;
+
+	std::sort(order.begin(), order.end(), [reads](size_t a, size_t b) { return reads[a].m_pSrc.GetAddr() < reads[b].m_pSrc.GetAddr(); });
+
+	constexpr DWORD readable = PAGE_READONLY | PAGE_READWRITE | PAGE_WRITECOPY | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY;
+
+	MEMORY_BASIC_INFORMATION info{};
+	uintptr_t start = 0, end = 0;
+
+	size_t done = 0;
+
+	for (const size_t i : order)
+	{
+		auto& read = reads[i];
+		const uintptr_t src = read.m_pSrc;
+
+		read.m_nRead = 0;
+
+		if (src < start || src >= end)
+		{
+			if (VirtualQuery(read.m_pSrc, &info, sizeof(info)) == 0)
+			{
+				start = end = 0;
+				continue;
+			}
+
+			start = reinterpret_cast<uintptr_t>(info.BaseAddress);
+			end = start + info.RegionSize;
+		}
+
+		if (info.State != MEM_COMMIT || !(info.Protect & readable) || (info.Protect & PAGE_GUARD))
+			continue;
+
+		read.m_nRead = std::min<uintptr_t>(end - src, read.m_nSize);
+		std::memcpy(read.m_pDest, read.m_pSrc, read.m_nRead);
+		done++;
+	}
+
+	return done;
+}
+
 ProtFlag CMemAccessor::MemProtect(CMemory dest, size_t size, ProtFlag prot, bool& status)
 {
 	DWORD orig;
 	status = VirtualProtect(dest, size, TranslateProtection(prot), &orig) != 0;
-	return TranslateProtection(static_cast<int>(prot));
+	return status ? TranslateProtection(static_cast<int>(orig)) : ProtFlag::UNSET;
+}
+
+void CMemAccessor::InvalidateRegions() noexcept
+{
 }
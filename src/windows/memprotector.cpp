@@ -45,10 +45,12 @@ namespace DynLibUtils
 				flags = flags | ProtFlag::R;
 				break;
 			case PAGE_READWRITE:
+			case PAGE_WRITECOPY:
 				flags = flags | ProtFlag::W;
 				flags = flags | ProtFlag::R;
 				break;
 			case PAGE_EXECUTE_READWRITE:
+			case PAGE_EXECUTE_WRITECOPY:
 				flags = flags | ProtFlag::X;
 				flags = flags | ProtFlag::R;
 				flags = flags | ProtFlag::W;
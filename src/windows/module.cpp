@@ -11,6 +11,7 @@
 
 #include <cstring>
 #include <cmath>
+#include <unordered_map>
 
 namespace DynLibUtils
 {
@@ -18,8 +19,13 @@ namespace DynLibUtils
 template<typename Mutex>
 CAssemblyModule<Mutex>::~CAssemblyModule()
 {
+	CloseResolves();
+
 	if (IsValid())
-		FreeLibrary(RCast<HMODULE>());
+	{
+		SaveCacheFile();
+		Unload();
+	}
 }
 
 static std::string GetModulePath(HMODULE hModule)
@@ -46,6 +52,41 @@ static std::string GetModulePath(HMODULE hModule)
 	return modulePath;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Adds the exported symbols (the forwarded ones are resolved by GetProcAddress)
+// Input  : symbols
+//          hModule
+//          *pNTHeaders
+//-----------------------------------------------------------------------------
+static void IndexSymbols(CSymbolIndex& symbols, HMODULE hModule, const IMAGE_NT_HEADERS64* pNTHeaders)
+{
+	const IMAGE_DATA_DIRECTORY& exportDirectory = pNTHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+
+	if (!exportDirectory.VirtualAddress || !exportDirectory.Size)
+		return;
+
+	const auto nBase = reinterpret_cast<std::uintptr_t>(hModule);
+	const auto* pExports = reinterpret_cast<const IMAGE_EXPORT_DIRECTORY*>(nBase + exportDirectory.VirtualAddress);
+	const auto* pNames = reinterpret_cast<const DWORD*>(nBase + pExports->AddressOfNames);
+	const auto* pOrdinals = reinterpret_cast<const WORD*>(nBase + pExports->AddressOfNameOrdinals);
+	const auto* pFunctions = reinterpret_cast<const DWORD*>(nBase + pExports->AddressOfFunctions);
+
+	symbols.Reserve(pExports->NumberOfNames, pExports->NumberOfNames * 32);
+
+	for (DWORD i = 0; i < pExports->NumberOfNames; ++i)
+	{
+		if (pOrdinals[i] >= pExports->NumberOfFunctions)
+			continue;
+
+		const DWORD nRva = pFunctions[pOrdinals[i]];
+		const bool bForwarded = nRva >= exportDirectory.VirtualAddress && nRva < exportDirectory.VirtualAddress + exportDirectory.Size; // RVA of a forwarder string.
+
+		symbols.Add(reinterpret_cast<const char*>(nBase + pNames[i]), nRva, 0, bForwarded);
+	}
+
+	symbols.Build();
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Initializes the module from module name
 // Input  : svModuleName
@@ -128,15 +169,20 @@ bool CAssemblyModule<Mutex>::LoadFromPath(const std::string_view svModelePath, i
 	for (WORD i = 0; i < pNTHeaders->FileHeader.NumberOfSections; ++i) // Loop through the sections.
 	{
 		const IMAGE_SECTION_HEADER& hCurrentSection = hSection[i]; // Get current section.
-		m_vecSections.emplace_back(static_cast<std::uintptr_t>(reinterpret_cast<std::uintptr_t>(handle) + hCurrentSection.VirtualAddress), hCurrentSection.Misc.VirtualSize, reinterpret_cast<const char*>(hCurrentSection.Name)); // Push back a struct with the section data.
+		m_vecSections.emplace_back(static_cast<std::uintptr_t>(reinterpret_cast<std::uintptr_t>(handle) + hCurrentSection.VirtualAddress), hCurrentSection.Misc.VirtualSize, std::string_view(reinterpret_cast<const char*>(hCurrentSection.Name), strnlen(reinterpret_cast<const char*>(hCurrentSection.Name), IMAGE_SIZEOF_SHORT_NAME))); // Push back a struct with the section data.
 	}
 
+	m_symbols.Clear();
+	IndexSymbols(m_symbols, handle, pNTHeaders);
+
 	SetPtr(static_cast<void *>(handle));
 	m_sPath.assign(svModelePath);
 
-	m_pExecutableSection = GetSectionByName(".text");
+	IndexSections({ ".text", ".rdata", {}, {}, ".data" });
 	assert(m_pExecutableSection != nullptr);
 
+	LoadCacheFile();
+
 	return true;
 }
 
@@ -158,12 +204,17 @@ CMemory CAssemblyModule<Mutex>::GetVirtualTable(const std::string_view svTableNa
 	if (svTableName.empty())
 		return DYNLIB_INVALID_MEMORY;
 
-	const Section_t *pRunTimeData = GetSectionByName(".data"), *pReadOnlyData = GetSectionByName(".rdata");
+	const Section_t *pRunTimeData = GetSection(SectionKind::Data), *pReadOnlyData = GetSection(SectionKind::ReadOnlyData);
 
 	assert(pRunTimeData != nullptr);
 	assert(pReadOnlyData != nullptr);
 
 	std::string sDecoratedTableName(bDecorated ? svTableName : ".?AV" + std::string(svTableName) + "@@");
+
+	if (const auto pTypes = GetTypes())
+		if (const auto* pTable = pTypes->Find(sDecoratedTableName).GetPrimary())
+			return GetBase() + pTable->m_nOffset;
+
 	std::string sMask(sDecoratedTableName.length() + 1, 'x');
 
 	CMemory typeDescriptorName = FindPattern(sDecoratedTableName.data(), sMask, nullptr, pRunTimeData);
@@ -192,6 +243,64 @@ CMemory CAssemblyModule<Mutex>::GetVirtualTable(const std::string_view svTableNa
 	return DYNLIB_INVALID_MEMORY;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Indexes the vtables by the MSVC RTTI: each vtable is preceded by
+//          a pointer to its complete object locator, which is
+//          [signature][offset][cd offset][type descriptor RVA][hierarchy RVA][self RVA]
+// Output : count of the indexed types
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+std::size_t CAssemblyModule<Mutex>::BuildTypeIndex()
+{
+	if (!IsValid())
+		return PublishTypes(nullptr);
+
+	const Section_t *pRunTimeData = GetSection(SectionKind::Data), *pReadOnlyData = GetSection(SectionKind::ReadOnlyData);
+
+	if (!pRunTimeData || !pReadOnlyData || pReadOnlyData->m_nSectionSize < 0x18)
+		return PublishTypes(nullptr);
+
+	auto pTypes = std::make_shared<CTypeIndex>();
+
+	const std::uintptr_t nBase = GetBase().GetAddr();
+	const auto nDataStart = static_cast<std::uintptr_t>(pRunTimeData->GetAddr()), nDataEnd = nDataStart + pRunTimeData->m_nSectionSize;
+	const auto nReadOnlyStart = static_cast<std::uintptr_t>(pReadOnlyData->GetAddr()), nReadOnlyEnd = nReadOnlyStart + pReadOnlyData->m_nSectionSize;
+
+	// Complete object locator -> type name and offset of the vtable.
+	std::unordered_map<std::uintptr_t, std::pair<std::string_view, std::int32_t>> mapLocators;
+
+	for (std::uintptr_t nAddr = nReadOnlyStart; nAddr + 0x18 <= nReadOnlyEnd; nAddr += 0x4)
+	{
+		const auto* pLocator = reinterpret_cast<const std::int32_t*>(nAddr);
+
+		if (pLocator[0] != 1 || static_cast<std::uintptr_t>(static_cast<std::uint32_t>(pLocator[5])) != nAddr - nBase) // Signature and self RVA.
+			continue;
+
+		const std::uintptr_t nName = nBase + static_cast<std::uint32_t>(pLocator[3]) + 0x10; // Name of the type descriptor.
+		if (nName < nDataStart || nName >= nDataEnd)
+			continue;
+
+		const auto* pszName = reinterpret_cast<const char*>(nName);
+		std::string_view svName(pszName, strnlen(pszName, nDataEnd - nName));
+
+		if (!svName.empty())
+			mapLocators.emplace(nAddr, std::make_pair(svName, pLocator[1]));
+	}
+
+	for (std::uintptr_t nAddr = nReadOnlyStart; nAddr + 2 * sizeof(std::uintptr_t) <= nReadOnlyEnd; nAddr += sizeof(std::uintptr_t))
+	{
+		auto it = mapLocators.find(*reinterpret_cast<const std::uintptr_t*>(nAddr));
+		if (it == mapLocators.end())
+			continue;
+
+		pTypes->Add(it->second.first, nAddr + sizeof(std::uintptr_t) - nBase, -static_cast<std::ptrdiff_t>(it->second.second));
+	}
+
+	pTypes->Build();
+
+	return PublishTypes(std::move(pTypes));
+}
+
 //-----------------------------------------------------------------------------
 // Purpose: Gets an address of a virtual method table by rtti type descriptor name
 // Input  : svFunctionName
@@ -212,6 +321,23 @@ CMemory CAssemblyModule<Mutex>::GetBase() const noexcept
 	return *this;
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Returns the build identity (PE timestamp + checksum + image size)
+//-----------------------------------------------------------------------------
+template<typename Mutex>
+std::string CAssemblyModule<Mutex>::GetIdentity() const
+{
+	if (!IsValid())
+		return {};
+
+	IMAGE_DOS_HEADER* pDOSHeader = RCast<IMAGE_DOS_HEADER*>();
+	IMAGE_NT_HEADERS64* pNTHeaders = reinterpret_cast<IMAGE_NT_HEADERS64*>(GetAddr() + pDOSHeader->e_lfanew);
+
+	const DWORD aIdentity[] = { pNTHeaders->FileHeader.TimeDateStamp, pNTHeaders->OptionalHeader.CheckSum, pNTHeaders->OptionalHeader.SizeOfImage };
+
+	return std::string(reinterpret_cast<const char*>(aIdentity), sizeof(aIdentity));
+}
+
 template<typename Mutex>
 void CAssemblyModule<Mutex>::SaveLastError()
 {
@@ -237,4 +363,11 @@ void CAssemblyModule<Mutex>::SaveLastError()
 	LocalFree(messageBuffer);
 }
 
+template<typename Mutex>
+void CAssemblyModule<Mutex>::Unload()
+{
+	FreeLibrary(RCast<HMODULE>());
+	*static_cast<CMemory*>(this) = DYNLIB_INVALID_MEMORY;
+}
+
 }; // namespace DynLibUtils
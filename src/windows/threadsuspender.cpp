@@ -0,0 +1,191 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+#include "os.h"
+
+#include <dynlibutils/threadsuspender.hpp>
+
+#include <algorithm>
+#include <mutex>
+
+using namespace DynLibUtils;
+
+static constexpr std::size_t s_nMinThreads = 64; // Capacity of the first try.
+static constexpr DWORD s_nAccess = THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_SET_CONTEXT | THREAD_QUERY_LIMITED_INFORMATION;
+
+static std::mutex s_mutex; // Of the suspension.
+
+// Of ntdll, walks the threads by handles (the toolhelp snapshots allocate of the heap).
+using NtGetNextThread_t = LONG (NTAPI *)(HANDLE hProcess, HANDLE hThread, ACCESS_MASK nAccess, ULONG nAttributes, ULONG nFlags, PHANDLE phNext);
+
+static NtGetNextThread_t GetNextThreadFunc() noexcept
+{
+	static const auto s_pfnNext = reinterpret_cast<NtGetNextThread_t>(reinterpret_cast<void *>(GetProcAddress(GetModuleHandleW(L"ntdll.dll"), "NtGetNextThread")));
+
+	return s_pfnNext;
+}
+
+bool CThreadSuspender::Suspend() noexcept
+{
+	if (m_bSuspended)
+		return true;
+
+	const NtGetNextThread_t pfnNext = GetNextThreadFunc();
+
+	if (!pfnNext)
+		return false;
+
+	s_mutex.lock();
+
+	const DWORD nSelf = GetCurrentThreadId();
+
+	// The handles are only added in the capacity while the threads are suspended, retried with more if it's short.
+	for (std::size_t nCapacity = s_nMinThreads;; nCapacity *= 2)
+	{
+		try
+		{
+			m_vecThreads.clear();
+			m_vecThreads.reserve(nCapacity);
+		}
+		catch (...)
+		{
+			s_mutex.unlock();
+
+			return false;
+		}
+
+		m_bSuspended = true;
+
+		bool bFull = false;
+
+		// Until a pass suspends none, as the running ones may start others.
+		for (bool bNew = true; bNew && !bFull;)
+		{
+			bNew = false;
+
+			HANDLE hThread = nullptr, hNext;
+
+			for (; pfnNext(GetCurrentProcess(), hThread, s_nAccess, 0, 0, &hNext) >= 0; hThread = hNext)
+			{
+				if (hThread && std::find(m_vecThreads.begin(), m_vecThreads.end(), reinterpret_cast<std::uintptr_t>(hThread)) == m_vecThreads.end())
+					CloseHandle(hThread); // Not kept.
+
+				const DWORD nId = GetThreadId(hNext);
+
+				if (nId == nSelf)
+					continue;
+
+				bool bKnown = false;
+
+				for (const std::uintptr_t nHandle : m_vecThreads)
+				{
+					if (GetThreadId(reinterpret_cast<HANDLE>(nHandle)) == nId)
+					{
+						bKnown = true;
+
+						break;
+					}
+				}
+
+				if (bKnown)
+					continue;
+
+				if (m_vecThreads.size() == m_vecThreads.capacity())
+				{
+					bFull = true;
+
+					continue;
+				}
+
+				if (SuspendThread(hNext) == static_cast<DWORD>(-1))
+					continue; // Exiting.
+
+				// Waits for the suspension to complete.
+				CONTEXT context {};
+
+				context.ContextFlags = CONTEXT_CONTROL;
+				GetThreadContext(hNext, &context);
+
+				m_vecThreads.push_back(reinterpret_cast<std::uintptr_t>(hNext));
+				bNew = true;
+			}
+
+			if (hThread && std::find(m_vecThreads.begin(), m_vecThreads.end(), reinterpret_cast<std::uintptr_t>(hThread)) == m_vecThreads.end())
+				CloseHandle(hThread);
+		}
+
+		if (!bFull)
+			return true;
+
+		// Resumes all for the allocation.
+		for (const std::uintptr_t nHandle : m_vecThreads)
+		{
+			ResumeThread(reinterpret_cast<HANDLE>(nHandle));
+			CloseHandle(reinterpret_cast<HANDLE>(nHandle));
+		}
+
+		m_bSuspended = false;
+	}
+}
+
+void CThreadSuspender::Resume() noexcept
+{
+	if (!m_bSuspended)
+		return;
+
+	for (const std::uintptr_t nHandle : m_vecThreads)
+	{
+		ResumeThread(reinterpret_cast<HANDLE>(nHandle));
+		CloseHandle(reinterpret_cast<HANDLE>(nHandle));
+	}
+
+	m_vecThreads.clear();
+	m_bSuspended = false;
+
+	s_mutex.unlock();
+}
+
+bool CThreadSuspender::VisitThreads(Visitor_t pfnVisit, void *pContext) noexcept
+{
+	if (!m_bSuspended)
+		return false;
+
+	for (const std::uintptr_t nHandle : m_vecThreads)
+	{
+		const auto hThread = reinterpret_cast<HANDLE>(nHandle);
+
+		CONTEXT context {};
+
+		context.ContextFlags = CONTEXT_CONTROL;
+
+		if (!GetThreadContext(hThread, &context))
+			return false;
+
+#if defined(_M_X64)
+		auto &nIP = context.Rip;
+#elif defined(_M_IX86)
+		auto &nIP = context.Eip;
+#elif defined(_M_ARM64)
+		auto &nIP = context.Pc;
+#else
+#	error "Unsupported architecture"
+#endif
+
+		std::uintptr_t nAddr = static_cast<std::uintptr_t>(nIP);
+
+		pfnVisit(pContext, nAddr);
+
+		if (nAddr != static_cast<std::uintptr_t>(nIP))
+		{
+			nIP = static_cast<std::remove_reference_t<decltype(nIP)>>(nAddr);
+
+			if (!SetThreadContext(hThread, &context))
+				return false;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,277 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+// The instruction decoder (of known encodings and by sweeping the functions of libc), the relocation
+// of the prologues to the trampolines, and the threads moved out of the jump on hooking.
+
+#include <dynlibutils/detour.hpp>
+#include <dynlibutils/module.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace DynLibUtils;
+
+static int s_nFailures = 0;
+
+#define CHECK(expr) ((expr) ? (void)0 : (std::fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #expr), (void)++s_nFailures))
+
+// Decodes each function of the symbols of libc to its end.
+static void SweepLibc()
+{
+	CModule module;
+	CHECK(module.InitFromName("libc"));
+
+	const Section_t *pText = module.GetSection(SectionKind::Text);
+	CHECK(pText != nullptr);
+
+	if (!pText)
+		return;
+
+	const std::uintptr_t nBase = module.GetBase().GetAddr(), nText = pText->GetAddr();
+
+	std::size_t nFunctions = 0, nMismatches = 0;
+
+	for (const auto &symbol : module.GetSymbols())
+	{
+		const std::uintptr_t nBegin = nBase + symbol.m_nOffset, nEnd = nBegin + symbol.m_nSize;
+
+		if (!symbol.m_nSize || nBegin < nText || nEnd > nText + pText->m_nSectionSize)
+			continue;
+
+		std::uintptr_t nAddr = nBegin;
+
+		for (Instruction_t insn; nAddr < nEnd && DecodeInstruction(CMemory(nAddr), insn);)
+			nAddr += insn.m_nLength;
+
+		if (nAddr != nEnd)
+		{
+			if (++nMismatches <= 8)
+				std::fprintf(stderr, "%s: stops at +%zu of %zu\n", module.GetSymbols().GetName(symbol), static_cast<std::size_t>(nAddr - nBegin), symbol.m_nSize);
+		}
+
+		nFunctions++;
+	}
+
+	CHECK(nFunctions > 500);
+	CHECK(nMismatches == 0);
+}
+
+#if defined(__x86_64__)
+struct Encoding_t
+{
+	const char *m_pszName;
+	std::uint8_t m_aBytes[16];
+	Instruction_t m_insn; // Expected.
+};
+
+static const Encoding_t s_aEncodings[] =
+{
+	{ "push rbp", { 0x55 }, { 1, 0, 0, 0, 0, false } },
+	{ "push r15", { 0x41, 0x57 }, { 2, 1, 0, 0, 0, false } },
+	{ "mov rbp, rsp", { 0x48, 0x89, 0xE5 }, { 3, 1, 0, 0, 0, false } },
+	{ "sub rsp, 0x10", { 0x48, 0x83, 0xEC, 0x10 }, { 4, 1, 0, 0, 0, false } },
+	{ "sub rsp, 0x1000", { 0x48, 0x81, 0xEC, 0x00, 0x10, 0x00, 0x00 }, { 7, 1, 0, 0, 0, false } },
+	{ "mov rax, [rip+d]", { 0x48, 0x8B, 0x05, 0x11, 0x22, 0x33, 0x44 }, { 7, 1, 3, 0, 0, true } },
+	{ "lea rdi, [rip+d]", { 0x48, 0x8D, 0x3D, 0x11, 0x22, 0x33, 0x44 }, { 7, 1, 3, 0, 0, true } },
+	{ "mov dword [rip+d], imm", { 0xC7, 0x05, 0x11, 0x22, 0x33, 0x44, 0x01, 0x00, 0x00, 0x00 }, { 10, 0, 2, 0, 0, true } },
+	{ "cmp byte [rip+d], imm", { 0x80, 0x3D, 0x11, 0x22, 0x33, 0x44, 0x00 }, { 7, 0, 2, 0, 0, true } },
+	{ "mov rax, [rsp+8]", { 0x48, 0x8B, 0x44, 0x24, 0x08 }, { 5, 1, 0, 0, 0, false } },
+	{ "mov rax, [rbx+rcx*8+0x100]", { 0x48, 0x8B, 0x84, 0xCB, 0x00, 0x01, 0x00, 0x00 }, { 8, 1, 0, 0, 0, false } },
+	{ "movabs rax, imm64", { 0x48, 0xB8, 1, 2, 3, 4, 5, 6, 7, 8 }, { 10, 1, 0, 0, 0, false } },
+	{ "mov ax, imm16", { 0x66, 0xB8, 0x34, 0x12 }, { 4, 1, 0, 0, 0, false } },
+	{ "call rel32", { 0xE8, 0x11, 0x22, 0x33, 0x44 }, { 5, 0, 0, 1, 4, true } },
+	{ "jmp rel32", { 0xE9, 0x11, 0x22, 0x33, 0x44 }, { 5, 0, 0, 1, 4, true } },
+	{ "jmp rel8", { 0xEB, 0x10 }, { 2, 0, 0, 1, 1, true } },
+	{ "je rel8", { 0x74, 0x10 }, { 2, 0, 0, 1, 1, true } },
+	{ "je rel32", { 0x0F, 0x84, 0x11, 0x22, 0x33, 0x44 }, { 6, 0, 0, 2, 4, true } },
+	{ "call [rip+d]", { 0xFF, 0x15, 0x11, 0x22, 0x33, 0x44 }, { 6, 0, 2, 0, 0, true } },
+	{ "call rax", { 0xFF, 0xD0 }, { 2, 0, 0, 0, 0, false } },
+	{ "endbr64", { 0xF3, 0x0F, 0x1E, 0xFA }, { 4, 1, 0, 0, 0, false } },
+	{ "nopw [rax+rax]", { 0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00 }, { 6, 1, 0, 0, 0, false } },
+	{ "lock cmpxchg [rip+d], rcx", { 0xF0, 0x48, 0x0F, 0xB1, 0x0D, 0x11, 0x22, 0x33, 0x44 }, { 9, 2, 5, 0, 0, true } },
+	{ "movaps xmm0, [rip+d]", { 0x0F, 0x28, 0x05, 0x11, 0x22, 0x33, 0x44 }, { 7, 0, 3, 0, 0, true } },
+	{ "pshufd xmm0, xmm1, imm", { 0x66, 0x0F, 0x70, 0xC1, 0x1B }, { 5, 1, 0, 0, 0, false } },
+	{ "vmovaps ymm0, [rip+d]", { 0xC5, 0xFC, 0x28, 0x05, 0x11, 0x22, 0x33, 0x44 }, { 8, 0, 4, 0, 0, true } },
+	{ "vpshufb ymm0, ymm1, [rip+d]", { 0xC4, 0xE2, 0x75, 0x00, 0x05, 0x11, 0x22, 0x33, 0x44 }, { 9, 0, 5, 0, 0, true } },
+	{ "ret", { 0xC3 }, { 1, 0, 0, 0, 0, false } },
+	{ "ret imm16", { 0xC2, 0x08, 0x00 }, { 3, 0, 0, 0, 0, false } },
+};
+
+static void CheckEncodings()
+{
+	for (const auto &encoding : s_aEncodings)
+	{
+		Instruction_t insn;
+
+		if (!DecodeInstruction(CMemory(reinterpret_cast<std::uintptr_t>(encoding.m_aBytes)), insn))
+		{
+			std::fprintf(stderr, "%s: not decoded\n", encoding.m_pszName);
+			s_nFailures++;
+
+			continue;
+		}
+
+		const Instruction_t &expected = encoding.m_insn;
+
+		if (insn.m_nLength != expected.m_nLength || insn.m_nDispOffset != expected.m_nDispOffset || insn.m_nRelOffset != expected.m_nRelOffset ||
+		    insn.m_nRelSize != expected.m_nRelSize || insn.m_bPCRelative != expected.m_bPCRelative || insn.m_nOpcodeOffset != expected.m_nOpcodeOffset)
+		{
+			std::fprintf(stderr, "%s: length %u, opcode +%u, disp +%u, rel +%u/%u, pc-relative %d\n", encoding.m_pszName, insn.m_nLength, insn.m_nOpcodeOffset, insn.m_nDispOffset, insn.m_nRelOffset, insn.m_nRelSize, insn.m_bPCRelative);
+			s_nFailures++;
+		}
+	}
+
+	static const std::uint8_t s_aInvalid[] = { 0x06 }; // PUSH ES, of 32-bit only.
+
+	Instruction_t insn;
+	CHECK(!DecodeInstruction(CMemory(reinterpret_cast<std::uintptr_t>(s_aInvalid)), insn));
+}
+
+extern "C" int g_nDetourValue;
+int g_nDetourValue = 41;
+
+extern "C" int DetourRipLoad();
+extern "C" int DetourBranch(int n);
+extern "C" int DetourCall();
+extern "C" long DetourSyscall(long nNumber);
+
+// Prologues of each kind of relocation.
+asm(R"(
+	.text
+
+	.p2align 4
+	.type DetourRipLoad, @function
+DetourRipLoad: # The disp32 is fixed.
+	movl g_nDetourValue(%rip), %eax
+	addl $1, %eax
+	ret
+	.size DetourRipLoad, . - DetourRipLoad
+
+	.p2align 4
+	.type DetourBranch, @function
+DetourBranch: # The rel8 is expanded to a rel32, out of the patch.
+	testl %edi, %edi
+	je 1f
+	movl $1, %eax
+	ret
+1:
+	movl $2, %eax
+	ret
+	.size DetourBranch, . - DetourBranch
+
+	.p2align 4
+	.type DetourCallee, @function
+DetourCallee:
+	movl $41, %eax
+	ret
+	.size DetourCallee, . - DetourCallee
+
+	.p2align 4
+	.type DetourCall, @function
+DetourCall: # The call returns to the trampoline.
+	call DetourCallee
+	addl $1, %eax
+	ret
+	.size DetourCall, . - DetourCall
+
+	.p2align 4
+	.type DetourSyscall, @function
+DetourSyscall: # Blocks with the instruction pointer inside the jump (+4).
+	movl %edi, %eax
+	syscall
+	nop
+	ret
+	.size DetourSyscall, . - DetourSyscall
+)");
+
+static CDetour s_detourRipLoad, s_detourBranch, s_detourCall, s_detourSyscall;
+
+static int DetourRipLoadHook() { return s_detourRipLoad.Call<int>() + 100; }
+static int DetourBranchHook(int n) { return s_detourBranch.Call<int>(n) + 100; }
+static int DetourCallHook() { return s_detourCall.Call<int>() + 100; }
+static long DetourSyscallHook(long) { return 100; }
+
+static void CheckRelocations()
+{
+	CHECK(s_detourRipLoad.Hook(reinterpret_cast<void *>(&DetourRipLoad), &DetourRipLoadHook));
+	CHECK(DetourRipLoad() == 142);
+	CHECK(s_detourRipLoad.Unhook());
+	CHECK(DetourRipLoad() == 42);
+
+	CHECK(s_detourBranch.Hook(reinterpret_cast<void *>(&DetourBranch), &DetourBranchHook));
+	CHECK(DetourBranch(0) == 102);
+	CHECK(DetourBranch(1) == 101);
+	CHECK(s_detourBranch.Unhook());
+	CHECK(DetourBranch(0) == 2);
+
+	CHECK(s_detourCall.Hook(reinterpret_cast<void *>(&DetourCall), &DetourCallHook));
+	CHECK(DetourCall() == 142);
+	CHECK(s_detourCall.Unhook());
+	CHECK(DetourCall() == 42);
+}
+
+// Whether the thread is blocked in the syscall.
+static bool IsInSyscall(pid_t nTid, long nNumber)
+{
+	std::ifstream file("/proc/self/task/" + std::to_string(nTid) + "/syscall");
+
+	long nCurrent = -1;
+
+	return file >> nCurrent && nCurrent == nNumber;
+}
+
+// A thread blocked at +4 of the target is moved to the trampoline, interrupted (EINTR), and returns by it.
+static void CheckMovedThread()
+{
+	std::atomic<pid_t> nTid {0};
+	std::atomic<long> nResult {0};
+
+	std::thread thread([&]()
+	{
+		nTid = static_cast<pid_t>(syscall(SYS_gettid));
+		nResult = DetourSyscall(SYS_pause);
+	});
+
+	for (int i = 0; i < 5000 && !(nTid && IsInSyscall(nTid, SYS_pause)); i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	CHECK(IsInSyscall(nTid, SYS_pause));
+	CHECK(s_detourSyscall.Hook(reinterpret_cast<void *>(&DetourSyscall), &DetourSyscallHook));
+
+	thread.join();
+
+	CHECK(nResult == -EINTR);
+	CHECK(DetourSyscall(SYS_getpid) == 100);
+	CHECK(s_detourSyscall.Unhook());
+	CHECK(DetourSyscall(SYS_getpid) == getpid());
+}
+#endif
+
+int main()
+{
+	SweepLibc();
+
+#if defined(__x86_64__)
+	CheckEncodings();
+	CheckRelocations();
+	CheckMovedThread();
+#endif
+
+	CDetour::GetArena().Collect();
+
+	if (s_nFailures)
+		std::fprintf(stderr, "%d failure(s)\n", s_nFailures);
+
+	return s_nFailures ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+// Hot reload of a library rebuilt at the same path: the module is released, the host unloads
+// the library and loads the new build, then the module is reloaded of it.
+
+#include <dynlibutils/mappedimage.hpp>
+#include <dynlibutils/module.hpp>
+
+#include <dlfcn.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+using namespace DynLibUtils;
+
+static int s_nFailures = 0;
+
+#define CHECK(expr) ((expr) ? (void)0 : (std::fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #expr), (void)++s_nFailures))
+
+// Replaces the file as an install does (a new inode).
+static void Install(const std::string& sFrom, const std::string& sTo)
+{
+	const std::string sTemp = sTo + ".tmp";
+
+	std::filesystem::copy_file(sFrom, sTemp, std::filesystem::copy_options::overwrite_existing);
+	std::filesystem::rename(sTemp, sTo);
+}
+
+static std::size_t GetTextSize(const std::string& sPath)
+{
+	const auto pImage = CMappedImage::Open(sPath);
+	const auto* pText = pImage ? pImage->GetSectionByName(".text") : nullptr;
+
+	return pText ? pText->m_nSize : 0;
+}
+
+int main()
+{
+	const std::string sPath = std::string(DYNLIBUTILS_TEST_DIR) + "/libreload.so";
+
+	Install(DYNLIBUTILS_RELOAD_V1, sPath);
+
+	void* pHost = dlopen(sPath.c_str(), RTLD_NOW);
+	CHECK(pHost != nullptr);
+
+	CModule module;
+	CHECK(module.InitFromName("libreload"));
+	CHECK(module.GetSymbol("ReloadCommon") == CMemory(dlsym(pHost, "ReloadCommon")));
+	CHECK(!module.GetSymbol("ReloadAdded"));
+
+	const std::size_t nV1Text = GetTextSize(DYNLIBUTILS_RELOAD_V1), nV2Text = GetTextSize(DYNLIBUTILS_RELOAD_V2);
+	CHECK(nV1Text != nV2Text);
+	CHECK(module.GetSection(SectionKind::Text) && module.GetSection(SectionKind::Text)->m_nSectionSize == nV1Text);
+
+	// The same build at another base: the cached addresses are rebased.
+	// The pattern is of the function's own bytes (its size), as an optimized build may end the section by it.
+	const CMemory pCommon = module.GetSymbol("ReloadCommon");
+	const auto* pCommonSymbol = module.GetSymbols().Find("ReloadCommon");
+	CHECK(pCommonSymbol && pCommonSymbol->m_nSize);
+
+	const std::string sMask(pCommonSymbol ? std::min<std::size_t>(pCommonSymbol->m_nSize, 16) : 1, 'x');
+	const CMemory pFound = module.FindPattern(CMemoryView<std::uint8_t>(pCommon.RCast<std::uint8_t*>()), sMask, nullptr, nullptr);
+	CHECK(pFound == pCommon);
+
+	module.Release();
+	CHECK(module.IsReleased() && !module.IsValid());
+
+	dlclose(pHost);
+	CHECK(dlopen(sPath.c_str(), RTLD_NOW | RTLD_NOLOAD) == nullptr); // Unloaded indeed.
+
+	pHost = dlopen(sPath.c_str(), RTLD_NOW);
+	CHECK(module.Reload());
+	CHECK(!module.IsReleased());
+	CHECK(module.GetSymbol("ReloadCommon") == CMemory(dlsym(pHost, "ReloadCommon")));
+	CHECK(module.GetCacheSize() == 1);
+
+	// Rebuilt: the sections and the symbols are of the new build, the cache is dropped.
+	module.Release();
+	dlclose(pHost);
+
+	Install(DYNLIBUTILS_RELOAD_V2, sPath);
+
+	pHost = dlopen(sPath.c_str(), RTLD_NOW);
+	CHECK(pHost != nullptr);
+	CHECK(module.Reload());
+	CHECK(module.GetSection(SectionKind::Text) && module.GetSection(SectionKind::Text)->m_nSectionSize == nV2Text);
+	CHECK(module.GetSymbol("ReloadAdded") && module.GetSymbol("ReloadAdded") == CMemory(dlsym(pHost, "ReloadAdded")));
+	CHECK(module.GetSymbol("ReloadCommon") == CMemory(dlsym(pHost, "ReloadCommon")));
+	CHECK(module.GetCacheSize() == 0);
+
+	// A new module of the same path isn't given the old build either.
+	CModule other;
+	CHECK(other.InitFromName("libreload"));
+	CHECK(other.GetSymbol("ReloadAdded"));
+
+	dlclose(pHost);
+
+	std::printf("%d failures\n", s_nFailures);
+
+	return s_nFailures ? 1 : 0;
+}
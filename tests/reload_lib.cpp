@@ -0,0 +1,30 @@
+//
+// DynLibUtils
+// Copyright (C) 2023-2025 Vladimir Ezhikov (Wend4r), Borys Komashchenko (Phoenix), Nikita Ushakov (qubka)
+// Licensed under the MIT license. See LICENSE file in the project root for details.
+//
+
+// Two builds of the library hot reloaded by the reload test, the second one has more code.
+
+// Not to be shrunk by an optimized build below the pattern of the test.
+extern "C" __attribute__((noinline)) int ReloadCommon(int x)
+{
+	volatile int s = 1;
+
+	for (int i = 0; i < x; ++i)
+		s = s * 3 + i;
+
+	return s;
+}
+
+#ifdef DYNLIBUTILS_RELOAD_V2
+extern "C" int ReloadAdded(int x)
+{
+	volatile int s = 0;
+
+	for (int i = 0; i < x; ++i)
+		s = s ^ (i * 7 + x);
+
+	return s;
+}
+#endif